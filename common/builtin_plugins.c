@@ -0,0 +1,476 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "config.h"
+#include "builtin_plugins.h"
+#include "check_utils.h"
+#include "utils.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#define GM_BUILTIN_SOCKET_TIMEOUT      10
+
+static const char * builtin_state_text[] = { "OK", "WARNING", "CRITICAL", "UNKNOWN" };
+
+/* registered builtin plugins */
+static gm_builtin_plugin_t builtin_plugins[] = {
+    { "check_dummy",    builtin_check_dummy    },
+    { "check_tcp",      builtin_check_tcp      },
+    { "check_file_age", builtin_check_file_age },
+    { "check_procs",    builtin_check_procs    },
+    { NULL,             NULL                   }
+};
+
+/* simple threshold range like used by the monitoring plugins */
+typedef struct builtin_range_struct {
+    long start;
+    long end;
+    int  start_infinity;
+    int  end_infinity;
+    int  alert_inside;
+} builtin_range_t;
+
+static int is_builtin_integer(const char *value, long *number);
+static int parse_builtin_args(int argc, char **argv, const char *shortopts, const char **longopts, char **values, char **positional);
+static int parse_builtin_range(const char *value, builtin_range_t *range);
+static int check_builtin_range(long value, builtin_range_t *range);
+
+
+/* run a check with a builtin plugin */
+int run_builtin_check(char *processed_command, char **ret, char **err) {
+    char *argv[MAX_CMD_ARGS];
+    char *cmd;
+    char *output = NULL;
+    int argc, rc;
+    gm_builtin_func func;
+
+    if(mod_gm_opt->builtin_plugins != GM_ENABLED)
+        return GM_NO_BUILTIN;
+
+    /* only simple command lines, everything else needs a shell */
+    if(strpbrk(processed_command,"!$^&*()~[]\\|{};<>?`\"'") != NULL)
+        return GM_NO_BUILTIN;
+
+    cmd = gm_strdup(processed_command);
+    parse_command_line(cmd, argv);
+    if(argv[0] == NULL || (func = get_builtin_plugin(argv[0])) == NULL) {
+        free(cmd);
+        return GM_NO_BUILTIN;
+    }
+    for(argc = 0; argv[argc] != NULL; argc++)
+        ;
+
+    /* plugins return GM_NO_BUILTIN for everything they do not implement */
+    rc = func(argc, argv, &output);
+    if(rc == GM_NO_BUILTIN) {
+        GM_LOG( GM_LOG_TRACE, "builtin plugin does not support arguments, falling back to exec: %s\n", processed_command );
+        free(output);
+        free(cmd);
+        return GM_NO_BUILTIN;
+    }
+    GM_LOG( GM_LOG_TRACE, "using builtin plugin for: %s\n", argv[0] );
+
+    *ret = gm_escape_newlines(output, GM_DISABLED);
+    *err = gm_strdup("");
+    free(output);
+    free(cmd);
+
+    /* same format as the exit status returned by waitpid() */
+    return(rc << 8);
+}
+
+
+/* lookup builtin plugin by basename */
+gm_builtin_func get_builtin_plugin(const char *command) {
+    const char *name;
+    int x;
+
+    name = strrchr(command, '/');
+    name = name == NULL ? command : name + 1;
+
+    for(x = 0; builtin_plugins[x].name != NULL; x++) {
+        if(!strcmp(builtin_plugins[x].name, name))
+            return builtin_plugins[x].func;
+    }
+    return NULL;
+}
+
+
+/* check_dummy <state> [text] */
+int builtin_check_dummy(int argc, char **argv, char **output) {
+    long state;
+
+    /* usage, help and version output is left to the real plugin */
+    if(argc < 2 || argv[1][0] == '-' || !is_builtin_integer(argv[1], &state))
+        return GM_NO_BUILTIN;
+
+    if(state < STATE_OK || state > STATE_UNKNOWN) {
+        gm_asprintf(output, "UNKNOWN: Status %ld is not a supported error state\n", state);
+        return STATE_UNKNOWN;
+    }
+
+    if(argc >= 3)
+        gm_asprintf(output, "%s: %s\n", builtin_state_text[state], argv[2]);
+    else
+        gm_asprintf(output, "%s\n", builtin_state_text[state]);
+
+    return (int)state;
+}
+
+
+/* check_tcp -H <host> -p <port> [-t <timeout>] [-w <sec>] [-c <sec>] */
+int builtin_check_tcp(int argc, char **argv, char **output) {
+    const char *longopts[] = { "hostname", "port", "timeout", "warning", "critical" };
+    char *values[5] = { NULL, NULL, NULL, NULL, NULL };
+    char port_str[20];
+    char warn_str[64], crit_str[64];
+    long port, timeout = GM_BUILTIN_SOCKET_TIMEOUT;
+    double warning = 0, critical = 0, elapsed;
+    int sd = -1, rc, state, err = 0, remaining;
+    socklen_t errlen;
+    struct addrinfo hints, *res, *r;
+    struct pollfd pfd;
+    struct timeval start_time, end_time;
+
+    if(parse_builtin_args(argc, argv, "Hptwc", longopts, values, NULL) != GM_OK)
+        return GM_NO_BUILTIN;
+    if(values[0] == NULL || values[0][0] == '/' || values[1] == NULL)
+        return GM_NO_BUILTIN;
+    if(!is_builtin_integer(values[1], &port) || port <= 0 || port > 65535)
+        return GM_NO_BUILTIN;
+    if(values[2] != NULL && (!is_builtin_integer(values[2], &timeout) || timeout <= 0))
+        return GM_NO_BUILTIN;
+    if(values[3] != NULL)
+        warning = atof(values[3]);
+    if(values[4] != NULL)
+        critical = atof(values[4]);
+
+    /* invalid addresses get the usage text of the real plugin */
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port_str, sizeof(port_str), "%ld", port);
+    if(getaddrinfo(values[0], port_str, &hints, &res) != 0)
+        return GM_NO_BUILTIN;
+
+    gettimeofday(&start_time, NULL);
+    rc = -1;
+    for(r = res; r != NULL && rc != 0; r = r->ai_next) {
+        if(sd != -1)
+            close(sd);
+        sd = socket(r->ai_family, r->ai_socktype, r->ai_protocol);
+        if(sd == -1) {
+            err = errno;
+            continue;
+        }
+        fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK);
+        rc = connect(sd, r->ai_addr, r->ai_addrlen);
+        if(rc == 0)
+            break;
+        err = errno;
+        if(errno != EINPROGRESS)
+            continue;
+
+        /* wait for the connection within the remaining socket timeout */
+        gettimeofday(&end_time, NULL);
+        remaining = (int)(timeout * 1000 - ((end_time.tv_sec - start_time.tv_sec) * 1000 + (end_time.tv_usec - start_time.tv_usec) / 1000));
+        pfd.fd     = sd;
+        pfd.events = POLLOUT;
+        if(remaining <= 0 || poll(&pfd, 1, remaining) <= 0) {
+            close(sd);
+            freeaddrinfo(res);
+            gm_asprintf(output, "CRITICAL - Socket timeout after %ld seconds\n", timeout);
+            return STATE_CRITICAL;
+        }
+        errlen = sizeof(err);
+        if(getsockopt(sd, SOL_SOCKET, SO_ERROR, &err, &errlen) == 0 && err == 0)
+            rc = 0;
+    }
+    gettimeofday(&end_time, NULL);
+    if(sd != -1)
+        close(sd);
+    freeaddrinfo(res);
+
+    if(rc != 0) {
+        gm_asprintf(output, "connect to address %s and port %ld: %s\n", values[0], port, strerror(err));
+        return STATE_CRITICAL;
+    }
+
+    elapsed = (double)(end_time.tv_sec - start_time.tv_sec) + (double)(end_time.tv_usec - start_time.tv_usec) / 1000000;
+    state   = STATE_OK;
+    if(values[4] != NULL && elapsed > critical)
+        state = STATE_CRITICAL;
+    else if(values[3] != NULL && elapsed > warning)
+        state = STATE_WARNING;
+
+    /* thresholds are left empty if not set, like the real plugin does */
+    warn_str[0] = '\x0';
+    crit_str[0] = '\x0';
+    if(values[3] != NULL)
+        snprintf(warn_str, sizeof(warn_str), "%f", warning);
+    if(values[4] != NULL)
+        snprintf(crit_str, sizeof(crit_str), "%f", critical);
+    gm_asprintf(output, "TCP %s - %.3f second response time on %s port %ld|time=%fs;%s;%s;%f;%f\n",
+                builtin_state_text[state], elapsed, values[0], port,
+                elapsed, warn_str, crit_str, 0.0, (double)timeout);
+    return state;
+}
+
+
+/* check_file_age [-w <sec>] [-c <sec>] [-W <size>] [-C <size>] -f <file> */
+int builtin_check_file_age(int argc, char **argv, char **output) {
+    const char *longopts[] = { "file", "warning-age", "critical-age", "warning-size", "critical-size" };
+    char *values[5] = { NULL, NULL, NULL, NULL, NULL };
+    char *positional = NULL;
+    long limits[4] = { 240, 600, 0, 0 };
+    long age, size;
+    int x, state;
+    char *file;
+    struct stat st;
+
+    if(parse_builtin_args(argc, argv, "fwcWC", longopts, values, &positional) != GM_OK)
+        return GM_NO_BUILTIN;
+    file = values[0] != NULL ? values[0] : positional;
+    if(file == NULL)
+        return GM_NO_BUILTIN;
+    for(x = 0; x < 4; x++) {
+        if(values[x+1] != NULL && (!is_builtin_integer(values[x+1], &limits[x]) || limits[x] < 0))
+            return GM_NO_BUILTIN;
+    }
+
+    if(stat(file, &st) != 0) {
+        gm_asprintf(output, "FILE_AGE CRITICAL: File not found - %s\n", file);
+        return STATE_CRITICAL;
+    }
+    age  = (long)(time(NULL) - st.st_mtime);
+    size = (long)st.st_size;
+
+    state = STATE_OK;
+    if((limits[1] && age > limits[1]) || (limits[3] && size < limits[3]))
+        state = STATE_CRITICAL;
+    else if((limits[0] && age > limits[0]) || (limits[2] && size < limits[2]))
+        state = STATE_WARNING;
+
+    gm_asprintf(output, "FILE_AGE %s: %s is %ld second%s old and %ld byte%s | age=%lds;%ld;%ld size=%ldB;%ld;%ld;0\n",
+                builtin_state_text[state], file, age, age == 1 ? "" : "s", size, size == 1 ? "" : "s",
+                age, limits[0], limits[1], size, limits[2], limits[3]);
+    return state;
+}
+
+
+/* check_procs [-w <range>] [-c <range>] [-C <command>] */
+int builtin_check_procs(int argc, char **argv, char **output) {
+    const char *longopts[] = { "warning", "critical", "command" };
+    char *values[3] = { NULL, NULL, NULL };
+    char path[300];
+    char buf[512];
+    char *start, *end;
+    builtin_range_t warning, critical;
+    long procs = 0;
+    int state, fd, len;
+    DIR *dir;
+    struct dirent *entry;
+
+    if(parse_builtin_args(argc, argv, "wcC", longopts, values, NULL) != GM_OK)
+        return GM_NO_BUILTIN;
+    if(values[0] != NULL && parse_builtin_range(values[0], &warning) != GM_OK)
+        return GM_NO_BUILTIN;
+    if(values[1] != NULL && parse_builtin_range(values[1], &critical) != GM_OK)
+        return GM_NO_BUILTIN;
+
+    /* process list is read from the linux proc filesystem */
+    if((dir = opendir("/proc")) == NULL)
+        return GM_NO_BUILTIN;
+    if(access("/proc/self/stat", R_OK) != 0) {
+        closedir(dir);
+        return GM_NO_BUILTIN;
+    }
+
+    while((entry = readdir(dir)) != NULL) {
+        if(entry->d_name[0] < '1' || entry->d_name[0] > '9')
+            continue;
+        if(values[2] == NULL) {
+            procs++;
+            continue;
+        }
+        /* command name is the part in brackets, it may contain brackets itself */
+        snprintf(path, sizeof(path), "/proc/%s/stat", entry->d_name);
+        if((fd = open(path, O_RDONLY)) == -1)
+            continue;
+        len = read(fd, buf, sizeof(buf)-1);
+        close(fd);
+        if(len <= 0)
+            continue;
+        buf[len] = '\x0';
+        start = strchr(buf, '(');
+        end   = strrchr(buf, ')');
+        if(start == NULL || end == NULL || end < start)
+            continue;
+        *end = '\x0';
+        if(!strcmp(start+1, values[2]))
+            procs++;
+    }
+    closedir(dir);
+
+    state = STATE_OK;
+    if(values[1] != NULL && check_builtin_range(procs, &critical))
+        state = STATE_CRITICAL;
+    else if(values[0] != NULL && check_builtin_range(procs, &warning))
+        state = STATE_WARNING;
+
+    if(values[2] != NULL)
+        snprintf(buf, sizeof(buf), " with command name '%s'", values[2]);
+    else
+        buf[0] = '\x0';
+
+    gm_asprintf(output, "PROCS %s: %ld process%s%s | procs=%ld;%s;%s;0;\n",
+                builtin_state_text[state], procs, procs == 1 ? "" : "es", buf,
+                procs, values[0] != NULL ? values[0] : "", values[1] != NULL ? values[1] : "");
+    return state;
+}
+
+
+/* strict integer conversion */
+static int is_builtin_integer(const char *value, long *number) {
+    char *end;
+    if(value == NULL || *value == '\x0')
+        return FALSE;
+    errno   = 0;
+    *number = strtol(value, &end, 10);
+    if(errno != 0 || *end != '\x0' || *number > INT_MAX || *number < INT_MIN)
+        return FALSE;
+    return TRUE;
+}
+
+
+/* parse -x value, -xvalue, --long=value and --long value style arguments */
+static int parse_builtin_args(int argc, char **argv, const char *shortopts, const char **longopts, char **values, char **positional) {
+    int i, x, len;
+    char *arg, *value;
+
+    for(i = 1; i < argc; i++) {
+        arg   = argv[i];
+        value = NULL;
+        x     = -1;
+
+        if(arg[0] != '-' || arg[1] == '\x0') {
+            /* at most one positional argument */
+            if(positional == NULL || *positional != NULL)
+                return GM_ERROR;
+            *positional = arg;
+            continue;
+        }
+
+        if(arg[1] == '-') {
+            for(x = strlen(shortopts)-1; x >= 0; x--) {
+                len = strlen(longopts[x]);
+                if(!strncmp(arg+2, longopts[x], len) && (arg[len+2] == '\x0' || arg[len+2] == '=')) {
+                    if(arg[len+2] == '=')
+                        value = arg+len+3;
+                    break;
+                }
+            }
+        }
+        else {
+            for(x = strlen(shortopts)-1; x >= 0; x--) {
+                if(arg[1] == shortopts[x]) {
+                    if(arg[2] != '\x0')
+                        value = arg+2;
+                    break;
+                }
+            }
+        }
+
+        /* unknown option */
+        if(x < 0)
+            return GM_ERROR;
+
+        if(value == NULL) {
+            if(i+1 >= argc)
+                return GM_ERROR;
+            value = argv[++i];
+        }
+        values[x] = value;
+    }
+
+    return GM_OK;
+}
+
+
+/* parse threshold range: 10, 10:, 5:10, ~:10 and @5:10 */
+static int parse_builtin_range(const char *value, builtin_range_t *range) {
+    char *colon;
+    char buf[64];
+
+    range->start          = 0;
+    range->end            = 0;
+    range->start_infinity = FALSE;
+    range->end_infinity   = FALSE;
+    range->alert_inside   = FALSE;
+
+    if(*value == '@') {
+        range->alert_inside = TRUE;
+        value++;
+    }
+    if(strlen(value) >= sizeof(buf))
+        return GM_ERROR;
+    strcpy(buf, value);
+
+    colon = strchr(buf, ':');
+    if(colon != NULL) {
+        *colon = '\x0';
+        if(!strcmp(buf, "~"))
+            range->start_infinity = TRUE;
+        else if(!is_builtin_integer(buf, &range->start))
+            return GM_ERROR;
+        value = colon+1;
+    }
+    else {
+        value = buf;
+    }
+
+    if(*value == '\x0')
+        range->end_infinity = TRUE;
+    else if(!is_builtin_integer(value, &range->end))
+        return GM_ERROR;
+
+    if(!range->start_infinity && !range->end_infinity && range->start > range->end)
+        return GM_ERROR;
+
+    return GM_OK;
+}
+
+
+/* returns true if value should alert */
+static int check_builtin_range(long value, builtin_range_t *range) {
+    int inside = TRUE;
+    if(!range->start_infinity && value < range->start)
+        inside = FALSE;
+    if(!range->end_infinity && value > range->end)
+        inside = FALSE;
+    return(range->alert_inside ? inside : !inside);
+}
@@ -27,8 +27,14 @@
 #include "epn_utils.h"
 #include "gearman_utils.h"
 #include "popenRWE.h"
+#include "builtin_plugins.h"
+#include "dl_plugins.h"
+#include "result_sender.h"
+#include "exec_plan.h"
 
 pid_t current_child_pid = 0;
+struct rusage last_check_rusage;
+int last_check_rusage_valid = FALSE;
 
 /* convert number to signal name */
 char *nr2signal(int sig) {
@@ -92,60 +98,62 @@ char *extract_check_result(FILE *fp, int trimmed) {
 
 /* run a check */
 int run_check(char *processed_command, char **ret, char **err) {
-    char *argv[MAX_CMD_ARGS];
+    gm_exec_plan_t *plan;
     FILE *fp;
     pid_t pid;
     int pipe_stdout[2], pipe_stderr[2], pipe_rwe[3];
     int retval;
     int i;
-    int restricted_ok = FALSE;
     sigset_t mask;
 
+    /* parsed command line, shell decision and restriction verdict are cached */
+    plan = get_exec_plan(processed_command);
+
+    last_check_rusage_valid = FALSE;
+
     /* verify restricted paths
      * make sure our command does not contain any bash special characters
      * and starts with one of the allowed paths
      */
-    if(mod_gm_opt->restrict_path_num) {
-        if(*processed_command != '/') {
-            *err = gm_strdup("");
+    if(plan->verdict != GM_EXEC_ALLOWED) {
+        *err = gm_strdup("");
+        if(plan->verdict == GM_EXEC_NOT_ABSOLUTE)
             gm_asprintf(ret, "ERROR: restricted paths in affect, but command does not start with an absolute path: %.*s...\n", 8, processed_command);
-            return(GM_EXIT_UNKNOWN);
-        }
-        if(strpbrk(processed_command,mod_gm_opt->restrict_command_characters) != NULL) {
-            *err = gm_strdup("");
+        else if(plan->verdict == GM_EXEC_FORBIDDEN_CHARACTERS)
             gm_asprintf(ret, "ERROR: restricted paths in affect, but command contains forbidden character(s): %.*s...\n", 8, processed_command);
-            return(GM_EXIT_UNKNOWN);
-        }
-        for(i=0;i<mod_gm_opt->restrict_path_num;i++) {
-            if(starts_with(mod_gm_opt->restrict_path[i], processed_command)) {
-                restricted_ok = TRUE;
-            }
-        }
-        if(!restricted_ok) {
-            *err = gm_strdup("");
+        else
             gm_asprintf(ret, "ERROR: command does not start with any of the restricted paths: %.*s...\n", 8, processed_command);
-            return(GM_EXIT_UNKNOWN);
-        }
+        release_exec_plan(plan);
+        return(GM_EXIT_UNKNOWN);
     }
 
 #ifdef EMBEDDEDPERL
     retval = run_epn_check(processed_command, ret, err);
     if(retval != GM_NO_EPN) {
+        release_exec_plan(plan);
         return retval;
     }
 #endif
 
-    /* check for check execution method (shell or execvp)
-     * command line does not have to contain shell meta characters
-     * and cmd must begin with a /. Otherwise "BLAH=BLUB cmd" would lead
-     * to file not found errors
-     */
-    if((*processed_command == '/' || *processed_command == '.') && strpbrk(processed_command,"!$^&*()~[]\\|{};<>?`\"'") == NULL) {
+    /* cheap plugins can be run without fork and exec */
+    retval = run_builtin_check(processed_command, ret, err);
+    if(retval != GM_NO_BUILTIN) {
+        release_exec_plan(plan);
+        return retval;
+    }
+
+    /* shared object plugins from the plugin_dir */
+    retval = run_dl_plugin_check(processed_command, ret, err);
+    if(retval != GM_NO_DL_PLUGIN) {
+        release_exec_plan(plan);
+        return retval;
+    }
+
+    if(plan->use_shell == FALSE) {
         /* use the fast execvp when there are no shell characters */
-        gm_log( GM_LOG_TRACE, "using execvp, no shell characters found\n" );
+        GM_LOG( GM_LOG_TRACE, "using execvp, no shell characters found\n" );
 
-        parse_command_line(processed_command,argv);
-        if(!argv[0])
+        if(!plan->argv[0])
             _exit(STATE_UNKNOWN);
 
         if(pipe(pipe_stdout)) {
@@ -170,14 +178,19 @@ int run_check(char *processed_command, char **ret, char **err) {
                 gm_log( GM_LOG_ERROR, "dup2 error\n");
                 _exit(STATE_UNKNOWN);
             }
-            if((dup2(pipe_stderr[1],STDERR_FILENO)<0)){
+            if((dup2(plan->stderr_to_stdout ? pipe_stdout[1] : pipe_stderr[1],STDERR_FILENO)<0)){
                 gm_log( GM_LOG_ERROR, "dup2 error\n");
                 _exit(STATE_UNKNOWN);
             }
             close(pipe_stdout[1]);
             close(pipe_stderr[1]);
             current_child_pid = getpid();
-            execvp(argv[0], argv);
+            for(i = 0; plan->env[i] != NULL; i++)
+                putenv(plan->env[i]);
+            if(plan->path != NULL)
+                execv(plan->path, plan->argv);
+            else
+                execvp(plan->argv[0], plan->argv);
             if(errno == 2)
                 _exit(127);
             if(errno == 13)
@@ -208,12 +221,14 @@ int run_check(char *processed_command, char **ret, char **err) {
 
         close(pipe_stdout[0]);
         close(pipe_stderr[0]);
-        if(waitpid(pid,&retval,0)!=pid)
+        if(wait4(pid,&retval,0,&last_check_rusage)!=pid)
             retval=-1;
+        else
+            last_check_rusage_valid = TRUE;
     }
     else {
         /* use the slower popen when there were shell characters */
-        gm_log( GM_LOG_TRACE, "using popen, found shell characters\n" );
+        GM_LOG( GM_LOG_TRACE, "using popen, found shell characters\n" );
         current_child_pid = getpid();
         pid = popenRWE(pipe_rwe, processed_command);
 
@@ -235,10 +250,15 @@ int run_check(char *processed_command, char **ret, char **err) {
         *err = extract_check_result(fp, GM_ENABLED);
         fclose(fp);
 
-        /* close the process */
-        retval=pcloseRWE(pid, pipe_rwe);
+        /* close the process, like pcloseRWE but with resource usage */
+        close(pipe_rwe[0]);
+        if(wait4(pid,&retval,0,&last_check_rusage)!=pid)
+            retval=-1;
+        else
+            last_check_rusage_valid = TRUE;
     }
 
+    release_exec_plan(plan);
     return retval;
 }
 
@@ -255,7 +275,7 @@ int execute_safe_command(gm_job_t * exec_job, int fork_exec, char * identifier)
     pid_t pid    = 0;
     source[0]    = '\x0';
 
-    gm_log( GM_LOG_TRACE, "execute_safe_command(%d, %s)\n", exec_job->timeout, exec_job->command_line );
+    GM_LOG( GM_LOG_TRACE, "execute_safe_command(%d, %s)\n", exec_job->timeout, exec_job->command_line );
 
     /* mark all filehandles to close on exec */
     for(x = 0; x<=64; x++)
@@ -330,13 +350,15 @@ int execute_safe_command(gm_job_t * exec_job, int fork_exec, char * identifier)
     if( fork_exec == GM_DISABLED || pid > 0 ){
 
         if( fork_exec == GM_ENABLED) {
-            gm_log( GM_LOG_TRACE, "started check with pid: %d\n", pid);
+            GM_LOG( GM_LOG_TRACE, "started check with pid: %d\n", pid);
 
             close(pipe_stdout[1]);
             close(pipe_stderr[1]);
 
-            waitpid(pid, &return_code, 0);
-            gm_log( GM_LOG_TRACE, "finished check from pid: %d with status: %d\n", pid, return_code);
+            /* includes the plugin, which has been reaped by our child */
+            if(wait4(pid, &return_code, 0, &exec_job->rusage) == pid)
+                exec_job->has_rusage = TRUE;
+            GM_LOG( GM_LOG_TRACE, "finished check from pid: %d with status: %d\n", pid, return_code);
             /* get all lines of plugin output */
             plugin_output = gm_malloc(GM_BUFFERSIZE);
             plugin_output[0]='\x0';
@@ -371,8 +393,8 @@ int execute_safe_command(gm_job_t * exec_job, int fork_exec, char * identifier)
         }
         /* other error codes > 3 */
         else if(return_code > 3) {
-            gm_log( GM_LOG_DEBUG, "check exited with exit code > 3. Exit: %d\n", (int)(return_code));
-            gm_log( GM_LOG_DEBUG, "stdout: %s\n", plugin_output);
+            GM_LOG( GM_LOG_DEBUG, "check exited with exit code > 3. Exit: %d\n", (int)(return_code));
+            GM_LOG( GM_LOG_DEBUG, "stdout: %s\n", plugin_output);
             bufdup = gm_strdup(plugin_output);
             free(plugin_output);
             gm_asprintf(&plugin_output, "CRITICAL: Return code of %d is out of bounds. (worker: %s)\\n%s", (int)(return_code), identifier, bufdup);
@@ -385,6 +407,10 @@ int execute_safe_command(gm_job_t * exec_job, int fork_exec, char * identifier)
         exec_job->output      = plugin_output;
         exec_job->error       = plugin_error;
         exec_job->return_code = return_code;
+        if( fork_exec == GM_DISABLED && last_check_rusage_valid == TRUE) {
+            exec_job->rusage     = last_check_rusage;
+            exec_job->has_rusage = TRUE;
+        }
         if( fork_exec == GM_ENABLED) {
             close(pipe_stdout[0]);
             close(pipe_stderr[0]);
@@ -424,7 +450,7 @@ int execute_safe_command(gm_job_t * exec_job, int fork_exec, char * identifier)
 void check_alarm_handler(int sig) {
     pid_t pid;
 
-    gm_log( GM_LOG_TRACE, "check_alarm_handler(%i)\n", sig );
+    GM_LOG( GM_LOG_TRACE, "check_alarm_handler(%i)\n", sig );
     pid = getpid();
     if(current_job != NULL && mod_gm_opt->fork_on_exec == GM_DISABLED) {
         /* create a useful log message*/
@@ -442,14 +468,14 @@ void check_alarm_handler(int sig) {
     }
 
     signal(SIGTERM, SIG_IGN);
-    gm_log( GM_LOG_TRACE, "send SIGTERM to %d\n", pid);
+    GM_LOG( GM_LOG_TRACE, "send SIGTERM to %d\n", pid);
     kill(-pid, SIGTERM);
     kill(pid, SIGTERM);
     signal(SIGTERM, SIG_DFL);
     sleep(1);
 
     signal(SIGINT, SIG_IGN);
-    gm_log( GM_LOG_TRACE, "send SIGINT to %d\n", pid);
+    GM_LOG( GM_LOG_TRACE, "send SIGINT to %d\n", pid);
     kill(-pid, SIGINT);
     kill(pid, SIGINT);
     signal(SIGINT, SIG_DFL);
@@ -457,7 +483,7 @@ void check_alarm_handler(int sig) {
 
     /* skip sigkill in test mode */
     if(getenv("MODGEARMANTEST") == NULL) {
-        gm_log( GM_LOG_TRACE, "send SIGKILL to %d\n", pid);
+        GM_LOG( GM_LOG_TRACE, "send SIGKILL to %d\n", pid);
         kill(-pid, SIGKILL);
         kill(pid, SIGKILL);
     }
@@ -473,7 +499,7 @@ void kill_child_checks(void) {
     signal(SIGINT, SIG_IGN);
     pid = getpid();
     if(current_child_pid > 0 && current_child_pid != pid) {
-        gm_log( GM_LOG_TRACE, "kill_child_checks(): send SIGINT to %d\n", current_child_pid);
+        GM_LOG( GM_LOG_TRACE, "kill_child_checks(): send SIGINT to %d\n", current_child_pid);
         kill(-current_child_pid, SIGINT);
         kill(current_child_pid, SIGINT);
         sleep(1);
@@ -482,11 +508,11 @@ void kill_child_checks(void) {
             return;
         }
         if(pid_alive(current_child_pid)) {
-            gm_log( GM_LOG_TRACE, "kill_child_checks(): send SIGKILL to %d\n", current_child_pid);
+            GM_LOG( GM_LOG_TRACE, "kill_child_checks(): send SIGKILL to %d\n", current_child_pid);
             kill(current_child_pid, SIGKILL);
         }
     }
-    gm_log( GM_LOG_TRACE, "send SIGINT to %d\n", pid);
+    GM_LOG( GM_LOG_TRACE, "send SIGINT to %d\n", pid);
     kill(0, SIGINT);
     signal(SIGINT, SIG_DFL);
     return;
@@ -498,7 +524,7 @@ void send_timeout_result(gm_job_t * exec_job) {
     char buffer[GM_BUFFERSIZE];
     buffer[0] = '\x0';
 
-    gm_log( GM_LOG_TRACE, "send_timeout_result()\n");
+    GM_LOG( GM_LOG_TRACE, "send_timeout_result()\n");
 
     gettimeofday(&end_time, NULL);
     exec_job->finish_time = end_time;
@@ -512,6 +538,8 @@ void send_timeout_result(gm_job_t * exec_job) {
     free(exec_job->output);
     exec_job->output = gm_strdup( buffer );
 
+    /* the process exits soon, we are in a signal handler and must not join the sender thread */
+    request_result_sender_stop();
     send_result_back(exec_job);
 
     return;
@@ -525,7 +553,7 @@ void send_failed_result(gm_job_t * exec_job, int sig) {
     char * signame;
     buffer[0] = '\x0';
 
-    gm_log( GM_LOG_TRACE, "send_failed_result()\n");
+    GM_LOG( GM_LOG_TRACE, "send_failed_result()\n");
 
     gettimeofday(&end_time, NULL);
     exec_job->finish_time = end_time;
@@ -537,6 +565,7 @@ void send_failed_result(gm_job_t * exec_job, int sig) {
     exec_job->output = gm_strdup( buffer );
     free(signame);
 
+    request_result_sender_stop();
     send_result_back(exec_job);
 
     return;
@@ -545,44 +574,112 @@ void send_failed_result(gm_job_t * exec_job, int sig) {
 
 /* convert a command line to an array of arguments, suitable for exec* functions */
 int parse_command_line(char *cmd, char *argv[MAX_CMD_ARGS]) {
-    unsigned int argc=0;
-    char *parsed_cmd;
-
-    /* Skip initial white-space characters. */
-    for(parsed_cmd=cmd;isspace(*cmd);++cmd)
-        ;
-
-    /* Parse command line. */
-    while(*cmd&&(argc<MAX_CMD_ARGS-1)){
-        argv[argc++]=parsed_cmd;
-        switch(*cmd){
-        case '\'':
-            while((*cmd)&&(*cmd!='\''))
-                *(parsed_cmd++)=*(cmd++);
-            if(*cmd)
-                ++cmd;
-            break;
-        case '"':
-            while((*cmd)&&(*cmd!='"')){
-                if((*cmd=='\\')&&cmd[1]&&strchr("\"\\\n",cmd[1]))
-                    ++cmd;
-                *(parsed_cmd++)=*(cmd++);
-                }
-            if(*cmd)
-                ++cmd;
+    int assignments, stderr_to_stdout;
+
+    lex_command_line(cmd, argv, &assignments, &stderr_to_stdout);
+
+    return GM_OK;
+}
+
+
+/* split a command line into words like /bin/sh does
+ * returns FALSE if the command uses anything besides quoting, escapes,
+ * leading variable assignments and 2>&1, otherwise TRUE
+ */
+int lex_command_line(char *cmd, char *argv[MAX_CMD_ARGS], int *assignments, int *stderr_to_stdout) {
+    char *in  = cmd;
+    char *out = cmd;
+    char *word, *name;
+    int argc = 0, is_assignment;
+
+    *assignments      = 0;
+    *stderr_to_stdout = FALSE;
+    argv[0]           = NULL;
+
+    while(1) {
+        while(*in == ' ' || *in == '\t')
+            in++;
+        if(*in == '\0')
             break;
-        default:
-            while((*cmd)&&!isspace(*cmd)){
-                if((*cmd=='\\')&&cmd[1])
-                    ++cmd;
-                *(parsed_cmd++)=*(cmd++);
+        if(argc >= MAX_CMD_ARGS-1)
+            return FALSE;
+
+        /* the only supported redirection */
+        if(!strncmp(in, "2>&1", 4) && (in[4] == ' ' || in[4] == '\t' || in[4] == '\0')) {
+            *stderr_to_stdout = TRUE;
+            in += 4;
+            continue;
+        }
+
+        /* NAME=value before the command */
+        is_assignment = FALSE;
+        if(argc == *assignments && (isalpha(*in) || *in == '_')) {
+            for(name = in; isalnum(*name) || *name == '_'; name++)
+                ;
+            if(*name == '=')
+                is_assignment = TRUE;
+        }
+
+        /* comment */
+        if(*in == '#')
+            return FALSE;
+
+        word = out;
+        while(*in != '\0' && *in != ' ' && *in != '\t') {
+            if(*in == '\'') {
+                /* everything is literal inside single quotes */
+                in++;
+                while(*in != '\0' && *in != '\'')
+                    *out++ = *in++;
+                if(*in == '\0')
+                    return FALSE;
+                in++;
+            }
+            else if(*in == '"') {
+                /* backslash only escapes $ ` " and \ inside double quotes */
+                in++;
+                while(*in != '\0' && *in != '"') {
+                    if(*in == '$' || *in == '`')
+                        return FALSE;
+                    if(*in == '\\' && in[1] != '\0' && strchr("$`\"\\", in[1]) != NULL)
+                        in++;
+                    else if(*in == '\\' && in[1] == '\n')
+                        return FALSE;
+                    *out++ = *in++;
                 }
+                if(*in == '\0')
+                    return FALSE;
+                in++;
+            }
+            else if(*in == '\\') {
+                if(in[1] == '\0' || in[1] == '\n')
+                    return FALSE;
+                in++;
+                *out++ = *in++;
+            }
+            else if(strchr("|&;<>()$`*?[]{}!^~\n\r", *in) != NULL) {
+                /* expansions, globbing, redirections, lists, ... */
+                return FALSE;
+            }
+            else {
+                *out++ = *in++;
             }
-        while(isspace(*cmd))
-            ++cmd;
-        *(parsed_cmd++)='\0';
         }
-    argv[argc]=NULL;
 
-    return GM_OK;
+        /* step over the separator before terminating the word, it might be overwritten */
+        if(*in != '\0')
+            in++;
+        *out++ = '\0';
+
+        argv[argc++] = word;
+        argv[argc]   = NULL;
+        if(is_assignment)
+            (*assignments)++;
+    }
+
+    /* plain assignments change the shell environment only */
+    if(argc == *assignments)
+        return FALSE;
+
+    return TRUE;
 }
@@ -0,0 +1,504 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "config.h"
+#include "dl_plugins.h"
+#include "check_utils.h"
+#include "utils.h"
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+static gm_dl_plugin_t dl_plugins[GM_MAX_DL_PLUGINS];
+static int dl_plugins_num = 0;
+
+/* helper process for isolated plugins */
+static pid_t helper_pid = 0;
+static int   helper_fd  = -1;
+
+/* watchdog thread */
+static pthread_mutex_t   watchdog_mutex;
+static pthread_cond_t    watchdog_cond;
+static pthread_t         watchdog_target;
+static pid_t             watchdog_owner    = 0;
+static pid_t             watchdog_kill_pid = 0;
+static int               watchdog_armed    = FALSE;
+static int               watchdog_fired    = FALSE;
+static struct timespec   watchdog_deadline;
+
+static const mod_gearman_plugin_t *find_dl_plugin(const char *command);
+static int get_dl_plugin_timeout(const mod_gearman_plugin_t *plugin);
+static int run_dl_plugin_isolated(char *command, int timeout, char **output);
+static int start_dl_plugin_helper(void);
+static void stop_dl_plugin_helper(void);
+static void arm_dl_plugin_watchdog(int timeout, pid_t kill_pid);
+static int disarm_dl_plugin_watchdog(void);
+static int read_all(int fd, void *buf, size_t len);
+static int write_all(int fd, const void *buf, size_t len);
+
+
+/* load all shared objects from a directory */
+int load_dl_plugins(char *dir) {
+    DIR *d;
+    struct dirent *entry;
+    char path[GM_BUFFERSIZE];
+    void *handle;
+    mod_gearman_plugin_entry_t plugin_entry;
+    const mod_gearman_plugin_t *plugin;
+    size_t len;
+
+    if((d = opendir(dir)) == NULL) {
+        gm_log( GM_LOG_ERROR, "cannot open plugin_dir %s: %s\n", dir, strerror(errno));
+        return dl_plugins_num;
+    }
+
+    while((entry = readdir(d)) != NULL) {
+        len = strlen(entry->d_name);
+        if(len <= 3 || strcmp(entry->d_name+len-3, ".so"))
+            continue;
+        if(dl_plugins_num >= GM_MAX_DL_PLUGINS) {
+            gm_log( GM_LOG_ERROR, "too many plugins in %s, only %d are supported\n", dir, GM_MAX_DL_PLUGINS);
+            break;
+        }
+
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+        if(handle == NULL) {
+            gm_log( GM_LOG_ERROR, "cannot load plugin %s: %s\n", path, dlerror());
+            continue;
+        }
+
+        *(void **)(&plugin_entry) = dlsym(handle, MOD_GEARMAN_PLUGIN_ENTRY);
+        if(plugin_entry == NULL) {
+            gm_log( GM_LOG_ERROR, "plugin %s does not export %s()\n", path, MOD_GEARMAN_PLUGIN_ENTRY);
+            dlclose(handle);
+            continue;
+        }
+
+        plugin = plugin_entry();
+        if(plugin == NULL || plugin->abi_version != MOD_GEARMAN_PLUGIN_ABI_VERSION) {
+            gm_log( GM_LOG_ERROR, "plugin %s has abi version %d, but version %d is required\n", path, plugin == NULL ? -1 : plugin->abi_version, MOD_GEARMAN_PLUGIN_ABI_VERSION);
+            dlclose(handle);
+            continue;
+        }
+        if(plugin->name == NULL || plugin->run == NULL) {
+            gm_log( GM_LOG_ERROR, "plugin %s has no name or run function\n", path);
+            dlclose(handle);
+            continue;
+        }
+
+        dl_plugins[dl_plugins_num].handle  = handle;
+        dl_plugins[dl_plugins_num].plugin  = plugin;
+        dl_plugins[dl_plugins_num].path    = gm_strdup(path);
+        dl_plugins[dl_plugins_num].enabled = TRUE;
+        dl_plugins_num++;
+        GM_LOG( GM_LOG_DEBUG, "loaded plugin %s from %s\n", plugin->name, path);
+    }
+    closedir(d);
+
+    return dl_plugins_num;
+}
+
+
+/* call init of all plugins */
+int init_dl_plugins() {
+    int x;
+    for(x = 0; x < dl_plugins_num; x++) {
+        if(dl_plugins[x].plugin->init == NULL)
+            continue;
+        if(dl_plugins[x].plugin->init() != 0) {
+            gm_log( GM_LOG_ERROR, "init of plugin %s failed, disabling it\n", dl_plugins[x].path);
+            dl_plugins[x].enabled = FALSE;
+        }
+    }
+    return GM_OK;
+}
+
+
+/* call teardown of all plugins */
+void teardown_dl_plugins() {
+    int x;
+    stop_dl_plugin_helper();
+    for(x = 0; x < dl_plugins_num; x++) {
+        if(dl_plugins[x].enabled && dl_plugins[x].plugin->teardown != NULL)
+            dl_plugins[x].plugin->teardown();
+    }
+    return;
+}
+
+
+/* run a check with a shared object plugin */
+int run_dl_plugin_check(char *processed_command, char **ret, char **err) {
+    char *argv[MAX_CMD_ARGS];
+    char *cmd;
+    char *output = NULL;
+    int argc, rc, timeout;
+    const mod_gearman_plugin_t *plugin;
+
+    if(dl_plugins_num == 0)
+        return GM_NO_DL_PLUGIN;
+
+    /* only simple command lines, everything else needs a shell */
+    if(strpbrk(processed_command,"!$^&*()~[]\\|{};<>?`\"'") != NULL)
+        return GM_NO_DL_PLUGIN;
+
+    cmd = gm_strdup(processed_command);
+    parse_command_line(cmd, argv);
+    if(argv[0] == NULL || (plugin = find_dl_plugin(argv[0])) == NULL) {
+        free(cmd);
+        return GM_NO_DL_PLUGIN;
+    }
+    for(argc = 0; argv[argc] != NULL; argc++)
+        ;
+    timeout = get_dl_plugin_timeout(plugin);
+
+    /* forked checks are isolated already */
+    if(mod_gm_opt->plugin_isolation == GM_ENABLED && mod_gm_opt->fork_on_exec == GM_DISABLED) {
+        GM_LOG( GM_LOG_TRACE, "using isolated plugin %s for: %s\n", plugin->name, processed_command );
+        rc = run_dl_plugin_isolated(processed_command, timeout, &output);
+    }
+    else {
+        GM_LOG( GM_LOG_TRACE, "using plugin %s for: %s\n", plugin->name, processed_command );
+        arm_dl_plugin_watchdog(timeout, 0);
+        rc = run_dl_plugin(plugin, argc, argv, timeout, &output);
+        disarm_dl_plugin_watchdog();
+    }
+
+    *ret = gm_escape_newlines(output, GM_DISABLED);
+    *err = gm_strdup("");
+    free(output);
+    free(cmd);
+
+    /* same format as the exit status returned by waitpid() */
+    return(rc << 8);
+}
+
+
+/* run plugin in current process */
+int run_dl_plugin(const mod_gearman_plugin_t *plugin, int argc, char **argv, int timeout, char **output) {
+    mod_gearman_plugin_result_t result;
+
+    result.rc       = STATE_UNKNOWN;
+    result.output   = NULL;
+    result.perfdata = NULL;
+
+    if(plugin->run(argc, argv, timeout, &result) != 0) {
+        if(result.output == NULL)
+            gm_asprintf(&result.output, "UNKNOWN - plugin %s failed", plugin->name);
+        result.rc = STATE_UNKNOWN;
+    }
+    if(result.output == NULL)
+        result.output = gm_strdup("");
+    if(result.rc < 0 || result.rc > 255)
+        result.rc = STATE_UNKNOWN;
+
+    if(result.perfdata != NULL && *result.perfdata != '\x0')
+        gm_asprintf(output, "%s|%s", result.output, result.perfdata);
+    else
+        *output = gm_strdup(result.output);
+
+    free(result.output);
+    free(result.perfdata);
+    return result.rc;
+}
+
+
+/* main loop of the helper process */
+void dl_plugin_helper_loop(int fd) {
+    int request[2], response[2];
+    char *argv[MAX_CMD_ARGS];
+    char *cmd;
+    char *output;
+    int argc;
+    const mod_gearman_plugin_t *plugin;
+
+    /* request: timeout, length, command - response: exit code, length, output */
+    while(read_all(fd, request, sizeof(request)) == GM_OK) {
+        if(request[1] <= 0 || request[1] > GM_BUFFERSIZE)
+            break;
+        cmd = gm_malloc(request[1]);
+        if(read_all(fd, cmd, request[1]) != GM_OK) {
+            free(cmd);
+            break;
+        }
+        cmd[request[1]-1] = '\x0';
+
+        parse_command_line(cmd, argv);
+        plugin = argv[0] == NULL ? NULL : find_dl_plugin(argv[0]);
+        if(plugin == NULL) {
+            gm_asprintf(&output, "UNKNOWN - no plugin found for %s", argv[0] == NULL ? "" : argv[0]);
+            response[0] = STATE_UNKNOWN;
+        }
+        else {
+            for(argc = 0; argv[argc] != NULL; argc++)
+                ;
+            response[0] = run_dl_plugin(plugin, argc, argv, request[0], &output);
+        }
+        response[1] = strlen(output);
+
+        if(write_all(fd, response, sizeof(response)) != GM_OK || write_all(fd, output, response[1]) != GM_OK) {
+            free(output);
+            free(cmd);
+            break;
+        }
+        free(output);
+        free(cmd);
+    }
+    close(fd);
+    return;
+}
+
+
+/* watchdog enforcing plugin timeouts */
+void *dl_plugin_watchdog(void *arg) {
+    sigset_t mask;
+    arg = arg;
+
+    /* signals are handled by the worker thread */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    pthread_mutex_lock(&watchdog_mutex);
+    while(1) {
+        while(watchdog_armed == FALSE)
+            pthread_cond_wait(&watchdog_cond, &watchdog_mutex);
+        if(pthread_cond_timedwait(&watchdog_cond, &watchdog_mutex, &watchdog_deadline) == ETIMEDOUT && watchdog_armed == TRUE) {
+            watchdog_fired = TRUE;
+            watchdog_armed = FALSE;
+            if(watchdog_kill_pid > 0) {
+                /* isolated plugin, just kill the helper */
+                kill(watchdog_kill_pid, SIGKILL);
+            } else {
+                /* in process plugin, use the usual job timeout handling */
+                pthread_kill(watchdog_target, SIGALRM);
+            }
+        }
+    }
+    return NULL;
+}
+
+
+/* find plugin by basename of the command */
+static const mod_gearman_plugin_t *find_dl_plugin(const char *command) {
+    const char *name;
+    int x;
+
+    name = strrchr(command, '/');
+    name = name == NULL ? command : name + 1;
+
+    for(x = 0; x < dl_plugins_num; x++) {
+        if(dl_plugins[x].enabled && !strcmp(dl_plugins[x].plugin->name, name))
+            return dl_plugins[x].plugin;
+    }
+    return NULL;
+}
+
+
+/* plugin timeout must not exceed the job timeout */
+static int get_dl_plugin_timeout(const mod_gearman_plugin_t *plugin) {
+    int timeout = mod_gm_opt->job_timeout;
+    if(current_job != NULL && current_job->timeout > 0)
+        timeout = current_job->timeout;
+    if(plugin->timeout > 0 && plugin->timeout < timeout)
+        timeout = plugin->timeout;
+    return timeout;
+}
+
+
+/* send command to helper process and read result */
+static int run_dl_plugin_isolated(char *command, int timeout, char **output) {
+    int request[2], response[2];
+    int success = FALSE;
+
+    if(helper_pid <= 0 && start_dl_plugin_helper() != GM_OK) {
+        *output = gm_strdup("UNKNOWN - cannot start plugin helper");
+        return STATE_UNKNOWN;
+    }
+
+    request[0] = timeout;
+    request[1] = strlen(command)+1;
+    *output    = NULL;
+
+    arm_dl_plugin_watchdog(timeout, helper_pid);
+    if(   write_all(helper_fd, request, sizeof(request)) == GM_OK
+       && write_all(helper_fd, command, request[1]) == GM_OK
+       && read_all(helper_fd, response, sizeof(response)) == GM_OK
+       && response[1] >= 0 && response[1] <= GM_MAX_OUTPUT) {
+        *output = gm_malloc(response[1]+1);
+        if(read_all(helper_fd, *output, response[1]) == GM_OK) {
+            (*output)[response[1]] = '\x0';
+            success = TRUE;
+        }
+    }
+
+    if(disarm_dl_plugin_watchdog() == TRUE) {
+        stop_dl_plugin_helper();
+        free(*output);
+        gm_asprintf(output, "(Plugin Timed Out On Worker: %s)", mod_gm_opt->identifier);
+        return mod_gm_opt->timeout_return;
+    }
+    if(success == FALSE) {
+        stop_dl_plugin_helper();
+        free(*output);
+        *output = gm_strdup("CRITICAL - plugin helper exited unexpectedly");
+        return STATE_CRITICAL;
+    }
+
+    return response[0];
+}
+
+
+/* fork helper process, plugins are loaded already */
+static int start_dl_plugin_helper() {
+    int sv[2];
+    sigset_t mask;
+
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        gm_log( GM_LOG_ERROR, "socketpair failed: %s\n", strerror(errno));
+        return GM_ERROR;
+    }
+
+    helper_pid = fork();
+    if(helper_pid == -1) {
+        gm_log( GM_LOG_ERROR, "fork error: %s\n", strerror(errno));
+        close(sv[0]);
+        close(sv[1]);
+        helper_pid = 0;
+        return GM_ERROR;
+    }
+
+    /* helper */
+    if(helper_pid == 0) {
+        close(sv[0]);
+        signal(SIGINT,  SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGALRM, SIG_DFL);
+        sigfillset(&mask);
+        sigprocmask(SIG_UNBLOCK, &mask, NULL);
+        watchdog_owner = 0;
+        dl_plugin_helper_loop(sv[1]);
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(sv[1]);
+    helper_fd = sv[0];
+    fcntl(helper_fd, F_SETFD, FD_CLOEXEC);
+    GM_LOG( GM_LOG_TRACE, "started plugin helper with pid: %d\n", helper_pid);
+    return GM_OK;
+}
+
+
+/* stop helper process */
+static void stop_dl_plugin_helper() {
+    int status;
+    if(helper_fd != -1)
+        close(helper_fd);
+    helper_fd = -1;
+    if(helper_pid > 0) {
+        kill(helper_pid, SIGKILL);
+        waitpid(helper_pid, &status, 0);
+    }
+    helper_pid = 0;
+    return;
+}
+
+
+/* start watching the current plugin run */
+static void arm_dl_plugin_watchdog(int timeout, pid_t kill_pid) {
+    pthread_t thread;
+
+    /* threads do not survive a fork, so every process needs its own watchdog */
+    if(watchdog_owner != getpid()) {
+        pthread_mutex_init(&watchdog_mutex, NULL);
+        pthread_cond_init(&watchdog_cond, NULL);
+        watchdog_armed = FALSE;
+        if(pthread_create(&thread, NULL, dl_plugin_watchdog, NULL) != 0) {
+            gm_log( GM_LOG_ERROR, "cannot start plugin watchdog: %s\n", strerror(errno));
+            return;
+        }
+        pthread_detach(thread);
+        watchdog_owner = getpid();
+    }
+
+    pthread_mutex_lock(&watchdog_mutex);
+    clock_gettime(CLOCK_REALTIME, &watchdog_deadline);
+    watchdog_deadline.tv_sec += timeout;
+    watchdog_target   = pthread_self();
+    watchdog_kill_pid = kill_pid;
+    watchdog_fired    = FALSE;
+    watchdog_armed    = TRUE;
+    pthread_cond_signal(&watchdog_cond);
+    pthread_mutex_unlock(&watchdog_mutex);
+    return;
+}
+
+
+/* stop watching, returns true if the timeout was hit */
+static int disarm_dl_plugin_watchdog() {
+    int fired;
+    if(watchdog_owner != getpid())
+        return FALSE;
+    pthread_mutex_lock(&watchdog_mutex);
+    watchdog_armed = FALSE;
+    fired          = watchdog_fired;
+    pthread_cond_signal(&watchdog_cond);
+    pthread_mutex_unlock(&watchdog_mutex);
+    return fired;
+}
+
+
+/* read exactly len bytes */
+static int read_all(int fd, void *buf, size_t len) {
+    ssize_t r;
+    char *p = buf;
+    while(len > 0) {
+        r = read(fd, p, len);
+        if(r < 0 && errno == EINTR)
+            continue;
+        if(r <= 0)
+            return GM_ERROR;
+        p   += r;
+        len -= r;
+    }
+    return GM_OK;
+}
+
+
+/* write exactly len bytes */
+static int write_all(int fd, const void *buf, size_t len) {
+    ssize_t r;
+    const char *p = buf;
+    while(len > 0) {
+        r = write(fd, p, len);
+        if(r < 0 && errno == EINTR)
+            continue;
+        if(r <= 0)
+            return GM_ERROR;
+        p   += r;
+        len -= r;
+    }
+    return GM_OK;
+}
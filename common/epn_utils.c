@@ -28,6 +28,10 @@
 #include "worker_client.h"
 #include "gearman_utils.h"
 
+int  epn_cache_hits   = 0;
+int  epn_cache_misses = 0;
+long epn_compile_usec = 0;
+
 #ifdef EMBEDDEDPERL
 #include <EXTERN.h>
 #include <perl.h>
@@ -40,6 +44,10 @@ extern int enable_embedded_perl;
 extern int use_embedded_perl_implicitly;
 extern int use_perl_cache;
 extern char *p1_file;
+static gm_epn_cache_t epn_cache[GM_EPN_CACHE_SIZE];
+
+static int compile_epn_plugin(char *fname, char *plugin_args, SV **plugin_hndlr_cr, char **error);
+static int read_epn_directive(char *fname);
 #endif
 
 int run_epn_check(char *processed_command, char **ret, char **err) {
@@ -84,24 +92,8 @@ int run_epn_check(char *processed_command, char **ret, char **err) {
     else
         args[3]=processed_command+strlen(fname)+1;
 
-    ENTER;
-    SAVETMPS;
-    PUSHMARK(SP);
-    XPUSHs(sv_2mortal(newSVpv(args[0],0)));
-    XPUSHs(sv_2mortal(newSVpv(args[1],0)));
-    XPUSHs(sv_2mortal(newSVpv(args[2],0)));
-    XPUSHs(sv_2mortal(newSVpv(args[3],0)));
-    PUTBACK;
-
-    /* call our perl interpreter to compile and optionally cache the command */
-    call_pv("Embed::Persistent::eval_file", G_SCALAR | G_EVAL);
-    SPAGAIN ;
-
-    /* compile failed */
-    if( SvTRUE(ERRSV) ){
-        /* remove the top element of the Perl stack (undef) */
-        (void) POPs ;
-        perl_plugin_output=SvPVX(ERRSV);
+    /* compile and optionally cache the command */
+    if(compile_epn_plugin(fname, args[3], &plugin_hndlr_cr, &perl_plugin_output) != GM_OK) {
         if(perl_plugin_output == NULL)
             *ret = gm_strdup("(Embedded Perl failed to compile)");
         else
@@ -110,13 +102,7 @@ int run_epn_check(char *processed_command, char **ret, char **err) {
         gm_log( GM_LOG_TRACE, "Embedded Perl failed to compile %s, compile error %s - skipping plugin\n", fname, perl_plugin_output);
         return(GM_EXIT_UNKNOWN);
     }
-    else {
-        plugin_hndlr_cr=newSVsv(POPs);
-        PUTBACK;
-        FREETMPS;
-        LEAVE;
-        gm_log( GM_LOG_TRACE, "Embedded Perl successfully compiled %s and returned code ref to plugin handler\n", fname );
-    }
+    gm_log( GM_LOG_TRACE, "Embedded Perl successfully compiled %s and returned code ref to plugin handler\n", fname );
     /* now run run the check */
     if(pipe(pipe_stdout)) {
         gm_log( GM_LOG_ERROR, "error creating pipe: %s\n", strerror(errno));
@@ -217,18 +203,103 @@ int run_epn_check(char *processed_command, char **ret, char **err) {
 }
 
 
+#ifdef EMBEDDEDPERL
+/* compile a perl plugin with the p1 file, returns the code ref of its handler */
+static int compile_epn_plugin(char *fname, char *plugin_args, SV **plugin_hndlr_cr, char **error) {
+    struct timeval start, end;
+    int rc = GM_OK;
+#ifdef aTHX
+    dTHX;
+#endif
+    dSP;
+
+    gettimeofday(&start, NULL);
+
+    ENTER;
+    SAVETMPS;
+    PUSHMARK(SP);
+    XPUSHs(sv_2mortal(newSVpv(fname,0)));
+    XPUSHs(sv_2mortal(newSVpv(use_perl_cache==GM_ENABLED ? "0" : "1",0)));
+    XPUSHs(sv_2mortal(newSVpv("",0)));
+    XPUSHs(sv_2mortal(newSVpv(plugin_args,0)));
+    PUTBACK;
+
+    /* call our perl interpreter to compile and optionally cache the command */
+    call_pv("Embed::Persistent::eval_file", G_SCALAR | G_EVAL);
+    SPAGAIN ;
+
+    /* compile failed */
+    if( SvTRUE(ERRSV) ){
+        /* remove the top element of the Perl stack (undef) */
+        (void) POPs ;
+        *error = SvPVX(ERRSV);
+        rc     = GM_ERROR;
+    }
+    else {
+        *plugin_hndlr_cr=newSVsv(POPs);
+        PUTBACK;
+        FREETMPS;
+        LEAVE;
+    }
+
+    gettimeofday(&end, NULL);
+    epn_compile_usec += (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+
+    return rc;
+}
+#endif
+
+
 /* checks to see if we should run a script using the embedded Perl interpreter */
 int file_uses_embedded_perl(char *fname) {
 #ifndef EMBEDDEDPERL
     return FALSE;
 #else
-    int line;
-    FILE *fp = NULL;
-    char buf[256] = "";
+    struct stat st;
+    gm_epn_cache_t *cached;
+    int decision;
 
     if(enable_embedded_perl != TRUE)
         return FALSE;
 
+    if(stat(fname, &st) != 0)
+        return FALSE;
+
+    /* the directive only changes when the file changes */
+    cached = &epn_cache[(st.st_ino ^ (st.st_dev * 31)) % GM_EPN_CACHE_SIZE];
+    if(   cached->valid    == TRUE
+       && cached->dev      == st.st_dev
+       && cached->ino      == st.st_ino
+       && cached->mtime    == st.st_mtime
+       && cached->size     == st.st_size) {
+        epn_cache_hits++;
+        decision = cached->decision;
+    }
+    else {
+        epn_cache_misses++;
+        decision         = read_epn_directive(fname);
+        cached->dev      = st.st_dev;
+        cached->ino      = st.st_ino;
+        cached->mtime    = st.st_mtime;
+        cached->size     = st.st_size;
+        cached->decision = decision;
+        cached->valid    = TRUE;
+    }
+
+    if(decision == GM_EPN_IMPLICIT)
+        return use_embedded_perl_implicitly;
+    return decision;
+#endif
+}
+
+
+#ifdef EMBEDDEDPERL
+/* read the epn directive from the plugin, returns TRUE, FALSE or GM_EPN_IMPLICIT */
+static int read_epn_directive(char *fname) {
+    int line;
+    FILE *fp = NULL;
+    char buf[256] = "";
+
     /* open the file, check if its a Perl script and see if we can use epn */
     fp = fopen(fname, "r");
     if(fp == NULL)
@@ -266,8 +337,39 @@ int file_uses_embedded_perl(char *fname) {
 
     fclose(fp);
 
-    return use_embedded_perl_implicitly;
+    return GM_EPN_IMPLICIT;
+}
+#endif
+
+
+/* compile perl plugins before forking worker */
+int precompile_epn_plugins(char **plugins, int num) {
+    int compiled = 0;
+#ifdef EMBEDDEDPERL
+    int x;
+    long start_usec, total_usec = epn_compile_usec;
+    char *error;
+    SV *plugin_hndlr_cr;
+
+    for(x = 0; x < num; x++) {
+        if(file_uses_embedded_perl(plugins[x]) != TRUE) {
+            gm_log( GM_LOG_INFO, "not precompiling %s, it does not use embedded perl\n", plugins[x] );
+            continue;
+        }
+        start_usec = epn_compile_usec;
+        if(compile_epn_plugin(plugins[x], "", &plugin_hndlr_cr, &error) != GM_OK) {
+            gm_log( GM_LOG_ERROR, "precompiling %s failed: %s\n", plugins[x], error );
+            continue;
+        }
+        gm_log( GM_LOG_DEBUG, "precompiled %s in %.3fs\n", plugins[x], (double)(epn_compile_usec - start_usec) / 1000000 );
+        compiled++;
+    }
+    gm_log( GM_LOG_INFO, "precompiled %d perl plugins in %.3fs\n", compiled, (double)(epn_compile_usec - total_usec) / 1000000 );
+#else
+    plugins = plugins;
+    num     = num;
 #endif
+    return compiled;
 }
 
 
@@ -280,6 +382,10 @@ int init_embedded_perl(char **env){
     argc=argc;
     struct stat stat_buf;
 
+    /* already initialized by the main process */
+    if(my_perl != NULL)
+        return GM_OK;
+
     /* make sure the P1 file exists... */
     if(p1_file==NULL || stat(p1_file,&stat_buf)!=0){
         use_embedded_perl=FALSE;
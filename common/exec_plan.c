@@ -0,0 +1,281 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "config.h"
+#include "exec_plan.h"
+#include "check_utils.h"
+#include "utils.h"
+
+#include <limits.h>
+
+int exec_plan_hits   = 0;
+int exec_plan_misses = 0;
+
+static gm_exec_plan_t *exec_plan_buckets[GM_EXEC_PLAN_BUCKETS];
+static gm_exec_plan_t *exec_plan_lru_head = NULL;
+static gm_exec_plan_t *exec_plan_lru_tail = NULL;
+static int             exec_plan_num      = 0;
+
+static gm_exec_plan_t *create_exec_plan(char *command, unsigned long hash);
+static void set_exec_plan_verdict(gm_exec_plan_t *plan);
+static int exec_plan_is_valid(gm_exec_plan_t *plan);
+static void remove_exec_plan(gm_exec_plan_t *plan);
+static void free_exec_plan(gm_exec_plan_t *plan);
+static unsigned long hash_command(const char *command);
+
+
+/* return cached plan for this command or create a new one */
+gm_exec_plan_t *get_exec_plan(char *command) {
+    unsigned long hash = hash_command(command);
+    gm_exec_plan_t *plan;
+
+    for(plan = exec_plan_buckets[hash % GM_EXEC_PLAN_BUCKETS]; plan != NULL; plan = plan->bucket_next) {
+        if(plan->hash == hash && !strcmp(plan->command, command))
+            break;
+    }
+
+    if(plan != NULL && exec_plan_is_valid(plan) == FALSE) {
+        remove_exec_plan(plan);
+        free_exec_plan(plan);
+        plan = NULL;
+    }
+
+    if(plan != NULL) {
+        exec_plan_hits++;
+
+        /* move to the front of the lru list */
+        if(plan != exec_plan_lru_head) {
+            plan->lru_prev->lru_next = plan->lru_next;
+            if(plan->lru_next != NULL)
+                plan->lru_next->lru_prev = plan->lru_prev;
+            else
+                exec_plan_lru_tail = plan->lru_prev;
+            plan->lru_prev               = NULL;
+            plan->lru_next               = exec_plan_lru_head;
+            exec_plan_lru_head->lru_prev = plan;
+            exec_plan_lru_head           = plan;
+        }
+
+        /* restrictions have been changed since */
+        if(plan->verdict_version != restrict_options_version || plan->verdict_paths != mod_gm_opt->restrict_path_num)
+            set_exec_plan_verdict(plan);
+
+        return plan;
+    }
+
+    exec_plan_misses++;
+    plan = create_exec_plan(command, hash);
+    if(mod_gm_opt->exec_plan_cache <= 0)
+        return plan;
+
+    /* make room for the new plan */
+    while(exec_plan_num >= mod_gm_opt->exec_plan_cache && exec_plan_lru_tail != NULL) {
+        gm_exec_plan_t *oldest = exec_plan_lru_tail;
+        remove_exec_plan(oldest);
+        free_exec_plan(oldest);
+    }
+
+    plan->cached      = TRUE;
+    plan->bucket_next = exec_plan_buckets[hash % GM_EXEC_PLAN_BUCKETS];
+    exec_plan_buckets[hash % GM_EXEC_PLAN_BUCKETS] = plan;
+    plan->lru_next    = exec_plan_lru_head;
+    if(exec_plan_lru_head != NULL)
+        exec_plan_lru_head->lru_prev = plan;
+    exec_plan_lru_head = plan;
+    if(exec_plan_lru_tail == NULL)
+        exec_plan_lru_tail = plan;
+    exec_plan_num++;
+
+    return plan;
+}
+
+
+/* free plans which are not cached */
+void release_exec_plan(gm_exec_plan_t *plan) {
+    if(plan != NULL && plan->cached == FALSE)
+        free_exec_plan(plan);
+    return;
+}
+
+
+/* remove all cached plans */
+void flush_exec_plans() {
+    while(exec_plan_lru_head != NULL) {
+        gm_exec_plan_t *plan = exec_plan_lru_head;
+        remove_exec_plan(plan);
+        free_exec_plan(plan);
+    }
+    return;
+}
+
+
+/* parse command line and resolve the executable */
+static gm_exec_plan_t *create_exec_plan(char *command, unsigned long hash) {
+    gm_exec_plan_t *plan;
+    char *argv[MAX_CMD_ARGS];
+    struct stat st;
+    int x, assignments;
+
+    plan          = gm_malloc(sizeof(gm_exec_plan_t));
+    memset(plan, 0, sizeof(gm_exec_plan_t));
+    plan->hash    = hash;
+    plan->command = gm_strdup(command);
+    plan->cached  = FALSE;
+    set_exec_plan_verdict(plan);
+
+    /* check for check execution method (shell or execvp)
+     * command line must not use any shell feature besides quoting,
+     * leading variable assignments and 2>&1 and the command must contain
+     * a /. Otherwise PATH lookup and shell builtins would behave differently.
+     */
+    plan->args = gm_strdup(command);
+    if(lex_command_line(plan->args, argv, &assignments, &plan->stderr_to_stdout) != TRUE || strchr(argv[assignments], '/') == NULL) {
+        plan->use_shell = TRUE;
+        free(plan->args);
+        plan->args = NULL;
+        return plan;
+    }
+    plan->use_shell = FALSE;
+
+    for(x = assignments; argv[x] != NULL; x++)
+        ;
+    plan->argc = x - assignments;
+    plan->argv = gm_malloc(sizeof(char*) * (plan->argc + 1));
+    memcpy(plan->argv, argv + assignments, sizeof(char*) * (plan->argc + 1));
+    plan->env  = gm_malloc(sizeof(char*) * (assignments + 1));
+    memcpy(plan->env, argv, sizeof(char*) * assignments);
+    plan->env[assignments] = NULL;
+
+    /* missing plugins are left to execvp, it reports the usual errors.
+     * argv[0] contains a / so there is no PATH lookup, symlinks are not resolved,
+     * multi call plugins and scripts rely on the name they were called with */
+    if(plan->argc > 0 && stat(plan->argv[0], &st) == 0) {
+        plan->path    = gm_strdup(plan->argv[0]);
+        plan->dev     = st.st_dev;
+        plan->ino     = st.st_ino;
+        plan->mtime   = st.st_mtime;
+        plan->checked = time(NULL);
+    }
+
+    return plan;
+}
+
+
+/* apply restrict_path and restrict_command_characters */
+static void set_exec_plan_verdict(gm_exec_plan_t *plan) {
+    int i;
+
+    plan->verdict_version = restrict_options_version;
+    plan->verdict_paths   = mod_gm_opt->restrict_path_num;
+    plan->verdict         = GM_EXEC_ALLOWED;
+
+    if(mod_gm_opt->restrict_path_num == 0)
+        return;
+
+    if(*plan->command != '/') {
+        plan->verdict = GM_EXEC_NOT_ABSOLUTE;
+        return;
+    }
+    if(strpbrk(plan->command, mod_gm_opt->restrict_command_characters) != NULL) {
+        plan->verdict = GM_EXEC_FORBIDDEN_CHARACTERS;
+        return;
+    }
+    for(i = 0; i < mod_gm_opt->restrict_path_num; i++) {
+        if(starts_with(mod_gm_opt->restrict_path[i], plan->command))
+            return;
+    }
+    plan->verdict = GM_EXEC_NOT_RESTRICTED_PATH;
+    return;
+}
+
+
+/* make sure the executable has not been replaced, at most once per second */
+static int exec_plan_is_valid(gm_exec_plan_t *plan) {
+    struct stat st;
+    time_t now;
+
+    if(plan->path == NULL)
+        return TRUE;
+
+    now = time(NULL);
+    if(plan->checked == now)
+        return TRUE;
+
+    if(stat(plan->argv[0], &st) != 0)
+        return FALSE;
+    if(st.st_dev != plan->dev || st.st_ino != plan->ino || st.st_mtime != plan->mtime)
+        return FALSE;
+
+    plan->checked = now;
+    return TRUE;
+}
+
+
+/* unlink plan from bucket and lru list */
+static void remove_exec_plan(gm_exec_plan_t *plan) {
+    gm_exec_plan_t **ptr;
+
+    for(ptr = &exec_plan_buckets[plan->hash % GM_EXEC_PLAN_BUCKETS]; *ptr != NULL; ptr = &(*ptr)->bucket_next) {
+        if(*ptr == plan) {
+            *ptr = plan->bucket_next;
+            break;
+        }
+    }
+
+    if(plan->lru_prev != NULL)
+        plan->lru_prev->lru_next = plan->lru_next;
+    else
+        exec_plan_lru_head = plan->lru_next;
+    if(plan->lru_next != NULL)
+        plan->lru_next->lru_prev = plan->lru_prev;
+    else
+        exec_plan_lru_tail = plan->lru_prev;
+
+    plan->cached = FALSE;
+    exec_plan_num--;
+    return;
+}
+
+
+/* free plan */
+static void free_exec_plan(gm_exec_plan_t *plan) {
+    free(plan->command);
+    free(plan->args);
+    free(plan->argv);
+    free(plan->env);
+    free(plan->path);
+    free(plan);
+    return;
+}
+
+
+/* djb2 string hash */
+static unsigned long hash_command(const char *command) {
+    unsigned long hash = 5381;
+    int c;
+
+    while((c = *command++))
+        hash = ((hash << 5) + hash) + c;
+
+    return hash;
+}
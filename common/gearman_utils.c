@@ -73,7 +73,7 @@ int create_client( gm_server_t * server_list[GM_LISTSIZE], gearman_client_st *cl
     gearman_return_t ret;
     int x = 0;
 
-    gm_log( GM_LOG_TRACE, "create_client()\n" );
+    GM_LOG( GM_LOG_TRACE, "create_client()\n" );
 
     signal(SIGPIPE, SIG_IGN);
 
@@ -99,13 +99,41 @@ int create_client( gm_server_t * server_list[GM_LISTSIZE], gearman_client_st *cl
 }
 
 
+/* create a background task, it is sent by the next gearman_client_run_tasks */
+static gearman_task_st *create_task( gearman_client_st *client, char * queue, char * uniq, char * data, int priority, int transport_mode, gearman_return_t *ret ) {
+    gearman_task_st *task = NULL;
+    char * crypted_data;
+    int size;
+
+    size = mod_gm_encrypt(&crypted_data, data, transport_mode);
+    GM_LOG( GM_LOG_TRACE, "%d +++>\n%s\n<+++\n", size, crypted_data );
+
+    if( priority == GM_JOB_PRIO_LOW ) {
+        task = gearman_client_add_task_low_background( client, NULL, NULL, queue, uniq, ( void * )crypted_data, ( size_t )size, ret );
+        gearman_task_give_workload(task,crypted_data,size);
+    }
+    else if( priority == GM_JOB_PRIO_NORMAL ) {
+        task = gearman_client_add_task_background( client, NULL, NULL, queue, uniq, ( void * )crypted_data, ( size_t )size, ret );
+        gearman_task_give_workload(task,crypted_data,size);
+    }
+    else if( priority == GM_JOB_PRIO_HIGH ) {
+        task = gearman_client_add_task_high_background( client, NULL, NULL, queue, uniq, ( void * )crypted_data, ( size_t )size, ret );
+        gearman_task_give_workload(task,crypted_data,size);
+    }
+    else {
+        gm_log( GM_LOG_ERROR, "add_job_to_queue() wrong priority: %d\n", priority );
+    }
+
+    return task;
+}
+
+
 /* create a task and send it */
 int add_job_to_queue( gearman_client_st *client, gm_server_t * server_list[GM_LISTSIZE], char * queue, char * uniq, char * data, int priority, int retries, int transport_mode, int send_now ) {
     gearman_task_st *task = NULL;
     gearman_return_t ret1 = GEARMAN_SUCCESS;
     gearman_return_t ret2 = GEARMAN_SUCCESS;
-    char * crypted_data;
-    int size, free_uniq;
+    int free_uniq;
     struct timeval now;
 
     /* check too long queue names */
@@ -123,30 +151,16 @@ int add_job_to_queue( gearman_client_st *client, gm_server_t * server_list[GM_LI
 
     signal(SIGPIPE, SIG_IGN);
 
-    gm_log( GM_LOG_TRACE, "add_job_to_queue(%s, %s, %d, %d, %d, %d)\n", queue, uniq, priority, retries, transport_mode, send_now );
-    gm_log( GM_LOG_TRACE, "%d --->%s<---\n", strlen(data), data );
+    GM_LOG( GM_LOG_TRACE, "add_job_to_queue(%s, %s, %d, %d, %d, %d)\n", queue, uniq, priority, retries, transport_mode, send_now );
+    GM_LOG( GM_LOG_TRACE, "%d --->%s<---\n", strlen(data), data );
 
-    size = mod_gm_encrypt(&crypted_data, data, transport_mode);
-    gm_log( GM_LOG_TRACE, "%d +++>\n%s\n<+++\n", size, crypted_data );
+    task = create_task( client, queue, uniq, data, priority, transport_mode, &ret1 );
 
-    if( priority == GM_JOB_PRIO_LOW ) {
-        task = gearman_client_add_task_low_background( client, NULL, NULL, queue, uniq, ( void * )crypted_data, ( size_t )size, &ret1 );
-        gearman_task_give_workload(task,crypted_data,size);
-    }
-    else if( priority == GM_JOB_PRIO_NORMAL ) {
-        task = gearman_client_add_task_background( client, NULL, NULL, queue, uniq, ( void * )crypted_data, ( size_t )size, &ret1 );
-        gearman_task_give_workload(task,crypted_data,size);
-    }
-    else if( priority == GM_JOB_PRIO_HIGH ) {
-        task = gearman_client_add_task_high_background( client, NULL, NULL, queue, uniq, ( void * )crypted_data, ( size_t )size, &ret1 );
-        gearman_task_give_workload(task,crypted_data,size);
+    if(send_now != TRUE) {
+        if(free_uniq)
+            free(uniq);
+        return task == NULL ? GM_ERROR : GM_OK;
     }
-    else {
-        gm_log( GM_LOG_ERROR, "add_job_to_queue() wrong priority: %d\n", priority );
-    }
-
-    if(send_now != TRUE)
-        return GM_OK;
 
     ret2 = gearman_client_run_tasks( client );
     gearman_client_task_free_all( client );
@@ -179,7 +193,7 @@ int add_job_to_queue( gearman_client_st *client, gm_server_t * server_list[GM_LI
         /* retry as long as we have retries */
         if(retries > 0) {
             retries--;
-            gm_log( GM_LOG_TRACE, "add_job_to_queue() retrying... %d\n", retries );
+            GM_LOG( GM_LOG_TRACE, "add_job_to_queue() retrying... %d\n", retries );
             ret2 = add_job_to_queue( client, server_list, queue, uniq, data, priority, retries, transport_mode, send_now );
             if(free_uniq)
                 free(uniq);
@@ -187,7 +201,7 @@ int add_job_to_queue( gearman_client_st *client, gm_server_t * server_list[GM_LI
         }
         /* no more retries... */
         else {
-            gm_log( GM_LOG_TRACE, "add_job_to_queue() finished with errors: %d %d\n", ret1, ret2 );
+            GM_LOG( GM_LOG_TRACE, "add_job_to_queue() finished with errors: %d %d\n", ret1, ret2 );
             if(free_uniq)
                 free(uniq);
             return GM_ERROR;
@@ -200,11 +214,56 @@ int add_job_to_queue( gearman_client_st *client, gm_server_t * server_list[GM_LI
     if(free_uniq)
         free(uniq);
 
-    gm_log( GM_LOG_TRACE, "add_job_to_queue() finished successfully: %d %d\n", ret1, ret2 );
+    GM_LOG( GM_LOG_TRACE, "add_job_to_queue() finished successfully: %d %d\n", ret1, ret2 );
     return GM_OK;
 }
 
 
+/* queue all jobs and send them with a single round trip, resend failed jobs one by one */
+int add_jobs_to_queue( gearman_client_st *client, gm_server_t * server_list[GM_LISTSIZE], char * queue, char ** data, int num, int priority, int transport_mode, int * failed_jobs ) {
+    gearman_task_st **tasks;
+    gearman_return_t ret;
+    int x, failed = 0;
+
+    if(num <= 0)
+        return(0);
+    if(strlen(queue) > GEARMAN_FUNCTION_MAX_SIZE - 1) {
+        gm_log( GM_LOG_ERROR, "queue name too long: '%s'\n", queue );
+        for(x = 0; x < num; x++)
+            failed_jobs[x] = TRUE;
+        return(num);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    tasks = gm_malloc(num * sizeof(gearman_task_st *));
+    for(x = 0; x < num; x++)
+        tasks[x] = create_task( client, queue, NULL, data[x], priority, transport_mode, &ret );
+    ret = gearman_client_run_tasks( client );
+
+    /* background tasks succeed once gearmand created the job, so even
+     * after a broken round trip only the jobs without handle are resent */
+    for(x = 0; x < num; x++)
+        failed_jobs[x] = tasks[x] == NULL || gearman_task_return( tasks[x] ) != GEARMAN_SUCCESS;
+    gearman_client_task_free_all( client );
+    free(tasks);
+    GM_LOG( GM_LOG_TRACE, "add_jobs_to_queue() sent %d jobs: %s\n", num, gearman_strerror(ret) );
+
+    /* recreate client, otherwise gearman sigsegvs. add_job_to_queue retries */
+    if(ret != GEARMAN_SUCCESS) {
+        gearman_client_free( client );
+        create_client( server_list, client );
+    }
+    for(x = 0; x < num; x++) {
+        if(failed_jobs[x])
+            failed_jobs[x] = add_job_to_queue( client, server_list, queue, NULL, data[x],
+                                               priority, GM_DEFAULT_JOB_RETRIES, transport_mode, TRUE ) != GM_OK;
+        failed += failed_jobs[x];
+    }
+    return(failed);
+}
+
+
 void *dummy( gearman_job_st *job, void *context, size_t *result_size, gearman_return_t *ret_ptr ) {
 
     /* avoid "unused parameter" warning */
@@ -234,8 +293,7 @@ void free_worker(gearman_worker_st *worker) {
 /* get worker/jobs data from gearman server */
 int get_gearman_server_data(mod_gm_server_status_t *stats, char ** message, char ** version, char * hostnam, int port) {
     int rc;
-    char *total, *running, *worker, *output, *output_c, *line, *name;
-    mod_gm_status_function_t *func;
+    char *output;
 
     *version  = gm_malloc(GM_BUFFERSIZE);
     snprintf(*version,  GM_BUFFERSIZE, "%s", "" );
@@ -247,25 +305,39 @@ int get_gearman_server_data(mod_gm_server_status_t *stats, char ** message, char
         return rc;
     }
 
-    output_c = output;
+    if(parse_gearman_server_data(stats, output, *version, GM_BUFFERSIZE) == GM_OK) {
+        free(output);
+        return( STATE_OK );
+    }
+
+    snprintf(*message, GM_BUFFERSIZE, "got no valid data from %s:%i\n", hostnam, (int)port);
+    free(output);
+    return(rc);
+}
+
+
+/* parse answer of the status and version admin commands */
+int parse_gearman_server_data(mod_gm_server_status_t *stats, char * output, char * version, int version_size) {
+    char *total, *running, *worker, *line, *name;
+    mod_gm_status_function_t *func;
+
     while ( (line = strsep( &output, "\n" )) != NULL ) {
-        gm_log( GM_LOG_TRACE, "%s\n", line );
+        GM_LOG( GM_LOG_TRACE, "%s\n", line );
         if(!strcmp( line, ".")) {
             if((line = strsep( &output, "\n" )) != NULL) {
-                gm_log( GM_LOG_TRACE, "%s\n", line );
+                GM_LOG( GM_LOG_TRACE, "%s\n", line );
                 if(line[0] == 'O') {
-                    strncpy(*version, line+3, 10);
+                    snprintf(version, version_size, "%.10s", line+3);
                 } else {
-                    snprintf(*version, GM_BUFFERSIZE, "%s", line);
+                    snprintf(version, version_size, "%s", line);
                 }
-                gm_log( GM_LOG_TRACE, "extracted version: '%s'\n", *version );
+                GM_LOG( GM_LOG_TRACE, "extracted version: '%s'\n", version );
             }
 
             /* sort our array by queue name */
             qsort(stats->function, stats->function_num, sizeof(mod_gm_status_function_t*), struct_cmp_by_queue);
 
-            free(output_c);
-            return( STATE_OK );
+            return( GM_OK );
         }
         name = strsep(&line, "\t");
         if(name == NULL)
@@ -279,6 +351,8 @@ int get_gearman_server_data(mod_gm_server_status_t *stats, char ** message, char
         worker  = strsep(&line, "\x0");
         if(worker == NULL)
             break;
+        if(stats->function_num >= GM_LISTSIZE)
+            continue;
         func = gm_malloc(sizeof(mod_gm_status_function_t));
         func->queue   = gm_strdup(name);
         func->running = atoi(running);
@@ -294,12 +368,10 @@ int get_gearman_server_data(mod_gm_server_status_t *stats, char ** message, char
         }
 
         stats->function[stats->function_num++] = func;
-        gm_log( GM_LOG_DEBUG, "%i: name:%-20s worker:%-5i waiting:%-5i running:%-5i\n", stats->function_num, func->queue, func->worker, func->waiting, func->running );
+        GM_LOG( GM_LOG_DEBUG, "%i: name:%-20s worker:%-5i waiting:%-5i running:%-5i\n", stats->function_num, func->queue, func->worker, func->waiting, func->running );
     }
 
-    snprintf(*message, GM_BUFFERSIZE, "got no valid data from %s:%i\n", hostnam, (int)port);
-    free(output_c);
-    return(rc);
+    return( GM_ERROR );
 }
 
 
@@ -317,7 +389,7 @@ int send2gearmandadmin(char * cmd, char * hostnam, int port, char ** output, cha
         return(STATE_CRITICAL);
     }
 
-    gm_log( GM_LOG_TRACE, "sending '%s' to %s on port %i\n", cmd, hostnam, port );
+    GM_LOG( GM_LOG_TRACE, "sending '%s' to %s on port %i\n", cmd, hostnam, port );
     n = write(sockfd,cmd,strlen(cmd));
     if (n < 0) {
         snprintf(*error, GM_BUFFERSIZE, "failed to send to %s:%i - %s\n", hostnam, (int)port, strerror(errno));
@@ -333,13 +405,87 @@ int send2gearmandadmin(char * cmd, char * hostnam, int port, char ** output, cha
     }
     buf[n] = '\x0';
     free(*output);
-    gm_log( GM_LOG_TRACE, "got answer:\n%s\n", buf);
+    GM_LOG( GM_LOG_TRACE, "got answer:\n%s\n", buf);
     *output = gm_strdup(buf);
     close(sockfd);
 
     return( STATE_OK );
 }
 
+/* listen on unix socket or tcp address */
+int gm_net_listen(const char *address, char **socket_path) {
+    struct sockaddr_un sun;
+    struct addrinfo hints, *res = NULL;
+    char *host, *port;
+    int fd, rc, on = 1;
+
+    if(socket_path != NULL)
+        *socket_path = NULL;
+    if(address == NULL || *address == '\0')
+        return -1;
+
+    if(!strncmp(address, "unix:", 5)) {
+        if(strlen(address+5) >= sizeof(sun.sun_path)) {
+            gm_log( GM_LOG_ERROR, "socket path too long: %s\n", address+5);
+            return -1;
+        }
+        memset(&sun, 0, sizeof(sun));
+        sun.sun_family = AF_UNIX;
+        strcpy(sun.sun_path, address+5);
+        if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+            gm_log( GM_LOG_ERROR, "cannot create socket: %s\n", strerror(errno));
+            return -1;
+        }
+        unlink(sun.sun_path);
+        if(bind(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0 || listen(fd, 16) < 0) {
+            gm_log( GM_LOG_ERROR, "cannot listen on socket %s: %s\n", sun.sun_path, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        if(socket_path != NULL)
+            *socket_path = gm_strdup(sun.sun_path);
+    } else {
+        host = gm_strdup(address);
+        port = strrchr(host, ':');
+        if(port == NULL) {
+            gm_log( GM_LOG_ERROR, "listen address must be unix:<path> or <host>:<port>, got: %s\n", address);
+            free(host);
+            return -1;
+        }
+        *port++ = '\0';
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags    = AI_PASSIVE;
+        rc = getaddrinfo(*host != '\0' ? host : "127.0.0.1", port, &hints, &res);
+        free(host);
+        if(rc != 0) {
+            gm_log( GM_LOG_ERROR, "cannot resolve listen address %s: %s\n", address, gai_strerror(rc));
+            return -1;
+        }
+        if((fd = socket(res->ai_family, SOCK_STREAM, 0)) < 0) {
+            gm_log( GM_LOG_ERROR, "cannot create socket: %s\n", strerror(errno));
+            freeaddrinfo(res);
+            return -1;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if(bind(fd, res->ai_addr, res->ai_addrlen) < 0 || listen(fd, 16) < 0) {
+            gm_log( GM_LOG_ERROR, "cannot listen on address %s: %s\n", address, strerror(errno));
+            freeaddrinfo(res);
+            close(fd);
+            return -1;
+        }
+        freeaddrinfo(res);
+    }
+
+    /* never block the caller */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    return fd;
+}
+
+
 /* opens a tcp connection to a remote host */
 int gm_net_connect (const char *host_name, int port, int *sd, char ** error) {
     struct addrinfo hints;
@@ -0,0 +1,125 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "config.h"
+#include "histogram.h"
+#include "utils.h"
+
+
+/* add observation to histogram */
+void observe_histogram(gm_histogram_t *hist, const double *limits, double seconds) {
+    int x;
+
+    /* clocks of different hosts may differ slightly */
+    if(seconds < 0)
+        seconds = 0;
+    for(x = 0; x < GM_HISTOGRAM_BUCKETS-1; x++) {
+        if(seconds <= limits[x])
+            break;
+    }
+    __sync_fetch_and_add(&hist->buckets[x], 1);
+    __sync_fetch_and_add(&hist->sum_usec, (unsigned long long)(seconds * 1000000));
+    __sync_fetch_and_add(&hist->count, 1);
+    return;
+}
+
+
+/* find or add queue, lock is only needed for new queues */
+int histogram_queue(gm_histogram_queues_t *queues, pthread_mutex_t *mutex, const char *queue) {
+    int x, used;
+
+    if(queue == NULL || *queue == '\0')
+        queue = "(unknown)";
+
+    used = queues->used;
+    for(x = 0; x < used; x++) {
+        if(!strcmp(queues->names[x], queue))
+            return x;
+    }
+
+    /* shared mutexes may be robust, their owner may have died */
+    if(pthread_mutex_lock(mutex) == EOWNERDEAD)
+        pthread_mutex_consistent(mutex);
+    for(x = 0; x < queues->used; x++) {
+        if(!strcmp(queues->names[x], queue))
+            break;
+    }
+    if(x == queues->used) {
+        /* table is full, everything else is summed up in the last entry */
+        if(x == GM_HISTOGRAM_QUEUES) {
+            x--;
+        } else {
+            snprintf(queues->names[x], GM_HISTOGRAM_QUEUE_NAME, "%s", x == GM_HISTOGRAM_QUEUES-1 ? "(other)" : queue);
+            __sync_synchronize();
+            queues->used++;
+        }
+    }
+    pthread_mutex_unlock(mutex);
+
+    return x;
+}
+
+
+/* write cumulative buckets, sum and count */
+int format_histogram(char *buf, int size, const char *name, const char *labels, const double *limits, gm_histogram_t *hist) {
+    unsigned long long total = 0;
+    const char *sep    = *labels != '\0' ? "," : "";
+    const char *lbrace = *labels != '\0' ? "{" : "";
+    const char *rbrace = *labels != '\0' ? "}" : "";
+    int x, len = 0;
+
+    for(x = 0; x < GM_HISTOGRAM_BUCKETS && len < size; x++) {
+        total += hist->buckets[x];
+        if(x < GM_HISTOGRAM_BUCKETS-1)
+            len += snprintf(buf+len, size-len, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, sep, limits[x], total);
+        else
+            len += snprintf(buf+len, size-len, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, sep, total);
+    }
+    if(len < size)
+        len += snprintf(buf+len, size-len, "%s_sum%s%s%s %.6f\n", name, lbrace, labels, rbrace, (double)hist->sum_usec / 1000000);
+    if(len < size)
+        len += snprintf(buf+len, size-len, "%s_count%s%s%s %llu\n", name, lbrace, labels, rbrace, hist->count);
+
+    return(len < size ? len : size);
+}
+
+
+/* escape backslash, double quote and newline in label values */
+char *escape_label_value(char *buf, int size, const char *value) {
+    int len = 0;
+
+    for(; *value != '\0' && len < size - 2; value++) {
+        if(*value == '\\' || *value == '"') {
+            buf[len++] = '\\';
+            buf[len++] = *value;
+        } else if(*value == '\n') {
+            buf[len++] = '\\';
+            buf[len++] = 'n';
+        } else {
+            buf[len++] = *value;
+        }
+    }
+    buf[len] = '\0';
+
+    return buf;
+}
@@ -0,0 +1,195 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "config.h"
+#include "job_trace.h"
+#include "utils.h"
+
+#include <pthread.h>
+
+static gm_trace_table_t   *trace_table   = NULL;
+static pthread_mutex_t     trace_mutex   = PTHREAD_MUTEX_INITIALIZER;
+static time_t              trace_started = 0;
+static unsigned long long  trace_counter = 0;
+static const double        trace_limits[GM_HISTOGRAM_BUCKETS-1] = GM_TRACE_BUCKET_LIMITS;
+
+static void observe_between(int slot, int segment, struct timeval *from, struct timeval *to);
+
+
+/* allocate histograms */
+void init_job_trace() {
+    if(trace_table != NULL)
+        return;
+    trace_table   = gm_malloc(sizeof(gm_trace_table_t));
+    memset(trace_table, 0, sizeof(gm_trace_table_t));
+    trace_started = time(NULL);
+    return;
+}
+
+
+/* free histograms */
+void free_job_trace() {
+    free(trace_table);
+    trace_table = NULL;
+    return;
+}
+
+
+/* start time and pid make ids unique across core restarts */
+char *next_trace_id(char *buf, int size) {
+    unsigned long long id = __sync_add_and_fetch(&trace_counter, 1);
+    snprintf(buf, size, "%lx-%x-%llx", (unsigned long)trace_started, (unsigned int)getpid(), id);
+    return buf;
+}
+
+
+/* find or add histograms of a queue */
+int trace_queue(const char *queue) {
+    if(trace_table == NULL)
+        return -1;
+    return histogram_queue(&trace_table->queue_names, &trace_mutex, queue);
+}
+
+
+/* add observation to histogram */
+void trace_observe(int slot, int segment, double seconds) {
+    if(trace_table == NULL || slot < 0 || slot >= GM_HISTOGRAM_QUEUES || segment < 0 || segment >= GM_TRACE_SEGMENTS)
+        return;
+    observe_histogram(&trace_table->segments[slot][segment], trace_limits, seconds);
+    return;
+}
+
+
+/* add time elapsed since start */
+void trace_observe_since(int slot, int segment, struct timeval *start) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    observe_between(slot, segment, start, &now);
+    return;
+}
+
+
+/* account all segments of a returned job */
+int trace_result(gm_job_trace_t *trace) {
+    int slot;
+
+    if(trace->trace_id == NULL)
+        return -1;
+
+    slot = trace_queue(trace->queue);
+    if(slot < 0)
+        return -1;
+
+    observe_between(slot, GM_TRACE_SCHEDULE, &trace->next_check,  &trace->core_time);
+    observe_between(slot, GM_TRACE_QUEUE,    &trace->core_time,   &trace->pickup_time);
+    observe_between(slot, GM_TRACE_WORKER,   &trace->pickup_time, &trace->start_time);
+    observe_between(slot, GM_TRACE_EXEC,     &trace->start_time,  &trace->finish_time);
+    observe_between(slot, GM_TRACE_SEND,     &trace->finish_time, &trace->sent_time);
+    observe_between(slot, GM_TRACE_RETURN,   &trace->sent_time,   &trace->received);
+
+    GM_LOG( GM_LOG_TRACE, "trace %s: queue=%s schedule=%.3f queue=%.3f worker=%.3f exec=%.3f send=%.3f return=%.3f\n",
+            trace->trace_id,
+            trace_table->queue_names.names[slot],
+            timeval2double(&trace->core_time)   - timeval2double(&trace->next_check),
+            timeval2double(&trace->pickup_time) - timeval2double(&trace->core_time),
+            timeval2double(&trace->start_time)  - timeval2double(&trace->pickup_time),
+            timeval2double(&trace->finish_time) - timeval2double(&trace->start_time),
+            timeval2double(&trace->sent_time)   - timeval2double(&trace->finish_time),
+            timeval2double(&trace->received)    - timeval2double(&trace->sent_time)
+    );
+
+    return slot;
+}
+
+
+/* write segment histograms in prometheus text format */
+int format_trace_histograms(char *buf, int size) {
+    const char *segments[GM_TRACE_SEGMENTS] = GM_TRACE_SEGMENT_NAMES;
+    char name[GM_HISTOGRAM_QUEUE_NAME*2];
+    char labels[GM_HISTOGRAM_QUEUE_NAME*2+64];
+    int x, y, used, len = 0;
+
+    if(size <= 0)
+        return 0;
+    buf[0] = '\0';
+    if(trace_table == NULL)
+        return 0;
+
+    len += snprintf(buf+len, size-len, "# HELP mod_gearman_job_segment_seconds Time spent in each segment of the job lifecycle per queue.\n");
+    if(len < size)
+        len += snprintf(buf+len, size-len, "# TYPE mod_gearman_job_segment_seconds histogram\n");
+    used = trace_table->queue_names.used;
+    for(x = 0; x < used && len < size; x++) {
+        escape_label_value(name, sizeof(name), trace_table->queue_names.names[x]);
+        for(y = 0; y < GM_TRACE_SEGMENTS && len < size; y++) {
+            snprintf(labels, sizeof(labels), "queue=\"%s\",segment=\"%s\"", name, segments[y]);
+            len += format_histogram(buf+len, size-len, "mod_gearman_job_segment_seconds", labels, trace_limits, &trace_table->segments[x][y]);
+        }
+    }
+
+    return(len < size ? len : size - 1);
+}
+
+
+/* replace trace file atomically, so readers never see partial files */
+int write_trace_file(const char *path) {
+    char tmpfile[GM_BUFFERSIZE];
+    char *buf;
+    FILE *fp;
+    int len;
+
+    snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", path);
+    fp = fopen(tmpfile, "w");
+    if(fp == NULL) {
+        gm_log( GM_LOG_ERROR, "cannot write trace file %s: %s\n", tmpfile, strerror(errno));
+        return GM_ERROR;
+    }
+    buf = gm_malloc(GM_TRACE_BUFFERSIZE);
+    len = format_trace_histograms(buf, GM_TRACE_BUFFERSIZE);
+    if(fwrite(buf, 1, len, fp) != (size_t)len) {
+        gm_log( GM_LOG_ERROR, "cannot write trace file %s: %s\n", tmpfile, strerror(errno));
+        free(buf);
+        fclose(fp);
+        unlink(tmpfile);
+        return GM_ERROR;
+    }
+    free(buf);
+    fclose(fp);
+
+    if(rename(tmpfile, path) != 0) {
+        gm_log( GM_LOG_ERROR, "cannot rename trace file %s: %s\n", tmpfile, strerror(errno));
+        unlink(tmpfile);
+        return GM_ERROR;
+    }
+
+    return GM_OK;
+}
+
+
+/* observe the difference of two timestamps if both are known */
+static void observe_between(int slot, int segment, struct timeval *from, struct timeval *to) {
+    if(from->tv_sec == 0 || to->tv_sec == 0)
+        return;
+    trace_observe(slot, segment, timeval2double(to) - timeval2double(from));
+    return;
+}
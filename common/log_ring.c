@@ -0,0 +1,272 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "config.h"
+#include "log_ring.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+
+/* producers only claim slots with an atomic increment of ring_head, the
+ * writer owns ring_tail. Every slot carries a sequence number which tells
+ * whether it is free (seq == pos), filled (seq == pos + 1) or still in use
+ * by the previous round. */
+static gm_log_record_t        *ring            = NULL;
+static volatile unsigned long  ring_head       = 0;
+static unsigned long           ring_tail       = 0;
+static pthread_once_t          ring_once       = PTHREAD_ONCE_INIT;
+static pthread_mutex_t         writer_mutex    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t         wakeup_mutex    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t          wakeup_cond     = PTHREAD_COND_INITIALIZER;
+static pthread_t               writer_thread;
+static volatile int            writer_running  = FALSE;
+static volatile int            writer_sleeping = FALSE;
+static volatile int            writer_stop     = FALSE;
+
+static void init_log_ring(void);
+static void lock_log_ring(void);
+static void unlock_log_ring(void);
+static void reset_log_ring(void);
+static int  start_log_writer(void);
+static int  record_ready(void);
+static int  write_records(void);
+static void *log_writer_loop(void *arg);
+
+
+/* queue log line, never blocks */
+int log_ring_write(FILE *fp, const char *line, int len) {
+    gm_log_record_t *rec;
+    unsigned long pos;
+    long diff;
+
+    if(len >= GM_LOG_RING_RECORD_SIZE)
+        return GM_ERROR;
+
+    pthread_once(&ring_once, init_log_ring);
+    if(writer_running == FALSE && start_log_writer() != GM_OK)
+        return GM_ERROR;
+
+    pos = ring_head;
+    while(1) {
+        rec  = &ring[pos & (GM_LOG_RING_SLOTS - 1)];
+        diff = (long)(rec->seq - pos);
+        if(diff == 0) {
+            if(__sync_bool_compare_and_swap(&ring_head, pos, pos + 1))
+                break;
+        }
+        else if(diff < 0) {
+            /* ring is full */
+            return GM_ERROR;
+        }
+        pos = ring_head;
+    }
+
+    rec->fp  = fp;
+    rec->len = len;
+    memcpy(rec->data, line, len);
+    __sync_synchronize();
+    rec->seq = pos + 1;
+    __sync_synchronize();
+
+    if(writer_sleeping == TRUE) {
+        pthread_mutex_lock(&wakeup_mutex);
+        pthread_cond_signal(&wakeup_cond);
+        pthread_mutex_unlock(&wakeup_mutex);
+    }
+
+    return GM_OK;
+}
+
+
+/* write queued records, then the line itself */
+void log_ring_write_sync(FILE *fp, const char *line, int len) {
+    if(ring == NULL) {
+        fwrite(line, 1, len, fp);
+        fflush(fp);
+        return;
+    }
+    pthread_mutex_lock(&writer_mutex);
+    write_records();
+    fwrite(line, 1, len, fp);
+    fflush(fp);
+    pthread_mutex_unlock(&writer_mutex);
+    return;
+}
+
+
+/* write queued records from the calling thread */
+void log_ring_flush() {
+    if(ring == NULL)
+        return;
+    pthread_mutex_lock(&writer_mutex);
+    write_records();
+    pthread_mutex_unlock(&writer_mutex);
+    return;
+}
+
+
+/* flush ring and stop the writer thread */
+void log_ring_stop() {
+    if(writer_running == TRUE) {
+        pthread_mutex_lock(&wakeup_mutex);
+        writer_stop = TRUE;
+        pthread_cond_signal(&wakeup_cond);
+        pthread_mutex_unlock(&wakeup_mutex);
+
+        pthread_join(writer_thread, NULL);
+        writer_running = FALSE;
+        writer_stop    = FALSE;
+    }
+    log_ring_flush();
+    return;
+}
+
+
+/* allocate ring, called once per process */
+static void init_log_ring() {
+    unsigned long x;
+    ring = gm_malloc(GM_LOG_RING_SLOTS * sizeof(gm_log_record_t));
+    for(x = 0; x < GM_LOG_RING_SLOTS; x++)
+        ring[x].seq = x;
+    pthread_atfork(lock_log_ring, unlock_log_ring, reset_log_ring);
+    return;
+}
+
+
+/* do not fork while the writer is in the middle of a record */
+static void lock_log_ring() {
+    pthread_mutex_lock(&writer_mutex);
+    return;
+}
+
+
+static void unlock_log_ring() {
+    pthread_mutex_unlock(&writer_mutex);
+    return;
+}
+
+
+/* the child has no writer thread and must not write the records of its parent again */
+static void reset_log_ring() {
+    unsigned long pos;
+    for(pos = ring_tail; pos != ring_head; pos++)
+        ring[pos & (GM_LOG_RING_SLOTS - 1)].seq = pos + GM_LOG_RING_SLOTS;
+    ring_tail       = ring_head;
+    writer_running  = FALSE;
+    writer_sleeping = FALSE;
+    writer_stop     = FALSE;
+    pthread_mutex_init(&wakeup_mutex, NULL);
+    pthread_cond_init(&wakeup_cond, NULL);
+    pthread_mutex_unlock(&writer_mutex);
+    return;
+}
+
+
+/* start background writer unless already running */
+static int start_log_writer() {
+    int rc = GM_OK;
+    pthread_mutex_lock(&wakeup_mutex);
+    if(writer_running == FALSE) {
+        if(pthread_create(&writer_thread, NULL, log_writer_loop, NULL) == 0)
+            writer_running = TRUE;
+        else
+            rc = GM_ERROR;
+    }
+    pthread_mutex_unlock(&wakeup_mutex);
+    return rc;
+}
+
+
+/* returns true if the next record has been filled */
+static int record_ready() {
+    return(ring[ring_tail & (GM_LOG_RING_SLOTS - 1)].seq == ring_tail + 1);
+}
+
+
+/* write all filled records, caller must hold the writer_mutex */
+static int write_records() {
+    gm_log_record_t *rec;
+    FILE *last = NULL;
+    int written = 0;
+
+    while(record_ready()) {
+        rec = &ring[ring_tail & (GM_LOG_RING_SLOTS - 1)];
+        __sync_synchronize();
+        if(rec->fp != last) {
+            if(last != NULL)
+                fflush(last);
+            last = rec->fp;
+        }
+        fwrite(rec->data, 1, rec->len, rec->fp);
+        __sync_synchronize();
+        rec->seq = ring_tail + GM_LOG_RING_SLOTS;
+        ring_tail++;
+        written++;
+    }
+    if(last != NULL)
+        fflush(last);
+
+    return written;
+}
+
+
+/* write records as they come in, one flush per batch */
+static void *log_writer_loop(void *arg) {
+    struct timeval now;
+    struct timespec wakeup;
+    sigset_t mask;
+    int written;
+    arg = arg;
+
+    /* signals are handled by the main thread */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    while(1) {
+        pthread_mutex_lock(&writer_mutex);
+        written = write_records();
+        pthread_mutex_unlock(&writer_mutex);
+        if(written > 0)
+            continue;
+
+        pthread_mutex_lock(&wakeup_mutex);
+        if(writer_stop == TRUE) {
+            pthread_mutex_unlock(&wakeup_mutex);
+            break;
+        }
+        writer_sleeping = TRUE;
+        __sync_synchronize();
+        if(!record_ready()) {
+            gettimeofday(&now, NULL);
+            wakeup.tv_sec  = now.tv_sec + GM_LOG_RING_IDLE_TIMEOUT;
+            wakeup.tv_nsec = now.tv_usec * 1000;
+            pthread_cond_timedwait(&wakeup_cond, &wakeup_mutex, &wakeup);
+        }
+        writer_sleeping = FALSE;
+        pthread_mutex_unlock(&wakeup_mutex);
+    }
+
+    return NULL;
+}
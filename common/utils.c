@@ -28,6 +28,7 @@
 #include "gearman_utils.h"
 #include "popenRWE.h"
 #include "polarssl/md5.h"
+#include "log_ring.h"
 
 #ifdef EMBEDDEDPERL
 #include "epn_utils.h"
@@ -37,6 +38,16 @@ int use_perl_cache               = GM_ENABLED;
 char *p1_file                    = NULL;
 #endif
 
+/* optional asynchronous result sender, see worker/result_sender.c */
+int (*gm_result_sender)(char *queue, char *data) = NULL;
+
+/* increased whenever path restrictions change */
+int restrict_options_version = 0;
+
+static const char *log_timestamp(int format);
+static int log_escape(char *dst, int size, const char *msg, int json);
+static int format_log_line(char *buf, int size, int format, char *level, char *message);
+
 /* escapes newlines in a string */
 char *gm_escape_newlines(char *rawbuf, int trimmed) {
     char *tmpbuf=NULL;
@@ -226,6 +237,8 @@ int set_default_options(mod_gm_opt_t *opt) {
     opt->logfile            = NULL;
     opt->logmode            = GM_LOG_MODE_AUTO;
     opt->logfile_fp         = NULL;
+    opt->log_format         = GM_LOG_FORMAT_TEXT;
+    opt->log_async          = GM_DISABLED;
     opt->message            = NULL;
     opt->delimiter          = gm_strdup("\t");
     opt->return_code        = 0;
@@ -251,9 +264,29 @@ int set_default_options(mod_gm_opt_t *opt) {
     opt->transportmode      = GM_ENCODE_AND_ENCRYPT;
     opt->daemon_mode        = GM_DISABLED;
     opt->fork_on_exec       = GM_DISABLED;
+    opt->builtin_plugins    = GM_DISABLED;
+    opt->plugin_dir         = NULL;
+    opt->plugin_isolation   = GM_DISABLED;
+    opt->async_results      = GM_DISABLED;
+    opt->result_batch_size  = 1;
+    opt->result_batch_wait  = 5;
+    opt->exec_plan_cache    = 1000;
+    opt->single_flight      = GM_DISABLED;
+    opt->plugin_usage_dump  = 0;
+    opt->plugin_usage_result = GM_DISABLED;
+    opt->prefetch_jobs      = 0;
+    opt->cpu_affinity       = GM_CPU_AFFINITY_NONE;
+    opt->cpu_affinity_mbind = GM_DISABLED;
+    opt->metrics_listen     = NULL;
+    opt->options_hash       = 5381;
+    opt->queue_options_hash = 5381;
+    opt->job_trace          = GM_DISABLED;
+    opt->job_trace_file     = NULL;
     opt->idle_timeout       = GM_DEFAULT_IDLE_TIMEOUT;
     opt->max_jobs           = GM_DEFAULT_MAX_JOBS;
     opt->spawn_rate         = GM_DEFAULT_SPAWN_RATE;
+    opt->min_spare_workers  = 0;
+    opt->max_spare_workers  = 0;
     opt->timeout_return     = 2;
     opt->identifier         = NULL;
     opt->queue_cust_var     = NULL;
@@ -263,6 +296,12 @@ int set_default_options(mod_gm_opt_t *opt) {
     opt->orphan_service_checks   = GM_ENABLED;
     opt->orphan_return           = 2;
     opt->accept_clear_results    = GM_DISABLED;
+    opt->bulk_size          = 0;
+    opt->daemon_listen_num  = 0;
+    opt->nsca_listen_num    = 0;
+    opt->daemon_buffer_size = 10000;
+    opt->daemon_spool_dir   = NULL;
+    opt->import_dir         = NULL;
     opt->has_starttime      = FALSE;
     opt->has_finishtime     = FALSE;
     opt->has_latency        = FALSE;
@@ -279,6 +318,9 @@ int set_default_options(mod_gm_opt_t *opt) {
     opt->use_embedded_perl_implicitly = GM_DISABLED;
     opt->use_perl_cache               = GM_ENABLED;
     opt->p1_file                      = NULL;
+    opt->perl_precompile_num          = 0;
+    for(i=0;i<GM_LISTSIZE;i++)
+        opt->perl_precompile[i] = NULL;
 #endif
 
     opt->server_num         = 0;
@@ -302,6 +344,9 @@ int set_default_options(mod_gm_opt_t *opt) {
     opt->local_servicegroups_num  = 0;
     for(i=0;i<GM_LISTSIZE;i++)
         opt->local_servicegroups_list[i] = NULL;
+    opt->queue_node_num     = 0;
+    for(i=0;i<GM_LISTSIZE;i++)
+        opt->queue_node_list[i] = NULL;
     for(i=0;i<GM_NEBTYPESSIZE;i++) {
         mod_gm_exp_t *mod_gm_exp;
         mod_gm_exp              = gm_malloc(sizeof(mod_gm_exp_t));
@@ -310,6 +355,7 @@ int set_default_options(mod_gm_opt_t *opt) {
     }
     opt->exports_count = 0;
     opt->restrict_path_num      = 0;
+    restrict_options_version++;
     opt->gearman_connection_timeout = -1;
     for(i=0;i<GM_LISTSIZE;i++)
         opt->restrict_path[i] = NULL;
@@ -374,13 +420,20 @@ int parse_args_line(mod_gm_opt_t *opt, char * arg, int recursion_level) {
     while(key[0] == '-')
         key++;
 
-    /* daemon mode or delimiter */
+    /* fingerprint options, so reloads know if queues can be changed in place */
+    if(is_queue_option(key))
+        opt->queue_options_hash = hash_option(opt->queue_options_hash, key, value);
+    else
+        opt->options_hash = hash_option(opt->options_hash, key, value);
+
+    /* daemon mode or delimiter, anything but a boolean is a delimiter */
     if ( !strcmp( key, "daemon" ) ||  !strcmp( key, "d" ) ) {
-        opt->daemon_mode = parse_yes_or_no(value, GM_ENABLED);
         if(value != NULL) {
             free(opt->delimiter);
             opt->delimiter = gm_strdup( value );
         }
+        if(value == NULL || parse_yes_or_no(value, -1) != -1)
+            opt->daemon_mode = parse_yes_or_no(value, GM_ENABLED);
         return(GM_OK);
     }
 
@@ -469,6 +522,135 @@ int parse_args_line(mod_gm_opt_t *opt, char * arg, int recursion_level) {
         return(GM_OK);
     }
 
+    /* builtin_plugins */
+    else if ( !strcmp( key, "builtin_plugins" ) ) {
+        opt->builtin_plugins = parse_yes_or_no(value, GM_ENABLED);
+        return(GM_OK);
+    }
+
+    /* plugin_isolation */
+    else if ( !strcmp( key, "plugin_isolation" ) ) {
+        opt->plugin_isolation = parse_yes_or_no(value, GM_ENABLED);
+        return(GM_OK);
+    }
+
+    /* result_batch_size */
+    else if ( !strcmp( key, "result_batch_size" ) ) {
+        opt->result_batch_size = atoi( value );
+        if(opt->result_batch_size < 1) { opt->result_batch_size = 1; }
+        if(opt->result_batch_size > GM_MULTI_RESULT_MAX) { opt->result_batch_size = GM_MULTI_RESULT_MAX; }
+        return(GM_OK);
+    }
+
+    /* result_batch_wait */
+    else if ( !strcmp( key, "result_batch_wait" ) ) {
+        opt->result_batch_wait = atoi( value );
+        if(opt->result_batch_wait < 0) { opt->result_batch_wait = 0; }
+        return(GM_OK);
+    }
+
+    /* exec_plan_cache */
+    else if ( !strcmp( key, "exec_plan_cache" ) ) {
+        opt->exec_plan_cache = atoi( value );
+        if(opt->exec_plan_cache < 0) { opt->exec_plan_cache = 0; }
+        return(GM_OK);
+    }
+
+    /* single_flight */
+    else if ( !strcmp( key, "single_flight" ) ) {
+        opt->single_flight = parse_yes_or_no(value, GM_ENABLED);
+        return(GM_OK);
+    }
+
+    /* plugin_usage_dump */
+    else if ( !strcmp( key, "plugin_usage_dump" ) ) {
+        opt->plugin_usage_dump = atoi( value );
+        if(opt->plugin_usage_dump < 0) { opt->plugin_usage_dump = 0; }
+        return(GM_OK);
+    }
+
+    /* plugin_usage_result */
+    else if ( !strcmp( key, "plugin_usage_result" ) ) {
+        opt->plugin_usage_result = parse_yes_or_no(value, GM_ENABLED);
+        return(GM_OK);
+    }
+
+    /* prefetch_jobs */
+    else if ( !strcmp( key, "prefetch_jobs" ) ) {
+        opt->prefetch_jobs = atoi( value );
+        if(opt->prefetch_jobs < 0) { opt->prefetch_jobs = 0; }
+        return(GM_OK);
+    }
+
+    /* cpu_affinity */
+    else if ( !strcmp( key, "cpu_affinity" ) ) {
+        if ( value != NULL && ( !strcmp( value, "core" ) || !strcmp( value, "cores" ) ) ) {
+            opt->cpu_affinity = GM_CPU_AFFINITY_CORE;
+        } else if ( value != NULL && ( !strcmp( value, "node" ) || !strcmp( value, "nodes" ) ) ) {
+            opt->cpu_affinity = GM_CPU_AFFINITY_NODE;
+        } else if ( value != NULL && ( parse_yes_or_no(value, GM_ENABLED) == GM_DISABLED || !strcmp( value, "none" ) ) ) {
+            opt->cpu_affinity = GM_CPU_AFFINITY_NONE;
+        } else {
+            gm_log( GM_LOG_ERROR, "unknown cpu_affinity value: %s, use no, core or node\n", value );
+            return(GM_ERROR);
+        }
+        return(GM_OK);
+    }
+
+    /* cpu_affinity_mbind */
+    else if ( !strcmp( key, "cpu_affinity_mbind" ) ) {
+        opt->cpu_affinity_mbind = parse_yes_or_no(value, GM_ENABLED);
+        return(GM_OK);
+    }
+
+    /* queue_node */
+    else if ( !strcmp( key, "queue_node" ) ) {
+        char *entry, *node;
+        while ( (entry = strsep( &value, "," )) != NULL ) {
+            entry = trim(entry);
+            if ( !strcmp( entry, "" ) )
+                continue;
+            node = strrchr(entry, ':');
+            if ( node == NULL || node == entry || *(node+1) == '\0' ) {
+                gm_log( GM_LOG_ERROR, "queue_node must be <queue>:<node>, got: %s\n", entry );
+                return(GM_ERROR);
+            }
+            *node++ = '\0';
+            if ( opt->queue_node_num < GM_LISTSIZE ) {
+                opt->queue_node_list[opt->queue_node_num] = gm_strdup(entry);
+                opt->queue_node_ids[opt->queue_node_num]  = atoi(node);
+                opt->queue_node_num++;
+            }
+        }
+        return(GM_OK);
+    }
+
+    /* metrics_listen */
+    else if ( !strcmp( key, "metrics_listen" ) ) {
+        free(opt->metrics_listen);
+        opt->metrics_listen = gm_strdup( value );
+        return(GM_OK);
+    }
+
+    /* job_trace */
+    else if ( !strcmp( key, "job_trace" ) ) {
+        opt->job_trace = parse_yes_or_no(value, GM_ENABLED);
+        return(GM_OK);
+    }
+
+    /* job_trace_file */
+    else if ( !strcmp( key, "job_trace_file" ) && value != NULL ) {
+        free(opt->job_trace_file);
+        opt->job_trace_file = gm_strdup( value );
+        return(GM_OK);
+    }
+
+    /* async_results */
+    else if ( !strcmp( key, "async_results" ) ) {
+        opt->async_results = parse_yes_or_no(value, GM_ENABLED);
+        return(GM_OK);
+    }
+
     /* do_hostchecks */
     else if ( !strcmp( key, "do_hostchecks" ) ) {
         opt->do_hostchecks = parse_yes_or_no(value, GM_ENABLED);
@@ -554,6 +736,12 @@ int parse_args_line(mod_gm_opt_t *opt, char * arg, int recursion_level) {
         return(GM_OK);
     }
 
+    /* log_async */
+    else if ( !strcmp( key, "log_async" ) ) {
+        opt->log_async = parse_yes_or_no(value, GM_ENABLED);
+        return(GM_OK);
+    }
+
     else if ( value == NULL ) {
         gm_log( GM_LOG_ERROR, "unknown switch '%s'\n", key );
         return(GM_OK);
@@ -588,6 +776,24 @@ int parse_args_line(mod_gm_opt_t *opt, char * arg, int recursion_level) {
         }
     }
 
+    /* log_format */
+    else if ( !strcmp( key, "log_format" ) ) {
+        if ( !strcmp( value, "text" ) ) {
+            opt->log_format = GM_LOG_FORMAT_TEXT;
+        }
+        else if ( !strcmp( value, "kv" ) ) {
+            opt->log_format = GM_LOG_FORMAT_KV;
+        }
+        else if ( !strcmp( value, "json" ) ) {
+            opt->log_format = GM_LOG_FORMAT_JSON;
+        }
+        else {
+            gm_log( GM_LOG_ERROR, "unknown log format '%s', use one of 'text', 'kv' and 'json'\n", value );
+            return(GM_ERROR);
+        }
+        return(GM_OK);
+    }
+
     /* result worker */
     else if ( !strcmp( key, "result_workers" ) ) {
         opt->result_workers = atoi( value );
@@ -650,6 +856,44 @@ int parse_args_line(mod_gm_opt_t *opt, char * arg, int recursion_level) {
         string2timeval(value, &opt->finishtime);
     }
 
+    /* bulk size */
+    else if ( !strcmp( key, "bulk_size" ) ) {
+        opt->bulk_size = atoi( value );
+        if(opt->bulk_size < 0) { opt->bulk_size = 0; }
+        if(opt->bulk_size > GM_MAX_BULK_SIZE) { opt->bulk_size = GM_MAX_BULK_SIZE; }
+    }
+
+    /* daemon_listen */
+    else if ( !strcmp( key, "daemon_listen" ) ) {
+        if(opt->daemon_listen_num < GM_LISTSIZE)
+            opt->daemon_listen[opt->daemon_listen_num++] = gm_strdup( value );
+    }
+
+    /* nsca_listen */
+    else if ( !strcmp( key, "nsca_listen" ) ) {
+        if(opt->nsca_listen_num < GM_LISTSIZE)
+            opt->nsca_listen[opt->nsca_listen_num++] = gm_strdup( value );
+    }
+
+    /* daemon_buffer_size */
+    else if ( !strcmp( key, "daemon_buffer_size" ) ) {
+        opt->daemon_buffer_size = atoi( value );
+        if(opt->daemon_buffer_size < 1) { opt->daemon_buffer_size = 1; }
+    }
+
+    /* daemon_spool_dir */
+    else if ( !strcmp( key, "daemon_spool_dir" ) ) {
+        free(opt->daemon_spool_dir);
+    free(opt->import_dir);
+        opt->daemon_spool_dir = gm_strdup( value );
+    }
+
+    /* import_dir */
+    else if ( !strcmp( key, "import_dir" ) ) {
+        free(opt->import_dir);
+        opt->import_dir = gm_strdup( value );
+    }
+
     /* configfile / includes */
     else if (   !strcmp( key, "config" )
              || !strcmp( key, "configfile" )
@@ -675,6 +919,12 @@ int parse_args_line(mod_gm_opt_t *opt, char * arg, int recursion_level) {
         opt->keyfile = gm_strdup( value );
     }
 
+    /* plugin_dir */
+    else if ( !strcmp( key, "plugin_dir" ) ) {
+        free(opt->plugin_dir);
+        opt->plugin_dir = gm_strdup( value );
+    }
+
     /* pidfile */
     else if ( !strcmp( key, "pidfile" ) ) {
         opt->pidfile = gm_strdup( value );
@@ -739,6 +989,18 @@ int parse_args_line(mod_gm_opt_t *opt, char * arg, int recursion_level) {
         if(opt->spawn_rate < 0) { opt->spawn_rate = GM_DEFAULT_SPAWN_RATE; }
     }
 
+    /* min-spare-workers */
+    else if ( !strcmp( key, "min-spare-workers" ) || !strcmp( key, "min_spare_workers" ) ) {
+        opt->min_spare_workers = atoi( value );
+        if(opt->min_spare_workers < 0) { opt->min_spare_workers = 0; }
+    }
+
+    /* max-spare-workers */
+    else if ( !strcmp( key, "max-spare-workers" ) || !strcmp( key, "max_spare_workers" ) ) {
+        opt->max_spare_workers = atoi( value );
+        if(opt->max_spare_workers < 0) { opt->max_spare_workers = 0; }
+    }
+
     /* load limit 1min */
     else if ( !strcmp( key, "load_limit1" ) ) {
         opt->load_limit1 = atof( value );
@@ -917,16 +1179,32 @@ int parse_args_line(mod_gm_opt_t *opt, char * arg, int recursion_level) {
 #endif
     }
 
+    /* perl_precompile */
+    else if ( !strcmp( key, "perl_precompile" ) ) {
+#ifdef EMBEDDEDPERL
+        char *plugin;
+        while ( (plugin = strsep( &value, "," )) != NULL ) {
+            plugin = trim(plugin);
+            if ( strcmp( plugin, "" ) && opt->perl_precompile_num < GM_LISTSIZE ) {
+                opt->perl_precompile[opt->perl_precompile_num] = gm_strdup(plugin);
+                opt->perl_precompile_num++;
+            }
+        }
+#endif
+    }
+
     /* restrict_path */
     else if ( !strcmp( key, "restrict_path" ) || !strcmp( key, "restrictpath" )) {
         opt->restrict_path[opt->restrict_path_num] = gm_strdup(value);
         opt->restrict_path_num++;
+        restrict_options_version++;
     }
 
     /* restrict_command_characters */
     else if ( !strcmp( key, "restrict_command_characters") ) {
         free(opt->restrict_command_characters);
         opt->restrict_command_characters = gm_strdup(value);
+        restrict_options_version++;
     }
 
     /* timeout while connecting to gearmand server*/
@@ -1008,6 +1286,13 @@ void dumpconfig(mod_gm_opt_t *opt, int mode) {
         gm_log( GM_LOG_DEBUG, "log mode:                        syslog (%d)\n", opt->logmode);
     if(opt->logmode == GM_LOG_MODE_TOOLS)
         gm_log( GM_LOG_DEBUG, "log mode:                        tools (%d)\n", opt->logmode);
+    if(opt->log_format == GM_LOG_FORMAT_TEXT)
+        gm_log( GM_LOG_DEBUG, "log format:                      text\n");
+    if(opt->log_format == GM_LOG_FORMAT_KV)
+        gm_log( GM_LOG_DEBUG, "log format:                      kv\n");
+    if(opt->log_format == GM_LOG_FORMAT_JSON)
+        gm_log( GM_LOG_DEBUG, "log format:                      json\n");
+    gm_log( GM_LOG_DEBUG, "log async:                       %s\n", opt->log_async == GM_ENABLED ? "yes" : "no");
 
     if(mode == GM_WORKER_MODE) {
         gm_log( GM_LOG_DEBUG, "identifier:                      %s\n", opt->identifier);
@@ -1019,7 +1304,25 @@ void dumpconfig(mod_gm_opt_t *opt, int mode) {
         gm_log( GM_LOG_DEBUG, "min worker:                      %d\n", opt->min_worker);
         gm_log( GM_LOG_DEBUG, "max worker:                      %d\n", opt->max_worker);
         gm_log( GM_LOG_DEBUG, "spawn rate:                      %d\n", opt->spawn_rate);
+        gm_log( GM_LOG_DEBUG, "min spare worker:                %d\n", opt->min_spare_workers);
+        gm_log( GM_LOG_DEBUG, "max spare worker:                %d\n", opt->max_spare_workers);
         gm_log( GM_LOG_DEBUG, "fork on exec:                    %s\n", opt->fork_on_exec == GM_ENABLED ? "yes" : "no");
+        gm_log( GM_LOG_DEBUG, "builtin plugins:                 %s\n", opt->builtin_plugins == GM_ENABLED ? "yes" : "no");
+        gm_log( GM_LOG_DEBUG, "plugin dir:                      %s\n", opt->plugin_dir == NULL ? "no" : opt->plugin_dir);
+        gm_log( GM_LOG_DEBUG, "plugin isolation:                %s\n", opt->plugin_isolation == GM_ENABLED ? "yes" : "no");
+        gm_log( GM_LOG_DEBUG, "async results:                   %s\n", opt->async_results == GM_ENABLED ? "yes" : "no");
+        gm_log( GM_LOG_DEBUG, "result batch size:               %d\n", opt->result_batch_size);
+        gm_log( GM_LOG_DEBUG, "result batch wait:               %dms\n", opt->result_batch_wait);
+        gm_log( GM_LOG_DEBUG, "exec plan cache:                 %d\n", opt->exec_plan_cache);
+        gm_log( GM_LOG_DEBUG, "single flight:                   %s\n", opt->single_flight == GM_ENABLED ? "yes" : "no");
+        gm_log( GM_LOG_DEBUG, "plugin usage dump:               %ds\n", opt->plugin_usage_dump);
+        gm_log( GM_LOG_DEBUG, "plugin usage result:             %s\n", opt->plugin_usage_result == GM_ENABLED ? "yes" : "no");
+        gm_log( GM_LOG_DEBUG, "prefetch jobs:                   %d\n", opt->prefetch_jobs);
+        gm_log( GM_LOG_DEBUG, "cpu affinity:                    %s\n", opt->cpu_affinity == GM_CPU_AFFINITY_CORE ? "core" : opt->cpu_affinity == GM_CPU_AFFINITY_NODE ? "node" : "no");
+        gm_log( GM_LOG_DEBUG, "cpu affinity mbind:              %s\n", opt->cpu_affinity_mbind == GM_ENABLED ? "yes" : "no");
+        for(i=0;i<opt->queue_node_num;i++)
+            gm_log( GM_LOG_DEBUG, "queue node:                      %s:%d\n", opt->queue_node_list[i], opt->queue_node_ids[i]);
+        gm_log( GM_LOG_DEBUG, "metrics listen:                  %s\n", opt->metrics_listen == NULL ? "no" : opt->metrics_listen);
 #ifndef EMBEDDEDPERL
         gm_log( GM_LOG_DEBUG, "embedded perl:                   not compiled\n");
 #endif
@@ -1029,6 +1332,8 @@ void dumpconfig(mod_gm_opt_t *opt, int mode) {
         gm_log( GM_LOG_DEBUG, "use_epn_implicitly:              %s\n", opt->use_embedded_perl_implicitly == GM_ENABLED ? "yes" : "no");
         gm_log( GM_LOG_DEBUG, "use_perl_cache:                  %s\n", opt->use_perl_cache == GM_ENABLED ? "yes" : "no");
         gm_log( GM_LOG_DEBUG, "p1_file:                         %s\n", opt->p1_file == NULL ? "not set" : opt->p1_file );
+        for(i=0;i<opt->perl_precompile_num;i++)
+            gm_log( GM_LOG_DEBUG, "perl_precompile:                 %s\n", opt->perl_precompile[i]);
         for(i=0;i<opt->restrict_path_num;i++)
             gm_log( GM_LOG_DEBUG, "restricted path:                 %s\n", opt->restrict_path[i]);
         if(opt->restrict_path_num > 0)
@@ -1042,6 +1347,8 @@ void dumpconfig(mod_gm_opt_t *opt, int mode) {
             gm_log( GM_LOG_DEBUG, "result_worker:                   %d\n", opt->result_workers);
         gm_log( GM_LOG_DEBUG, "do_hostchecks:                   %s\n", opt->do_hostchecks == GM_ENABLED ? "yes" : "no");
         gm_log( GM_LOG_DEBUG, "route_eventhandler_like_checks:  %s\n", opt->route_eventhandler_like_checks == GM_ENABLED ? "yes" : "no");
+        gm_log( GM_LOG_DEBUG, "job trace:                       %s\n", opt->job_trace == GM_ENABLED ? "yes" : "no");
+        gm_log( GM_LOG_DEBUG, "job trace file:                  %s\n", opt->job_trace_file == NULL ? "no" : opt->job_trace_file);
     }
     if(mode == GM_NEB_MODE || mode == GM_SEND_GEARMAN_MODE) {
         gm_log( GM_LOG_DEBUG, "result_queue:                    %s\n", opt->result_queue);
@@ -1136,12 +1443,22 @@ void mod_gm_free_opt(mod_gm_opt_t *opt) {
     for(i=0;i<opt->restrict_path_num;i++) {
         free(opt->restrict_path[i]);
     }
+    for(i=0;i<opt->queue_node_num;i++)
+        free(opt->queue_node_list[i]);
+    for(i=0;i<opt->daemon_listen_num;i++)
+        free(opt->daemon_listen[i]);
+    for(i=0;i<opt->nsca_listen_num;i++)
+        free(opt->nsca_listen[i]);
+    free(opt->daemon_spool_dir);
     free(opt->restrict_command_characters);
     free(opt->crypt_key);
     free(opt->keyfile);
     free(opt->message);
     free(opt->delimiter);
     free(opt->pidfile);
+    free(opt->metrics_listen);
+    free(opt->job_trace_file);
+    free(opt->plugin_dir);
     free(opt->logfile);
     free(opt->host);
     free(opt->service);
@@ -1149,6 +1466,9 @@ void mod_gm_free_opt(mod_gm_opt_t *opt) {
     free(opt->queue_cust_var);
 #ifdef EMBEDDEDPERL
     free(opt->p1_file);
+    for(i=0;i<opt->perl_precompile_num;i++) {
+        free(opt->perl_precompile[i]);
+    }
 #endif
     free(opt);
     opt=NULL;
@@ -1156,6 +1476,60 @@ void mod_gm_free_opt(mod_gm_opt_t *opt) {
 }
 
 
+/* decide what a reload has to do */
+int compare_options(mod_gm_opt_t *old_opt, mod_gm_opt_t *new_opt) {
+    if(old_opt->options_hash != new_opt->options_hash)
+        return(GM_RELOAD_RESTART);
+
+    /* keyfiles may change without changing the options */
+    if((old_opt->crypt_key == NULL) != (new_opt->crypt_key == NULL))
+        return(GM_RELOAD_RESTART);
+    if(old_opt->crypt_key != NULL && strcmp(old_opt->crypt_key, new_opt->crypt_key))
+        return(GM_RELOAD_RESTART);
+
+    if(old_opt->queue_options_hash != new_opt->queue_options_hash)
+        return(GM_RELOAD_QUEUES);
+
+    return(GM_RELOAD_NONE);
+}
+
+
+/* options which only change the registered queues */
+int is_queue_option(char *key) {
+    if(   !strcmp( key, "hosts" )
+       || !strcmp( key, "services" )
+       || !strcmp( key, "eventhandlers" )
+       || !strcmp( key, "eventhandler" )
+       || !strcmp( key, "notifications" )
+       || !strcmp( key, "notification" )
+       || !strcmp( key, "hostgroups" )
+       || !strcmp( key, "hostgroup" )
+       || !strcmp( key, "servicegroups" )
+       || !strcmp( key, "servicegroup" )
+       || !strcmp( key, "queue_node" )
+    )
+        return(TRUE);
+    return(FALSE);
+}
+
+
+/* add option to fingerprint */
+unsigned long hash_option(unsigned long hash, char *key, char *value) {
+    const char *c;
+
+    for(c = key; *c != '\0'; c++)
+        hash = ((hash << 5) + hash) + (unsigned char)*c;
+    hash = ((hash << 5) + hash) + '=';
+    if(value != NULL) {
+        for(c = value; *c != '\0'; c++)
+            hash = ((hash << 5) + hash) + (unsigned char)*c;
+    }
+    hash = ((hash << 5) + hash) + '\n';
+
+    return(hash);
+}
+
+
 /* read keyfile */
 int read_keyfile(mod_gm_opt_t *opt) {
     FILE *fp;
@@ -1226,12 +1600,15 @@ int set_default_job(gm_job_t *job, mod_gm_opt_t *opt) {
     job->host_name           = NULL;
     job->service_description = NULL;
     job->result_queue        = NULL;
+    job->queue               = NULL;
     job->command_line        = NULL;
     job->source              = NULL;
     job->output              = NULL;
     job->long_output         = NULL;
     job->error               = NULL;
+    job->trace_id            = NULL;
     job->exited_ok           = TRUE;
+    job->has_rusage          = FALSE;
     job->scheduled_check     = TRUE;
     job->reschedule_check    = TRUE;
     job->return_code         = STATE_OK;
@@ -1239,6 +1616,13 @@ int set_default_job(gm_job_t *job, mod_gm_opt_t *opt) {
     job->timeout             = opt->job_timeout;
     job->start_time.tv_sec   = 0L;
     job->start_time.tv_usec  = 0L;
+    job->next_check.tv_sec   = 0L;
+    job->next_check.tv_usec  = 0L;
+    job->core_time.tv_sec    = 0L;
+    job->core_time.tv_usec   = 0L;
+    job->pickup_time.tv_sec  = 0L;
+    job->pickup_time.tv_usec = 0L;
+    job->check_options       = 0;
     job->has_been_sent       = FALSE;
 
     return(GM_OK);
@@ -1252,7 +1636,9 @@ int free_job(gm_job_t *job) {
     free(job->host_name);
     free(job->service_description);
     free(job->result_queue);
+    free(job->queue);
     free(job->command_line);
+    free(job->trace_id);
     if(job->output != NULL)
         free(job->output);
     if(job->long_output != NULL)
@@ -1394,19 +1780,20 @@ void gm_log( int lvl, const char *text, ... ) {
     FILE * fp       = NULL;
     int debug_level = GM_LOG_ERROR;
     int logmode     = GM_LOG_MODE_STDOUT;
-    int slevel;
+    int format      = GM_LOG_FORMAT_TEXT;
+    int async       = GM_DISABLED;
+    int slevel, len;
     char * level;
-    char buffer1[GM_BUFFERSIZE];
-    char buffer2[GM_BUFFERSIZE];
-    char buffer3[GM_BUFFERSIZE];
-    time_t t;
+    char message[GM_BUFFERSIZE];
+    char line[GM_BUFFERSIZE];
     va_list ap;
-    struct tm now;
 
     if(mod_gm_opt != NULL) {
         debug_level = mod_gm_opt->debug_level;
         logmode     = mod_gm_opt->logmode;
         fp          = mod_gm_opt->logfile_fp;
+        format      = mod_gm_opt->log_format;
+        async       = mod_gm_opt->log_async;
     }
 
     if(logmode == GM_LOG_MODE_CORE) {
@@ -1416,19 +1803,19 @@ void gm_log( int lvl, const char *text, ... ) {
             return;
 
         if ( lvl == GM_LOG_ERROR ) {
-            snprintf( buffer1, 22, "mod_gearman: ERROR - " );
+            snprintf( message, 22, "mod_gearman: ERROR - " );
         } else {
-            snprintf( buffer1, 14, "mod_gearman: " );
+            snprintf( message, 14, "mod_gearman: " );
         }
         va_start( ap, text );
-        vsnprintf( buffer1 + strlen( buffer1 ), sizeof( buffer1 ) - strlen( buffer1 ), text, ap );
+        vsnprintf( message + strlen( message ), sizeof( message ) - strlen( message ), text, ap );
         va_end( ap );
 
         if ( debug_level >= GM_LOG_STDOUT ) {
-            printf( "%s", buffer1 );
+            printf( "%s", message );
             return;
         }
-        write_core_log( buffer1 );
+        write_core_log( message );
         return;
     }
 
@@ -1437,58 +1824,140 @@ void gm_log( int lvl, const char *text, ... ) {
         return;
     }
     if ( lvl == GM_LOG_ERROR ) {
-        level  = "ERROR";
+        level  = format == GM_LOG_FORMAT_TEXT ? "ERROR" : "error";
         slevel = LOG_ERR;
     }
     else if ( lvl == GM_LOG_INFO ) {
-        level  = "INFO ";
+        level  = format == GM_LOG_FORMAT_TEXT ? "INFO " : "info";
         slevel = LOG_INFO;
     }
     else if ( lvl == GM_LOG_DEBUG ) {
-        level  = "DEBUG";
+        level  = format == GM_LOG_FORMAT_TEXT ? "DEBUG" : "debug";
         slevel = LOG_DEBUG;
     }
     else if ( lvl >= GM_LOG_TRACE ) {
-        level  = "TRACE";
+        level  = format == GM_LOG_FORMAT_TEXT ? "TRACE" : "trace";
         slevel = LOG_DEBUG;
     }
     else {
-        level = "UNKNOWN";
+        level  = format == GM_LOG_FORMAT_TEXT ? "UNKNOWN" : "unknown";
         slevel = LOG_DEBUG;
     }
 
-    /* set timestring */
-    t = time(NULL);
-    localtime_r(&t, &now);
-    strftime(buffer1, sizeof(buffer1), "[%Y-%m-%d %H:%M:%S]", &now );
-
-    /* set timestring */
-    snprintf(buffer2, sizeof(buffer2), "[%i][%s]", getpid(), level );
-
     va_start( ap, text );
-    vsnprintf( buffer3, GM_BUFFERSIZE, text, ap );
+    vsnprintf( message, GM_BUFFERSIZE, text, ap );
     va_end( ap );
 
     if ( debug_level >= GM_LOG_STDOUT || logmode == GM_LOG_MODE_TOOLS ) {
-        printf( "%s", buffer3 );
+        printf( "%s", message );
         return;
     }
 
-    if(logmode == GM_LOG_MODE_FILE && fp != NULL) {
-        fprintf( fp, "%s%s %s", buffer1, buffer2, buffer3 );
-        fflush( fp );
+    if(logmode == GM_LOG_MODE_SYSLOG) {
+        syslog(slevel , "[%i][%s] %s", getpid(), level, message );
+        return;
     }
-    else if(logmode == GM_LOG_MODE_SYSLOG) {
-        syslog(slevel , "%s %s", buffer2, buffer3 );
+
+    len = format_log_line(line, sizeof(line), format, level, message);
+
+    if(logmode == GM_LOG_MODE_FILE && fp != NULL) {
+        if(async != GM_ENABLED) {
+            fputs( line, fp );
+            fflush( fp );
+        }
+        /* errors are written immediately, everything else goes through the ring unless it is full */
+        else if(lvl == GM_LOG_ERROR || log_ring_write(fp, line, len) != GM_OK) {
+            log_ring_write_sync(fp, line, len);
+        }
     }
     else {
         /* stdout logging */
-        printf( "%s%s %s", buffer1, buffer2, buffer3 );
+        printf( "%s", line );
     }
 
     return;
 }
 
+
+/* return formatted time, the string only changes once per second */
+static const char *log_timestamp(int format) {
+    static __thread char   timestamp[32];
+    static __thread time_t last   = 0;
+    static __thread int    last_format = -1;
+    time_t t;
+    struct tm now;
+
+    t = time(NULL);
+    if(t != last || format != last_format) {
+        localtime_r(&t, &now);
+        if(format == GM_LOG_FORMAT_TEXT)
+            strftime(timestamp, sizeof(timestamp), "[%Y-%m-%d %H:%M:%S]", &now );
+        else
+            strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S%z", &now );
+        last        = t;
+        last_format = format;
+    }
+
+    return timestamp;
+}
+
+
+/* escape message for key=value or json logs, trailing newlines are removed */
+static int log_escape(char *dst, int size, const char *msg, int json) {
+    char buf[8];
+    int x, n, end;
+    int len = 0;
+    unsigned char ch;
+
+    end = strlen(msg);
+    while(end > 0 && msg[end-1] == '\n')
+        end--;
+
+    for(x = 0; x < end; x++) {
+        ch = (unsigned char)msg[x];
+        if(json && ch < 0x20 && ch != '\n' && ch != '\r' && ch != '\t') {
+            snprintf(buf, sizeof(buf), "\\u%04x", ch);
+        }
+        else if(escaped(ch)) {
+            escape(buf, ch);
+        }
+        else {
+            buf[0] = (char)ch;
+            buf[1] = '\0';
+        }
+        n = strlen(buf);
+        if(len + n >= size)
+            break;
+        memcpy(dst + len, buf, n);
+        len += n;
+    }
+    dst[len] = '\0';
+
+    return len;
+}
+
+
+/* format a single log line including the trailing newline */
+static int format_log_line(char *buf, int size, int format, char *level, char *message) {
+    int len;
+
+    if(format == GM_LOG_FORMAT_TEXT) {
+        len = snprintf(buf, size, "%s[%i][%s] %s", log_timestamp(format), getpid(), level, message);
+        return(len < size ? len : size - 1);
+    }
+
+    if(format == GM_LOG_FORMAT_JSON)
+        len = snprintf(buf, size, "{\"ts\":\"%s\",\"pid\":%i,\"level\":\"%s\",\"msg\":\"", log_timestamp(format), getpid(), level);
+    else
+        len = snprintf(buf, size, "ts=%s pid=%i level=%s msg=\"", log_timestamp(format), getpid(), level);
+
+    /* keep room for the closing quotes */
+    len += log_escape(buf + len, size - len - 4, message, format == GM_LOG_FORMAT_JSON);
+    len += snprintf(buf + len, size - len, format == GM_LOG_FORMAT_JSON ? "\"}\n" : "\"\n");
+
+    return len;
+}
+
 /* check server for duplicates */
 int check_param_server(gm_server_t * new_server, gm_server_t * server_list[GM_LISTSIZE], int server_num) {
     int i;
@@ -1507,6 +1976,7 @@ void send_result_back(gm_job_t * exec_job) {
     char * temp_buffer1;
     char * temp_buffer2;
     int result_size;
+    struct timeval sent_time;
     gm_log( GM_LOG_TRACE, "send_result_back()\n" );
 
     /* avoid duplicate returned results */
@@ -1550,6 +2020,31 @@ void send_result_back(gm_job_t * exec_job) {
             );
     temp_buffer1[result_size-1]='\x0';
 
+    /* resource usage of the plugin */
+    if(mod_gm_opt->plugin_usage_result == GM_ENABLED && exec_job->has_rusage == TRUE) {
+        snprintf( temp_buffer2, result_size-1, "rusage=%lf,%lf,%ld,%ld,%ld\n",
+                  timeval2double(&exec_job->rusage.ru_utime),
+                  timeval2double(&exec_job->rusage.ru_stime),
+                  exec_job->rusage.ru_maxrss,
+                  exec_job->rusage.ru_nvcsw,
+                  exec_job->rusage.ru_nivcsw
+                );
+        strcat(temp_buffer1, temp_buffer2);
+    }
+
+    /* lifecycle timestamps for the neb module */
+    if(exec_job->trace_id != NULL) {
+        gettimeofday(&sent_time, NULL);
+        snprintf( temp_buffer2, result_size-1, "trace_id=%s\nqueue=%s\ncore_time=%lf\npickup_time=%lf\nsent_time=%lf\n",
+                  exec_job->trace_id,
+                  exec_job->queue != NULL ? exec_job->queue : "(unknown)",
+                  timeval2double(&exec_job->core_time),
+                  timeval2double(&exec_job->pickup_time),
+                  timeval2double(&sent_time)
+                );
+        strcat(temp_buffer1, temp_buffer2);
+    }
+
     if(exec_job->service_description != NULL) {
         temp_buffer2[0]='\x0';
         strcat(temp_buffer2, "service_description=");
@@ -1584,7 +2079,10 @@ void send_result_back(gm_job_t * exec_job) {
 
     gm_log( GM_LOG_TRACE, "data:\n%s\n", temp_buffer1);
 
-    if(add_job_to_queue( current_client,
+    if(gm_result_sender != NULL && gm_result_sender(exec_job->result_queue, temp_buffer1) == GM_OK) {
+        gm_log( GM_LOG_TRACE, "send_result_back() queued result\n" );
+    }
+    else if(add_job_to_queue( current_client,
                          mod_gm_opt->server_list,
                          exec_job->result_queue,
                          NULL,
@@ -1732,3 +2230,80 @@ int read_pipe(char **target, int input) {
     }
     return(size);
 }
+
+
+/* pack multiple results into a single result packet */
+char *build_multi_result(char **results, int num) {
+    char *packet;
+    size_t size, len;
+    int x;
+
+    size = strlen(GM_MULTI_RESULT_HEADER) + 20;
+    for(x = 0; x < num; x++)
+        size += strlen(results[x]) + 2;
+
+    packet = gm_malloc(size);
+    snprintf(packet, size, "%s=%d\n\n", GM_MULTI_RESULT_HEADER, GM_MULTI_RESULT_VERSION);
+    len = strlen(packet);
+    for(x = 0; x < num; x++) {
+        /* results are separated by a single empty line */
+        size_t rlen = strlen(results[x]);
+        while(rlen > 0 && results[x][rlen-1] == '\n')
+            rlen--;
+        memcpy(packet+len, results[x], rlen);
+        len += rlen;
+        packet[len++] = '\n';
+        packet[len++] = '\n';
+    }
+    packet[len] = '\0';
+
+    return packet;
+}
+
+
+/* returns the format version of a multi result packet and skips the header, 0 for single results */
+int parse_multi_result_header(char **data) {
+    char *ptr = *data;
+    int version;
+
+    if(ptr == NULL || !starts_with(GM_MULTI_RESULT_HEADER"=", ptr))
+        return 0;
+
+    ptr += strlen(GM_MULTI_RESULT_HEADER) + 1;
+    version = atoi(ptr);
+    if(version <= 0)
+        version = -1;
+
+    ptr = strchr(ptr, '\n');
+    *data = ptr == NULL ? *data + strlen(*data) : ptr;
+
+    return version;
+}
+
+
+/* returns the next result of a multi result packet, NULL when done */
+char *next_multi_result(char **data) {
+    char *start = *data;
+    char *end;
+
+    if(start == NULL)
+        return NULL;
+
+    while(*start == '\n')
+        start++;
+
+    if(*start == '\0') {
+        *data = start;
+        return NULL;
+    }
+
+    end = strstr(start, "\n\n");
+    if(end == NULL) {
+        *data = start + strlen(start);
+        return start;
+    }
+    end[1] = '\0';
+    *data  = end + 2;
+
+    return start;
+}
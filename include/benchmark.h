@@ -0,0 +1,188 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/**
+ * @file
+ * @brief end to end benchmark
+ * @addtogroup mod_gearman_benchmark benchmark
+ *
+ * Starts a local gearmand, a mod_gearman_worker with N worker processes
+ * and a synthetic result consumer, submits host checks at a fixed rate and
+ * reports throughput, latency, cpu per job and memory of every component
+ * as json or key=value lines.
+ *
+ * The benchmark binary is the check plugin as well, called with --plugin
+ * it sleeps the configured runtime and prints output of the given size.
+ *
+ * @{
+ */
+
+#include <getopt.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "common.h"
+
+#define GM_BENCH_FORMAT_JSON         0   /**< print one json object */
+#define GM_BENCH_FORMAT_TEXT         1   /**< print key=value lines */
+
+#define GM_BENCH_GEARMAND            0   /**< index of the gearmand process */
+#define GM_BENCH_WORKER              1   /**< index of the mod_gearman_worker process */
+#define GM_BENCH_INJECTOR            2   /**< index of the job injector process */
+#define GM_BENCH_CONSUMER            3   /**< index of the result consumer process */
+#define GM_BENCH_PROCS               4   /**< number of components */
+
+#define GM_BENCH_DEFAULT_PORT    54731   /**< port of the local gearmand */
+#define GM_BENCH_START_TIMEOUT      30   /**< seconds to wait for gearmand and the workers */
+#define GM_BENCH_STOP_TIMEOUT       10   /**< seconds to wait before killing a component */
+#define GM_BENCH_SAMPLE_INTERVAL   0.5   /**< seconds between two memory samples */
+
+/** timestamps of a single job */
+typedef struct gm_bench_sample {
+    double   scheduled;                 /**< time the job was due for submission */
+    double   pickup;                    /**< worker received the job */
+    double   start;                     /**< plugin started */
+    double   finish;                    /**< plugin finished */
+    double   sent;                      /**< worker sent the result */
+    double   received;                  /**< result arrived at the consumer */
+} gm_bench_sample_t;
+
+/** counters shared between the benchmark processes */
+typedef struct gm_bench_shared {
+    double              start_time;     /**< time the first job was due */
+    volatile long       submitted;      /**< jobs handed to gearmand, written by the injector */
+    volatile long       failed;         /**< jobs which could not be submitted */
+    volatile long       received;       /**< results received, written by the consumer */
+    volatile long       invalid;        /**< results which could not be parsed */
+    volatile double     plugin_cpu;     /**< cpu seconds of all plugins as reported by the worker */
+    long                max_samples;    /**< size of the samples array */
+    gm_bench_sample_t   samples[1];     /**< one entry per received result */
+} gm_bench_shared_t;
+
+/** a benchmarked process */
+typedef struct gm_bench_proc {
+    const char    * name;               /**< name used in the report */
+    pid_t           pid;                /**< process id, 0 if not running */
+    int             exited;             /**< process has been reaped */
+    int             status;             /**< exit status from wait4 */
+    struct rusage   usage;              /**< resource usage including reaped children */
+    long            rss_sampled;        /**< highest rss in kB of the process and its direct children */
+} gm_bench_proc_t;
+
+/** statistics of a latency distribution in seconds */
+typedef struct gm_bench_dist {
+    long     num;                       /**< number of values */
+    double   p50;                       /**< median */
+    double   p90;                       /**< 90th percentile */
+    double   p99;                       /**< 99th percentile */
+    double   max;                       /**< maximum */
+} gm_bench_dist_t;
+
+/**
+ * main
+ *
+ * main function of the benchmark
+ *
+ * @param[in] argc - number of arguments
+ * @param[in] argv - list of arguments
+ *
+ * @return exit code, 0 on success, 1 on errors and 2 if --min-rate was not reached
+ */
+int main (int argc, char **argv);
+
+/**
+ *
+ * print the usage and exit
+ *
+ * @return just exits
+ */
+void print_usage(void);
+
+/**
+ *
+ * print the version and exit
+ *
+ * @return just exits
+ */
+void print_version(void);
+
+/**
+ *
+ * act as check plugin: sleep and print output
+ *
+ * @param[in] spec - <runtime ms>,<output size>,<sequence number>
+ *
+ * @return exit code of the plugin
+ */
+int run_plugin(char * spec);
+
+/**
+ *
+ * submit jobs at the configured rate until the run is over
+ *
+ * @return exit code of the injector process
+ */
+int run_injector(void);
+
+/**
+ *
+ * receive results and record their timestamps until terminated
+ *
+ * @return exit code of the consumer process
+ */
+int run_consumer(void);
+
+/**
+ *
+ * parse a result from the worker into a sample
+ *
+ * @param[in] data - decrypted result
+ * @param[out] sample - timestamps of the job
+ * @param[out] plugin_cpu - cpu seconds of the plugin, 0 if unknown
+ *
+ * @return GM_OK if all timestamps were found
+ */
+int parse_bench_result(char * data, gm_bench_sample_t * sample, double * plugin_cpu);
+
+/**
+ *
+ * calculate percentiles, sorts the values
+ *
+ * @param[in] values - list of values
+ * @param[in] num - number of values
+ * @param[out] dist - resulting distribution
+ *
+ * @return nothing
+ */
+void bench_distribution(double * values, long num, gm_bench_dist_t * dist);
+
+/**
+ *
+ * print the report
+ *
+ * @return sustained throughput in jobs per second
+ */
+double print_report(void);
+
+/**
+ * @}
+ */
@@ -0,0 +1,121 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief builtin check plugins executed inside the worker
+ *
+ *  @{
+ */
+
+#include "common.h"
+
+#define GM_NO_BUILTIN                  -2
+
+/** builtin plugin function, returns plugin exit code or GM_NO_BUILTIN */
+typedef int (*gm_builtin_func)(int argc, char **argv, char **output);
+
+/** registry entry for a builtin plugin */
+typedef struct gm_builtin_plugin_struct {
+    const char      * name;                 /**< basename of the plugin */
+    gm_builtin_func   func;                 /**< function implementing it */
+} gm_builtin_plugin_t;
+
+/**
+ * run_builtin_check
+ *
+ * run a check with a builtin plugin when available
+ *
+ * @param[in] processed_command - command line
+ * @param[out] plugin_output - pointer to plugin output
+ * @param[out] plugin_error - pointer to plugin error output
+ *
+ * @return wait status like run_check or GM_NO_BUILTIN
+ */
+int run_builtin_check(char *processed_command, char **plugin_output, char **plugin_error);
+
+/**
+ * get_builtin_plugin
+ *
+ * lookup builtin plugin by the basename of the command
+ *
+ * @param[in] command - plugin path or name
+ *
+ * @return plugin function or NULL
+ */
+gm_builtin_func get_builtin_plugin(const char *command);
+
+/**
+ * builtin_check_dummy
+ *
+ * check_dummy replacement
+ *
+ * @param[in] argc - number of arguments
+ * @param[in] argv - arguments
+ * @param[out] output - plugin output
+ *
+ * @return exit code or GM_NO_BUILTIN
+ */
+int builtin_check_dummy(int argc, char **argv, char **output);
+
+/**
+ * builtin_check_tcp
+ *
+ * check_tcp replacement, only plain connect checks are supported
+ *
+ * @param[in] argc - number of arguments
+ * @param[in] argv - arguments
+ * @param[out] output - plugin output
+ *
+ * @return exit code or GM_NO_BUILTIN
+ */
+int builtin_check_tcp(int argc, char **argv, char **output);
+
+/**
+ * builtin_check_file_age
+ *
+ * check_file_age replacement
+ *
+ * @param[in] argc - number of arguments
+ * @param[in] argv - arguments
+ * @param[out] output - plugin output
+ *
+ * @return exit code or GM_NO_BUILTIN
+ */
+int builtin_check_file_age(int argc, char **argv, char **output);
+
+/**
+ * builtin_check_procs
+ *
+ * check_procs replacement, only counts processes by command name
+ *
+ * @param[in] argc - number of arguments
+ * @param[in] argv - arguments
+ * @param[out] output - plugin output
+ *
+ * @return exit code or GM_NO_BUILTIN
+ */
+int builtin_check_procs(int argc, char **argv, char **output);
+
+/**
+ * @}
+ */
@@ -36,10 +36,22 @@
 
 #define PLUGIN_NAME    "check_gearman"   /**< set the name of the plugin */
 
+#define GM_PROBE_PERCENTILES    3        /**< number of reported percentiles */
+
 #include <stdlib.h>
 #include <signal.h>
+#include <sys/time.h>
 #include "common.h"
 
+/** state of a single probe job */
+typedef struct gm_probe_job {
+    double         start;           /**< time the job was submitted */
+    double         duration;        /**< round trip time in seconds */
+    int            done;            /**< job is finished */
+    int            failed;          /**< job failed or returned unexpected text */
+    char         * expect;          /**< expected text in the result */
+} gm_probe_job_t;
+
 /** check_gearman
  *
  * main function of check_gearman
@@ -99,6 +111,32 @@ int check_server(char * server, in_port_t port);
  */
 int check_worker(char * queue, char * send, char * expect);
 
+/**
+ *
+ * send probe jobs and report round trip time percentiles
+ *
+ * @param[in] queue - queue name (function)
+ * @param[in] send - put this text as job into the queue
+ * @param[in] expect - returning text to expect
+ * @param[in] count - number of probe jobs
+ * @param[in] parallel - number of jobs sent at once
+ *
+ * @return returns a nagios compatible exit code
+ */
+int check_latency(char * queue, char * send, char * expect, int count, int parallel);
+
+/**
+ *
+ * nearest rank percentile
+ *
+ * @param[in] sorted - sorted list of values
+ * @param[in] num - number of values
+ * @param[in] pct - percentile between 0 and 100
+ *
+ * @return value at the given percentile
+ */
+double percentile(double * sorted, int num, double pct);
+
 /**
  * @}
  */
@@ -31,6 +31,9 @@
 #include "common.h"
 #include <fcntl.h>
 
+extern struct rusage last_check_rusage;   /**< resource usage of the last plugin run by run_check */
+extern int last_check_rusage_valid;       /**< flag if last_check_rusage is set */
+
 /**
  * nr2signal
  *
@@ -64,7 +67,22 @@ char *extract_check_result(FILE *fp, int trimmed);
  *
  * @return true on success
  */
-int parse_command_line(char *cmd, char *argv[GM_LISTSIZE]);
+int parse_command_line(char *cmd, char *argv[MAX_CMD_ARGS]);
+
+/**
+ * lex_command_line
+ *
+ * split command line into words following the quoting rules of /bin/sh.
+ * The command line is modified in place.
+ *
+ * @param[in,out] cmd - command line
+ * @param[out] argv - argv array, starting with the variable assignments
+ * @param[out] assignments - number of leading NAME=value words
+ * @param[out] stderr_to_stdout - set when the command contains 2>&1
+ *
+ * @return TRUE if the command can be executed without a shell
+ */
+int lex_command_line(char *cmd, char *argv[MAX_CMD_ARGS], int *assignments, int *stderr_to_stdout);
 
 /**
  * run_check
@@ -49,6 +49,7 @@
 #include <gm_alloc.h>
 #include <stdio.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <arpa/inet.h>
 
 #ifndef MOD_GM_COMMON_H
@@ -61,6 +62,10 @@
 #define GM_BUFFERSIZE               65536
 #define GM_MAX_OUTPUT            10485760   /* limit plugin output size to 10mb */
 #define GM_LISTSIZE                   512
+
+#define GM_CPU_AFFINITY_NONE            0       /**< do not pin worker */
+#define GM_CPU_AFFINITY_CORE            1       /**< pin each worker to one core */
+#define GM_CPU_AFFINITY_NODE            2       /**< pin each worker to the cores of one numa node */
 #define GM_NEBTYPESSIZE                33   /* maximum number of neb types */
 #define GM_MAX_HOST_ADDRESS_LENGTH    256   /* max size of a host address */
 
@@ -73,6 +78,11 @@
 
 #define GM_EXIT_UNKNOWN               768   /* results in exit code 3 after processed by WEXITSTATUS() */
 
+#define GM_MULTI_RESULT_HEADER  "mod_gearman_results"   /* first key of a packet with multiple results */
+#define GM_MULTI_RESULT_VERSION         1               /* format version of multi result packets */
+#define GM_MULTI_RESULT_MAX           100               /* maximum number of results in one packet */
+#define GM_MAX_BULK_SIZE            10000               /* maximum number of results send_gearman sends per round trip */
+
 /* log modes */
 #define GM_LOG_ERROR                   -1
 #define GM_LOG_INFO                     0
@@ -90,6 +100,11 @@
 #define GM_LOG_MODE_SYSLOG              4
 #define GM_LOG_MODE_TOOLS               5
 
+/* log formats */
+#define GM_LOG_FORMAT_TEXT              0
+#define GM_LOG_FORMAT_KV                1
+#define GM_LOG_FORMAT_JSON              2
+
 /* job priorities */
 #define GM_JOB_PRIO_LOW                 1
 #define GM_JOB_PRIO_NORMAL              2
@@ -124,6 +139,11 @@
 #define GM_WORKER_STOP                  1
 #define GM_WORKER_RESTART               2
 
+/* config reload modes */
+#define GM_RELOAD_NONE                  0      /**< nothing changed */
+#define GM_RELOAD_QUEUES                1      /**< only queues changed, worker re-register in place */
+#define GM_RELOAD_RESTART               2      /**< worker have to be restarted */
+
 /* perfdata modes */
 #define GM_PERFDATA_OVERWRITE           1
 #define GM_PERFDATA_APPEND              2
@@ -198,6 +218,8 @@ typedef struct mod_gm_opt_struct {
     int            logmode;                                 /**< logmode: auto, syslog, file or core */
     char         * logfile;                                 /**< path for the logfile */
     FILE         * logfile_fp;                              /**< filedescriptor for the logfile */
+    int            log_format;                              /**< log format: text, kv or json */
+    int            log_async;                               /**< flag whether the logfile is written by a background thread */
     int            use_uniq_jobs;                           /**< flag whether normal jobs will be sent with/without uniq set */
 /* neb module */
     char         * result_queue;                            /**< name of the result queue used by the neb module */
@@ -228,9 +250,32 @@ typedef struct mod_gm_opt_struct {
     int            min_worker;                              /**< minimum number of workers */
     int            max_worker;                              /**< maximum number of workers */
     int            fork_on_exec;                            /**< flag to disable additional forks for each job */
+    int            builtin_plugins;                         /**< run simple plugins inside the worker */
+    char         * plugin_dir;                              /**< directory with shared object plugins */
+    int            plugin_isolation;                        /**< run shared object plugins in a helper process */
+    int            async_results;                           /**< send results from a background thread */
+    int            result_batch_size;                       /**< maximum number of results per result job */
+    int            result_batch_wait;                       /**< milliseconds to wait for more results */
+    int            exec_plan_cache;                         /**< number of cached command lines */
+    int            single_flight;                           /**< share results of identical concurrent checks */
+    int            plugin_usage_dump;                       /**< log plugin resource usage every x seconds */
+    int            plugin_usage_result;                     /**< send plugin resource usage with the result */
+    int            prefetch_jobs;                           /**< number of jobs executed earliest deadline first */
+    int            cpu_affinity;                            /**< pin worker to cores or numa nodes */
+    int            cpu_affinity_mbind;                      /**< bind worker memory to its numa node */
+    char         * queue_node_list[GM_LISTSIZE];            /**< queues which are only served on one numa node */
+    int            queue_node_ids[GM_LISTSIZE];             /**< numa node for each queue in queue_node_list */
+    int            queue_node_num;                          /**< number of elements in queue_node_list */
+    char         * metrics_listen;                          /**< address of the prometheus metrics endpoint */
+    unsigned long  options_hash;                            /**< fingerprint of all parsed options except queues */
+    unsigned long  queue_options_hash;                      /**< fingerprint of all parsed queue options */
+    int            job_trace;                               /**< flag whether jobs carry a trace id and timestamps */
+    char         * job_trace_file;                          /**< file for the job segment histograms */
     int            idle_timeout;                            /**< number of seconds till a idle worker exits */
     int            max_jobs;                                /**< maximum number of jobs done after a worker exits */
     int            spawn_rate;                              /**< number of spawned new worker */
+    int            min_spare_workers;                       /**< minimum number of idle worker */
+    int            max_spare_workers;                       /**< maximum number of idle worker */
     int            show_error_output;                       /**< optional display the stderr output of plugins */
     int            timeout_return;                          /**< timeout return code */
     int            orphan_return;                           /**< orphan return code */
@@ -243,6 +288,8 @@ typedef struct mod_gm_opt_struct {
     int            use_embedded_perl_implicitly;            /**< use embedded perl implicitly */
     int            use_perl_cache;                          /**< cache embedded perl scripts */
     char         * p1_file;                                 /**< path to p1 file, needed for embedded perl */
+    char         * perl_precompile[GM_LISTSIZE];            /**< perl plugins compiled by the main process */
+    int            perl_precompile_num;                     /**< number of precompiled perl plugins */
 #endif
     char         * restrict_path[GM_LISTSIZE];              /**< list of path restrictions */
     int            restrict_path_num;                       /**< number of path restrictions */
@@ -262,6 +309,14 @@ typedef struct mod_gm_opt_struct {
     struct timeval finishtime;                              /**< time when the check finished */
     int            has_latency;                             /**< flag when latency is set */
     struct timeval latency;                                 /**< latency for this result */
+    int            bulk_size;                               /**< number of results sent with a single round trip */
+    char         * daemon_listen[GM_LISTSIZE];              /**< addresses for results in the delimited line format */
+    int            daemon_listen_num;                       /**< number of line format addresses */
+    char         * nsca_listen[GM_LISTSIZE];                /**< addresses for results from send_nsca */
+    int            nsca_listen_num;                         /**< number of nsca addresses */
+    int            daemon_buffer_size;                      /**< maximum number of results kept in memory */
+    char         * daemon_spool_dir;                        /**< directory for results which do not fit into memory */
+    char         * import_dir;                              /**< directory with checkresult files to send */
     int            gearman_connection_timeout;              /**< timeout on job submission */
 } mod_gm_opt_t;
 
@@ -273,10 +328,12 @@ typedef struct gm_job_struct {
     char         * command_line;        /**< command line to execute */
     char         * type;                /**< type of this job */
     char         * result_queue;        /**< name of the result queue */
+    char         * queue;               /**< name of the queue this job came from */
     char         * output;              /**< output from the executed command line (stdout) */
     char         * long_output;         /**< used for sending long_plugin_output to notification workers */
     char         * error;               /**< errors from the executed command line (stderr) */
     char         * source;              /**< source of this check */
+    char         * trace_id;            /**< trace id from the neb module or NULL */
     int            return_code;         /**< return code for this job */
     int            early_timeout;       /**< did the check run into a timeout */
     int            check_options;       /**< check_options given from the core */
@@ -287,9 +344,12 @@ typedef struct gm_job_struct {
     double         latency;             /**< latency for from this job */
     struct timeval next_check;          /**< next_check value of host / service */
     struct timeval core_time;           /**< time when the core started the job */
+    struct timeval pickup_time;         /**< time when the worker received the job */
     struct timeval start_time;          /**< time when the job really started */
     struct timeval finish_time;         /**< time when the job was finished */
     int            has_been_sent;       /**< flag if job has been sent back */
+    int            has_rusage;          /**< flag if rusage has been collected */
+    struct rusage  rusage;              /**< resource usage of the plugin */
 } gm_job_t;
 
 
@@ -0,0 +1,101 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief pin worker to cores or numa nodes
+ *
+ *  @{
+ */
+
+#include <sched.h>
+
+#include "common.h"
+
+#define GM_MAX_NUMA_NODES               64      /**< maximum number of supported numa nodes */
+#define GM_SYSFS_NODE_DIR  "/sys/devices/system/node" /**< sysfs directory with one entry per numa node */
+
+extern int worker_numa_node;    /**< numa node of this worker or -1 if not pinned */
+
+/**
+ * parse_cpulist
+ *
+ * parse a kernel cpu list like 0-3,8,10-11
+ *
+ * @param[in] list - cpu list
+ * @param[out] set - cpu set
+ *
+ * @return number of cpus in the set
+ */
+int parse_cpulist(char *list, cpu_set_t *set);
+
+/**
+ * get_numa_nodes
+ *
+ * get numa node numbers and their cpus, limited to the cpus we are
+ * allowed to run on. Returns a single node 0 with all allowed cpus if
+ * the system has no numa information.
+ *
+ * @param[out] nodes - node numbers, sorted
+ * @param[out] cpus - cpus of each node
+ * @param[in] max - size of both arrays
+ *
+ * @return number of nodes
+ */
+int get_numa_nodes(int *nodes, cpu_set_t *cpus, int max);
+
+/**
+ * set_worker_affinity
+ *
+ * pin the current process round robin according to cpu_affinity. The
+ * setting is inherited by all plugins started by this worker.
+ *
+ * @param[in] worker_nr - number of the worker, starting at 0
+ *
+ * @return GM_OK on success
+ */
+int set_worker_affinity(int worker_nr);
+
+/**
+ * verify_cpu_affinity
+ *
+ * log a warning for queue_node mappings which cannot be served
+ *
+ * @return number of problems found
+ */
+int verify_cpu_affinity(void);
+
+/**
+ * queue_allowed_on_worker
+ *
+ * check if the queue may be served by this worker, queues mapped
+ * with queue_node are only served on their numa node.
+ *
+ * @param[in] queue - queue name
+ *
+ * @return TRUE if the worker should register the queue
+ */
+int queue_allowed_on_worker(char *queue);
+
+/**
+ * @}
+ */
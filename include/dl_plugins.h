@@ -0,0 +1,125 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief loader for shared object check plugins
+ *
+ *  @{
+ */
+
+#include "common.h"
+#include "mod_gearman_plugin.h"
+
+#define GM_NO_DL_PLUGIN                -3
+#define GM_MAX_DL_PLUGINS              64
+
+/** loaded shared object plugin */
+typedef struct gm_dl_plugin_struct {
+    void                       * handle;    /**< handle from dlopen */
+    const mod_gearman_plugin_t * plugin;    /**< plugin description */
+    char                       * path;      /**< path to the shared object */
+    int                          enabled;   /**< false if init failed */
+} gm_dl_plugin_t;
+
+/**
+ * load_dl_plugins
+ *
+ * load all shared objects from a directory
+ *
+ * @param[in] dir - plugin directory
+ *
+ * @return number of loaded plugins
+ */
+int load_dl_plugins(char *dir);
+
+/**
+ * init_dl_plugins
+ *
+ * call init function of all loaded plugins, must be called in each worker
+ *
+ * @return true on success
+ */
+int init_dl_plugins(void);
+
+/**
+ * teardown_dl_plugins
+ *
+ * call teardown function of all loaded plugins and stop the helper
+ *
+ * @return nothing
+ */
+void teardown_dl_plugins(void);
+
+/**
+ * run_dl_plugin_check
+ *
+ * run a check with a shared object plugin when available
+ *
+ * @param[in] processed_command - command line
+ * @param[out] plugin_output - pointer to plugin output
+ * @param[out] plugin_error - pointer to plugin error output
+ *
+ * @return wait status like run_check or GM_NO_DL_PLUGIN
+ */
+int run_dl_plugin_check(char *processed_command, char **plugin_output, char **plugin_error);
+
+/**
+ * run_dl_plugin
+ *
+ * run a plugin in the current process
+ *
+ * @param[in] plugin - plugin to run
+ * @param[in] argc - number of arguments
+ * @param[in] argv - arguments
+ * @param[in] timeout - timeout in seconds
+ * @param[out] output - plugin output including perfdata
+ *
+ * @return plugin exit code
+ */
+int run_dl_plugin(const mod_gearman_plugin_t *plugin, int argc, char **argv, int timeout, char **output);
+
+/**
+ * dl_plugin_helper_loop
+ *
+ * main loop of the isolated helper process
+ *
+ * @param[in] fd - socket to the worker
+ *
+ * @return nothing, exits when the worker closes the socket
+ */
+void dl_plugin_helper_loop(int fd);
+
+/**
+ * dl_plugin_watchdog
+ *
+ * watchdog thread which enforces plugin timeouts
+ *
+ * @param[in] arg - unused
+ *
+ * @return nothing
+ */
+void *dl_plugin_watchdog(void *arg);
+
+/**
+ * @}
+ */
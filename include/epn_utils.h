@@ -23,12 +23,31 @@
 
 #include "common.h"
 
+#include <sys/types.h>
+
 /** @file
  *  @brief embedded perl utility components for all parts of mod_gearman
  *
  *  @{
  */
 
+#define GM_EPN_CACHE_SIZE    1024   /**< number of cached epn decisions */
+#define GM_EPN_IMPLICIT        -1   /**< plugin has no epn directive    */
+
+/** cached epn decision of a plugin file */
+typedef struct gm_epn_cache_struct {
+    int    valid;      /**< entry is in use */
+    dev_t  dev;        /**< device of the plugin file */
+    ino_t  ino;        /**< inode of the plugin file */
+    time_t mtime;      /**< modification time of the plugin file */
+    off_t  size;       /**< size of the plugin file */
+    int    decision;   /**< TRUE, FALSE or GM_EPN_IMPLICIT */
+} gm_epn_cache_t;
+
+extern int  epn_cache_hits;      /**< number of epn decisions taken from the cache */
+extern int  epn_cache_misses;    /**< number of epn decisions read from the plugin */
+extern long epn_compile_usec;    /**< microseconds spent compiling perl plugins */
+
 /**
  * run_epn_check
  *
@@ -53,6 +72,18 @@ int run_epn_check(char *processed_command, char **ret, char **err);
  */
 int file_uses_embedded_perl(char *);
 
+/**
+ * precompile_epn_plugins
+ *
+ * compile perl plugins in the main process, so all worker share them
+ *
+ * @param[in] plugins - list of plugin paths
+ * @param[in] num - number of plugins
+ *
+ * @return number of compiled plugins
+ */
+int precompile_epn_plugins(char **plugins, int num);
+
 /**
  * init_embedded_perl
  *
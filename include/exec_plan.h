@@ -0,0 +1,101 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief cache of parsed command lines for the worker
+ *
+ *  @{
+ */
+
+#include "common.h"
+
+#include <sys/types.h>
+
+#define GM_EXEC_PLAN_BUCKETS        1024   /**< number of hash buckets */
+
+#define GM_EXEC_ALLOWED                0   /**< command passed the path restrictions */
+#define GM_EXEC_NOT_ABSOLUTE           1   /**< command does not start with a / */
+#define GM_EXEC_FORBIDDEN_CHARACTERS   2   /**< command contains restrict_command_characters */
+#define GM_EXEC_NOT_RESTRICTED_PATH    3   /**< command is not in any restrict_path */
+
+/** everything run_check needs to know about a command line */
+typedef struct gm_exec_plan_struct {
+    unsigned long                 hash;            /**< hash of the command line */
+    char                        * command;         /**< command line */
+    int                           verdict;         /**< result of the restrict_path checks */
+    int                           verdict_version; /**< restrict_options_version of the verdict */
+    int                           verdict_paths;   /**< restrict_path_num of the verdict */
+    int                           use_shell;       /**< command needs /bin/sh */
+    char                        * args;            /**< parsed command line, argv points into it */
+    char                       ** argv;            /**< NULL terminated argument list */
+    int                           argc;            /**< number of arguments */
+    char                       ** env;             /**< NULL terminated list of NAME=value assignments */
+    int                           stderr_to_stdout; /**< command contains 2>&1 */
+    char                        * path;            /**< path of the executable as given on the command line */
+    dev_t                         dev;             /**< device of the executable */
+    ino_t                         ino;             /**< inode of the executable */
+    time_t                        mtime;           /**< modification time of the executable */
+    time_t                        checked;         /**< last time the executable was verified */
+    int                           cached;          /**< plan is part of the cache */
+    struct gm_exec_plan_struct  * bucket_next;     /**< next plan in the same bucket */
+    struct gm_exec_plan_struct  * lru_prev;        /**< more recently used plan */
+    struct gm_exec_plan_struct  * lru_next;        /**< less recently used plan */
+} gm_exec_plan_t;
+
+extern int exec_plan_hits;     /**< number of plans taken from the cache */
+extern int exec_plan_misses;   /**< number of plans created */
+
+/**
+ * get_exec_plan
+ *
+ * returns the cached plan for a command line or creates a new one
+ *
+ * @param[in] command - command line
+ *
+ * @return plan, must be handed back with release_exec_plan()
+ */
+gm_exec_plan_t *get_exec_plan(char *command);
+
+/**
+ * release_exec_plan
+ *
+ * free plans which are not part of the cache
+ *
+ * @param[in] plan - plan from get_exec_plan()
+ *
+ * @return nothing
+ */
+void release_exec_plan(gm_exec_plan_t *plan);
+
+/**
+ * flush_exec_plans
+ *
+ * remove all plans from the cache
+ *
+ * @return nothing
+ */
+void flush_exec_plans(void);
+
+/**
+ * @}
+ */
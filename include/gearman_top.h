@@ -29,6 +29,9 @@
  * Command line utility which connects to the admin interface of a gearman daemon.
  * displays current worker and queue utilization.
  *
+ * All servers are polled in parallel with non-blocking sockets. Rates are
+ * derived from consecutive samples, because gearmand only reports gauges.
+ *
  * @{
  */
 
@@ -36,7 +39,65 @@
 #include <signal.h>
 #include <curses.h>
 #include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/time.h>
 #include "common.h"
+#include "gearman_utils.h"
+
+#define GM_TOP_HISTORY          20   /**< number of samples kept for the sparkline */
+#define GM_TOP_ERROR_SIZE      256   /**< size of the per server error message */
+#define GM_TOP_VERSION_SIZE     64   /**< size of the per server version string */
+
+#define GM_TOP_FORMAT_TEXT       0   /**< print tables */
+#define GM_TOP_FORMAT_JSON       1   /**< print one json object per sample */
+#define GM_TOP_FORMAT_CSV        2   /**< print one csv row per queue and sample */
+
+#define GM_TOP_STATE_IDLE        0   /**< nothing to do */
+#define GM_TOP_STATE_CONNECTING  1   /**< waiting for the non-blocking connect */
+#define GM_TOP_STATE_READING     2   /**< command sent, waiting for the answer */
+#define GM_TOP_STATE_DONE        3   /**< got a complete answer */
+#define GM_TOP_STATE_FAILED      4   /**< connect, send or read failed */
+
+/** queue statistics with history */
+typedef struct gm_top_queue {
+    char         * name;                        /**< name of the queue */
+    int            seen;                        /**< queue was part of the last sample */
+    int            worker;                      /**< number of worker */
+    int            waiting;                     /**< number of waiting jobs */
+    int            running;                     /**< number of running jobs */
+    int            has_prev;                    /**< prev_waiting is valid */
+    int            prev_waiting;                /**< waiting jobs of the previous sample */
+    int            has_rate;                    /**< waiting_delta is valid */
+    double         waiting_delta;               /**< change of waiting jobs per second, not the throughput */
+    int            history[GM_TOP_HISTORY];     /**< waiting jobs of the last samples */
+    int            history_num;                 /**< number of samples in history */
+    int            history_pos;                 /**< next slot in history */
+} gm_top_queue_t;
+
+/** set of queues, either from one server or merged from all servers */
+typedef struct gm_top_view {
+    gm_top_queue_t * queue[GM_LISTSIZE];        /**< list of queues */
+    int              queue_num;                 /**< number of queues */
+    double           last_sample;               /**< time of the previous sample */
+} gm_top_view_t;
+
+/** state of a polled server */
+typedef struct gm_top_server {
+    char           * name;                      /**< server as given on the command line */
+    char           * host;                      /**< hostname */
+    int              port;                      /**< port */
+    struct addrinfo* addr;                      /**< resolved address */
+    int              fd;                        /**< socket */
+    int              state;                     /**< one of GM_TOP_STATE_* */
+    char           * buf;                       /**< answer from gearmand */
+    size_t           len;                       /**< length of answer */
+    char             version[GM_TOP_VERSION_SIZE]; /**< last known version */
+    char             error[GM_TOP_ERROR_SIZE];  /**< error of the last poll */
+    int              was_ok;                    /**< previous poll was successful */
+    gm_top_view_t    view;                      /**< queues of this server */
+} gm_top_server_t;
 
 /** gearman_top
  *
@@ -77,13 +138,99 @@ void print_version(void);
 
 /**
  *
- * print the statistics for a given hostname
+ * query all servers in parallel and wait until all answered or timed out
+ *
+ * @param[in] servers - list of servers
+ * @param[in] num - number of servers
+ * @param[in] timeout - timeout in seconds
+ *
+ * @return nothing
+ */
+void poll_servers(gm_top_server_t ** servers, int num, int timeout);
+
+/**
+ *
+ * mark all queues of a view as unseen before adding a new sample
+ *
+ * @param[in] view - view to reset
+ *
+ * @return nothing
+ */
+void view_begin_sample(gm_top_view_t * view);
+
+/**
+ *
+ * add queue statistics to a view, counts of the same queue are summed up
+ *
+ * @param[in] view - view to add to
+ * @param[in] stats - stats from a server
+ *
+ * @return nothing
+ */
+void view_add_stats(gm_top_view_t * view, mod_gm_server_status_t * stats);
+
+/**
+ *
+ * finish a sample, calculate the change of waiting jobs and append to the history
+ *
+ * @param[in] view - view to update
+ * @param[in] now - time of this sample
+ * @param[in] valid - false if the sample is incomplete, the change starts over then
+ *
+ * @return nothing
+ */
+void view_end_sample(gm_top_view_t * view, double now, int valid);
+
+/**
+ *
+ * render history of a queue as ascii sparkline
+ *
+ * @param[in] queue - queue to render
+ * @param[out] buf - buffer of at least GM_TOP_HISTORY+1 bytes
+ *
+ * @return nothing
+ */
+void sparkline(gm_top_queue_t * queue, char * buf);
+
+/**
+ *
+ * print the statistics of all servers or the merged view as tables
+ *
+ * @param[in] now - time of this sample
+ *
+ * @return nothing
+ */
+void print_text(double now);
+
+/**
+ *
+ * print the statistics of a view as table
+ *
+ * @param[in] view - view to print
+ *
+ * @return nothing
+ */
+void print_view(gm_top_view_t * view);
+
+/**
+ *
+ * print one sample as json object
+ *
+ * @param[in] now - time of this sample
+ *
+ * @return nothing
+ */
+void print_json(double now);
+
+/**
+ *
+ * print one sample as csv rows
  *
- * @param[in] hostname - hostname to connect to
+ * @param[in] now - time of this sample
  *
  * @return nothing
  */
-void print_stats(char * hostname);
+void print_csv(double now);
 
 /**
  *
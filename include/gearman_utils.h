@@ -37,6 +37,8 @@
 #include <unistd.h>
 #include <assert.h>
 #include <netinet/in.h>
+#include <fcntl.h>
+#include <sys/un.h>
 #ifdef LIBGEARMAN_1_0
 #include "libgearman-1.0/gearman.h"
 #else
@@ -52,6 +54,7 @@ gearman_job_st *current_gearman_job;
 int create_client( gm_server_t * server_list[GM_LISTSIZE], gearman_client_st * client);
 int create_worker( gm_server_t * server_list[GM_LISTSIZE], gearman_worker_st * worker);
 int add_job_to_queue( gearman_client_st *client, gm_server_t * server_list[GM_LISTSIZE], char * queue, char * uniq, char * data, int priority, int retries, int transport_mode, int send_now );
+int add_jobs_to_queue( gearman_client_st *client, gm_server_t * server_list[GM_LISTSIZE], char * queue, char ** data, int num, int priority, int transport_mode, int * failed_jobs );
 int worker_add_function( gearman_worker_st * worker, char * queue, gearman_worker_fn *function);
 void *dummy( gearman_job_st *, void *, size_t *, gearman_return_t * );
 void free_client(gearman_client_st *client);
@@ -101,6 +104,20 @@ typedef struct mod_gm_status_server {
  */
 int get_gearman_server_data(mod_gm_server_status_t *stats, char ** message, char **version, char * hostname, int port);
 
+/**
+ * parse_gearman_server_data
+ *
+ * parse the answer of the status and version admin commands
+ *
+ * @param[out] stats - stats structure
+ * @param[in] output - raw answer from gearmand, will be modified
+ * @param[out] version - version string from server
+ * @param[in] version_size - size of the version buffer
+ *
+ * @return GM_OK if the answer was complete
+ */
+int parse_gearman_server_data(mod_gm_server_status_t *stats, char * output, char * version, int version_size);
+
 /**
  * send2gearmandadmin
  *
@@ -132,6 +149,18 @@ int send2gearmandadmin(char * cmd, char * hostnam, int port, char ** output, cha
  */
 int gm_net_connect (const char *host_name, int port, int *sd, char ** error);
 
+/**
+ * gm_net_listen
+ *
+ * open a non-blocking listening socket
+ *
+ * @param[in] address - unix:<path> or <host>:<port>
+ * @param[out] socket_path - path of the unix socket, must be freed, NULL for tcp
+ *
+ * @return socket or -1 on errors
+ */
+int gm_net_listen(const char *address, char **socket_path);
+
 /**
  * free_mod_gm_status_server
  *
@@ -0,0 +1,114 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief latency histograms per queue in prometheus text format
+ *
+ *  @{
+ */
+
+#ifndef MOD_GM_HISTOGRAM_H
+#define MOD_GM_HISTOGRAM_H
+
+#include "common.h"
+
+#include <pthread.h>
+
+#define GM_HISTOGRAM_BUCKETS            12      /**< number of histogram buckets, including +Inf */
+#define GM_HISTOGRAM_QUEUES             64      /**< number of queues with own histograms, the rest is summed up as (other) */
+#define GM_HISTOGRAM_QUEUE_NAME        128      /**< maximum length of a queue name */
+
+/** histogram, buckets are not cumulative */
+typedef struct gm_histogram_struct {
+    unsigned long long count;                         /**< number of observations */
+    unsigned long long sum_usec;                      /**< sum of all observations */
+    unsigned long long buckets[GM_HISTOGRAM_BUCKETS]; /**< observations per bucket */
+} gm_histogram_t;
+
+/** names of the queues, the index is the slot of the queue */
+typedef struct gm_histogram_queues_struct {
+    int  used;                                                 /**< number of used slots */
+    char names[GM_HISTOGRAM_QUEUES][GM_HISTOGRAM_QUEUE_NAME];  /**< queue names */
+} gm_histogram_queues_t;
+
+/**
+ * observe_histogram
+ *
+ * add an observation to a histogram
+ *
+ * @param[in] hist    - histogram
+ * @param[in] limits  - upper bounds of all buckets but +Inf
+ * @param[in] seconds - observed duration
+ *
+ * @return nothing
+ */
+void observe_histogram(gm_histogram_t *hist, const double *limits, double seconds);
+
+/**
+ * histogram_queue
+ *
+ * find the slot of a queue, new queues are added on first use. When all
+ * slots are used, the last one sums up all other queues.
+ *
+ * @param[in] queues - queue names
+ * @param[in] mutex  - lock, only taken when adding a queue
+ * @param[in] queue  - queue name
+ *
+ * @return slot number
+ */
+int histogram_queue(gm_histogram_queues_t *queues, pthread_mutex_t *mutex, const char *queue);
+
+/**
+ * format_histogram
+ *
+ * write cumulative buckets, sum and count in prometheus text format
+ *
+ * @param[out] buf    - output buffer
+ * @param[in]  size   - size of buf
+ * @param[in]  name   - metric name
+ * @param[in]  labels - labels without braces, may be empty
+ * @param[in]  limits - upper bounds of all buckets but +Inf
+ * @param[in]  hist   - histogram
+ *
+ * @return number of bytes written
+ */
+int format_histogram(char *buf, int size, const char *name, const char *labels, const double *limits, gm_histogram_t *hist);
+
+/**
+ * escape_label_value
+ *
+ * escape backslash, double quote and newline for use as label value
+ *
+ * @param[out] buf   - output buffer, should be twice the size of value
+ * @param[in]  size  - size of buf
+ * @param[in]  value - label value
+ *
+ * @return buf
+ */
+char *escape_label_value(char *buf, int size, const char *value);
+
+#endif
+
+/**
+ * @}
+ */
@@ -0,0 +1,178 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief job lifecycle tracing for the neb module
+ *
+ *  @{
+ */
+
+#include "common.h"
+#include "histogram.h"
+
+#include <sys/time.h>
+
+#define GM_TRACE_ID_SIZE                32      /**< maximum length of a trace id */
+#define GM_TRACE_WRITE_INTERVAL         60      /**< seconds between updates of the trace file */
+#define GM_TRACE_BUFFERSIZE         262144      /**< maximum size of the trace file */
+
+/** upper bounds of the histogram buckets in seconds, the last bucket is +Inf */
+#define GM_TRACE_BUCKET_LIMITS { 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 2.5, 5, 10, 30 }
+
+/* job lifecycle segments */
+#define GM_TRACE_SCHEDULE                0      /**< next_check until the neb module dispatches the job */
+#define GM_TRACE_SUBMIT                  1      /**< dispatch until gearmand acknowledged the job */
+#define GM_TRACE_QUEUE                   2      /**< dispatch until a worker picked up the job */
+#define GM_TRACE_WORKER                  3      /**< pickup until the plugin has been started */
+#define GM_TRACE_EXEC                    4      /**< plugin runtime */
+#define GM_TRACE_SEND                    5      /**< plugin exit until the result has been sent */
+#define GM_TRACE_RETURN                  6      /**< result sent until a result thread received it */
+#define GM_TRACE_CORE                    7      /**< result received until it has been handed to the core */
+#define GM_TRACE_SEGMENTS                8      /**< number of segments */
+
+/** segment names used as label in the trace file */
+#define GM_TRACE_SEGMENT_NAMES { "schedule", "submit", "queue", "worker", "exec", "send", "return", "core" }
+
+/** timestamps of a single job, zero if unknown */
+typedef struct gm_job_trace_struct {
+    char           * trace_id;      /**< trace id assigned by the neb module */
+    char           * queue;         /**< queue the job has been sent to */
+    struct timeval   next_check;    /**< scheduled by the core */
+    struct timeval   core_time;     /**< dispatched by the neb module */
+    struct timeval   pickup_time;   /**< picked up by the worker */
+    struct timeval   start_time;    /**< plugin started */
+    struct timeval   finish_time;   /**< plugin exited */
+    struct timeval   sent_time;     /**< result sent by the worker */
+    struct timeval   received;      /**< result received by the result thread */
+} gm_job_trace_t;
+
+/** segment histograms of all queues */
+typedef struct gm_trace_table_struct {
+    gm_histogram_queues_t queue_names;                                  /**< names of the queues */
+    gm_histogram_t        segments[GM_HISTOGRAM_QUEUES][GM_TRACE_SEGMENTS]; /**< one histogram per queue and segment */
+} gm_trace_table_t;
+
+/**
+ * next_trace_id
+ *
+ * create a new trace id, unique for this core process
+ *
+ * @param[out] buf  - buffer for the trace id
+ * @param[in]  size - size of buf
+ *
+ * @return buf
+ */
+char *next_trace_id(char *buf, int size);
+
+/**
+ * trace_queue
+ *
+ * get the histogram slot of a queue, new queues are added on first use
+ *
+ * @param[in] queue - queue name
+ *
+ * @return slot number or -1 if tracing has not been initialized
+ */
+int trace_queue(const char *queue);
+
+/**
+ * trace_observe
+ *
+ * add the duration of a segment to the histogram of a queue
+ *
+ * @param[in] slot    - slot from trace_queue
+ * @param[in] segment - one of GM_TRACE_SEGMENTS
+ * @param[in] seconds - duration
+ *
+ * @return nothing
+ */
+void trace_observe(int slot, int segment, double seconds);
+
+/**
+ * trace_observe_since
+ *
+ * add the time elapsed since start to the histogram of a queue
+ *
+ * @param[in] slot    - slot from trace_queue
+ * @param[in] segment - one of GM_TRACE_SEGMENTS
+ * @param[in] start   - start of the segment
+ *
+ * @return nothing
+ */
+void trace_observe_since(int slot, int segment, struct timeval *start);
+
+/**
+ * trace_result
+ *
+ * account all segments of a returned job
+ *
+ * @param[in] trace - timestamps of the job
+ *
+ * @return slot of the job queue or -1 if the result was not traced
+ */
+int trace_result(gm_job_trace_t *trace);
+
+/**
+ * format_trace_histograms
+ *
+ * write segment histograms in prometheus text format
+ *
+ * @param[out] buf  - output buffer
+ * @param[in]  size - size of buf
+ *
+ * @return number of bytes written
+ */
+int format_trace_histograms(char *buf, int size);
+
+/**
+ * write_trace_file
+ *
+ * replace the trace file with the current histograms
+ *
+ * @param[in] path - trace file
+ *
+ * @return GM_OK on success
+ */
+int write_trace_file(const char *path);
+
+/**
+ * init_job_trace
+ *
+ * allocate histograms
+ *
+ * @return nothing
+ */
+void init_job_trace(void);
+
+/**
+ * free_job_trace
+ *
+ * free histograms
+ *
+ * @return nothing
+ */
+void free_job_trace(void);
+
+/**
+ * @}
+ */
@@ -0,0 +1,87 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief prefetched jobs, executed earliest deadline first
+ *
+ *  @{
+ */
+
+#include "common.h"
+
+#define GM_JOB_WINDOW_WAIT              10      /**< milliseconds to wait for more jobs while the window is not empty */
+#define GM_CHECK_OPTION_FORCE_EXECUTION  1      /**< same as CHECK_OPTION_FORCE_EXECUTION from the core */
+
+/** prefetched job */
+typedef struct gm_window_job_struct {
+    gm_job_t                    * job;       /**< the job */
+    double                        deadline;  /**< jobs are executed in order of their deadline */
+    struct gm_window_job_struct * next;      /**< job with the next later deadline */
+} gm_window_job_t;
+
+/**
+ * job_deadline
+ *
+ * get deadline of a job, which is next_check plus timeout. Forced
+ * checks are sorted before all other jobs. The deadline only decides
+ * the order, stale jobs are dropped by max_age only.
+ *
+ * @param[in] job - job
+ *
+ * @return deadline as unix timestamp
+ */
+double job_deadline(gm_job_t *job);
+
+/**
+ * job_window_add
+ *
+ * add job to the window. If the window already contains a job for the
+ * same host or service, the older one is superseded and returned.
+ *
+ * @param[in] job - job to add
+ *
+ * @return superseded job or NULL
+ */
+gm_job_t *job_window_add(gm_job_t *job);
+
+/**
+ * job_window_next
+ *
+ * remove the job with the earliest deadline from the window
+ *
+ * @return job or NULL if the window is empty
+ */
+gm_job_t *job_window_next(void);
+
+/**
+ * job_window_size
+ *
+ * get number of jobs in the window
+ *
+ * @return number of jobs
+ */
+int job_window_size(void);
+
+/**
+ * @}
+ */
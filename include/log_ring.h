@@ -0,0 +1,94 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief lock-free log ring drained by a background writer thread
+ *
+ *  @{
+ */
+
+#include "common.h"
+
+#include <stdio.h>
+
+#define GM_LOG_RING_SLOTS             1024    /**< number of records in the ring, must be a power of two */
+#define GM_LOG_RING_RECORD_SIZE       1024    /**< longer records are written synchronously */
+#define GM_LOG_RING_IDLE_TIMEOUT         1    /**< seconds the writer sleeps when the ring is empty */
+
+/** log record */
+typedef struct gm_log_record_struct {
+    volatile unsigned long seq;                          /**< slot sequence number */
+    FILE                 * fp;                           /**< file to write the record into */
+    int                    len;                          /**< length of data */
+    char                   data[GM_LOG_RING_RECORD_SIZE]; /**< formatted log line */
+} gm_log_record_t;
+
+/**
+ * log_ring_write
+ *
+ * put a formatted log line into the ring, starts the writer thread
+ * on first use. Never blocks.
+ *
+ * @param[in] fp   - file the line should be written to
+ * @param[in] line - formatted log line
+ * @param[in] len  - length of line
+ *
+ * @return GM_OK if the line has been queued, GM_ERROR if the ring is full
+ *         or the line is too long and has to be written synchronously
+ */
+int log_ring_write(FILE *fp, const char *line, int len);
+
+/**
+ * log_ring_write_sync
+ *
+ * write all queued records and then the given line
+ *
+ * @param[in] fp   - file the line should be written to
+ * @param[in] line - formatted log line
+ * @param[in] len  - length of line
+ *
+ * @return nothing
+ */
+void log_ring_write_sync(FILE *fp, const char *line, int len);
+
+/**
+ * log_ring_flush
+ *
+ * write all queued records from the calling thread
+ *
+ * @return nothing
+ */
+void log_ring_flush(void);
+
+/**
+ * log_ring_stop
+ *
+ * write all queued records and stop the writer thread
+ *
+ * @return nothing
+ */
+void log_ring_stop(void);
+
+/**
+ * @}
+ */
@@ -101,10 +101,12 @@ int nebmodule_deinit( int flags, int reason );
 /** adds check result to result list
  *
  * @param[in] newcheckresult - new checkresult structure to add to list
+ * @param[in] trace_slot     - job trace queue slot or -1
+ * @param[in] received       - time the result has been received or NULL
  *
  * @return nothing
  */
-void mod_gm_add_result_to_list(check_result * newcheckresult);
+void mod_gm_add_result_to_list(check_result * newcheckresult, int trace_slot, struct timeval *received);
 
 /** wraps the nm_log / write_to_all_logs core logger
  *
@@ -0,0 +1,68 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief shared object plugin interface for the mod_gearman worker
+ *
+ *  Plugins are loaded from the plugin_dir and must export a function
+ *  called mod_gearman_plugin() returning a pointer to a static
+ *  mod_gearman_plugin_t structure. This header does not depend on any
+ *  other mod_gearman header, so plugins can be built standalone.
+ *
+ *  @{
+ */
+
+#ifndef MOD_GEARMAN_PLUGIN_H
+#define MOD_GEARMAN_PLUGIN_H
+
+#define MOD_GEARMAN_PLUGIN_ABI_VERSION     1                     /**< increased on incompatible changes */
+#define MOD_GEARMAN_PLUGIN_ENTRY           "mod_gearman_plugin"  /**< name of the exported entry function */
+
+/** result of a plugin run, strings must be allocated with malloc and are freed by the worker */
+typedef struct mod_gearman_plugin_result_struct {
+    int          rc;                        /**< exit code, 0-3 */
+    char       * output;                    /**< plugin output */
+    char       * perfdata;                  /**< performance data or NULL */
+} mod_gearman_plugin_result_t;
+
+/** plugin description */
+typedef struct mod_gearman_plugin_struct {
+    int          abi_version;               /**< must be MOD_GEARMAN_PLUGIN_ABI_VERSION */
+    const char * name;                      /**< command basename handled by this plugin */
+    int          timeout;                   /**< max runtime in seconds, 0 uses the job timeout */
+    int        (*init)(void);               /**< called once in each worker process, returns 0 on success, may be NULL */
+    int        (*run)(int argc, char **argv, int timeout, mod_gearman_plugin_result_t *result); /**< run the check, returns 0 on success */
+    void       (*teardown)(void);           /**< called before the worker process exits, may be NULL */
+} mod_gearman_plugin_t;
+
+/** type of the exported entry function */
+typedef const mod_gearman_plugin_t * (*mod_gearman_plugin_entry_t)(void);
+
+/** entry function every plugin has to export */
+const mod_gearman_plugin_t * mod_gearman_plugin(void);
+
+#endif
+
+/**
+ * @}
+ */
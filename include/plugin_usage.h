@@ -0,0 +1,126 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief resource usage of executed plugins, aggregated per plugin name
+ *
+ *  @{
+ */
+
+#include "common.h"
+
+#include <pthread.h>
+#include <sys/resource.h>
+
+#define GM_PLUGIN_USAGE_SLOTS          256      /**< number of different plugins, the rest is summed up as (other) */
+#define GM_PLUGIN_USAGE_NAME            64      /**< maximum length of a plugin name */
+
+/** usage of one plugin */
+typedef struct gm_plugin_usage_struct {
+    char               name[GM_PLUGIN_USAGE_NAME]; /**< basename of the plugin */
+    unsigned long      count;                      /**< number of executions */
+    unsigned long long utime_usec;                 /**< user cpu time */
+    unsigned long long stime_usec;                 /**< system cpu time */
+    long               maxrss;                     /**< largest max rss in kB */
+    unsigned long long maxrss_sum;                 /**< sum of max rss, used for the average */
+    unsigned long long nvcsw;                      /**< voluntary context switches */
+    unsigned long long nivcsw;                     /**< involuntary context switches */
+} gm_plugin_usage_t;
+
+/** usage table, shared by all worker of this host */
+typedef struct gm_plugin_usage_table_struct {
+    pthread_mutex_t    mutex;                          /**< protects all entries */
+    int                used;                           /**< number of used entries */
+    gm_plugin_usage_t  entries[GM_PLUGIN_USAGE_SLOTS]; /**< entries */
+} gm_plugin_usage_table_t;
+
+/**
+ * init_plugin_usage
+ *
+ * create the shared table, must be called before forking the worker
+ *
+ * @return GM_OK on success
+ */
+int init_plugin_usage(void);
+
+/**
+ * free_plugin_usage
+ *
+ * unmap the shared table
+ *
+ * @return nothing
+ */
+void free_plugin_usage(void);
+
+/**
+ * add_plugin_usage
+ *
+ * add resource usage of an executed command
+ *
+ * @param[in] command_line - executed command line
+ * @param[in] usage - resource usage from wait4
+ *
+ * @return nothing
+ */
+void add_plugin_usage(char *command_line, struct rusage *usage);
+
+/**
+ * plugin_usage_name
+ *
+ * get plugin basename from a command line, leading variable
+ * assignments are skipped
+ *
+ * @param[in] command_line - command line
+ * @param[out] name - buffer for the name
+ * @param[in] size - size of the buffer
+ *
+ * @return name
+ */
+char *plugin_usage_name(char *command_line, char *name, int size);
+
+/**
+ * format_plugin_usage
+ *
+ * write usage table sorted by cpu time into buffer
+ *
+ * @param[out] buf - output buffer
+ * @param[in] size - size of the buffer
+ *
+ * @return number of listed plugins
+ */
+int format_plugin_usage(char *buf, int size);
+
+/**
+ * dump_plugin_usage
+ *
+ * write usage table to the log every interval seconds
+ *
+ * @param[in] interval - seconds between two dumps
+ *
+ * @return nothing
+ */
+void dump_plugin_usage(int interval);
+
+/**
+ * @}
+ */
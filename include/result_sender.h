@@ -0,0 +1,109 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief background result sender for the worker
+ *
+ *  @{
+ */
+
+#include "common.h"
+
+#define GM_RESULT_SENDER_MAX_QUEUE     10000    /**< results are sent synchronously when more are waiting */
+#define GM_RESULT_SENDER_BATCH_SIZE      100    /**< maximum number of results per gearman round trip */
+#define GM_RESULT_SENDER_EXIT_WAIT      2000    /**< milliseconds a worker exiting from a signal handler waits for queued results */
+
+/** queued result */
+typedef struct gm_queued_result_struct {
+    char                           * queue;  /**< result queue */
+    char                           * data;   /**< unencrypted result data */
+    struct timeval                   queued; /**< time the result has been queued */
+    struct gm_queued_result_struct * next;   /**< next result */
+} gm_queued_result_t;
+
+/**
+ * start_result_sender
+ *
+ * start background thread with its own gearman client
+ *
+ * @return true on success
+ */
+int start_result_sender(void);
+
+/**
+ * stop_result_sender
+ *
+ * send all queued results and stop the background thread
+ *
+ * @return nothing
+ */
+void stop_result_sender(void);
+
+/**
+ * request_result_sender_stop
+ *
+ * send further results synchronously, queued results are still sent by
+ * the thread. Only sets flags, so it is safe to use in signal handlers.
+ *
+ * @return nothing
+ */
+void request_result_sender_stop(void);
+
+/**
+ * wait_result_sender_idle
+ *
+ * wait until the thread has sent all queued results. Polls a flag
+ * without locking or joining, so it is safe to use in signal handlers.
+ *
+ * @param[in] msec - maximum time to wait
+ *
+ * @return true if nothing is queued anymore
+ */
+int wait_result_sender_idle(int msec);
+
+/**
+ * queue_result
+ *
+ * add result to the send queue
+ *
+ * @param[in] queue - result queue
+ * @param[in] data - result data
+ *
+ * @return GM_OK if the result has been queued
+ */
+int queue_result(char *queue, char *data);
+
+/**
+ * result_sender_loop
+ *
+ * main loop of the sender thread
+ *
+ * @param[in] arg - unused
+ *
+ * @return nothing
+ */
+void *result_sender_loop(void *arg);
+
+/**
+ * @}
+ */
@@ -40,6 +40,7 @@
 void *result_worker(void *);
 int set_worker( gearman_worker_st *worker );
 void *get_results( gearman_job_st *, void *, size_t *, gearman_return_t * );
+int process_result( char *, gearman_job_st *, struct timeval * );
 #ifdef GM_DEBUG
 void write_debug_file(char ** text);
 #endif
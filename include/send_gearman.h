@@ -106,6 +106,50 @@ int send_result(void);
  */
 int submit_result(void);
 
+/**
+ * build_result
+ *
+ * create result payload from the current options
+ *
+ * @return result, must be freed
+ */
+char * build_result(void);
+
+/**
+ * flush_bulk_results
+ *
+ * send all queued results with a single round trip and report failures
+ *
+ * @param[in] last_line - line number of the last queued result
+ *
+ * @return number of failed results
+ */
+int flush_bulk_results(int last_line);
+
+/**
+ * send_bulk_results
+ *
+ * send a list of results with a single round trip
+ *
+ * @param[in] results - list of result payloads
+ * @param[in] num - number of results, at most GM_MAX_BULK_SIZE
+ * @param[out] failed_results - set to TRUE for every result which could not be sent
+ *
+ * @return number of failed results
+ */
+int send_bulk_results(char ** results, int num, int * failed_results);
+
+/**
+ * parse_result_line
+ *
+ * parse a delimited result line into the current options
+ *
+ * @param[in] line - result line, will be modified
+ *
+ * @return GM_OK on success or GM_ERROR for incomplete lines
+ */
+int parse_result_line(char *line);
+
 /**
  * alarm_sighandler
  *
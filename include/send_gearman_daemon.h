@@ -0,0 +1,188 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/**
+ * @file
+ * @brief send_gearman daemon mode
+ * @addtogroup mod_gearman_send_gearman_daemon send_gearman_daemon
+ *
+ * long running result forwarder. Accepts results in the send_gearman line
+ * format or from send_nsca, buffers them and forwards them in batches over
+ * persistent gearmand connections.
+ *
+ * @{
+ */
+
+#include <poll.h>
+#include <dirent.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "common.h"
+
+#define GM_DAEMON_LINE                 0      /**< client sends delimited result lines */
+#define GM_DAEMON_NSCA                 1      /**< client sends send_nsca packets */
+
+#define GM_DAEMON_MAX_CLIENTS        256      /**< maximum number of concurrent clients */
+#define GM_DAEMON_DEFAULT_BATCH      100      /**< results per round trip if bulk_size is not set */
+#define GM_DAEMON_MAX_BACKOFF         30      /**< maximum seconds between retries when gearmand is down */
+
+#define GM_NSCA_INIT_PACKET_SIZE     132      /**< 128 bytes iv plus timestamp */
+#define GM_NSCA_PACKET_SIZE          720      /**< packet size with 512 bytes plugin output */
+#define GM_NSCA_LARGE_PACKET_SIZE   4304      /**< packet size with 4096 bytes plugin output */
+#define GM_NSCA_PACKET_VERSION         3      /**< supported nsca protocol version */
+
+/** a connected client */
+typedef struct gm_daemon_client {
+    int     fd;                 /**< client socket */
+    int     type;               /**< GM_DAEMON_LINE or GM_DAEMON_NSCA */
+    char  * buf;                /**< received but not yet processed data */
+    int     len;                /**< bytes used in buf */
+    int     size;               /**< allocated size of buf */
+    int     eof;                /**< client closed the connection */
+} gm_daemon_client_t;
+
+/** bounded fifo of result payloads */
+typedef struct gm_result_queue {
+    char ** items;              /**< ring buffer */
+    int     size;               /**< capacity */
+    int     head;               /**< index of the oldest result */
+    int     count;              /**< number of queued results */
+} gm_result_queue_t;
+
+/**
+ * run_daemon
+ *
+ * listen for results and forward them until terminated
+ *
+ * @return exit code
+ */
+int run_daemon(void);
+
+/**
+ * parse_nsca_packet
+ *
+ * verify a send_nsca data packet and store the result in the options
+ *
+ * @param[in] packet - packet data, will be modified
+ * @param[in] size - GM_NSCA_PACKET_SIZE or GM_NSCA_LARGE_PACKET_SIZE
+ *
+ * @return GM_OK on success or GM_ERROR if the packet is invalid
+ */
+int parse_nsca_packet(unsigned char *packet, int size);
+
+/**
+ * nsca_packet_size
+ *
+ * detect the size of the send_nsca packet at the start of the buffer by its checksum
+ *
+ * @param[in] packet - received data
+ * @param[in] len - number of received bytes
+ *
+ * @return packet size, 0 if the packet is incomplete or -1 if it is invalid
+ */
+int nsca_packet_size(unsigned char *packet, int len);
+
+/**
+ * nsca_crc32
+ *
+ * calculate crc32 like nsca does
+ *
+ * @param[in] data - buffer
+ * @param[in] size - buffer size
+ *
+ * @return checksum
+ */
+unsigned long nsca_crc32(const unsigned char *data, int size);
+
+/**
+ * result_queue_push
+ *
+ * append a result to the queue
+ *
+ * @param[in] queue - the queue
+ * @param[in] result - result payload, owned by the queue afterwards
+ *
+ * @return GM_OK or GM_ERROR if the queue is full
+ */
+int result_queue_push(gm_result_queue_t *queue, char *result);
+
+/**
+ * result_queue_push_front
+ *
+ * put a result back in front of the queue, used for failed results
+ *
+ * @param[in] queue - the queue
+ * @param[in] result - result payload, owned by the queue afterwards
+ *
+ * @return GM_OK or GM_ERROR if the queue is full
+ */
+int result_queue_push_front(gm_result_queue_t *queue, char *result);
+
+/**
+ * result_queue_pop
+ *
+ * remove the oldest result from the queue
+ *
+ * @param[in] queue - the queue
+ *
+ * @return result payload which must be freed or NULL if the queue is empty
+ */
+char * result_queue_pop(gm_result_queue_t *queue);
+
+/**
+ * spool_write
+ *
+ * append a result to the current spool file in daemon_spool_dir
+ *
+ * @param[in] result - result payload, not freed
+ *
+ * @return GM_OK or GM_ERROR if the spool file cannot be written
+ */
+int spool_write(char *result);
+
+/**
+ * spool_replay
+ *
+ * move spooled results back into memory, oldest spool file first
+ *
+ * @param[in] queue - the queue to fill until it is full
+ *
+ * @return nothing
+ */
+void spool_replay(gm_result_queue_t *queue);
+
+/**
+ * spool_save
+ *
+ * write buffered results and the unread rest of the spool to a file
+ * which is read first on the next start
+ *
+ * @param[in] queue - the queue, empty afterwards
+ *
+ * @return nothing
+ */
+void spool_save(gm_result_queue_t *queue);
+
+/**
+ * @}
+ */
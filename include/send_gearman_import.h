@@ -0,0 +1,118 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/**
+ * @file
+ * @brief send_gearman spool directory importer
+ * @addtogroup mod_gearman_send_gearman_import send_gearman_import
+ *
+ * sends checkresult files or files in the send_gearman line format from a
+ * spool directory and removes every file once all its results are sent.
+ *
+ * @{
+ */
+
+#include <dirent.h>
+#include <poll.h>
+#include "common.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+#define GM_INOTIFY_IMPORT                 /**< wait for new files instead of polling the directory */
+#include <sys/inotify.h>
+#endif
+
+#define GM_IMPORT_DEFAULT_BATCH       1000    /**< results per round trip if bulk_size is not set */
+#define GM_IMPORT_RESCAN_INTERVAL       10    /**< seconds between directory scans, retries failed files */
+#define GM_IMPORT_POLL_INTERVAL          1    /**< seconds between directory scans without inotify */
+
+#define GM_IMPORT_FORMAT_UNKNOWN         0    /**< no result line seen yet */
+#define GM_IMPORT_FORMAT_CHECKRESULT     1    /**< core checkresult file with key=value lines */
+#define GM_IMPORT_FORMAT_LINE            2    /**< delimited send_gearman lines */
+
+/** a file whose results are part of the current batch */
+typedef struct gm_import_file {
+    char  * path;               /**< full path */
+    int     results;            /**< number of results read */
+    int     failed;             /**< number of results which could not be sent */
+    int     complete;           /**< file has been read completely */
+    FILE  * retry;              /**< failed results, replace the file once it is complete */
+} gm_import_file_t;
+
+/** results waiting for the next round trip */
+typedef struct gm_import_batch {
+    char             ** results;        /**< result payloads */
+    int               * result_file;    /**< index of the file for each result */
+    int                 num;            /**< number of results */
+    int                 size;           /**< maximum number of results */
+    gm_import_file_t  * files;          /**< files of the queued results */
+    int                 file_num;       /**< number of files */
+} gm_import_batch_t;
+
+/**
+ * run_importer
+ *
+ * send all files from the import directory, keep watching in daemon mode
+ *
+ * @return exit code
+ */
+int run_importer(void);
+
+/**
+ * import_file
+ *
+ * read all results of a file into the batch, sends full batches.
+ * checkresult files are only read once their .ok marker exists.
+ *
+ * @param[in] batch - current batch
+ * @param[in] path - file to read
+ *
+ * @return number of results or -1 if the file could not be read or is not complete yet
+ */
+int import_file(gm_import_batch_t *batch, char *path);
+
+/**
+ * import_flush
+ *
+ * send the batch and remove all completely sent files. files with failed
+ * results are replaced by a checkresult file containing only those.
+ *
+ * @param[in] batch - current batch
+ *
+ * @return number of failed results
+ */
+int import_flush(gm_import_batch_t *batch);
+
+/**
+ * parse_checkresult_line
+ *
+ * store a key=value line of a checkresult file in the options
+ *
+ * @param[in] line - line without newline
+ *
+ * @return GM_OK if the key is known or GM_ERROR if not
+ */
+int parse_checkresult_line(char *line);
+
+/**
+ * @}
+ */
@@ -41,6 +41,7 @@
 #include <sys/wait.h>
 #include <libgearman/gearman.h>
 #include "common.h"
+#include "send_multi_parser.h"
 
 /** send_multi
  *
@@ -89,13 +90,16 @@ void print_version(void);
 int verify_options(mod_gm_opt_t *opt);
 
 /**
- * send_result
+ * send_results
  *
- * create and send back the gearman jobs
+ * send all child results with a single round trip
  *
- * @return TRUE on success or FALSE if something went wrong
+ * @param[in] results - list of result payloads
+ * @param[in] num - number of results
+ *
+ * @return number of failed results
  */
-int send_result(void);
+int send_results(char ** results, int num);
 
 /**
  * alarm_sighandler
@@ -111,45 +115,14 @@ void alarm_sighandler(int sig);
 /**
  * read_multi_stream
  *
- * read xml data from stream
+ * read xml data from stream and send all child checks
  *
  * @param[in] stream - file pointer to read xml data from
  *
- * @return TRUE on success or FALSE if something went wrong
+ * @return number of submitted checks or a negative nagios state on errors
  */
 int read_multi_stream(FILE *stream);
 
-/**
- * read_child_check
- *
- * @param[in] bufstart - start of buffer
- * @param[in] bufend   - end of buffer
- * @param[in] end_time - timestruct when check is over
- *
- * @return TRUE on success or FALSE if something went wrong
- */
-int read_child_check(char *bufstart, char *bufend, struct timeval * end_time);
-
-/**
- * read_multi_attribute
- *
- * @param[in] bufstart - start of buffer
- * @param[in] bufend - end of buffer
- * @param[in] attname - name of attribute to read
- *
- * @return value for this attribute
- */
-char *read_multi_attribute(char *bufstart, char *bufend, char *attname);
-
-/**
- * decode_xml
- *
- * @param[in] xml - xml to decode
- *
- * @return decoded string
- */
-char *decode_xml(char * xml);
-
 /**
  * @}
  */
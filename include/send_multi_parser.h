@@ -0,0 +1,145 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ * Copyright (c) 2010 Matthias Flacke - matthias.flacke@gmx.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/**
+ * @file
+ * @brief streaming check_multi xml parser
+ * @addtogroup mod_gearman_send_multi_parser send_multi_parser
+ *
+ * collects the child checks of check_multi xml output, input may be fed
+ * in chunks of any size.
+ *
+ * @{
+ */
+
+#include <sys/time.h>
+#include "common.h"
+
+#define GM_MULTI_TAG_SIZE        256     /**< longest tag we keep, attributes are cut off */
+#define GM_MULTI_PREVIEW_SIZE   4096     /**< input kept for error messages */
+
+#define GM_MULTI_NO                0     /**< child number, 0 is the parent */
+#define GM_MULTI_NAME              1     /**< service description */
+#define GM_MULTI_RC                2     /**< return code */
+#define GM_MULTI_RUNTIME           3     /**< runtime in seconds */
+#define GM_MULTI_OUTPUT            4     /**< plugin output */
+#define GM_MULTI_ERROR             5     /**< plugin stderr */
+#define GM_MULTI_PERFORMANCE       6     /**< performance data */
+#define GM_MULTI_PPLUGIN           7     /**< plugin name for the multi header */
+#define GM_MULTI_FIELDS            8     /**< number of fields read from each child */
+
+/** streaming check_multi xml parser */
+typedef struct gm_multi_parser {
+    int              in_tag;                             /**< inside <...> */
+    char             tag[GM_MULTI_TAG_SIZE];             /**< current tag */
+    int              tag_len;                            /**< length of current tag */
+    int              tags;                               /**< number of tags seen */
+    int              in_child;                           /**< inside <CHILD> */
+    int              field;                              /**< field currently read or -1 */
+    int              found[GM_MULTI_FIELDS];             /**< field exists in current child */
+    char           * value[GM_MULTI_FIELDS];             /**< raw field values */
+    int              value_len[GM_MULTI_FIELDS];         /**< length of field values */
+    int              value_size[GM_MULTI_FIELDS];        /**< allocated size of field values */
+    char          ** results;                            /**< result payloads of complete children */
+    int              num;                                /**< number of results */
+    int              size;                               /**< allocated size of results */
+    char             preview[GM_MULTI_PREVIEW_SIZE+1];   /**< start of input */
+    int              preview_len;                        /**< length of preview */
+    struct timeval   end_time;                           /**< finish time for all children */
+} gm_multi_parser_t;
+
+/**
+ * parse_multi_data
+ *
+ * feed a chunk of xml into the parser, tags and values may span chunks
+ *
+ * @param[in] parser - parser state
+ * @param[in] data - chunk of input
+ * @param[in] len - length of chunk
+ *
+ * @return nothing
+ */
+void parse_multi_data(gm_multi_parser_t *parser, const char *data, size_t len);
+
+/**
+ * handle_multi_tag
+ *
+ * open or close a child or one of its fields
+ *
+ * @param[in] parser - parser state with the complete tag
+ *
+ * @return nothing
+ */
+void handle_multi_tag(gm_multi_parser_t *parser);
+
+/**
+ * append_multi_value
+ *
+ * append raw text to a field of the current child
+ *
+ * @param[in] parser - parser state
+ * @param[in] field - field index
+ * @param[in] data - text
+ * @param[in] len - length of text
+ *
+ * @return nothing
+ */
+void append_multi_value(gm_multi_parser_t *parser, int field, const char *data, size_t len);
+
+/**
+ * build_child_result
+ *
+ * create the result payload of a complete child
+ *
+ * @param[in] parser - parser state with the values of the child
+ *
+ * @return result which must be freed, or NULL for the parent and incomplete children
+ */
+char * build_child_result(gm_multi_parser_t *parser);
+
+/**
+ * free_multi_parser
+ *
+ * free parser buffers and collected results
+ *
+ * @param[in] parser - parser state
+ *
+ * @return nothing
+ */
+void free_multi_parser(gm_multi_parser_t *parser);
+
+/**
+ * decode_xml
+ *
+ * decode xml entities in place with a single pass
+ *
+ * @param[in] xml - xml to decode
+ *
+ * @return decoded string
+ */
+char *decode_xml(char * xml);
+
+/**
+ * @}
+ */
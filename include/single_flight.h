@@ -0,0 +1,127 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief collapse identical concurrent checks on a worker host
+ *
+ *  @{
+ */
+
+#include "common.h"
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#define GM_FLIGHT_NONE                  -1      /**< run the command as usual */
+#define GM_FLIGHT_SHARED                -2      /**< result has been taken from another worker */
+#define GM_FLIGHT_MAX_COMMAND         4096      /**< longer command lines are never collapsed */
+
+#define GM_FLIGHT_FREE                   0      /**< slot is unused */
+#define GM_FLIGHT_RUNNING                1      /**< command is being executed */
+#define GM_FLIGHT_DONE                   2      /**< result is available */
+
+/** one command currently executed by a worker */
+typedef struct gm_flight_slot_struct {
+    int            state;                          /**< GM_FLIGHT_FREE, _RUNNING or _DONE */
+    unsigned int   generation;                     /**< changes whenever the slot is reused */
+    unsigned long  hash;                           /**< hash of the command line */
+    pid_t          pid;                            /**< pid of the executing worker */
+    int            waiters;                        /**< number of workers waiting for the result */
+    int            return_code;                    /**< return code of the plugin */
+    int            early_timeout;                  /**< did the check run into a timeout */
+    int            exited_ok;                      /**< did the plugin exit normally */
+    char           command[GM_FLIGHT_MAX_COMMAND]; /**< command line */
+    char           output[GM_BUFFERSIZE];          /**< plugin output */
+    char           error[GM_BUFFERSIZE];           /**< plugin stderr */
+} gm_flight_slot_t;
+
+/** single flight table, shared by all worker of this host */
+typedef struct gm_flight_table_struct {
+    pthread_mutex_t  mutex;       /**< protects all slots */
+    pthread_cond_t   cond;        /**< signaled when a result is available */
+    int              size;        /**< number of slots */
+    int              shared;      /**< number of results taken from other worker */
+    gm_flight_slot_t slots[];     /**< slots */
+} gm_flight_table_t;
+
+/**
+ * init_single_flight
+ *
+ * create the shared table, must be called before forking the worker
+ *
+ * @param[in] size - number of slots, usually max-worker
+ *
+ * @return GM_OK on success
+ */
+int init_single_flight(int size);
+
+/**
+ * free_single_flight
+ *
+ * unmap the shared table
+ *
+ * @return nothing
+ */
+void free_single_flight(void);
+
+/**
+ * single_flight_join
+ *
+ * either announce the job as running or wait for the result of an
+ * identical command running in another worker. The wait is bounded
+ * by the timeout of the job.
+ *
+ * @param[in] job - job to run
+ *
+ * @return slot number when the caller has to run the command and
+ *         publish the result, GM_FLIGHT_SHARED when the job result has
+ *         been filled in or GM_FLIGHT_NONE to run the command as usual
+ */
+int single_flight_join(gm_job_t *job);
+
+/**
+ * single_flight_done
+ *
+ * publish the result of a job and wake up all waiting worker. Results
+ * larger than the slot are not shared, waiting worker run the command
+ * themselves instead
+ *
+ * @param[in] slot - slot returned from single_flight_join
+ * @param[in] job - finished job
+ *
+ * @return nothing
+ */
+void single_flight_done(int slot, gm_job_t *job);
+
+/**
+ * single_flight_shared
+ *
+ * get number of results taken from other worker
+ *
+ * @return number of shared results
+ */
+int single_flight_shared(void);
+
+/**
+ * @}
+ */
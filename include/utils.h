@@ -46,6 +46,12 @@
 
 #define GM_PERFDATA_QUEUE    "perfdata"  /**< default performance data queue */
 
+/** optional asynchronous result sender, returns GM_OK if the result has been queued */
+extern int (*gm_result_sender)(char *queue, char *data);
+
+/** increased whenever the path restrictions change */
+extern int restrict_options_version;
+
 /**
  * escpae newlines
  *
@@ -238,6 +244,42 @@ void mod_gm_free_opt(mod_gm_opt_t *opt);
  */
 int read_keyfile(mod_gm_opt_t *opt);
 
+/**
+ * compare_options
+ *
+ * compare option structures of a config reload
+ *
+ * @param[in] old_opt - currently used options
+ * @param[in] new_opt - reloaded options
+ *
+ * @return GM_RELOAD_NONE, GM_RELOAD_QUEUES if only queues changed or GM_RELOAD_RESTART
+ */
+int compare_options(mod_gm_opt_t *old_opt, mod_gm_opt_t *new_opt);
+
+/**
+ * is_queue_option
+ *
+ * check if option only changes the registered queues
+ *
+ * @param[in] key - option name
+ *
+ * @return true if its a queue option
+ */
+int is_queue_option(char *key);
+
+/**
+ * hash_option
+ *
+ * add option to a fingerprint
+ *
+ * @param[in] hash - current fingerprint
+ * @param[in] key - option name
+ * @param[in] value - option value, may be NULL
+ *
+ * @return new fingerprint
+ */
+unsigned long hash_option(unsigned long hash, char *key, char *value);
+
 /**
  * string2timeval
  *
@@ -415,6 +457,20 @@ char * eventtype2str(int i);
  */
 void gm_log( int lvl, const char *text, ... );
 
+/**
+ * GM_LOG_ENABLED
+ *
+ * true if messages of this level would be logged
+ */
+#define GM_LOG_ENABLED(lvl) ((lvl) == GM_LOG_ERROR || mod_gm_opt == NULL || (lvl) <= mod_gm_opt->debug_level)
+
+/**
+ * GM_LOG
+ *
+ * same as gm_log, but the arguments are only evaluated if the level is enabled
+ */
+#define GM_LOG(lvl, ...) do { if(GM_LOG_ENABLED(lvl)) gm_log(lvl, __VA_ARGS__); } while(0)
+
 /**
  * write_core_log
  *
@@ -512,6 +568,40 @@ int read_filepointer(char **, FILE*);
  */
 int read_pipe(char **, int);
 
+/**
+ * build_multi_result
+ *
+ * pack multiple results into a single result packet
+ *
+ * @param[in] results - list of results
+ * @param[in] num - number of results
+ *
+ * @return malloced packet
+ */
+char *build_multi_result(char **results, int num);
+
+/**
+ * parse_multi_result_header
+ *
+ * check for a multi result packet and skip its header
+ *
+ * @param[in,out] data - packet, will point behind the header
+ *
+ * @return format version, 0 for single results and -1 for broken headers
+ */
+int parse_multi_result_header(char **data);
+
+/**
+ * next_multi_result
+ *
+ * get next result from a multi result packet. The packet will be modified.
+ *
+ * @param[in,out] data - remaining packet
+ *
+ * @return next result or NULL
+ */
+char *next_multi_result(char **data);
+
 /**
  * @}
  */
@@ -46,12 +46,27 @@
 
 int mod_gm_shm_key;             /**< key for the shared memory segment */
 
-#define SHM_SHIFT             5 /**< nr of global counter              */
+#define SHM_SHIFT            21 /**< nr of global counter              */
 #define SHM_JOBS_DONE         0 /**< shm id for jobs done counter      */
 #define SHM_WORKER_TOTAL      1 /**< shm id for total worker counter   */
 #define SHM_WORKER_RUNNING    2 /**< shm id for running worker counter */
 #define SHM_STATUS_WORKER_PID 3 /**< shm id for status worker pid      */
 #define SHM_WORKER_LAST_CHECK 4 /**< shm time of last check executed   */
+#define SHM_WORKER_BUSY_SINCE 5 /**< shm msec timestamp of the first unanswered busy signal */
+#define SHM_SCALE_UP_HIST     6 /**< shm id of the first scale up latency histogram bucket  */
+#define SHM_SCALE_UP_BUCKETS 12 /**< number of scale up latency histogram buckets           */
+#define SHM_EPN_CACHE_HITS   18 /**< shm id for epn decisions taken from the cache */
+#define SHM_EPN_CACHE_MISSES 19 /**< shm id for epn decisions read from the plugin */
+#define SHM_EPN_COMPILE_MSEC 20 /**< shm id for milliseconds spent compiling perl plugins */
+
+#define GM_ROLLING_RESTART_PARTS 10 /**< restart a tenth of the worker at once after a reload */
+
+/** upper bounds of the scale up latency buckets in ms, 0 means infinite */
+#define GM_SCALE_UP_BUCKET_LIMITS { 1, 2, 5, 10, 25, 50, 100, 250, 500, 1000, 5000, 0 }
+
+#if defined(HAVE_SYS_SIGNALFD_H) && defined(HAVE_SYS_EVENTFD_H)
+#define GM_EVENT_SUPERVISOR     /**< supervisor waits for events instead of polling */
+#endif
 
 /** Mod-Gearman Worker
  *
@@ -130,6 +145,14 @@ int  adjust_number_of_worker(int min, int max, int cur_workers, int cur_jobs);
  */
 void setup_child_communicator(void);
 
+/**
+ * compile the configured perl plugins once in the main process,
+ * forked worker share the compiled plugins.
+ *
+ * @return nothing
+ */
+void precompile_perl_plugins(void);
+
 /**
  * finish and clean all children and shared memory segments, then exit.
  *
@@ -164,6 +187,29 @@ int verify_options(mod_gm_opt_t *opt);
  */
 void reload_config(int sig);
 
+/**
+ * read options from the original command line into a new options
+ * structure, used to find out what a reload has to change
+ *
+ * @return new options or NULL on errors
+ */
+mod_gm_opt_t *read_worker_options(void);
+
+/**
+ * remember all running worker, they will be replaced step by step
+ *
+ * @return nothing
+ */
+void start_rolling_restart(void);
+
+/**
+ * stop the next worker of a rolling restart, at most a tenth of the
+ * worker are restarting at the same time
+ *
+ * @return nothing
+ */
+void continue_rolling_restart(void);
+
 /**
  * stop all child
  *
@@ -187,6 +233,22 @@ void monitor_loop(void);
  */
 void check_worker_population(void);
 
+/**
+ * stop one idle worker if there are more than max_spare_workers idle
+ *
+ * @return nothing
+ */
+void retire_spare_worker(void);
+
+/**
+ * add a scale up latency to the shared memory histogram
+ *
+ * @param[in] msec - milliseconds between busy signal and new worker
+ *
+ * @return nothing
+ */
+void record_scale_up_latency(int msec);
+
 /**
  * returns next number of the shared memory segment for a new child
  *
@@ -45,6 +45,15 @@
 #define GM_WORKER_STANDALONE    1
 #define GM_WORKER_STATUS        2
 
+#define GM_MSEC_TIMESTAMP_WRAP  2000000000 /**< msec timestamps wrap around at this value */
+
+#define GM_WORKER_RELOAD_SIGNAL SIGUSR1    /**< tells worker to re-register their queues */
+
+#define GM_BUSY_PERCENT         90         /**< more worker are started above this percentage of running worker */
+#define GM_BUSY_IDLE_WORKER     2          /**< more worker are started if no more than this number of worker is idle */
+
+extern int gm_busy_eventfd;     /**< eventfd to tell the supervisor that all worker are busy */
+
 #ifdef EMBEDDEDPERL
 void worker_client(int worker_mode, int indx, int shid, char**env);
 #else
@@ -53,11 +62,26 @@ void worker_client(int worker_mode, int indx, int shid);
 void worker_loop(void);
 void *get_job( gearman_job_st *, void *, size_t *, gearman_return_t * );
 void do_exec_job(void);
+int prefetch_job(gm_job_t *job);
+void run_window_job(void);
+void send_stale_result(gm_job_t *job, char *reason);
 int set_worker( gearman_worker_st *worker );
+void register_job_functions( gearman_worker_st *w );
+void add_job_function( gearman_worker_st *w, char *queue );
+void reload_worker_queues(void);
 void exit_sighandler(int sig);
 void idle_sighandler(int sig);
+void stop_sighandler(int sig);
+void reload_sighandler(int sig);
 void set_state(int status);
+void signal_busy_worker(int *shm);
+int is_spare_worker_needed(void);
+int worker_pool_busy(int workers, int jobs, int min_spare);
+int worker_pool_surplus(int workers, int jobs, int min_worker, int max_spare);
+int limit_spare_worker(int target, int workers, int jobs, int max_spare);
+int get_msec_timestamp(void);
 void clean_worker_exit(int sig);
+void worker_exit(int status);
 void *return_status( gearman_job_st *, void *, size_t *, gearman_return_t *);
 #ifdef GM_DEBUG
 void write_debug_file(char ** text);
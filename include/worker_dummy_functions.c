@@ -12,3 +12,9 @@ char * nebcallback2str(int i) {
 char * eventtype2str(int i) {
     return strdup("UNKNOWN");
 }
+
+/* worker reread their options on reloads, defined in worker.c */
+struct mod_gm_opt_struct * read_worker_options(void);
+struct mod_gm_opt_struct * read_worker_options(void) {
+    return NULL;
+}
@@ -0,0 +1,177 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/** @file
+ *  @brief worker metrics in prometheus text format
+ *
+ *  @{
+ */
+
+#include "common.h"
+#include "histogram.h"
+
+#include <pthread.h>
+
+#define GM_METRICS_REQUEST_TIMEOUT     100      /**< milliseconds a scraper may take for the whole request */
+#define GM_METRICS_BUFFERSIZE       131072      /**< maximum size of a metrics response */
+
+/** upper bounds of the histogram buckets in seconds, the last bucket is +Inf */
+#define GM_METRICS_BUCKET_LIMITS { 0.01, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60 }
+
+#define GM_METRIC_SPAWNED                0      /**< worker started by the supervisor */
+#define GM_METRIC_REAPED                 1      /**< worker exited */
+#define GM_METRIC_RECONNECTS             2      /**< reconnects to gearmand */
+#define GM_METRIC_COUNTERS               3      /**< number of plain counters */
+
+/** metrics of one queue */
+typedef struct gm_queue_metrics_struct {
+    unsigned long long jobs;                          /**< executed jobs */
+    unsigned long long timeouts;                      /**< jobs which ran into a timeout */
+    gm_histogram_t     exec_time;                     /**< execution time */
+} gm_queue_metrics_t;
+
+/** scoreboard shared by all worker */
+typedef struct gm_metrics_struct {
+    pthread_mutex_t       mutex;                         /**< protects adding queues */
+    gm_histogram_queues_t queue_names;                   /**< names of the queues */
+    gm_queue_metrics_t    queues[GM_HISTOGRAM_QUEUES];   /**< per queue metrics */
+    gm_histogram_t        result_send;                   /**< time from check end until the result is sent */
+    unsigned long long    counters[GM_METRIC_COUNTERS];  /**< plain counters */
+} gm_metrics_t;
+
+/**
+ * init_metrics
+ *
+ * create the shared scoreboard, must be called before forking the worker
+ *
+ * @return GM_OK on success
+ */
+int init_metrics(void);
+
+/**
+ * free_metrics
+ *
+ * unmap the scoreboard
+ *
+ * @return nothing
+ */
+void free_metrics(void);
+
+/**
+ * metrics_inc
+ *
+ * increase a counter
+ *
+ * @param[in] counter - GM_METRIC_SPAWNED, GM_METRIC_REAPED or GM_METRIC_RECONNECTS
+ *
+ * @return nothing
+ */
+void metrics_inc(int counter);
+
+/**
+ * metrics_job_done
+ *
+ * account an executed job
+ *
+ * @param[in] job - finished job
+ *
+ * @return nothing
+ */
+void metrics_job_done(gm_job_t *job);
+
+/**
+ * metrics_result_sent
+ *
+ * account the time it took to send a result
+ *
+ * @param[in] finished - time the check has been finished or the result queued
+ *
+ * @return nothing
+ */
+void metrics_result_sent(struct timeval *finished);
+
+/**
+ * format_metrics
+ *
+ * write all metrics in prometheus text format
+ *
+ * @param[out] buf - output buffer
+ * @param[in] size - size of the buffer
+ * @param[in] shm - worker shared memory with the population counters
+ *
+ * @return length of the output
+ */
+int format_metrics(char *buf, int size, int *shm);
+
+/**
+ * open_metrics_listener
+ *
+ * listen on a unix socket (unix:/path) or tcp address (host:port)
+ *
+ * @param[in] address - listen address
+ *
+ * @return file descriptor or -1 on errors
+ */
+int open_metrics_listener(char *address);
+
+/**
+ * close_metrics_listener
+ *
+ * close listener and remove the unix socket
+ *
+ * @param[in] fd - listener
+ *
+ * @return nothing
+ */
+void close_metrics_listener(int fd);
+
+/**
+ * handle_metrics_request
+ *
+ * accept a connection and answer a http request with the metrics. The
+ * whole request may take GM_METRICS_REQUEST_TIMEOUT milliseconds, slow
+ * scrapers get no or a truncated response.
+ *
+ * @param[in] fd - listener
+ * @param[in] shm - worker shared memory with the population counters
+ *
+ * @return nothing
+ */
+void handle_metrics_request(int fd, int *shm);
+
+/**
+ * serve_metrics
+ *
+ * wait for a scraper and answer its request
+ *
+ * @param[in] fd - listener
+ * @param[in] shm - worker shared memory with the population counters
+ * @param[in] timeout - maximum seconds to wait
+ *
+ * @return nothing
+ */
+void serve_metrics(int fd, int *shm, int timeout);
+
+/**
+ * @}
+ */
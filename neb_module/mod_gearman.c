@@ -25,6 +25,8 @@
 #include "result_thread.h"
 #include "mod_gearman.h"
 #include "gearman_utils.h"
+#include "log_ring.h"
+#include "job_trace.h"
 
 /* specify event broker API version (required) */
 NEB_API_VERSION( CURRENT_NEB_API_VERSION )
@@ -59,8 +61,16 @@ extern int            log_notifications;
 static check_result * mod_gm_result_list = 0;
 #endif
 #if defined(USENAEMON) || defined(USENAGIOS4)
-static objectlist * mod_gm_result_list = 0;
-#endif
+/* check result waiting to be handed over to the core */
+typedef struct gm_result_list_struct {
+    check_result                 * result;      /**< check result */
+    int                            trace_slot;  /**< job trace queue slot or -1 */
+    struct timeval                 received;    /**< time the result thread received the result */
+    struct gm_result_list_struct * next;        /**< next result */
+} gm_result_list_t;
+static gm_result_list_t * mod_gm_result_list = 0;
+#endif
+static time_t trace_file_written = 0;
 static pthread_mutex_t mod_gm_result_list_mutex = PTHREAD_MUTEX_INITIALIZER;
 void *gearman_module_handle=NULL;
 gearman_client_st client;
@@ -86,6 +96,8 @@ static int   handle_process_events( int, void * );
 static int   handle_timed_events( int, void * );
 #endif
 static void  start_threads(void);
+static char *trace_id_line(char *buf, int size);
+static void  write_job_trace(int force);
 #ifdef USENAGIOS3
 static check_result * merge_result_lists(check_result * lista, check_result * listb);
 static void move_results_to_core_3x(void);
@@ -118,10 +130,10 @@ int nebmodule_init( int flags, char *args, nebmodule *handle ) {
     set_default_options(mod_gm_opt);
 
     /* parse arguments */
-    gm_log( GM_LOG_DEBUG, "Version %s\n", GM_VERSION );
-    gm_log( GM_LOG_DEBUG, "args: %s\n", args );
-    gm_log( GM_LOG_TRACE, "nebmodule_init(%i, %i)\n", flags );
-    gm_log( GM_LOG_DEBUG, "running on libgearman %s\n", gearman_version() );
+    GM_LOG( GM_LOG_DEBUG, "Version %s\n", GM_VERSION );
+    GM_LOG( GM_LOG_DEBUG, "args: %s\n", args );
+    GM_LOG( GM_LOG_TRACE, "nebmodule_init(%i, %i)\n", flags );
+    GM_LOG( GM_LOG_DEBUG, "running on libgearman %s\n", gearman_version() );
 
     if( read_arguments( args ) == GM_ERROR )
         return NEB_ERROR;
@@ -183,6 +195,9 @@ int nebmodule_init( int flags, char *args, nebmodule *handle ) {
     }
     current_client = &client;
 
+    if(mod_gm_opt->job_trace == GM_ENABLED)
+        init_job_trace();
+
     /* register callback for process event where everything else starts */
     neb_register_callback( NEBCALLBACK_PROCESS_DATA, gearman_module_handle, 0, handle_process_events );
 #ifdef USENAGIOS
@@ -206,7 +221,7 @@ int nebmodule_init( int flags, char *args, nebmodule *handle ) {
         mod_gm_opt->logmode = logmode_saved;
     }
 
-    gm_log( GM_LOG_DEBUG, "finished initializing\n" );
+    GM_LOG( GM_LOG_DEBUG, "finished initializing\n" );
 
     return NEB_OK;
 }
@@ -236,7 +251,7 @@ static void register_neb_callbacks(void) {
     if ( mod_gm_opt->notifications == GM_ENABLED )
         neb_register_callback( NEBCALLBACK_CONTACT_NOTIFICATION_METHOD_DATA, gearman_module_handle, 0, handle_notifications );
 
-    gm_log( GM_LOG_DEBUG, "registered neb callbacks\n" );
+    GM_LOG( GM_LOG_DEBUG, "registered neb callbacks\n" );
 }
 
 
@@ -244,7 +259,7 @@ static void register_neb_callbacks(void) {
 int nebmodule_deinit( int flags, int reason ) {
     int x;
 
-    gm_log( GM_LOG_TRACE, "nebmodule_deinit(%i, %i)\n", flags, reason );
+    GM_LOG( GM_LOG_TRACE, "nebmodule_deinit(%i, %i)\n", flags, reason );
 
     /* should be removed already, but just for the case it wasn't */
     neb_deregister_callback( NEBCALLBACK_PROCESS_DATA, gearman_module_handle );
@@ -277,7 +292,7 @@ int nebmodule_deinit( int flags, int reason ) {
 
     neb_deregister_callback( NEBCALLBACK_PROCESS_DATA, gearman_module_handle );
 
-    gm_log( GM_LOG_DEBUG, "deregistered callbacks\n" );
+    GM_LOG( GM_LOG_DEBUG, "deregistered callbacks\n" );
 
     /* stop result threads */
     for(x = 0; x < result_threads_running; x++) {
@@ -288,6 +303,13 @@ int nebmodule_deinit( int flags, int reason ) {
     /* cleanup */
     free_client(&client);
 
+    /* last update of the segment histograms */
+    write_job_trace(TRUE);
+    free_job_trace();
+
+    /* stop log writer before the module gets unloaded */
+    log_ring_stop();
+
     /* close old logfile */
     if(mod_gm_opt->logfile_fp != NULL) {
         fclose(mod_gm_opt->logfile_fp);
@@ -312,7 +334,7 @@ static int handle_timed_events( int event_type, void *data ) {
     if (ted->event_type != EVENT_CHECK_REAPER)
         return NEB_OK;
 
-    gm_log( GM_LOG_TRACE, "handle_timed_events(%i, data)\n", event_type, ted->event_type );
+    GM_LOG( GM_LOG_TRACE, "handle_timed_events(%i, data)\n", event_type, ted->event_type );
 
 #ifdef USENAGIOS3
     move_results_to_core_3x();
@@ -353,7 +375,7 @@ static void move_results_to_core(struct nm_event_execution_properties *evprop) {
 #ifdef USENAGIOS4
 static void move_results_to_core() {
 #endif
-    objectlist *tmp_list = NULL;
+    gm_result_list_t *tmp_list = NULL;
 #ifdef USENAEMON
     if(evprop->execution_type == EVENT_EXEC_NORMAL) {
 #endif
@@ -362,15 +384,19 @@ static void move_results_to_core() {
 
     for( ; mod_gm_result_list; mod_gm_result_list = mod_gm_result_list->next) {
         free(tmp_list);
-        process_check_result(mod_gm_result_list->object_ptr);
-        free_check_result(mod_gm_result_list->object_ptr);
-        free(mod_gm_result_list->object_ptr);
+        process_check_result(mod_gm_result_list->result);
+        if(mod_gm_result_list->trace_slot >= 0)
+            trace_observe_since(mod_gm_result_list->trace_slot, GM_TRACE_CORE, &mod_gm_result_list->received);
+        free_check_result(mod_gm_result_list->result);
+        free(mod_gm_result_list->result);
         tmp_list = mod_gm_result_list;
     }
     mod_gm_result_list = 0;
     free(tmp_list);
 
     pthread_mutex_unlock(&mod_gm_result_list_mutex);
+
+    write_job_trace(FALSE);
 #ifdef USENAEMON
         schedule_event(1, move_results_to_core, NULL);
     }
@@ -391,23 +417,35 @@ static void move_results_to_core_3x() {
 
    /* merge local into check_result_list, store in check_result_list */
    check_result_list = merge_result_lists(local, check_result_list);
+
+   write_job_trace(FALSE);
 }
 #endif
 
 /* add list to gearman result list */
 #if defined(USENAEMON) || defined(USENAGIOS4)
-void mod_gm_add_result_to_list(check_result * newcr) {
+void mod_gm_add_result_to_list(check_result * newcr, int trace_slot, struct timeval *received) {
+    gm_result_list_t *item = gm_malloc(sizeof(gm_result_list_t));
+    item->result     = newcr;
+    item->trace_slot = received != NULL ? trace_slot : -1;
+    if(received != NULL)
+        item->received = *received;
     pthread_mutex_lock(&mod_gm_result_list_mutex);
-    add_object_to_objectlist(&mod_gm_result_list, newcr);
+    item->next         = mod_gm_result_list;
+    mod_gm_result_list = item;
     pthread_mutex_unlock(&mod_gm_result_list_mutex);
 }
 #endif
 
 /* add list to gearman result list */
 #ifdef USENAGIOS3
-void mod_gm_add_result_to_list(check_result * newcr) {
+void mod_gm_add_result_to_list(check_result * newcr, int trace_slot, struct timeval *received) {
    check_result ** curp;
 
+   /* results are merged into the core list, so there is no handover to measure */
+   trace_slot = trace_slot;
+   received   = received;
+
    assert(newcr);
 
    pthread_mutex_lock(&mod_gm_result_list_mutex);
@@ -428,7 +466,7 @@ static int handle_process_events( int event_type, void *data ) {
     int x=0;
     struct nebstruct_process_struct *ps;
 
-    gm_log( GM_LOG_TRACE, "handle_process_events(%i, data)\n", event_type );
+    GM_LOG( GM_LOG_TRACE, "handle_process_events(%i, data)\n", event_type );
 
     ps = ( struct nebstruct_process_struct * )data;
     if ( ps->type == NEBTYPE_PROCESS_EVENTLOOPSTART ) {
@@ -492,7 +530,7 @@ static int handle_eventhandler( int event_type, void *data ) {
     struct timeval core_time;
     gettimeofday(&core_time,NULL);
 
-    gm_log( GM_LOG_TRACE, "handle_eventhandler(%i, data)\n", event_type );
+    GM_LOG( GM_LOG_TRACE, "handle_eventhandler(%i, data)\n", event_type );
 
     if ( event_type != NEBCALLBACK_EVENT_HANDLER_DATA )
         return NEB_OK;
@@ -500,12 +538,12 @@ static int handle_eventhandler( int event_type, void *data ) {
     ds = ( nebstruct_event_handler_data * )data;
 
     if ( ds->type != NEBTYPE_EVENTHANDLER_START ) {
-        gm_log( GM_LOG_TRACE, "skiped type %i, expecting: %i\n", ds->type, NEBTYPE_EVENTHANDLER_START );
+        GM_LOG( GM_LOG_TRACE, "skiped type %i, expecting: %i\n", ds->type, NEBTYPE_EVENTHANDLER_START );
         return NEB_OK;
     }
 
-    gm_log( GM_LOG_DEBUG, "got eventhandler event\n" );
-    gm_log( GM_LOG_TRACE, "got eventhandler event: %s\n", ds->command_line );
+    GM_LOG( GM_LOG_DEBUG, "got eventhandler event\n" );
+    GM_LOG( GM_LOG_TRACE, "got eventhandler event: %s\n", ds->command_line );
 
     /* service event handler? */
     if(ds->service_description != NULL) {
@@ -529,9 +567,9 @@ static int handle_eventhandler( int event_type, void *data ) {
     set_target_queue( hst, svc );
     if(!strcmp( target_queue, "" )) {
         if(svc != NULL) {
-            gm_log( GM_LOG_DEBUG, "passing by local service eventhandler: %s - %s\n", svc->host_name, svc->description );
+            GM_LOG( GM_LOG_DEBUG, "passing by local service eventhandler: %s - %s\n", svc->host_name, svc->description );
         } else {
-            gm_log( GM_LOG_DEBUG, "passing by local host eventhandler: %s\n", hst->name );
+            GM_LOG( GM_LOG_DEBUG, "passing by local host eventhandler: %s\n", hst->name );
         }
         return NEB_OK;
     }
@@ -541,7 +579,7 @@ static int handle_eventhandler( int event_type, void *data ) {
         snprintf( target_queue, GM_BUFFERSIZE-1, "eventhandler" );
     }
 
-    gm_log( GM_LOG_DEBUG, "eventhandler for queue %s\n", target_queue );
+    GM_LOG( GM_LOG_DEBUG, "eventhandler for queue %s\n", target_queue );
 
     temp_buffer[0]='\x0';
     snprintf( temp_buffer,GM_BUFFERSIZE-1,
@@ -561,10 +599,10 @@ static int handle_eventhandler( int event_type, void *data ) {
                          mod_gm_opt->transportmode,
                          FALSE
                         ) == GM_OK) {
-        gm_log( GM_LOG_TRACE, "handle_eventhandler() finished successfully\n" );
+        GM_LOG( GM_LOG_TRACE, "handle_eventhandler() finished successfully\n" );
     }
     else {
-        gm_log( GM_LOG_TRACE, "handle_eventhandler() finished unsuccessfully\n" );
+        GM_LOG( GM_LOG_TRACE, "handle_eventhandler() finished unsuccessfully\n" );
     }
 
     /* tell naemon to not execute */
@@ -591,7 +629,7 @@ static int handle_notifications( int event_type, void *data ) {
     struct timeval core_time;
     gettimeofday(&core_time,NULL);
 
-    gm_log( GM_LOG_TRACE, "handle_notifications(%i, data)\n", event_type );
+    GM_LOG( GM_LOG_TRACE, "handle_notifications(%i, data)\n", event_type );
 
     if ( event_type != NEBCALLBACK_CONTACT_NOTIFICATION_METHOD_DATA)
         return NEB_OK;
@@ -599,7 +637,7 @@ static int handle_notifications( int event_type, void *data ) {
     ds = ( nebstruct_contact_notification_method_data * )data;
 
     if ( ds->type != NEBTYPE_CONTACTNOTIFICATIONMETHOD_START) {
-        gm_log( GM_LOG_TRACE, "skiped type %i, expecting: %i\n", ds->type,  NEBTYPE_CONTACTNOTIFICATIONMETHOD_START);
+        GM_LOG( GM_LOG_TRACE, "skiped type %i, expecting: %i\n", ds->type,  NEBTYPE_CONTACTNOTIFICATIONMETHOD_START);
         return NEB_OK;
     }
 
@@ -613,23 +651,23 @@ static int handle_notifications( int event_type, void *data ) {
             gm_log( GM_LOG_ERROR, "Notification handler received NULL host object pointer.\n" );
             return NEB_OK;
         }
-        gm_log( GM_LOG_DEBUG, "got notifications event, service: %s - %s for contact %s\n", ds->host_name, ds->service_description, ds->contact_name );
+        GM_LOG( GM_LOG_DEBUG, "got notifications event, service: %s - %s for contact %s\n", ds->host_name, ds->service_description, ds->contact_name );
     }
     else {
         if((hst=ds->object_ptr)==NULL) {
             gm_log( GM_LOG_ERROR, "Notification handler received NULL host object pointer.\n" );
             return NEB_OK;
         }
-        gm_log( GM_LOG_DEBUG, "got notifications event, host: %s for contact %s\n", ds->host_name, ds->contact_name );
+        GM_LOG( GM_LOG_DEBUG, "got notifications event, host: %s for contact %s\n", ds->host_name, ds->contact_name );
     }
 
     /* local eventhandler? */
     set_target_queue( hst, svc );
     if(!strcmp( target_queue, "" )) {
         if(svc != NULL) {
-            gm_log( GM_LOG_DEBUG, "passing by local service notification: %s - %s\n", svc->host_name, svc->description );
+            GM_LOG( GM_LOG_DEBUG, "passing by local service notification: %s - %s\n", svc->host_name, svc->description );
         } else {
-            gm_log( GM_LOG_DEBUG, "passing by local host notification: %s\n", hst->name );
+            GM_LOG( GM_LOG_DEBUG, "passing by local host notification: %s\n", hst->name );
         }
         return NEB_OK;
     }
@@ -783,10 +821,10 @@ static int handle_notifications( int event_type, void *data ) {
                          mod_gm_opt->transportmode,
                          FALSE
                         ) == GM_OK) {
-        gm_log( GM_LOG_TRACE, "handle_notifications() finished successfully\n" );
+        GM_LOG( GM_LOG_TRACE, "handle_notifications() finished successfully\n" );
     }
     else {
-        gm_log( GM_LOG_TRACE, "handle_notifications() finished unsuccessfully\n" );
+        GM_LOG( GM_LOG_TRACE, "handle_notifications() finished unsuccessfully\n" );
     }
 
     /* clean up */
@@ -926,20 +964,22 @@ static int handle_host_check( int event_type, void *data ) {
     struct timeval core_time;
     struct tm next_check;
     char buffer1[GM_BUFFERSIZE];
+    char trace_line[GM_TRACE_ID_SIZE+16];
+    struct timeval next_check_time;
 #if defined(USENAEMON) || defined(USENAGIOS4)
     nagios_macros mac;
 #endif
 
     gettimeofday(&core_time,NULL);
 
-    gm_log( GM_LOG_TRACE, "handle_host_check(%i)\n", event_type );
+    GM_LOG( GM_LOG_TRACE, "handle_host_check(%i)\n", event_type );
 
     if ( mod_gm_opt->do_hostchecks != GM_ENABLED )
         return NEB_OK;
 
     hostdata = ( nebstruct_host_check_data * )data;
 
-    gm_log( GM_LOG_TRACE, "---------------\nhost Job -> %i, %i\n", event_type, hostdata->type );
+    GM_LOG( GM_LOG_TRACE, "---------------\nhost Job -> %i, %i\n", event_type, hostdata->type );
 
     if ( event_type != NEBCALLBACK_HOST_CHECK_DATA )
         return NEB_OK;
@@ -958,11 +998,11 @@ static int handle_host_check( int event_type, void *data ) {
 
     /* local check? */
     if(!strcmp( target_queue, "" )) {
-        gm_log( GM_LOG_DEBUG, "passing by local hostcheck: %s\n", hostdata->host_name );
+        GM_LOG( GM_LOG_DEBUG, "passing by local hostcheck: %s\n", hostdata->host_name );
         return NEB_OK;
     }
 
-    gm_log( GM_LOG_DEBUG, "received job for queue %s: %s\n", target_queue, hostdata->host_name );
+    GM_LOG( GM_LOG_DEBUG, "received job for queue %s: %s\n", target_queue, hostdata->host_name );
 
     /* as we have to intercept host checks so early
      * (we cannot cancel checks otherwise)
@@ -1035,7 +1075,7 @@ static int handle_host_check( int event_type, void *data ) {
     if(mod_gm_opt->debug_level >= GM_LOG_DEBUG) {
         localtime_r(&hst->next_check, &next_check);
         strftime(buffer1, sizeof(buffer1), "%Y-%m-%d %H:%M:%S", &next_check );
-        gm_log( GM_LOG_DEBUG, "host: '%s', next_check is at %s, latency so far: %i\n", hst->name, buffer1, ((int)core_time.tv_sec - (int)hst->next_check));
+        GM_LOG( GM_LOG_DEBUG, "host: '%s', next_check is at %s, latency so far: %i\n", hst->name, buffer1, ((int)core_time.tv_sec - (int)hst->next_check));
     }
 
     /* increment number of host checks that are currently running */
@@ -1044,15 +1084,20 @@ static int handle_host_check( int event_type, void *data ) {
     /* set the execution flag */
     hst->is_executing=TRUE;
 
-    gm_log( GM_LOG_TRACE, "cmd_line: %s\n", processed_command );
+    GM_LOG( GM_LOG_TRACE, "cmd_line: %s\n", processed_command );
 
-    snprintf( temp_buffer,GM_BUFFERSIZE-1,"type=host\nresult_queue=%s\nhost_name=%s\nstart_time=%lf\nnext_check=%lf\ntimeout=%d\ncore_time=%lf\ncommand_line=%s\n\n\n",
+    /* next_check is a time_t */
+    next_check_time.tv_sec  = hst->next_check;
+    next_check_time.tv_usec = 0;
+
+    snprintf( temp_buffer,GM_BUFFERSIZE-1,"type=host\nresult_queue=%s\nhost_name=%s\nstart_time=%lf\nnext_check=%lf\ntimeout=%d\ncore_time=%lf\n%scommand_line=%s\n\n\n",
               mod_gm_opt->result_queue,
               hst->name,
-              timeval2double(&hst->next_check),
-              timeval2double(&hst->next_check),
+              timeval2double(&next_check_time),
+              timeval2double(&next_check_time),
               host_check_timeout,
               timeval2double(&core_time),
+              trace_id_line(trace_line, sizeof(trace_line)),
               processed_command
             );
 
@@ -1066,6 +1111,8 @@ static int handle_host_check( int event_type, void *data ) {
                          mod_gm_opt->transportmode,
                          TRUE
                         ) == GM_OK) {
+        if(mod_gm_opt->job_trace == GM_ENABLED)
+            trace_observe_since(trace_queue(target_queue), GM_TRACE_SUBMIT, &core_time);
     }
     else {
         my_free(raw_command);
@@ -1080,7 +1127,7 @@ static int handle_host_check( int event_type, void *data ) {
         /* decrement number of host checks that are currently running */
         currently_running_host_checks--;
 
-        gm_log( GM_LOG_TRACE, "handle_host_check() finished unsuccessfully -> %d\n", NEBERROR_CALLBACKCANCEL );
+        GM_LOG( GM_LOG_TRACE, "handle_host_check() finished unsuccessfully -> %d\n", NEBERROR_CALLBACKCANCEL );
         return NEBERROR_CALLBACKCANCEL;
     }
 
@@ -1094,7 +1141,7 @@ static int handle_host_check( int event_type, void *data ) {
     /* orphaned check - submit fake result to mark host as orphaned */
 #ifdef USENAGIOS
     if(mod_gm_opt->orphan_host_checks == GM_ENABLED && check_options & CHECK_OPTION_ORPHAN_CHECK) {
-        gm_log( GM_LOG_DEBUG, "host check for %s orphaned\n", hst->name );
+        GM_LOG( GM_LOG_DEBUG, "host check for %s orphaned\n", hst->name );
         if ( ( chk_result = ( check_result * )gm_malloc( sizeof *chk_result ) ) == 0 )
             return NEBERROR_CALLBACKCANCEL;
         snprintf( temp_buffer,GM_BUFFERSIZE-1,"(host check orphaned, is the mod-gearman worker on queue '%s' running?)\n", target_queue);
@@ -1112,13 +1159,13 @@ static int handle_host_check( int event_type, void *data ) {
         chk_result->start_time.tv_sec   = (unsigned long)time(NULL);
         chk_result->finish_time.tv_sec  = (unsigned long)time(NULL);
         chk_result->latency             = 0;
-        mod_gm_add_result_to_list( chk_result );
+        mod_gm_add_result_to_list( chk_result, -1, NULL );
         chk_result = NULL;
     }
 #endif
 
     /* tell naemon to not execute */
-    gm_log( GM_LOG_TRACE, "handle_host_check() finished successfully -> %d\n", NEBERROR_CALLBACKOVERRIDE );
+    GM_LOG( GM_LOG_TRACE, "handle_host_check() finished successfully -> %d\n", NEBERROR_CALLBACKOVERRIDE );
     return NEBERROR_CALLBACKOVERRIDE;
 }
 
@@ -1137,13 +1184,15 @@ static int handle_svc_check( int event_type, void *data ) {
     struct timeval core_time;
     struct tm next_check;
     char buffer1[GM_BUFFERSIZE];
+    char trace_line[GM_TRACE_ID_SIZE+16];
+    struct timeval next_check_time;
 #if defined(USENAEMON) || defined(USENAGIOS4)
     nagios_macros mac;
 #endif
 
     gettimeofday(&core_time,NULL);
 
-    gm_log( GM_LOG_TRACE, "handle_svc_check(%i, data)\n", event_type );
+    GM_LOG( GM_LOG_TRACE, "handle_svc_check(%i, data)\n", event_type );
     svcdata = ( nebstruct_service_check_data * )data;
 
     if ( event_type != NEBCALLBACK_SERVICE_CHECK_DATA )
@@ -1168,11 +1217,11 @@ static int handle_svc_check( int event_type, void *data ) {
 
     /* local check? */
     if(!strcmp( target_queue, "" )) {
-        gm_log( GM_LOG_DEBUG, "passing by local servicecheck: %s - %s\n", svcdata->host_name, svcdata->service_description);
+        GM_LOG( GM_LOG_DEBUG, "passing by local servicecheck: %s - %s\n", svcdata->host_name, svcdata->service_description);
         return NEB_OK;
     }
 
-    gm_log( GM_LOG_DEBUG, "received job for queue %s: %s - %s\n", target_queue, svcdata->host_name, svcdata->service_description );
+    GM_LOG( GM_LOG_DEBUG, "received job for queue %s: %s - %s\n", target_queue, svcdata->host_name, svcdata->service_description );
 
     temp_buffer[0]='\x0';
 
@@ -1236,7 +1285,7 @@ static int handle_svc_check( int event_type, void *data ) {
     if(mod_gm_opt->debug_level >= GM_LOG_DEBUG) {
         localtime_r(&svc->next_check, &next_check);
         strftime(buffer1, sizeof(buffer1), "%Y-%m-%d %H:%M:%S", &next_check );
-        gm_log( GM_LOG_DEBUG, "service: '%s' - '%s', next_check is at %s, latency so far: %i\n", svcdata->host_name, svcdata->service_description, buffer1, ((int)core_time.tv_sec - (int)svc->next_check));
+        GM_LOG( GM_LOG_DEBUG, "service: '%s' - '%s', next_check is at %s, latency so far: %i\n", svcdata->host_name, svcdata->service_description, buffer1, ((int)core_time.tv_sec - (int)svc->next_check));
     }
 
     /* increment number of service checks that are currently running... */
@@ -1245,16 +1294,21 @@ static int handle_svc_check( int event_type, void *data ) {
     /* set the execution flag */
     svc->is_executing=TRUE;
 
-    gm_log( GM_LOG_TRACE, "cmd_line: %s\n", processed_command );
+    GM_LOG( GM_LOG_TRACE, "cmd_line: %s\n", processed_command );
+
+    /* next_check is a time_t */
+    next_check_time.tv_sec  = svc->next_check;
+    next_check_time.tv_usec = 0;
 
-    snprintf( temp_buffer,GM_BUFFERSIZE-1,"type=service\nresult_queue=%s\nhost_name=%s\nservice_description=%s\nstart_time=%lf\nnext_check=%lf\ncore_time=%lf\ntimeout=%d\ncommand_line=%s\n\n\n",
+    snprintf( temp_buffer,GM_BUFFERSIZE-1,"type=service\nresult_queue=%s\nhost_name=%s\nservice_description=%s\nstart_time=%lf\nnext_check=%lf\ncore_time=%lf\ntimeout=%d\n%scommand_line=%s\n\n\n",
               mod_gm_opt->result_queue,
               svcdata->host_name,
               svcdata->service_description,
-              timeval2double(&svc->next_check),
-              timeval2double(&svc->next_check),
+              timeval2double(&next_check_time),
+              timeval2double(&next_check_time),
               timeval2double(&core_time),
               service_check_timeout,
+              trace_id_line(trace_line, sizeof(trace_line)),
               processed_command
             );
 
@@ -1280,7 +1334,9 @@ static int handle_svc_check( int event_type, void *data ) {
                          mod_gm_opt->transportmode,
                          TRUE
                         ) == GM_OK) {
-        gm_log( GM_LOG_TRACE, "handle_svc_check() finished successfully\n" );
+        if(mod_gm_opt->job_trace == GM_ENABLED)
+            trace_observe_since(trace_queue(target_queue), GM_TRACE_SUBMIT, &core_time);
+        GM_LOG( GM_LOG_TRACE, "handle_svc_check() finished successfully\n" );
     }
     else {
         my_free(raw_command);
@@ -1295,7 +1351,7 @@ static int handle_svc_check( int event_type, void *data ) {
         /* decrement number of host checks that are currently running */
         currently_running_service_checks--;
 
-        gm_log( GM_LOG_TRACE, "handle_svc_check() finished unsuccessfully\n" );
+        GM_LOG( GM_LOG_TRACE, "handle_svc_check() finished unsuccessfully\n" );
         return NEBERROR_CALLBACKCANCEL;
     }
 
@@ -1309,7 +1365,7 @@ static int handle_svc_check( int event_type, void *data ) {
     /* orphaned check - submit fake result to mark service as orphaned */
 #ifdef USENAGIOS
     if(mod_gm_opt->orphan_service_checks == GM_ENABLED && svc->check_options & CHECK_OPTION_ORPHAN_CHECK) {
-        gm_log( GM_LOG_DEBUG, "service check for %s - %s orphaned\n", svc->host_name, svc->description );
+        GM_LOG( GM_LOG_DEBUG, "service check for %s - %s orphaned\n", svc->host_name, svc->description );
         if ( ( chk_result = ( check_result * )gm_malloc( sizeof *chk_result ) ) == 0 )
             return NEBERROR_CALLBACKCANCEL;
         snprintf( temp_buffer,GM_BUFFERSIZE-1,"(service check orphaned, is the mod-gearman worker on queue '%s' running?)\n", target_queue);
@@ -1328,13 +1384,13 @@ static int handle_svc_check( int event_type, void *data ) {
         chk_result->start_time.tv_sec   = (unsigned long)time(NULL);
         chk_result->finish_time.tv_sec  = (unsigned long)time(NULL);
         chk_result->latency             = 0;
-        mod_gm_add_result_to_list( chk_result );
+        mod_gm_add_result_to_list( chk_result, -1, NULL );
         chk_result = NULL;
     }
 #endif
 
     /* tell naemon to not execute */
-    gm_log( GM_LOG_TRACE, "handle_svc_check() finished successfully -> %d\n", NEBERROR_CALLBACKOVERRIDE );
+    GM_LOG( GM_LOG_TRACE, "handle_svc_check() finished successfully -> %d\n", NEBERROR_CALLBACKOVERRIDE );
 
     return NEBERROR_CALLBACKOVERRIDE;
 }
@@ -1412,7 +1468,7 @@ static int verify_options(mod_gm_opt_t *opt) {
 
     /* nothing set by hand -> defaults */
     if( opt->set_queues_by_hand == 0 ) {
-        gm_log( GM_LOG_DEBUG, "starting client with default queues\n" );
+        GM_LOG( GM_LOG_DEBUG, "starting client with default queues\n" );
         opt->hosts    = GM_ENABLED;
         opt->services = GM_ENABLED;
         opt->events   = GM_ENABLED;
@@ -1437,10 +1493,10 @@ static void set_target_queue( host *hst, service *svc ) {
             for(; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
                 if(!strcmp(mod_gm_opt->queue_cust_var, temp_customvariablesmember->variable_name)) {
                     if(!strcmp(temp_customvariablesmember->variable_value, "local")) {
-                        gm_log( GM_LOG_TRACE, "bypassing local check from service custom variable\n" );
+                        GM_LOG( GM_LOG_TRACE, "bypassing local check from service custom variable\n" );
                         return;
                     }
-                    gm_log( GM_LOG_TRACE, "got target queue from service custom variable: %s\n", temp_customvariablesmember->variable_value );
+                    GM_LOG( GM_LOG_TRACE, "got target queue from service custom variable: %s\n", temp_customvariablesmember->variable_value );
                     snprintf( target_queue, GM_BUFFERSIZE-1, "%s", temp_customvariablesmember->variable_value );
                     return;
                 }
@@ -1452,10 +1508,10 @@ static void set_target_queue( host *hst, service *svc ) {
         for(; temp_customvariablesmember != NULL; temp_customvariablesmember = temp_customvariablesmember->next) {
             if(!strcmp(mod_gm_opt->queue_cust_var, temp_customvariablesmember->variable_name)) {
                 if(!strcmp(temp_customvariablesmember->variable_value, "local")) {
-                    gm_log( GM_LOG_TRACE, "bypassing local check from host custom variable\n" );
+                    GM_LOG( GM_LOG_TRACE, "bypassing local check from host custom variable\n" );
                     return;
                 }
-                gm_log( GM_LOG_TRACE, "got target queue from host custom variable: %s\n", temp_customvariablesmember->variable_value );
+                GM_LOG( GM_LOG_TRACE, "got target queue from host custom variable: %s\n", temp_customvariablesmember->variable_value );
                 snprintf( target_queue, GM_BUFFERSIZE-1, "%s", temp_customvariablesmember->variable_value );
                 return;
             }
@@ -1467,7 +1523,7 @@ static void set_target_queue( host *hst, service *svc ) {
         while ( mod_gm_opt->local_servicegroups_list[x] != NULL ) {
             servicegroup * temp_servicegroup = find_servicegroup( mod_gm_opt->local_servicegroups_list[x] );
             if ( temp_servicegroup != NULL && is_service_member_of_servicegroup( temp_servicegroup,svc )==TRUE ) {
-                gm_log( GM_LOG_TRACE, "service is member of local servicegroup: %s\n", mod_gm_opt->local_servicegroups_list[x] );
+                GM_LOG( GM_LOG_TRACE, "service is member of local servicegroup: %s\n", mod_gm_opt->local_servicegroups_list[x] );
                 return;
             }
             x++;
@@ -1479,7 +1535,7 @@ static void set_target_queue( host *hst, service *svc ) {
     while ( mod_gm_opt->local_hostgroups_list[x] != NULL ) {
         hostgroup * temp_hostgroup = find_hostgroup( mod_gm_opt->local_hostgroups_list[x] );
         if ( temp_hostgroup != NULL && is_host_member_of_hostgroup( temp_hostgroup,hst )==TRUE ) {
-            gm_log( GM_LOG_TRACE, "server is member of local hostgroup: %s\n", mod_gm_opt->local_hostgroups_list[x] );
+            GM_LOG( GM_LOG_TRACE, "server is member of local hostgroup: %s\n", mod_gm_opt->local_hostgroups_list[x] );
             return;
         }
         x++;
@@ -1491,7 +1547,7 @@ static void set_target_queue( host *hst, service *svc ) {
         while ( mod_gm_opt->servicegroups_list[x] != NULL ) {
             servicegroup * temp_servicegroup = find_servicegroup( mod_gm_opt->servicegroups_list[x] );
             if ( temp_servicegroup != NULL && is_service_member_of_servicegroup( temp_servicegroup,svc )==TRUE ) {
-                gm_log( GM_LOG_TRACE, "service is member of servicegroup: %s\n", mod_gm_opt->servicegroups_list[x] );
+                GM_LOG( GM_LOG_TRACE, "service is member of servicegroup: %s\n", mod_gm_opt->servicegroups_list[x] );
                 snprintf( target_queue, GM_BUFFERSIZE-1, "servicegroup_%s", mod_gm_opt->servicegroups_list[x] );
                 return;
             }
@@ -1504,7 +1560,7 @@ static void set_target_queue( host *hst, service *svc ) {
     while ( mod_gm_opt->hostgroups_list[x] != NULL ) {
         hostgroup * temp_hostgroup = find_hostgroup( mod_gm_opt->hostgroups_list[x] );
         if ( temp_hostgroup != NULL && is_host_member_of_hostgroup( temp_hostgroup,hst )==TRUE ) {
-            gm_log( GM_LOG_TRACE, "server is member of hostgroup: %s\n", mod_gm_opt->hostgroups_list[x] );
+            GM_LOG( GM_LOG_TRACE, "server is member of hostgroup: %s\n", mod_gm_opt->hostgroups_list[x] );
             snprintf( target_queue, GM_BUFFERSIZE-1, "hostgroup_%s", mod_gm_opt->hostgroups_list[x] );
             return;
         }
@@ -1555,9 +1611,9 @@ int handle_perfdata(int event_type, void *data) {
     char *perf_data;
 #endif
 
-    gm_log( GM_LOG_TRACE, "handle_perfdata(%d)\n", event_type );
+    GM_LOG( GM_LOG_TRACE, "handle_perfdata(%d)\n", event_type );
     if(process_performance_data == 0) {
-        gm_log( GM_LOG_TRACE, "handle_perfdata() process_performance_data disabled globally\n" );
+        GM_LOG( GM_LOG_TRACE, "handle_perfdata() process_performance_data disabled globally\n" );
         return 0;
     }
 
@@ -1574,7 +1630,7 @@ int handle_perfdata(int event_type, void *data) {
 
                 hst = (host *) hostchkdata->object_ptr;
                 if(hst->process_performance_data == 0 && mod_gm_opt->perfdata_send_all == GM_DISABLED) {
-                    gm_log( GM_LOG_TRACE, "handle_perfdata() process_performance_data disabled for: %s\n", hst->name );
+                    GM_LOG( GM_LOG_TRACE, "handle_perfdata() process_performance_data disabled for: %s\n", hst->name );
                     break;
                 }
 
@@ -1626,7 +1682,7 @@ int handle_perfdata(int event_type, void *data) {
                 /* find the naemon service object for this service */
                 svc = (service *) srvchkdata->object_ptr;
                 if(svc->process_performance_data == 0 && mod_gm_opt->perfdata_send_all == GM_DISABLED) {
-                    gm_log( GM_LOG_TRACE, "handle_perfdata() process_performance_data disabled for: %s - %s\n", svc->host_name, svc->description );
+                    GM_LOG( GM_LOG_TRACE, "handle_perfdata() process_performance_data disabled for: %s - %s\n", svc->host_name, svc->description );
                     break;
                 }
 
@@ -1685,10 +1741,10 @@ int handle_perfdata(int event_type, void *data) {
                                  mod_gm_opt->transportmode,
                                  TRUE
                                 ) == GM_OK) {
-                gm_log( GM_LOG_TRACE, "handle_perfdata() successfully added data to %s\n", perfdata_queue );
+                GM_LOG( GM_LOG_TRACE, "handle_perfdata() successfully added data to %s\n", perfdata_queue );
             }
             else {
-                gm_log( GM_LOG_TRACE, "handle_perfdata() failed to add data to %s\n", perfdata_queue );
+                GM_LOG( GM_LOG_TRACE, "handle_perfdata() failed to add data to %s\n", perfdata_queue );
             }
         }
     }
@@ -1833,6 +1889,32 @@ int handle_export(int callback_type, void *data) {
 }
 
 
+/* trace id line for the job payload, empty unless job_trace is enabled */
+static char *trace_id_line(char *buf, int size) {
+    char trace_id[GM_TRACE_ID_SIZE];
+    buf[0] = '\0';
+    if(mod_gm_opt->job_trace == GM_ENABLED)
+        snprintf(buf, size, "trace_id=%s\n", next_trace_id(trace_id, sizeof(trace_id)));
+    return buf;
+}
+
+
+/* update the trace file every GM_TRACE_WRITE_INTERVAL seconds */
+static void write_job_trace(int force) {
+    time_t now;
+
+    if(mod_gm_opt->job_trace != GM_ENABLED || mod_gm_opt->job_trace_file == NULL)
+        return;
+
+    now = time(NULL);
+    if(force == FALSE && now - trace_file_written < GM_TRACE_WRITE_INTERVAL)
+        return;
+    trace_file_written = now;
+    write_trace_file(mod_gm_opt->job_trace_file);
+    return;
+}
+
+
 /* core log wrapper */
 void write_core_log(char *data) {
 #ifdef USENAEMON
@@ -27,6 +27,7 @@
 #include "utils.h"
 #include "mod_gearman.h"
 #include "gearman_utils.h"
+#include "job_trace.h"
 
 #ifdef USENAEMON
 static const char *gearman_worker_source_name(void *source) {
@@ -54,7 +55,7 @@ static void cancel_worker_thread (void * data) {
     gearman_worker_remove_servers(worker);
     gearman_worker_free(worker);
 
-    gm_log( GM_LOG_DEBUG, "worker thread finished\n" );
+    GM_LOG( GM_LOG_DEBUG, "worker thread finished\n" );
 
     return;
 }
@@ -65,7 +66,7 @@ void *result_worker( void * data ) {
     int *worker_num = (int*)data;
     gearman_return_t ret;
 
-    gm_log( GM_LOG_TRACE, "worker %d started\n", *worker_num );
+    GM_LOG( GM_LOG_TRACE, "worker %d started\n", *worker_num );
 
     pthread_setcancelstate (PTHREAD_CANCEL_ENABLE, NULL);
     pthread_setcanceltype (PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
@@ -98,18 +99,12 @@ void *result_worker( void * data ) {
 
 /* put back the result into the core */
 void *get_results( gearman_job_st *job, void *context, size_t *result_size, gearman_return_t *ret_ptr ) {
-    int wsize, transportmode;
+    int wsize, transportmode, version, num;
     char *workload;
     char *decrypted_data;
     char *decrypted_data_c;
-#ifdef GM_DEBUG
-    char *decrypted_orig;
-#endif
-    struct timeval now, core_start_time;
-    check_result * chk_result;
-    int active_check = TRUE;
-    char *ptr;
-    double now_f, core_starttime_f, starttime_f, finishtime_f, exec_time, latency;
+    char *result;
+    struct timeval now;
 
     /* for calculating real latency */
     gettimeofday(&now,NULL);
@@ -128,8 +123,8 @@ void *get_results( gearman_job_st *job, void *context, size_t *result_size, gear
     workload = gm_malloc(sizeof(char*)*wsize+1);
     strncpy(workload, (const char*)gearman_job_workload(job), wsize);
     workload[wsize] = '\x0';
-    gm_log( GM_LOG_TRACE, "got result %s\n", gearman_job_handle( job ));
-    gm_log( GM_LOG_TRACE, "%d +++>\n%s\n<+++\n", strlen(workload), workload );
+    GM_LOG( GM_LOG_TRACE, "got result %s\n", gearman_job_handle( job ));
+    GM_LOG( GM_LOG_TRACE, "%d +++>\n%s\n<+++\n", strlen(workload), workload );
 
     /* decrypt data */
     decrypted_data   = gm_malloc(wsize*2);
@@ -146,10 +141,7 @@ void *get_results( gearman_job_st *job, void *context, size_t *result_size, gear
         *ret_ptr = GEARMAN_WORK_FAIL;
         return NULL;
     }
-    gm_log( GM_LOG_TRACE, "%d --->\n%s\n<---\n", strlen(decrypted_data), decrypted_data );
-#ifdef GM_DEBUG
-    decrypted_orig   = gm_strdup(decrypted_data);
-#endif
+    GM_LOG( GM_LOG_TRACE, "%d --->\n%s\n<---\n", strlen(decrypted_data), decrypted_data );
     free(workload);
 
     /*
@@ -167,16 +159,56 @@ void *get_results( gearman_job_st *job, void *context, size_t *result_size, gear
     }
 #endif
 
+    /* workers with result_batch_size > 1 send multiple results per job */
+    version = parse_multi_result_header(&decrypted_data);
+    if(version == 0) {
+        if(process_result(decrypted_data, job, &now) != GM_OK)
+            *ret_ptr = GEARMAN_WORK_FAIL;
+    }
+    else if(version != GM_MULTI_RESULT_VERSION) {
+        gm_log( GM_LOG_ERROR, "discarded result packet (%s) with unsupported format version %d\n", gearman_job_handle( job ), version );
+        *ret_ptr = GEARMAN_WORK_FAIL;
+    }
+    else {
+        num = 0;
+        while((result = next_multi_result(&decrypted_data)) != NULL) {
+            if(process_result(result, job, &now) != GM_OK)
+                *ret_ptr = GEARMAN_WORK_FAIL;
+            num++;
+        }
+        GM_LOG( GM_LOG_TRACE, "got %d results in %s\n", num, gearman_job_handle( job ));
+    }
+
+    free(decrypted_data_c);
+
+    return NULL;
+}
+
+
+/* parse a single result and add it to the result list */
+int process_result( char *data, gearman_job_st *job, struct timeval *received ) {
+#ifdef GM_DEBUG
+    char *decrypted_orig;
+#endif
+    struct timeval core_start_time;
+    gm_job_trace_t trace;
+    check_result * chk_result;
+    int active_check = TRUE;
+    int trace_slot;
+    char *ptr;
+    char *rusage = NULL;
+    double now_f, core_starttime_f, starttime_f, finishtime_f, exec_time, latency;
+
+#ifdef GM_DEBUG
+    decrypted_orig   = gm_strdup(data);
+#endif
+
     /* nagios will free it after processing */
     if ( ( chk_result = ( check_result * )gm_malloc( sizeof *chk_result ) ) == 0 ) {
-        *ret_ptr = GEARMAN_WORK_FAIL;
 #ifdef GM_DEBUG
     free(decrypted_orig);
 #endif
-#ifdef USENAEMON
-        free(decrypted_data);
-#endif
-        return NULL;
+        return GM_ERROR;
     }
     init_check_result(chk_result);
     chk_result->scheduled_check     = TRUE;
@@ -190,8 +222,9 @@ void *get_results( gearman_job_st *job, void *context, size_t *result_size, gear
 #endif
     core_start_time.tv_sec          = 0;
     core_start_time.tv_usec         = 0;
+    memset(&trace, 0, sizeof(trace));
 
-    while ( (ptr = strsep(&decrypted_data, "\n" )) != NULL ) {
+    while ( (ptr = strsep(&data, "\n" )) != NULL ) {
         char *key   = strsep( &ptr, "=" );
         char *value = strsep( &ptr, "\x0" );
 
@@ -254,16 +287,27 @@ void *get_results( gearman_job_st *job, void *context, size_t *result_size, gear
             string2timeval(value, &chk_result->finish_time);
         } else if ( !strcmp( key, "latency" ) ) {
             chk_result->latency = atof( value );
+        } else if ( !strcmp( key, "rusage" ) ) {
+            rusage = value;
+        } else if ( !strcmp( key, "trace_id" ) ) {
+            trace.trace_id = value;
+        } else if ( !strcmp( key, "queue" ) ) {
+            trace.queue = value;
+        } else if ( !strcmp( key, "core_time" ) ) {
+            string2timeval(value, &trace.core_time);
+        } else if ( !strcmp( key, "pickup_time" ) ) {
+            string2timeval(value, &trace.pickup_time);
+        } else if ( !strcmp( key, "sent_time" ) ) {
+            string2timeval(value, &trace.sent_time);
         }
     }
 
     if ( chk_result->host_name == NULL || chk_result->output == NULL ) {
-        *ret_ptr= GEARMAN_WORK_FAIL;
         gm_log( GM_LOG_ERROR, "discarded invalid job (%s), check your encryption settings\n", gearman_job_handle( job ) );
 #ifdef GM_DEBUG
     free(decrypted_orig);
 #endif
-        return NULL;
+        return GM_ERROR;
     }
 
     if ( chk_result->service_description != NULL ) {
@@ -278,6 +322,13 @@ void *get_results( gearman_job_st *job, void *context, size_t *result_size, gear
             chk_result->check_type       = HOST_CHECK_PASSIVE;
     }
 
+    /* account lifecycle segments before missing timestamps are filled in */
+    trace.next_check  = core_start_time;
+    trace.start_time  = chk_result->start_time;
+    trace.finish_time = chk_result->finish_time;
+    trace.received    = *received;
+    trace_slot        = trace_result(&trace);
+
     /* fill some maybe missing options */
     if(chk_result->start_time.tv_sec  == 0) {
         chk_result->start_time.tv_sec = (unsigned long)time(NULL);
@@ -290,7 +341,7 @@ void *get_results( gearman_job_st *job, void *context, size_t *result_size, gear
     }
 
     /* calculate real latency */
-    now_f            = timeval2double(&now);
+    now_f            = timeval2double(received);
     core_starttime_f = timeval2double(&core_start_time);
     starttime_f      = timeval2double(&chk_result->start_time);
     finishtime_f     = timeval2double(&chk_result->finish_time);
@@ -319,10 +370,10 @@ void *get_results( gearman_job_st *job, void *context, size_t *result_size, gear
         if(svc == NULL) {
             write_debug_file(&decrypted_orig);
             gm_log( GM_LOG_ERROR, "service '%s' on host '%s' could not be found\n", chk_result->service_description, chk_result->host_name );
-            return NULL;
+            return GM_ERROR;
         }
 #endif
-        gm_log( GM_LOG_DEBUG, "service job completed: %s %s: %d\n", chk_result->host_name, chk_result->service_description, chk_result->return_code );
+        GM_LOG( GM_LOG_DEBUG, "service job completed: %s %s: %d\n", chk_result->host_name, chk_result->service_description, chk_result->return_code );
     } else {
 #ifdef GM_DEBUG
         /* does this host exist */
@@ -331,7 +382,7 @@ void *get_results( gearman_job_st *job, void *context, size_t *result_size, gear
         if(hst == NULL) {
             write_debug_file(&decrypted_orig);
             gm_log( GM_LOG_ERROR, "host '%s' could not be found\n", chk_result->host_name );
-            return NULL;
+            return GM_ERROR;
         }
 #endif
 #if defined(USENAEMON)
@@ -342,21 +393,23 @@ void *get_results( gearman_job_st *job, void *context, size_t *result_size, gear
             }
         }
 #endif
-        gm_log( GM_LOG_DEBUG, "host job completed: %s: %d\n", chk_result->host_name, chk_result->return_code );
+        GM_LOG( GM_LOG_DEBUG, "host job completed: %s: %d\n", chk_result->host_name, chk_result->return_code );
+    }
+    if ( rusage != NULL ) {
+        GM_LOG( GM_LOG_DEBUG, "plugin usage (user,sys,max_rss,vcsw,ivcsw): %s\n", rusage );
     }
 
     /* add result to result list */
-    mod_gm_add_result_to_list( chk_result );
+    mod_gm_add_result_to_list( chk_result, trace_slot, received );
 
     /* reset pointer */
     chk_result = NULL;
 
-    free(decrypted_data_c);
 #ifdef GM_DEBUG
     free(decrypted_orig);
 #endif
 
-    return NULL;
+    return GM_OK;
 }
 
 
@@ -369,7 +422,7 @@ int set_worker( gearman_worker_st *worker ) {
         gm_log( GM_LOG_ERROR, "got no result queue!\n" );
         return GM_ERROR;
     }
-    gm_log( GM_LOG_DEBUG, "started result_worker thread for queue: %s\n", mod_gm_opt->result_queue );
+    GM_LOG( GM_LOG_DEBUG, "started result_worker thread for queue: %s\n", mod_gm_opt->result_queue );
 
     if(worker_add_function( worker, mod_gm_opt->result_queue, get_results ) != GM_OK) {
         return GM_ERROR;
@@ -7,6 +7,11 @@
 #include <common.h>
 #include <utils.h>
 #include <check_utils.h>
+#include <job_trace.h>
+#include <gearman_utils.h>
+#include <send_gearman_daemon.h>
+#include <send_gearman_import.h>
+#include <sys/stat.h>
 
 #include <worker_dummy_functions.c>
 
@@ -29,8 +34,247 @@ mod_gm_opt_t * renew_opts() {
     return mod_gm_opt;
 }
 
+/* send_gearman.c is not linked, results are passed through unchanged */
+gearman_client_st client;
+int results_sent   = 0;
+int results_failed = 0;
+
+int parse_result_line(char *line);
+int parse_result_line(char *line) {
+    free(mod_gm_opt->host);
+    mod_gm_opt->host = gm_strdup(line);
+    return(GM_OK);
+}
+
+char * build_result(void);
+char * build_result() {
+    return(gm_strdup(mod_gm_opt->host));
+}
+
+/* results containing "fail" are not accepted */
+int send_bulk_results(char ** results, int num, int * failed_results);
+int send_bulk_results(char ** results, int num, int * failed_results) {
+    int x, failed = 0;
+    for(x = 0; x < num; x++) {
+        failed_results[x] = strstr(results[x], "fail") != NULL;
+        failed += failed_results[x];
+    }
+    return(failed);
+}
+
+/* build a send_nsca version 3 data packet */
+void build_nsca_packet(unsigned char *packet, int size, char *host, char *service, int return_code, char *output);
+void build_nsca_packet(unsigned char *packet, int size, char *host, char *service, int return_code, char *output) {
+    int16_t version = htons(GM_NSCA_PACKET_VERSION), rc = htons(return_code);
+    uint32_t timestamp = htonl(1000), crc;
+
+    memset(packet, 0, size);
+    memcpy(packet, &version, 2);
+    memcpy(packet+8, &timestamp, 4);
+    memcpy(packet+12, &rc, 2);
+    strncpy((char *)packet+14, host, 63);
+    strncpy((char *)packet+78, service, 127);
+    strncpy((char *)packet+206, output, size-209);
+    crc = htonl(nsca_crc32(packet, size));
+    memcpy(packet+4, &crc, 4);
+}
+
+/* send_gearman daemon packets, queue and spool */
+void test_send_gearman_daemon(void);
+void test_send_gearman_daemon() {
+    unsigned char packet[GM_NSCA_LARGE_PACKET_SIZE];
+    char output[2001];
+    char *items[3];
+    char spool_dir[] = "/tmp/mod_gm_spool.XXXXXX";
+    gm_result_queue_t queue;
+
+    mod_gm_opt = renew_opts();
+
+    /* send_nsca packets */
+    build_nsca_packet(packet, GM_NSCA_PACKET_SIZE, "host", "service", 2, "CRITICAL - down");
+    cmp_ok(nsca_packet_size(packet, GM_NSCA_PACKET_SIZE - 1), "==", 0, "incomplete nsca packet");
+    cmp_ok(nsca_packet_size(packet, GM_NSCA_LARGE_PACKET_SIZE), "==", GM_NSCA_PACKET_SIZE, "nsca packet size detected by checksum");
+    ok(parse_nsca_packet(packet, GM_NSCA_PACKET_SIZE) == GM_OK, "parse nsca packet");
+    is(mod_gm_opt->host, "host", "nsca packet host");
+    is(mod_gm_opt->service, "service", "nsca packet service");
+    is(mod_gm_opt->message, "CRITICAL - down", "nsca packet output");
+    ok(mod_gm_opt->return_code == 2 && mod_gm_opt->starttime.tv_sec == 1000, "nsca packet return code and timestamp");
+
+    memset(output, 'x', sizeof(output)-1);
+    output[sizeof(output)-1] = '\0';
+    build_nsca_packet(packet, GM_NSCA_LARGE_PACKET_SIZE, "host", "", 1, output);
+    cmp_ok(nsca_packet_size(packet, GM_NSCA_PACKET_SIZE), "==", 0, "large nsca packet needs more data");
+    cmp_ok(nsca_packet_size(packet, GM_NSCA_LARGE_PACKET_SIZE), "==", GM_NSCA_LARGE_PACKET_SIZE, "large nsca packet size detected by checksum");
+    ok(parse_nsca_packet(packet, GM_NSCA_LARGE_PACKET_SIZE) == GM_OK, "parse large nsca packet");
+    ok(mod_gm_opt->service == NULL && strlen(mod_gm_opt->message) == sizeof(output)-1, "large nsca packet host result with full output");
+
+    build_nsca_packet(packet, GM_NSCA_LARGE_PACKET_SIZE, "host", "", 1, output);
+    packet[300] = 'y';
+    cmp_ok(nsca_packet_size(packet, GM_NSCA_LARGE_PACKET_SIZE), "==", -1, "nsca packet with wrong checksum");
+    ok(parse_nsca_packet(packet, GM_NSCA_LARGE_PACKET_SIZE) == GM_ERROR, "nsca packet with wrong checksum is rejected");
+    build_nsca_packet(packet, GM_NSCA_PACKET_SIZE, "", "service", 0, "OK");
+    ok(parse_nsca_packet(packet, GM_NSCA_PACKET_SIZE) == GM_ERROR, "nsca packet without host is rejected");
+
+    /* result queue */
+    queue.items = items;
+    queue.size  = 3;
+    queue.head  = 0;
+    queue.count = 0;
+    result_queue_push(&queue, "a");
+    result_queue_push(&queue, "b");
+    result_queue_push_front(&queue, "c");
+    ok(result_queue_push(&queue, "d") == GM_ERROR && result_queue_push_front(&queue, "d") == GM_ERROR, "full queue rejects results");
+    is(result_queue_pop(&queue), "c", "failed result is sent first");
+    is(result_queue_pop(&queue), "a", "queue keeps order 1");
+    result_queue_push(&queue, "e");
+    is(result_queue_pop(&queue), "b", "queue keeps order 2");
+    is(result_queue_pop(&queue), "e", "queue keeps order after wrap around");
+    ok(result_queue_pop(&queue) == NULL, "empty queue");
+
+    /* spool round trip */
+    ok(mkdtemp(spool_dir) != NULL, "created spool dir %s", spool_dir);
+    mod_gm_opt->daemon_spool_dir = gm_strdup(spool_dir);
+    ok(spool_write("r1\nline\n") == GM_OK, "spool result 1");
+    spool_write("r2\n");
+    spool_write("r3\n");
+    queue.size = 2;
+    queue.head = 0;
+    spool_replay(&queue);
+    cmp_ok(queue.count, "==", 2, "replay fills the queue");
+    is(queue.items[queue.head], "r1\nline\n", "replay keeps result with newlines");
+    spool_write("r4\n");
+    spool_save(&queue);
+    cmp_ok(queue.count, "==", 0, "save empties the queue");
+    spool_write("r5\n");
+
+    queue.size  = 3;
+    queue.head  = 0;
+    queue.count = 0;
+    spool_replay(&queue);
+    is(queue.items[0], "r1\nline\n", "saved results come first 1");
+    is(queue.items[1], "r2\n", "saved results come first 2");
+    is(queue.items[2], "r3\n", "unread rest of the spool follows");
+    while(queue.count > 0)
+        free(result_queue_pop(&queue));
+    spool_replay(&queue);
+    ok(queue.count == 2 && !strcmp(queue.items[0], "r4\n") && !strcmp(queue.items[1], "r5\n"), "later spooled results keep their order");
+    while(queue.count > 0)
+        free(result_queue_pop(&queue));
+    spool_replay(&queue);
+    ok(queue.count == 0 && rmdir(spool_dir) == 0, "spool files are removed once replayed");
+
+    mod_gm_free_opt(mod_gm_opt);
+    mod_gm_opt = NULL;
+}
+
+/* write a file for the importer */
+void write_import_file(char *dir, char *name, char *data);
+void write_import_file(char *dir, char *name, char *data) {
+    char path[1024];
+    FILE *fp;
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    fp = fopen(path, "w");
+    fputs(data, fp);
+    fclose(fp);
+}
+
+/* does a file exist in the import dir */
+int import_file_exists(char *dir, char *name);
+int import_file_exists(char *dir, char *name) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    return(access(path, F_OK) == 0);
+}
+
+/* send_gearman checkresult import */
+void test_send_gearman_import(void);
+void test_send_gearman_import() {
+    char import_dir[] = "/tmp/mod_gm_import.XXXXXX";
+    char line[100], path[1024];
+    gm_import_batch_t batch;
+
+    mod_gm_opt = renew_opts();
+
+    /* checkresult lines */
+    strcpy(line, "host_name=host");
+    ok(parse_checkresult_line(line) == GM_OK && !strcmp(mod_gm_opt->host, "host"), "checkresult host_name");
+    strcpy(line, "output=a\\nb\\\\c");
+    ok(parse_checkresult_line(line) == GM_OK, "checkresult output");
+    is(mod_gm_opt->message, "a\nb\\c", "checkresult output is unescaped");
+    strcpy(line, "check_type=1");
+    ok(parse_checkresult_line(line) == GM_OK && mod_gm_opt->active == GM_DISABLED, "checkresult passive check_type");
+    strcpy(line, "start_time=1000.5");
+    ok(parse_checkresult_line(line) == GM_OK && mod_gm_opt->has_starttime == TRUE && mod_gm_opt->starttime.tv_sec == 1000 && mod_gm_opt->starttime.tv_usec == 500000, "checkresult start_time");
+    strcpy(line, "file_time=1000");
+    ok(parse_checkresult_line(line) == GM_ERROR, "unknown checkresult key");
+    strcpy(line, "host_name");
+    ok(parse_checkresult_line(line) == GM_ERROR, "checkresult line without value");
+    mod_gm_opt->active = GM_ENABLED;
+
+    /* format detection, .ok markers and keep/unlink accounting */
+    ok(mkdtemp(import_dir) != NULL, "created import dir %s", import_dir);
+    batch.size        = 10;
+    batch.results     = gm_malloc(batch.size * sizeof(char *));
+    batch.result_file = gm_malloc(batch.size * sizeof(int));
+    batch.files       = gm_malloc((batch.size + 2) * sizeof(gm_import_file_t));
+    batch.num         = 0;
+    batch.file_num    = 0;
+
+    write_import_file(import_dir, "c1", "### comment\nhost_name=h1\nreturn_code=0\noutput=ok\nhost_name=h2\nservice_description=s\n");
+    snprintf(path, sizeof(path), "%s/c1", import_dir);
+    cmp_ok(import_file(&batch, path), "==", -1, "checkresult file without .ok marker is skipped");
+    ok(batch.file_num == 0 && batch.num == 0 && import_file_exists(import_dir, "c1"), "skipped checkresult file stays in place");
+    write_import_file(import_dir, "c1.ok", "");
+    cmp_ok(import_file(&batch, path), "==", 2, "checkresult file with .ok marker is imported");
+    ok(batch.num == 2 && !strcmp(batch.results[0], "h1") && !strcmp(batch.results[1], "h2"), "checkresult results are split at host_name");
+
+    write_import_file(import_dir, "l1", "# comment\nh1\tsvc\t0\tOK\nh2\t1\tDOWN\n");
+    snprintf(path, sizeof(path), "%s/l1", import_dir);
+    cmp_ok(import_file(&batch, path), "==", 2, "line format file without marker is imported");
+    is(batch.results[2], "h1\tsvc\t0\tOK", "line format detected");
+
+    write_import_file(import_dir, "f1", "h3\tsvc\t0\tOK\nh3\tfail\t2\tCRITICAL\n");
+    snprintf(path, sizeof(path), "%s/f1", import_dir);
+    import_file(&batch, path);
+
+    write_import_file(import_dir, "e1", "# nothing\n");
+    write_import_file(import_dir, "e1.ok", "");
+    snprintf(path, sizeof(path), "%s/e1", import_dir);
+    cmp_ok(import_file(&batch, path), "==", 0, "file without results");
+    ok(!import_file_exists(import_dir, "e1") && import_file_exists(import_dir, "e1.invalid"), "file without results is renamed");
+
+    cmp_ok(batch.file_num, "==", 3, "three files in the batch");
+    cmp_ok(import_flush(&batch), "==", 1, "one result failed");
+    ok(results_sent == 5 && results_failed == 1, "sent and failed results are counted");
+    ok(!import_file_exists(import_dir, "c1") && !import_file_exists(import_dir, "c1.ok") && !import_file_exists(import_dir, "l1"), "sent files and markers are removed");
+    ok(import_file_exists(import_dir, "f1") && batch.file_num == 0 && batch.num == 0, "file with failed results is kept");
+    ok(import_file_exists(import_dir, "f1.ok") && !import_file_exists(import_dir, "f1.tmp"), "file with failed results is rewritten as checkresult file");
+
+    /* only the failed result is sent again */
+    snprintf(path, sizeof(path), "%s/f1", import_dir);
+    cmp_ok(import_file(&batch, path), "==", 1, "rewritten file contains only the failed result");
+    is(batch.results[0], "h3\tfail\t2\tCRITICAL", "failed result is retried");
+    cmp_ok(import_flush(&batch), "==", 1, "retried result failed again");
+    ok(results_sent == 5 && results_failed == 2, "accepted results are not sent twice");
+
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/f1.ok", import_dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/e1.invalid", import_dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/e1.ok", import_dir);
+    unlink(path);
+    ok(rmdir(import_dir) == 0, "no other files left in the import dir");
+
+    free(batch.results);
+    free(batch.result_file);
+    free(batch.files);
+    mod_gm_free_opt(mod_gm_opt);
+    mod_gm_opt = NULL;
+}
+
 int main(void) {
-    plan(73);
+    plan(158);
 
     /* lowercase */
     char test[100];
@@ -209,6 +453,26 @@ int main(void) {
     ok(mod_gm_opt->server_list[2]->port == 4730, "duplicate server");
     ok(mod_gm_opt->server_num == 3, "server_number = %d", mod_gm_opt->server_num);
 
+    /* trace file and metrics listener are independent */
+    mod_gm_free_opt(mod_gm_opt);
+    mod_gm_opt = renew_opts();
+    strcpy(test, "job_trace_file=/tmp/trace.prom");
+    parse_args_line(mod_gm_opt, test, 0);
+    strcpy(test, "metrics_listen=127.0.0.1:9469");
+    parse_args_line(mod_gm_opt, test, 0);
+    is(mod_gm_opt->job_trace_file, "/tmp/trace.prom", "metrics_listen keeps job_trace_file");
+
+    /* daemon flag and delimiter share the same option */
+    mod_gm_free_opt(mod_gm_opt);
+    mod_gm_opt = renew_opts();
+    strcpy(test, "d=|");
+    parse_args_line(mod_gm_opt, test, 0);
+    ok(!strcmp(mod_gm_opt->delimiter, "|"), "d=| sets delimiter");
+    ok(mod_gm_opt->daemon_mode == GM_DISABLED, "d=| does not enable daemon mode");
+    strcpy(test, "daemon");
+    parse_args_line(mod_gm_opt, test, 0);
+    ok(mod_gm_opt->daemon_mode == GM_ENABLED, "daemon enables daemon mode");
+
     /* escape newlines */
     char * escaped = gm_escape_newlines(" test\n", GM_DISABLED);
     is(escaped, " test\\n", "untrimmed escape string");
@@ -244,8 +508,147 @@ int main(void) {
     is(starts_with(test2, test), FALSE,  "starts_with(xyz, test123)");
     free(test2);
 
+    /* multi result packets */
+    {
+        char *results[2];
+        char *packet, *ptr, *result;
+        results[0] = "host_name=host1\nreturn_code=0\noutput=ok\n\n\n\n";
+        results[1] = "host_name=host2\nservice_description=svc\noutput=\n\n\n\n";
+        packet = build_multi_result(results, 2);
+        ptr    = packet;
+        cmp_ok(parse_multi_result_header(&ptr), "==", GM_MULTI_RESULT_VERSION, "parse_multi_result_header()");
+        result = next_multi_result(&ptr);
+        is(result, "host_name=host1\nreturn_code=0\noutput=ok\n", "next_multi_result() first result");
+        result = next_multi_result(&ptr);
+        is(result, "host_name=host2\nservice_description=svc\noutput=\n", "next_multi_result() second result");
+        ok(next_multi_result(&ptr) == NULL, "next_multi_result() end of packet");
+        free(packet);
+
+        strcpy(test, results[0]);
+        ptr = test;
+        cmp_ok(parse_multi_result_header(&ptr), "==", 0, "parse_multi_result_header() single result");
+        ok(ptr == test, "single result is unchanged");
+        strcpy(test, GM_MULTI_RESULT_HEADER"=2\n\nhost_name=host1\n");
+        ptr = test;
+        cmp_ok(parse_multi_result_header(&ptr), "==", 2, "parse_multi_result_header() newer version");
+        strcpy(test, GM_MULTI_RESULT_HEADER"=x\n\n");
+        ptr = test;
+        cmp_ok(parse_multi_result_header(&ptr), "==", -1, "parse_multi_result_header() broken header");
+    }
+
+    /*****************************************
+     * config reload
+     */
+    {
+        mod_gm_opt_t *old_opt, *new_opt;
+        char *reload_args[] = { "server=localhost:4730", "hostgroups=a,b", "timeout=30", NULL };
+        int x;
+
+        old_opt = gm_malloc(sizeof(mod_gm_opt_t));
+        new_opt = gm_malloc(sizeof(mod_gm_opt_t));
+        set_default_options(old_opt);
+        set_default_options(new_opt);
+        for(x = 0; reload_args[x] != NULL; x++) {
+            strcpy(test, reload_args[x]);
+            parse_args_line(old_opt, test, 0);
+            strcpy(test, reload_args[x]);
+            parse_args_line(new_opt, test, 0);
+        }
+        cmp_ok(compare_options(old_opt, new_opt), "==", GM_RELOAD_NONE, "compare_options() unchanged");
+
+        strcpy(test, "--servicegroup=c");
+        parse_args_line(new_opt, test, 0);
+        strcpy(test, "queue_node=hostgroup_a:1");
+        parse_args_line(new_opt, test, 0);
+        cmp_ok(compare_options(old_opt, new_opt), "==", GM_RELOAD_QUEUES, "compare_options() queues changed");
+
+        new_opt->crypt_key = gm_strdup("secret");
+        cmp_ok(compare_options(old_opt, new_opt), "==", GM_RELOAD_RESTART, "compare_options() key changed");
+        old_opt->crypt_key = gm_strdup("secret");
+
+        strcpy(test, "min-worker=5");
+        parse_args_line(new_opt, test, 0);
+        cmp_ok(compare_options(old_opt, new_opt), "==", GM_RELOAD_RESTART, "compare_options() worker option changed");
+
+        mod_gm_free_opt(old_opt);
+        mod_gm_free_opt(new_opt);
+    }
+
+    /* job lifecycle tracing */
+    {
+        gm_job_trace_t trace;
+        char id1[GM_TRACE_ID_SIZE], id2[GM_TRACE_ID_SIZE];
+        char *buf;
+
+        cmp_ok(trace_queue("service"), "==", -1, "trace_queue() without init");
+        init_job_trace();
+        next_trace_id(id1, sizeof(id1));
+        next_trace_id(id2, sizeof(id2));
+        ok(strcmp(id1, id2) != 0, "trace ids are unique: %s %s", id1, id2);
+
+        memset(&trace, 0, sizeof(trace));
+        trace.queue = "service";
+        cmp_ok(trace_result(&trace), "==", -1, "results without trace id are not accounted");
+
+        trace.trace_id                = id1;
+        trace.next_check.tv_sec       = 1000;
+        trace.core_time.tv_sec        = 1001;
+        trace.pickup_time.tv_sec      = 1001;
+        trace.pickup_time.tv_usec     = 3000;
+        trace.start_time.tv_sec       = 1001;
+        trace.start_time.tv_usec      = 4000;
+        trace.finish_time.tv_sec      = 1003;
+        trace.finish_time.tv_usec     = 4000;
+        trace.sent_time.tv_sec        = 1003;
+        trace.sent_time.tv_usec       = 5000;
+        trace.received.tv_sec         = 1003;
+        trace.received.tv_usec        = 600000;
+        cmp_ok(trace_result(&trace), "==", trace_queue("service"), "traced result is accounted");
+        trace_observe(trace_queue("host"), GM_TRACE_SUBMIT, 0.002);
+
+        buf = gm_malloc(GM_TRACE_BUFFERSIZE);
+        format_trace_histograms(buf, GM_TRACE_BUFFERSIZE);
+        like(buf, "mod_gearman_job_segment_seconds_bucket\\{queue=\"service\",segment=\"queue\",le=\"0.005\"\\} 1", "queue segment histogram");
+        like(buf, "mod_gearman_job_segment_seconds_bucket\\{queue=\"service\",segment=\"exec\",le=\"1\"\\} 0", "exec segment histogram");
+        like(buf, "mod_gearman_job_segment_seconds_count\\{queue=\"host\",segment=\"submit\"\\} 1", "submit segment count");
+        trace_observe(trace_queue("a\"b"), GM_TRACE_SUBMIT, 0.002);
+        format_trace_histograms(buf, GM_TRACE_BUFFERSIZE);
+        like(buf, "mod_gearman_job_segment_seconds_count\\{queue=\"a\\\\\"b\",segment=\"submit\"\\} 1", "queue label is escaped");
+        free(buf);
+        free_job_trace();
+    }
+
+    /* parse gearmand admin answer */
+    {
+        mod_gm_server_status_t *stats;
+        char version[GM_BUFFERSIZE];
+        char answer[GM_BUFFERSIZE];
+
+        stats = gm_malloc(sizeof(mod_gm_server_status_t));
+        stats->function_num = 0;
+        stats->worker_num   = 0;
+        snprintf(answer, sizeof(answer), "service\t12\t2\t5\ndummy\t0\t0\t0\nhost\t3\t1\t4\n.\nOK 1.1.19\n");
+        ok(parse_gearman_server_data(stats, answer, version, sizeof(version)) == GM_OK, "parsed status answer");
+        ok(stats->function_num == 2, "empty dummy queue is skipped");
+        ok(!strcmp(stats->function[0]->queue, "host") && stats->function[1]->waiting == 10, "queues are sorted and waiting jobs calculated");
+        free_mod_gm_status_server(stats);
+
+        stats = gm_malloc(sizeof(mod_gm_server_status_t));
+        stats->function_num = 0;
+        stats->worker_num   = 0;
+        snprintf(answer, sizeof(answer), "service\t12\t2\t5\nhost\t3");
+        ok(parse_gearman_server_data(stats, answer, version, sizeof(version)) == GM_ERROR, "incomplete answer is rejected");
+        free_mod_gm_status_server(stats);
+    }
+
     mod_gm_free_opt(mod_gm_opt);
 
+    /* send_gearman daemon */
+    test_send_gearman_daemon();
+
+    /* send_gearman import */
+    test_send_gearman_import();
+
     return exit_status();
 }
 
@@ -8,6 +8,19 @@
 #include <common.h>
 #include <utils.h>
 #include <check_utils.h>
+#include <builtin_plugins.h>
+#include <dl_plugins.h>
+#include <exec_plan.h>
+#include <single_flight.h>
+#include <plugin_usage.h>
+#include <job_window.h>
+#include <cpu_affinity.h>
+#include <worker_metrics.h>
+#include <worker_client.h>
+#include <send_multi_parser.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/un.h>
 #ifdef EMBEDDEDPERL
 #include <epn_utils.h>
 #endif
@@ -16,6 +29,120 @@
 #include <worker_dummy_functions.c>
 
 mod_gm_opt_t *mod_gm_opt;
+extern int worker_run_mode;
+extern volatile sig_atomic_t shmid;
+extern int shm_index;
+extern pid_t current_pid;
+
+/* run single flight job in a child, result is reported through the returned pipe */
+int start_flight_follower(char *command_line, int timeout, pid_t *child);
+int start_flight_follower(char *command_line, int timeout, pid_t *child) {
+    gm_job_t *follower;
+    char buf[GM_BUFFERSIZE];
+    int fds[2], flight;
+
+    if(pipe(fds) != 0)
+        perror("pipe");
+    *child = fork();
+    if(*child == 0) {
+        close(fds[0]);
+        follower = ( gm_job_t * )malloc( sizeof *follower );
+        set_default_job(follower, mod_gm_opt);
+        follower->type         = gm_strdup("service");
+        follower->command_line = gm_strdup(command_line);
+        follower->timeout      = timeout;
+        gettimeofday(&follower->start_time, NULL);
+        flight = single_flight_join(follower);
+        snprintf(buf, sizeof(buf), "%d %d %s", flight, follower->return_code, follower->output != NULL ? follower->output : "");
+        if(write(fds[1], buf, strlen(buf)+1) <= 0)
+            perror("write");
+        _exit(0);
+    }
+    close(fds[1]);
+    return fds[0];
+}
+
+/* replace numbers by N, response times and counters differ between two runs */
+void mask_numbers(char *text);
+void mask_numbers(char *text) {
+    char *src = text, *dst = text;
+    while(*src != '\x0') {
+        if(*src >= '0' && *src <= '9') {
+            while((*src >= '0' && *src <= '9') || *src == '.')
+                src++;
+            *dst++ = 'N';
+            continue;
+        }
+        *dst++ = *src++;
+    }
+    *dst = '\x0';
+}
+
+/* run a command as builtin and with the real plugin and compare both */
+void compare_builtin(char *plugin, char *args, int exact);
+void compare_builtin(char *plugin, char *args, int exact) {
+    char *plugin_dirs[] = { "/usr/lib/nagios/plugins", "/usr/lib64/nagios/plugins", "/usr/lib/monitoring-plugins", "/usr/local/nagios/libexec", NULL };
+    char cmd[GM_BUFFERSIZE];
+    char *builtin_result = NULL, *exec_result = NULL, *error = NULL;
+    int x, builtin_rc, exec_rc;
+    struct stat st;
+
+    for(x = 0; plugin_dirs[x] != NULL; x++) {
+        snprintf(cmd, sizeof(cmd), "%s/%s", plugin_dirs[x], plugin);
+        if(stat(cmd, &st) == 0)
+            break;
+    }
+    if(plugin_dirs[x] == NULL) {
+        skippy(2, "no %s installed", plugin);
+        return;
+    }
+    snprintf(cmd, sizeof(cmd), "%s/%s %s", plugin_dirs[x], plugin, args);
+
+    mod_gm_opt->builtin_plugins = GM_ENABLED;
+    builtin_rc = run_builtin_check(cmd, &builtin_result, &error);
+    free(error);
+    mod_gm_opt->builtin_plugins = GM_DISABLED;
+    if(builtin_rc == GM_NO_BUILTIN) {
+        fail("cmd '%s' is not handled as builtin", cmd);
+        skippy(1, "no builtin result");
+        return;
+    }
+    exec_rc = run_check(cmd, &exec_result, &error);
+    free(error);
+
+    if(!exact) {
+        mask_numbers(builtin_result);
+        mask_numbers(exec_result);
+    }
+    cmp_ok(real_exit_code(builtin_rc), "==", real_exit_code(exec_rc), "builtin and real %s return the same exit code", plugin);
+    is(builtin_result, exec_result, "builtin and real %s return the same output", plugin);
+    free(builtin_result);
+    free(exec_result);
+}
+
+/* create a job for the job window tests */
+gm_job_t *window_job(char *host, char *service, int next_check, int timeout, int check_options);
+gm_job_t *window_job(char *host, char *service, int next_check, int timeout, int check_options) {
+    gm_job_t *job = ( gm_job_t * )malloc( sizeof *job );
+    set_default_job(job, mod_gm_opt);
+    job->type                = gm_strdup(service != NULL ? "service" : "host");
+    job->host_name           = gm_strdup(host);
+    job->service_description = service != NULL ? gm_strdup(service) : NULL;
+    job->command_line        = gm_strdup("/bin/true");
+    job->next_check.tv_sec   = next_check;
+    job->core_time.tv_sec    = 1000;
+    job->timeout             = timeout;
+    job->check_options       = check_options;
+    return job;
+}
+
+/* feed xml into the multi parser in chunks like read_multi_stream does */
+void feed_multi_parser(gm_multi_parser_t *parser, const char *data, size_t chunk);
+void feed_multi_parser(gm_multi_parser_t *parser, const char *data, size_t chunk) {
+    size_t len = strlen(data), x;
+    for(x = 0; x < len; x += chunk)
+        parse_multi_data(parser, data + x, len - x < chunk ? len - x : chunk);
+}
 
 int main (int argc, char **argv, char **env) {
     argc = argc; argv = argv; env  = env;
@@ -26,7 +153,7 @@ int main (int argc, char **argv, char **env) {
     char cwd[1024];
     struct stat st;
 
-    plan(80);
+    plan(202);
 
     /* set hostname and cwd */
     gethostname(hostname, GM_BUFFERSIZE-1);
@@ -91,6 +218,16 @@ int main (int argc, char **argv, char **env) {
     free(result);
     free(error);
 
+    /*****************************************
+     * send_gearman bulk
+     */
+    strcpy(cmd, "./send_gearman --server=blah --bulk_size=2 < t/data/send_gearman_results.txt");
+    rrc = real_exit_code(run_check(cmd, &result, &error));
+    cmp_ok(rrc, "==", 3, "cmd '%s' returned rc %d", cmd, rrc);
+    like(result, "batch 1 \\(lines 1-2\\): 2 of 2 result\\(s\\) failed", "failed batch is reported");
+    free(result);
+    free(error);
+
     /*****************************************
      * send_multi
      */
@@ -105,6 +242,63 @@ int main (int argc, char **argv, char **env) {
     free(result);
     free(error);
 
+    /*****************************************
+     * send_multi xml parser
+     */
+    {
+        gm_multi_parser_t parser;
+        char xml[200], *big, *output;
+        int x;
+
+        strcpy(xml, "a&#x7C;b&#124;c&lt;&amp;d&#X41;");
+        is(decode_xml(xml), "a|b|c<&dA", "decode_xml() numeric references");
+        strcpy(xml, "&#x;&#x80;&#xZZ;&#12");
+        is(decode_xml(xml), "&#x;&#x80;&#xZZ;&#12", "decode_xml() keeps invalid references");
+
+        free(mod_gm_opt->host);
+        mod_gm_opt->host = gm_strdup("multi");
+
+        /* tags and values split at every possible position */
+        strcpy(xml, "<CHILD><no>0</no></CHILD><CHILD><no>1</no><name>svc&#x20;1</name><rc>2</rc><runtime>0.5</runtime><output>out</output><error></error></CHILD>");
+        for(x = 1; x < 12; x++) {
+            memset(&parser, 0, sizeof(parser));
+            gettimeofday(&parser.end_time, NULL);
+            feed_multi_parser(&parser, xml, x);
+            if(parser.num != 1 || !strstr(parser.results[0], "service_description=svc 1\n")
+               || !strstr(parser.results[0], "return_code=2\n") || !strstr(parser.results[0], "output=out\n"))
+                break;
+            free_multi_parser(&parser);
+        }
+        cmp_ok(x, "==", 12, "tags split across chunks");
+        if(x < 12)
+            free_multi_parser(&parser);
+
+        /* child larger than one read buffer */
+        big = gm_malloc(GM_BUFFERSIZE * 3 + 200);
+        output = gm_malloc(GM_BUFFERSIZE * 2 + 1);
+        memset(output, 'x', GM_BUFFERSIZE * 2);
+        output[GM_BUFFERSIZE * 2] = '\0';
+        snprintf(big, GM_BUFFERSIZE * 3 + 200, "<CHILD><no>1</no><name>big</name><rc>0</rc><runtime>1</runtime><output>%s&amp;</output><error>e</error></CHILD>", output);
+        memset(&parser, 0, sizeof(parser));
+        gettimeofday(&parser.end_time, NULL);
+        feed_multi_parser(&parser, big, GM_BUFFERSIZE);
+        cmp_ok(parser.num, "==", 1, "child larger than GM_BUFFERSIZE");
+        ok(parser.num == 1 && strstr(parser.results[0], "xx& [e]\n") != NULL && strlen(strstr(parser.results[0], "output=")) == GM_BUFFERSIZE * 2 + 14, "large child output is complete");
+        free_multi_parser(&parser);
+        free(output);
+        free(big);
+    }
+
+    /*****************************************
+     * check_gearman probe jobs
+     */
+    strcpy(cmd, "./check_gearman -H 127.0.0.1:1 -q probe -s test -n 3 -P 2 -t 5");
+    rrc = real_exit_code(run_check(cmd, &result, &error));
+    cmp_ok(rrc, "==", 2, "cmd '%s' returned rc %d", cmd, rrc);
+    like(result, "check_gearman CRITICAL - 3 of 3 probe jobs failed.*\\|errors=100.0%;;;0;100 jobs=3", "probe result");
+    free(result);
+    free(error);
+
     /*****************************************
      * simple test command 1
      */
@@ -454,6 +648,582 @@ int main (int argc, char **argv, char **env) {
     free(result);
     free(error);
 
+    /*****************************************
+     * exec plan cache
+     */
+    mod_gm_opt->restrict_path_num = 0;
+    {
+        gm_exec_plan_t *plan, *plan2;
+        int hits;
+        plan = get_exec_plan("/bin/echo $HOME");
+        cmp_ok(plan->use_shell, "==", TRUE, "command with variables uses the shell");
+        plan = get_exec_plan("/bin/echo a  b");
+        cmp_ok(plan->use_shell, "==", FALSE, "plain command uses execv");
+        cmp_ok(plan->argc, "==", 3, "plan has %d arguments", plan->argc);
+        is(plan->argv[2], "b", "last argument");
+        is(plan->path, "/bin/echo", "symlinks in the plugin path are not resolved");
+        hits  = exec_plan_hits;
+        plan2 = get_exec_plan("/bin/echo a  b");
+        ok(plan == plan2 && exec_plan_hits == hits+1, "plan taken from cache");
+        snprintf(res, 150, "--restrict_path=/nonexisting/");
+        parse_args_line(mod_gm_opt, res, 0);
+        plan = get_exec_plan("/bin/echo a  b");
+        cmp_ok(plan->verdict, "==", GM_EXEC_NOT_RESTRICTED_PATH, "cached verdict follows restrict_path");
+        mod_gm_opt->restrict_path_num = 0;
+        plan = get_exec_plan("/bin/echo a  b");
+        cmp_ok(plan->verdict, "==", GM_EXEC_ALLOWED, "cached verdict without restrict_path");
+        flush_exec_plans();
+        hits = exec_plan_misses;
+        plan = get_exec_plan("/bin/echo a  b");
+        cmp_ok(exec_plan_misses, "==", hits+1, "flushed plan is created again");
+        mod_gm_opt->exec_plan_cache = 0;
+        plan = get_exec_plan("/bin/echo c");
+        cmp_ok(plan->cached, "==", FALSE, "exec_plan_cache=0 disables the cache");
+        release_exec_plan(plan);
+        mod_gm_opt->exec_plan_cache = 1000;
+    }
+
+    /*****************************************
+     * builtin plugins
+     */
+    mod_gm_opt->restrict_path_num = 0;
+    strcpy(cmd, "/usr/lib/nagios/plugins/check_dummy 0");
+    rc = run_builtin_check(cmd, &result, &error);
+    cmp_ok(rc, "==", GM_NO_BUILTIN, "builtin plugins are disabled by default");
+    mod_gm_opt->builtin_plugins = GM_ENABLED;
+
+    rc = run_builtin_check(cmd, &result, &error);
+    cmp_ok(real_exit_code(rc), "==", 0, "cmd '%s' returned rc %d", cmd, real_exit_code(rc));
+    is(result, "OK\\n", "builtin check_dummy output");
+    free(result);
+    free(error);
+
+    strcpy(cmd, "check_dummy 2 broken");
+    rc = run_builtin_check(cmd, &result, &error);
+    cmp_ok(real_exit_code(rc), "==", 2, "cmd '%s' returned rc %d", cmd, real_exit_code(rc));
+    is(result, "CRITICAL: broken\\n", "builtin check_dummy output");
+    free(result);
+    free(error);
+
+    strcpy(cmd, "check_dummy 7");
+    rc = run_builtin_check(cmd, &result, &error);
+    cmp_ok(real_exit_code(rc), "==", 3, "cmd '%s' returned rc %d", cmd, real_exit_code(rc));
+    is(result, "UNKNOWN: Status 7 is not a supported error state\\n", "builtin check_dummy output");
+    free(result);
+    free(error);
+
+    strcpy(cmd, "check_dummy --help");
+    cmp_ok(run_builtin_check(cmd, &result, &error), "==", GM_NO_BUILTIN, "cmd '%s' falls back to exec", cmd);
+    strcpy(cmd, "check_dummy 0 'quoted text'");
+    cmp_ok(run_builtin_check(cmd, &result, &error), "==", GM_NO_BUILTIN, "cmd '%s' falls back to exec", cmd);
+    strcpy(cmd, "/bin/true");
+    cmp_ok(run_builtin_check(cmd, &result, &error), "==", GM_NO_BUILTIN, "cmd '%s' falls back to exec", cmd);
+
+    /* check_tcp against a local listening socket */
+    char compare_args[100];
+    int sd, port;
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    sd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port        = 0;
+    bind(sd, (struct sockaddr *)&addr, sizeof(addr));
+    listen(sd, 5);
+    getsockname(sd, (struct sockaddr *)&addr, &addrlen);
+    port = ntohs(addr.sin_port);
+    snprintf(cmd, sizeof(cmd), "$USER1$/check_tcp -H 127.0.0.1 -p %d", port);
+    cmp_ok(run_builtin_check(cmd, &result, &error), "==", GM_NO_BUILTIN, "cmd '%s' with macros falls back to exec", cmd);
+    snprintf(cmd, sizeof(cmd), "/usr/lib/nagios/plugins/check_tcp -H 127.0.0.1 -p %d -t 5", port);
+    rc = run_builtin_check(cmd, &result, &error);
+    cmp_ok(real_exit_code(rc), "==", 0, "cmd '%s' returned rc %d", cmd, real_exit_code(rc));
+    like(result, "^TCP OK - [0-9]+\\.[0-9]{3} second response time on 127.0.0.1 port [0-9]+\\|time=[0-9.]+s;;;0.000000;5.000000\\\\n$", "builtin check_tcp output");
+    free(result);
+    free(error);
+    snprintf(cmd, sizeof(cmd), "/usr/lib/nagios/plugins/check_tcp -H 127.0.0.1 -p %d -w 3 -c 4", port);
+    rc = run_builtin_check(cmd, &result, &error);
+    like(result, "\\|time=[0-9.]+s;3.000000;4.000000;0.000000;10.000000\\\\n$", "builtin check_tcp perfdata with thresholds");
+    free(result);
+    free(error);
+    snprintf(compare_args, sizeof(compare_args), "-H 127.0.0.1 -p %d", port);
+    compare_builtin("check_tcp", compare_args, FALSE);
+    close(sd);
+
+    rc = run_builtin_check(cmd, &result, &error);
+    cmp_ok(real_exit_code(rc), "==", 2, "cmd '%s' returned rc %d", cmd, real_exit_code(rc));
+    like(result, "^connect to address 127.0.0.1 and port [0-9]+: Connection refused", "builtin check_tcp output");
+    free(result);
+    free(error);
+
+    /* check_file_age */
+    strcpy(cmd, "check_file_age -w 240 -c 600 -f ./t/rc");
+    rc = run_builtin_check(cmd, &result, &error);
+    cmp_ok(real_exit_code(rc), "<=", 2, "cmd '%s' returned rc %d", cmd, real_exit_code(rc));
+    like(result, "^FILE_AGE (OK|WARNING|CRITICAL): ./t/rc is [0-9]+ seconds old and [0-9]+ bytes \\| age=[0-9]+s;240;600 size=[0-9]+B;0;0;0", "builtin check_file_age output");
+    free(result);
+    free(error);
+
+    strcpy(cmd, "check_file_age -f /does/not/exist");
+    rc = run_builtin_check(cmd, &result, &error);
+    cmp_ok(real_exit_code(rc), "==", 2, "cmd '%s' returned rc %d", cmd, real_exit_code(rc));
+    is(result, "FILE_AGE CRITICAL: File not found - /does/not/exist\\n", "builtin check_file_age output");
+    free(result);
+    free(error);
+
+    compare_builtin("check_file_age", "-w 240 -c 600 -f ./t/rc", FALSE);
+
+    /* check_procs, our own process must be found */
+    char comm[32] = "";
+    FILE *fp = fopen("/proc/self/comm", "r");
+    if(fp != NULL) {
+        if(fgets(comm, sizeof(comm), fp) == NULL)
+            comm[0] = '\x0';
+        fclose(fp);
+    }
+    comm[strcspn(comm, "\n")] = '\x0';
+    if(comm[0] != '\x0') {
+        snprintf(cmd, sizeof(cmd), "check_procs -w 1: -c 1: -C %s", comm);
+        rc = run_builtin_check(cmd, &result, &error);
+        cmp_ok(real_exit_code(rc), "==", 0, "cmd '%s' returned rc %d", cmd, real_exit_code(rc));
+        like(result, "^PROCS OK: [0-9]+ process(es)? with command name '", "builtin check_procs output");
+        free(result);
+        free(error);
+        snprintf(cmd, sizeof(cmd), "check_procs -c 0 -C %s", comm);
+        rc = run_builtin_check(cmd, &result, &error);
+        cmp_ok(real_exit_code(rc), "==", 2, "cmd '%s' returned rc %d", cmd, real_exit_code(rc));
+        free(result);
+        free(error);
+        snprintf(compare_args, sizeof(compare_args), "-w 1: -c 1: -C %s", comm);
+        compare_builtin("check_procs", compare_args, FALSE);
+    } else {
+        skippy(5, "no /proc filesystem");
+    }
+
+    /* compare against the real plugins if they are installed */
+    compare_builtin("check_dummy", "1 builtin", TRUE);
+    mod_gm_opt->builtin_plugins = GM_DISABLED;
+
+    /*****************************************
+     * shared object plugins
+     */
+    if(stat("./t/plugins/check_example.so", &st) == 0) {
+        char *pid_str;
+        cmp_ok(load_dl_plugins("./t/plugins"), "==", 1, "loaded example plugin");
+        cmp_ok(init_dl_plugins(), "==", GM_OK, "initialized plugins");
+
+        strcpy(cmd, "/opt/plugins/check_example 2 inprocess");
+        rrc = real_exit_code(run_check(cmd, &result, &error));
+        cmp_ok(rrc, "==", 2, "cmd '%s' returned rc %d", cmd, rrc);
+        like(result, "^EXAMPLE inprocess pid [0-9]+\\|timeout=60s$", "plugin output with perfdata");
+        pid_str = strstr(result, "pid ");
+        cmp_ok(pid_str != NULL ? atoi(pid_str+4) : 0, "==", getpid(), "plugin ran in our process");
+        free(result);
+        free(error);
+
+        mod_gm_opt->plugin_isolation = GM_ENABLED;
+        strcpy(cmd, "/opt/plugins/check_example 1 isolated");
+        rrc = real_exit_code(run_check(cmd, &result, &error));
+        cmp_ok(rrc, "==", 1, "cmd '%s' returned rc %d", cmd, rrc);
+        like(result, "^EXAMPLE isolated pid [0-9]+\\|timeout=60s$", "isolated plugin output with perfdata");
+        pid_str = strstr(result, "pid ");
+        ok(pid_str != NULL && atoi(pid_str+4) != getpid(), "plugin ran in helper process");
+        free(result);
+        free(error);
+        mod_gm_opt->plugin_isolation = GM_DISABLED;
+        teardown_dl_plugins();
+    } else {
+        skippy(8, "example plugin not build, run make check");
+    }
+
+    /*****************************************
+     * cpu affinity
+     */
+    {
+        int nodes[GM_MAX_NUMA_NODES];
+        cpu_set_t cpus[GM_MAX_NUMA_NODES], set;
+        int status;
+        pid_t child;
+        char affinity_opt[100];
+
+        cmp_ok(parse_cpulist("0-3,8,10-11\n", &set), "==", 7, "parsed cpu list");
+        ok(CPU_ISSET(2, &set) && CPU_ISSET(8, &set) && !CPU_ISSET(9, &set) && CPU_ISSET(11, &set), "cpu list contains the right cpus");
+        ok(get_numa_nodes(nodes, cpus, GM_MAX_NUMA_NODES) >= 1 && CPU_COUNT(&cpus[0]) >= 1, "got numa nodes");
+
+        strcpy(affinity_opt, "queue_node=hostgroup_a:1, hostgroup_b:0");
+        cmp_ok(parse_args_line(mod_gm_opt, affinity_opt, 0), "==", GM_OK, "parsed queue_node option");
+        strcpy(affinity_opt, "queue_node=broken");
+        cmp_ok(parse_args_line(mod_gm_opt, affinity_opt, 0), "==", GM_ERROR, "invalid queue_node option");
+        strcpy(affinity_opt, "cpu_affinity=core");
+        parse_args_line(mod_gm_opt, affinity_opt, 0);
+        cmp_ok(mod_gm_opt->cpu_affinity, "==", GM_CPU_AFFINITY_CORE, "parsed cpu_affinity option");
+
+        worker_numa_node = 0;
+        ok(queue_allowed_on_worker("hostgroup_b") == TRUE && queue_allowed_on_worker("hostgroup_a") == FALSE && queue_allowed_on_worker("service") == TRUE, "queues are filtered by numa node");
+        worker_numa_node = -1;
+        ok(queue_allowed_on_worker("hostgroup_a") == TRUE, "unpinned worker serves all queues");
+
+        /* do not pin the test itself */
+        child = fork();
+        if(child == 0) {
+            if(set_worker_affinity(1) != GM_OK || sched_getaffinity(0, sizeof(set), &set) != 0)
+                _exit(1);
+            _exit(CPU_COUNT(&set) == 1 ? 0 : 2);
+        }
+        waitpid(child, &status, 0);
+        cmp_ok(real_exit_code(status), "==", 0, "worker pinned to a single core");
+        mod_gm_opt->cpu_affinity = GM_CPU_AFFINITY_NONE;
+    }
+
+    /*****************************************
+     * job window
+     */
+    {
+        gm_job_t *a, *b, *c, *d, *e, *superseded;
+        char window_file[64];
+        time_t now;
+
+        a = window_job("host1", "svc1", 1000, 60, 0);
+        b = window_job("host2", "svc1", 1000, 10, 0);
+        c = window_job("host3", NULL,   1005, 10, 0);
+        d = window_job("host4", "svc1", 2000, 60, GM_CHECK_OPTION_FORCE_EXECUTION);
+        cmp_ok((int)job_deadline(a), "==", 1060, "deadline is next_check plus timeout");
+        ok(job_deadline(d) < job_deadline(b), "forced checks are sorted first");
+
+        ok(job_window_add(a) == NULL && job_window_add(b) == NULL && job_window_add(c) == NULL && job_window_add(d) == NULL, "added jobs to window");
+        cmp_ok(job_window_size(), "==", 4, "window contains 4 jobs");
+
+        /* newer check of the same service supersedes the queued one */
+        e = window_job("host2", "svc1", 1030, 10, 0);
+        superseded = job_window_add(e);
+        ok(superseded == b && job_window_size() == 4, "older check of same service is superseded");
+        free_job(b);
+
+        /* older check than the queued one is superseded itself */
+        b = window_job("host3", NULL, 900, 10, 0);
+        superseded = job_window_add(b);
+        ok(superseded == b && job_window_size() == 4, "outdated check is superseded");
+        free_job(b);
+
+        ok(job_window_next() == d && job_window_next() == c && job_window_next() == e && job_window_next() == a, "jobs are returned earliest deadline first");
+        ok(job_window_next() == NULL && job_window_size() == 0, "window is empty");
+        free_job(a);
+        free_job(c);
+        free_job(d);
+        free_job(e);
+
+        /* forced and overdue jobs are executed, staleness is up to max_age */
+        worker_run_mode = GM_WORKER_STANDALONE;
+        now = time(NULL);
+        snprintf(window_file, sizeof(window_file), "/tmp/mod_gm_window.%d", (int)getpid());
+        unlink(window_file);
+        d = window_job("host4", "svc1", now - 100, 10, GM_CHECK_OPTION_FORCE_EXECUTION);
+        d->core_time.tv_sec = now - 5;
+        free(d->command_line);
+        gm_asprintf(&d->command_line, "/bin/touch %s", window_file);
+        job_window_add(d);
+        run_window_job();
+        ok(stat(window_file, &st) == 0, "forced job is executed");
+        unlink(window_file);
+
+        a = window_job("host1", "svc1", now - 100, 10, 0);
+        a->core_time.tv_sec = now - 100;
+        free(a->command_line);
+        gm_asprintf(&a->command_line, "/bin/touch %s", window_file);
+        job_window_add(a);
+        run_window_job();
+        ok(stat(window_file, &st) == 0, "overdue job is executed without max_age");
+        unlink(window_file);
+
+        /* prefetched jobs keep the worker slot busy and are counted once */
+        {
+            int *state_shm;
+
+            shmid           = shmget(IPC_PRIVATE, GM_SHM_SIZE, IPC_CREAT | 0600);
+            state_shm       = shmat(shmid, NULL, 0);
+            shm_index       = 30;
+            current_pid     = getpid();
+            worker_run_mode = GM_WORKER_MULTI;
+            state_shm[0]         = 0;
+            state_shm[shm_index] = -current_pid;
+
+            a = window_job("host1", "svc1", now, 10, 0);
+            job_window_add(a);
+            set_state(GM_JOB_START);
+            set_state(GM_JOB_START);
+            cmp_ok(state_shm[shm_index], "==", current_pid, "slot is busy with prefetched jobs");
+            run_window_job();
+            ok(state_shm[shm_index] == -current_pid && state_shm[0] == 1, "slot is idle once the window is empty, job counted once");
+
+            a = window_job("host1", "svc1", now, 10, 0);
+            b = window_job("host2", "svc1", now, 10, 0);
+            job_window_add(a);
+            job_window_add(b);
+            set_state(GM_JOB_START);
+            run_window_job();
+            ok(state_shm[shm_index] == current_pid && state_shm[0] == 2, "slot stays busy while jobs are waiting");
+            run_window_job();
+            ok(state_shm[shm_index] == -current_pid && state_shm[0] == 3, "slot is idle after the last prefetched job");
+
+            worker_run_mode = GM_WORKER_STANDALONE;
+            shmdt(state_shm);
+            shmctl(shmid, IPC_RMID, NULL);
+        }
+    }
+
+    /*****************************************
+     * plugin resource usage
+     */
+    {
+        gm_job_t *usage_job;
+        int x;
+        char usage_buf[GM_BUFFERSIZE];
+
+        is(plugin_usage_name("/usr/lib/plugins/check_ping -H localhost", usage_buf, sizeof(usage_buf)), "check_ping", "plugin name from path");
+        is(plugin_usage_name("  A=1 B='x' ./check_foo", usage_buf, sizeof(usage_buf)), "check_foo", "plugin name after assignments");
+        is(plugin_usage_name("check_bar", usage_buf, sizeof(usage_buf)), "check_bar", "plugin name without path");
+        is(plugin_usage_name("", usage_buf, sizeof(usage_buf)), "(unknown)", "plugin name of empty command");
+
+        usage_job = ( gm_job_t * )malloc( sizeof *usage_job );
+        set_default_job(usage_job, mod_gm_opt);
+        usage_job->type         = gm_strdup("service");
+        usage_job->command_line = gm_strdup("/bin/sh -c 'i=0; while [ $i -lt 100000 ]; do i=$((i+1)); done'");
+        usage_job->timeout      = 30;
+        execute_safe_command(usage_job, GM_DISABLED, hostname);
+        ok(usage_job->has_rusage == TRUE && usage_job->rusage.ru_utime.tv_sec + usage_job->rusage.ru_utime.tv_usec > 0, "rusage collected without fork_on_exec");
+        usage_job->has_rusage = FALSE;
+        execute_safe_command(usage_job, GM_ENABLED, hostname);
+        ok(usage_job->has_rusage == TRUE && usage_job->rusage.ru_maxrss > 0, "rusage collected with fork_on_exec");
+
+        cmp_ok(init_plugin_usage(), "==", GM_OK, "created plugin usage table");
+        add_plugin_usage(usage_job->command_line, &usage_job->rusage);
+        add_plugin_usage(usage_job->command_line, &usage_job->rusage);
+        usage_job->rusage.ru_utime.tv_sec  = 0;
+        usage_job->rusage.ru_utime.tv_usec = 0;
+        usage_job->rusage.ru_stime.tv_sec  = 0;
+        usage_job->rusage.ru_stime.tv_usec = 0;
+        add_plugin_usage("/bin/true", &usage_job->rusage);
+        cmp_ok(format_plugin_usage(usage_buf, sizeof(usage_buf)), "==", 2, "two plugins listed");
+        like(usage_buf, "^sh count=2 user=[0-9.]+s sys=[0-9.]+s avg_cpu=[0-9.]+s max_rss=[0-9]+kB avg_rss=[0-9]+kB vcsw=[0-9]+ ivcsw=[0-9]+\n"
+                        "true count=1 user=0.000s sys=0.000s ", "plugins are sorted by cpu time");
+
+        /* plugins which do not fit anymore are summed up as (other) */
+        for(x = 0; x < GM_PLUGIN_USAGE_SLOTS - 3; x++) {
+            snprintf(usage_buf, sizeof(usage_buf), "/usr/lib/plugins/check_fill_%d", x);
+            add_plugin_usage(usage_buf, &usage_job->rusage);
+        }
+        add_plugin_usage("check_over_1", &usage_job->rusage);
+        add_plugin_usage("check_over_2", &usage_job->rusage);
+        add_plugin_usage("check_over_3", &usage_job->rusage);
+        cmp_ok(format_plugin_usage(usage_buf, sizeof(usage_buf)), "==", GM_PLUGIN_USAGE_SLOTS, "usage table is full");
+        like(usage_buf, "(^|\n)\\(other\\) count=3 ", "overflowing plugins are summed up as (other)");
+        unlike(usage_buf, "check_over", "overflowing plugins do not rename (other)");
+        free_plugin_usage();
+        free_job(usage_job);
+    }
+
+    /*****************************************
+     * single flight
+     */
+    {
+        gm_job_t *leader;
+        char flight_buf[GM_BUFFERSIZE];
+        int flight_pipe, flight;
+        pid_t child;
+
+        cmp_ok(init_single_flight(2), "==", GM_OK, "created single flight table");
+        leader = ( gm_job_t * )malloc( sizeof *leader );
+        set_default_job(leader, mod_gm_opt);
+        leader->type         = gm_strdup("service");
+        leader->command_line = gm_strdup("/bin/echo flight");
+        leader->timeout      = 5;
+        gettimeofday(&leader->start_time, NULL);
+        flight = single_flight_join(leader);
+        ok(flight >= 0, "first job runs the command");
+
+
+        flight_pipe = start_flight_follower("/bin/echo flight", 5, &child);
+        usleep(300000);
+        leader->return_code = 1;
+        leader->output      = gm_strdup("shared output");
+        single_flight_done(flight, leader);
+        flight_buf[0] = '\0';
+        if(read(flight_pipe, flight_buf, sizeof(flight_buf)) < 0)
+            perror("read");
+        close(flight_pipe);
+        waitpid(child, NULL, 0);
+        is(flight_buf, "-2 1 shared output", "identical command waits for the running one");
+        cmp_ok(single_flight_shared(), "==", 1, "shared result is counted");
+
+        /* follower gives up after its own timeout */
+        flight = single_flight_join(leader);
+        ok(flight >= 0, "finished slot is reused");
+        flight_pipe = start_flight_follower("/bin/echo flight", 1, &child);
+        flight_buf[0] = '\0';
+        if(read(flight_pipe, flight_buf, sizeof(flight_buf)) < 0)
+            perror("read");
+        close(flight_pipe);
+        waitpid(child, NULL, 0);
+        like(flight_buf, "^-2 2 \\(Service Check Timed Out On Worker: ", "wait is bounded by the job timeout");
+        single_flight_done(flight, leader);
+
+        /* owner dies without result */
+        child = fork();
+        if(child == 0) {
+            free(leader->command_line);
+            leader->command_line = gm_strdup("/bin/echo dead");
+            _exit(single_flight_join(leader) >= 0 ? 0 : 1);
+        }
+        waitpid(child, &rc, 0);
+        free(leader->command_line);
+        leader->command_line = gm_strdup("/bin/echo dead");
+        flight = single_flight_join(leader);
+        ok(real_exit_code(rc) == 0 && flight >= 0, "command of a dead worker is taken over");
+        single_flight_done(flight, leader);
+
+        /* result larger than the slot is not shared */
+        flight = single_flight_join(leader);
+        ok(flight >= 0, "finished slot is taken again");
+        flight_pipe = start_flight_follower("/bin/echo dead", 5, &child);
+        usleep(300000);
+        free(leader->output);
+        leader->output = malloc(GM_BUFFERSIZE * 2);
+        memset(leader->output, 'x', GM_BUFFERSIZE * 2 - 1);
+        leader->output[GM_BUFFERSIZE * 2 - 1] = '\0';
+        single_flight_done(flight, leader);
+        flight_buf[0] = '\0';
+        if(read(flight_pipe, flight_buf, sizeof(flight_buf)) < 0)
+            perror("read");
+        close(flight_pipe);
+        waitpid(child, NULL, 0);
+        like(flight_buf, "^-1 ", "waiting worker runs a command with oversized output itself");
+
+        memset(flight_buf, 'x', GM_FLIGHT_MAX_COMMAND);
+        flight_buf[GM_FLIGHT_MAX_COMMAND] = '\0';
+        free(leader->command_line);
+        leader->command_line = gm_strdup(flight_buf);
+        cmp_ok(single_flight_join(leader), "==", GM_FLIGHT_NONE, "long command lines are not collapsed");
+        free_job(leader);
+        free_single_flight();
+    }
+
+    /*****************************************
+     * metrics
+     */
+    {
+        gm_job_t *metrics_job;
+        char *metrics_buf, *metrics_request;
+        int listener, client;
+        struct sockaddr_un sun;
+        struct timeval scrape_start, scrape_end;
+        pid_t child;
+
+        cmp_ok(init_metrics(), "==", GM_OK, "created metrics scoreboard");
+        metrics_job = ( gm_job_t * )malloc( sizeof *metrics_job );
+        set_default_job(metrics_job, mod_gm_opt);
+        metrics_job->type                = gm_strdup("service");
+        metrics_job->queue               = gm_strdup("hostgroup_test");
+        metrics_job->start_time.tv_sec   = 1000;
+        metrics_job->finish_time.tv_sec  = 1000;
+        metrics_job->finish_time.tv_usec = 200000;
+
+        /* worker update the scoreboard after fork */
+        child = fork();
+        if(child == 0) {
+            metrics_job_done(metrics_job);
+            metrics_job->early_timeout      = 1;
+            metrics_job->finish_time.tv_sec = 1040;
+            metrics_job_done(metrics_job);
+            metrics_inc(GM_METRIC_RECONNECTS);
+            _exit(0);
+        }
+        waitpid(child, NULL, 0);
+        metrics_inc(GM_METRIC_SPAWNED);
+        free(metrics_job->queue);
+        metrics_job->queue = gm_strdup("odd\"queue\\name\n");
+        metrics_job_done(metrics_job);
+
+        metrics_buf = malloc(GM_METRICS_BUFFERSIZE);
+        format_metrics(metrics_buf, GM_METRICS_BUFFERSIZE, NULL);
+        like(metrics_buf, "^# HELP mod_gearman_worker_spawned_total [^\n]*\n# TYPE mod_gearman_worker_spawned_total counter\nmod_gearman_worker_spawned_total 1\n", "spawned counter");
+        like(metrics_buf, "\nmod_gearman_worker_reconnects_total 1\n", "counters updated by worker");
+        like(metrics_buf, "\nmod_gearman_worker_jobs_total\\{queue=\"hostgroup_test\"\\} 2\n", "jobs per queue");
+        like(metrics_buf, "\nmod_gearman_worker_job_timeouts_total\\{queue=\"hostgroup_test\"\\} 1\n", "timeouts per queue");
+        like(metrics_buf, "_bucket\\{queue=\"hostgroup_test\",le=\"0.1\"\\} 0\n[^\n]*le=\"0.25\"\\} 1\n(.*\n)*[^\n]*le=\"30\"\\} 1\n[^\n]*le=\"60\"\\} 2\n[^\n]*le=\"\\+Inf\"\\} 2\n"
+                          "mod_gearman_worker_job_duration_seconds_sum\\{queue=\"hostgroup_test\"\\} 40.400000\n", "cumulative histogram");
+        like(metrics_buf, "\nmod_gearman_worker_jobs_total\\{queue=\"odd\\\\\"queue\\\\\\\\name\\\\n\"\\} 1\n", "label values are escaped");
+
+        /* scrape through a unix socket */
+        listener = open_metrics_listener("unix:/tmp/mod_gm_metrics_test.sock");
+        ok(listener >= 0, "metrics listener on unix socket");
+        memset(&sun, 0, sizeof(sun));
+        sun.sun_family = AF_UNIX;
+        strcpy(sun.sun_path, "/tmp/mod_gm_metrics_test.sock");
+        client = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(connect(client, (struct sockaddr *)&sun, sizeof(sun)) < 0)
+            perror("connect");
+        metrics_request = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        if(write(client, metrics_request, strlen(metrics_request)) < 0)
+            perror("write");
+        serve_metrics(listener, NULL, 1);
+        memset(metrics_buf, 0, GM_METRICS_BUFFERSIZE);
+        rc = 0;
+        while(rc < GM_METRICS_BUFFERSIZE-1) {
+            ssize_t got = read(client, metrics_buf+rc, GM_METRICS_BUFFERSIZE-1-rc);
+            if(got <= 0)
+                break;
+            rc += got;
+        }
+        close(client);
+        like(metrics_buf, "^HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n(.*\n)*mod_gearman_worker_jobs_total\\{queue=\"hostgroup_test\"\\} 2\n", "metrics served over http");
+
+        /* scraper which never sends its request */
+        client = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(connect(client, (struct sockaddr *)&sun, sizeof(sun)) < 0)
+            perror("connect");
+        gettimeofday(&scrape_start, NULL);
+        serve_metrics(listener, NULL, 1);
+        gettimeofday(&scrape_end, NULL);
+        close(client);
+        ok(timeval2double(&scrape_end) - timeval2double(&scrape_start) < 0.5, "slow scraper does not block the supervisor");
+
+        close_metrics_listener(listener);
+        ok(access("/tmp/mod_gm_metrics_test.sock", F_OK) != 0, "unix socket removed");
+
+        free(metrics_buf);
+        free_job(metrics_job);
+        free_metrics();
+    }
+
+    /*****************************************
+     * spare worker pool
+     */
+    {
+        int workers, jobs, max_spare, target, flapping = 0;
+
+        ok(worker_pool_busy(10, 10, 0) == TRUE, "all worker busy");
+        ok(worker_pool_busy(20, 5, 0) == FALSE, "enough idle worker");
+        ok(worker_pool_busy(20, 5, 16) == TRUE, "too few spare worker");
+        ok(worker_pool_surplus(20, 5, 1, 10) == TRUE, "too many idle worker");
+        ok(worker_pool_surplus(20, 5, 20, 10) == FALSE, "min worker are never retired");
+
+        /* worker started by the busy rule must not be stopped by the next check */
+        for(max_spare = 1; max_spare <= 5; max_spare++) {
+            for(workers = 1; workers <= 60; workers++) {
+                for(jobs = 0; jobs <= workers; jobs++) {
+                    if(!worker_pool_busy(workers, jobs, 0))
+                        continue;
+                    target = limit_spare_worker(workers + 1, workers, jobs, max_spare);
+                    if(target > workers && worker_pool_surplus(target, jobs, 1, max_spare))
+                        flapping++;
+                }
+            }
+        }
+        cmp_ok(flapping, "==", 0, "spawned worker are not retired again");
+        cmp_ok(limit_spare_worker(13, 12, 10, 2), "==", 12, "no new worker with max spare worker idle");
+        cmp_ok(limit_spare_worker(15, 12, 10, 0), "==", 15, "unlimited without max spare worker");
+    }
+
     /*****************************************
      * clean up
      */
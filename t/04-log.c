@@ -9,14 +9,24 @@
 #include <t/tap.h>
 #include <common.h>
 #include <utils.h>
+#include <log_ring.h>
 
 #include <worker_dummy_functions.c>
 
 mod_gm_opt_t *mod_gm_opt;
 
+int evaluated = 0;
+static int count_evaluation(void);
+static int count_evaluation() {
+    return ++evaluated;
+}
+
 /* main tests */
 int main(void) {
-    int tests = 4;
+    int tests = 9;
+    int x, lines;
+    char line[GM_BUFFERSIZE];
+    FILE *fp;
     plan(tests);
 
     mod_gm_opt = malloc(sizeof(mod_gm_opt_t));
@@ -34,6 +44,56 @@ int main(void) {
     mod_gm_opt->logmode = GM_LOG_MODE_CORE;
     lives_ok({gm_log(GM_LOG_INFO, "info message core\n");}, "info message in core mode");
 
+    /* structured formats */
+    fp = tmpfile();
+    mod_gm_opt->logmode    = GM_LOG_MODE_FILE;
+    mod_gm_opt->logfile_fp = fp;
+    mod_gm_opt->log_format = GM_LOG_FORMAT_KV;
+    gm_log(GM_LOG_INFO, "say \"hello\"\n");
+    mod_gm_opt->log_format = GM_LOG_FORMAT_JSON;
+    gm_log(GM_LOG_ERROR, "a\tb\nc\n");
+    rewind(fp);
+    if(fgets(line, sizeof(line), fp) == NULL)
+        line[0] = '\0';
+    line[strcspn(line, "\n")] = '\0';
+    like(line, "^ts=[0-9T:-]+[+-][0-9]+ pid=[0-9]+ level=info msg=\"say \\\\\"hello\\\\\"\"$", "key=value log line");
+    if(fgets(line, sizeof(line), fp) == NULL)
+        line[0] = '\0';
+    line[strcspn(line, "\n")] = '\0';
+    like(line, "^\\{\"ts\":\"[^\"]+\",\"pid\":[0-9]+,\"level\":\"error\",\"msg\":\"a\\\\tb\\\\nc\"\\}$", "json log line");
+    fclose(fp);
+
+    /* arguments are only evaluated for enabled levels */
+    mod_gm_opt->logmode     = GM_LOG_MODE_STDOUT;
+    mod_gm_opt->log_format  = GM_LOG_FORMAT_TEXT;
+    mod_gm_opt->debug_level = GM_LOG_INFO;
+    GM_LOG(GM_LOG_TRACE, "not evaluated %d\n", count_evaluation());
+    cmp_ok(evaluated, "==", 0, "disabled level does not evaluate arguments");
+    mod_gm_opt->debug_level = GM_LOG_TRACE;
+    GM_LOG(GM_LOG_TRACE, "evaluated %d\n", count_evaluation());
+    cmp_ok(evaluated, "==", 1, "enabled level evaluates arguments");
+    mod_gm_opt->debug_level = GM_LOG_INFO;
+
+    /* asynchronous logging keeps all records in order */
+    fp = tmpfile();
+    mod_gm_opt->logmode    = GM_LOG_MODE_FILE;
+    mod_gm_opt->logfile_fp = fp;
+    mod_gm_opt->log_async  = GM_ENABLED;
+    for(x = 0; x < 3 * GM_LOG_RING_SLOTS; x++)
+        gm_log(GM_LOG_INFO, "record %d\n", x);
+    log_ring_stop();
+    rewind(fp);
+    lines = 0;
+    while(fgets(line, sizeof(line), fp) != NULL) {
+        if(strstr(line, "] record ") == NULL || atoi(strstr(line, "] record ") + 9) != lines)
+            break;
+        lines++;
+    }
+    cmp_ok(lines, "==", 3 * GM_LOG_RING_SLOTS, "async log wrote all records in order");
+    fclose(fp);
+    mod_gm_opt->logfile_fp = NULL;
+    mod_gm_opt->log_async  = GM_DISABLED;
+
     return exit_status();
 }
 
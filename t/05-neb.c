@@ -135,13 +135,14 @@ int neb_deregister_callback(enum NEBCallbackType callback_type, void *callback_f
 int main(void) {
     int i;
 
-    plan(32);
+    plan(40);
 
     char * test_nebargs[] = {
         "encryption=no server=localhost",
         "key=test12345 server=localhost",
         "encryption=no server=localhost export=log_queue:1:NEBCALLBACK_LOG_DATA",
         "encryption=no server=localhost export=log_queue:1:NEBCALLBACK_LOG_DATA export=proc_queue:0:NEBCALLBACK_PROCESS_DATA",
+        "encryption=no server=localhost job_trace=yes job_trace_file=/tmp/mod_gm_trace_test.prom",
     };
 
     int num = sizeof(test_nebargs) / sizeof(test_nebargs[0]);
@@ -15,6 +15,40 @@
 
 mod_gm_opt_t *mod_gm_opt;
 
+/* commands which can be run without shell */
+static char *shell_conformance[] = {
+    "/usr/bin/printf '[%s]' a b",
+    "/usr/bin/printf   '[%s]'\ta   \"b  c\" 'd  e' f\\ g",
+    "/usr/bin/printf '[%s]' \"x\\\"y\" 'it'\\''s' \"back\\\\slash\" \"keep\\n\" no\\\\pe",
+    "/usr/bin/printf '[%s]' '' \"\" x''y",
+    "/usr/bin/printf '[%s]' a=b --opt=\"x y\" \"a'b\" 'c\"d' 'x$y' '*' '|'",
+    "FOO=bar /usr/bin/printenv FOO",
+    "FOO='a b' BAR=\"c\"d _X1= /usr/bin/printenv FOO BAR _X1",
+    "/bin/ls /nonexisting_mod_gearman_dir 2>&1",
+    "/bin/ls /nonexisting_mod_gearman_dir",
+    "./t/rc 2",
+    NULL
+};
+
+/* commands which need a shell */
+static char *shell_required[] = {
+    "/bin/echo $HOME",
+    "/bin/echo \"$HOME\"",
+    "/bin/echo `id`",
+    "/bin/echo a | /bin/cat",
+    "/bin/echo a; /bin/echo b",
+    "/bin/echo a && /bin/echo b",
+    "/bin/echo *",
+    "/bin/echo ~/x",
+    "/bin/echo a > /dev/null",
+    "/bin/echo a 2>/dev/null",
+    "/bin/echo a # comment",
+    "/bin/echo 'unterminated",
+    "FOO=bar",
+    "",
+    NULL
+};
+
 char* my_tmpfile(void);
 char* my_tmpfile() {
     char *sfn = strdup("/tmp/modgm.XXXXXX");
@@ -58,11 +92,12 @@ int main (int argc, char **argv, char **env) {
     argc = argc; argv = argv; env  = env;
     char *result, *error;
     char cmd[120];
+    char shcmd[GM_BUFFERSIZE];
     char logf[150];
     char * worker_logfile;
     int x, rc, matches;
 
-    plan(3);
+    plan(4 + 2*(sizeof(shell_conformance)/sizeof(char*)-1) + sizeof(shell_required)/sizeof(char*)-1);
 
     /* set hostname */
     gethostname(hostname, GM_BUFFERSIZE-1);
@@ -94,7 +129,7 @@ int main (int argc, char **argv, char **env) {
     gm_job_t * exec_job;
     exec_job = ( gm_job_t * )malloc( sizeof *exec_job );
     set_default_job(exec_job, mod_gm_opt);
-    strcpy(cmd, "BLAH=BLUB /bin/hostname");
+    strcpy(cmd, "/bin/hostname | /bin/cat");
     run_check(cmd, &result, &error);
     free(result);
     free(error);
@@ -106,10 +141,49 @@ int main (int argc, char **argv, char **env) {
     run_check(cmd, &result, &error);
     free(result);
     free(error);
-    mod_gm_opt->debug_level = 0;
     matches = check_logfile(worker_logfile, "using execvp");
     ok(matches == 1, "worker uses execvp");
 
+    /* assignments do not need a shell anymore */
+    strcpy(cmd, "BLAH=BLUB /bin/hostname");
+    run_check(cmd, &result, &error);
+    free(result);
+    free(error);
+    mod_gm_opt->debug_level = 0;
+    matches = check_logfile(worker_logfile, "using execvp");
+    ok(matches == 2, "worker uses execvp with variable assignments");
+
+    /* commands without shell features must behave exactly like /bin/sh */
+    for(x = 0; shell_conformance[x] != NULL; x++) {
+        char *args[MAX_CMD_ARGS];
+        char *shell_result, *shell_error;
+        int assignments, stderr_to_stdout, shell_rc;
+        char *lexed = strdup(shell_conformance[x]);
+        ok(lex_command_line(lexed, args, &assignments, &stderr_to_stdout) == TRUE, "no shell required: %s", shell_conformance[x]);
+        free(lexed);
+
+        /* the leading ':;' forces the shell */
+        snprintf(shcmd, sizeof(shcmd), "%s", shell_conformance[x]);
+        rc = run_check(shcmd, &result, &error);
+        snprintf(shcmd, sizeof(shcmd), ":; %s", shell_conformance[x]);
+        shell_rc = run_check(shcmd, &shell_result, &shell_error);
+        ok(rc == shell_rc && !strcmp(result, shell_result) && !strcmp(error, shell_error),
+           "same as /bin/sh: %s -> '%s' / '%s'", shell_conformance[x], result, shell_result);
+        free(result);
+        free(error);
+        free(shell_result);
+        free(shell_error);
+    }
+
+    /* everything else is left to the shell */
+    for(x = 0; shell_required[x] != NULL; x++) {
+        char *args[MAX_CMD_ARGS];
+        int assignments, stderr_to_stdout;
+        char *lexed = strdup(shell_required[x]);
+        ok(lex_command_line(lexed, args, &assignments, &stderr_to_stdout) == FALSE, "shell required: %s", shell_required[x]);
+        free(lexed);
+    }
+
     for(x=0;x<100;x++) {
         run_check(cmd, &result, &error);
         free(result);
@@ -32,7 +32,7 @@ int main (int argc, char **argv, char **env) {
     char *result, *error;
     char cmd[120];
 
-    plan(21);
+    plan(27);
 
     /* create options structure and set debug level */
     mod_gm_opt = malloc(sizeof(mod_gm_opt_t));
@@ -61,6 +61,30 @@ int main (int argc, char **argv, char **env) {
     rc=file_uses_embedded_perl("t/noepn.pl");
     cmp_ok(rc, "==", FALSE, "noepn.pl: file_uses_embedded_perl returned rc %d", rc);
 
+    /* epn decision cache */
+    rc=epn_cache_hits;
+    file_uses_embedded_perl("t/ok.pl");
+    cmp_ok(epn_cache_hits, "==", rc+1, "ok.pl: epn decision taken from cache");
+    rc=epn_cache_misses;
+    file_uses_embedded_perl("t/does_not_exist.pl");
+    cmp_ok(epn_cache_misses, "==", rc, "missing file is not cached");
+    strcpy(cmds, "--use_embedded_perl_implicitly=off");
+    parse_args_line(mod_gm_opt, cmds, 0);
+    rc=file_uses_embedded_perl("t/crit.pl");
+    cmp_ok(rc, "==", FALSE, "crit.pl: implicit epn disabled");
+    strcpy(cmds, "--use_embedded_perl_implicitly=on");
+    parse_args_line(mod_gm_opt, cmds, 0);
+    rc=file_uses_embedded_perl("t/crit.pl");
+    cmp_ok(rc, "==", TRUE, "crit.pl: implicit epn enabled, cached decision");
+
+    /* precompile */
+    {
+        char *plugins[2] = { "t/ok.pl", "t/noepn.pl" };
+        rc=precompile_epn_plugins(plugins, 2);
+        cmp_ok(rc, "==", 1, "precompiled %d plugins", rc);
+        ok(epn_compile_usec > 0, "compile time: %ldus", epn_compile_usec);
+    }
+
     strcpy(cmd, "./t/fail.pl");
     rrc = real_exit_code(run_check(cmd, &result, &error));
     cmp_ok(rrc, "==", 3, "cmd '%s' returned rc %d", cmd, rrc);
@@ -2,11 +2,13 @@
 
 use warnings;
 use strict;
-use Test::More tests => 8;
+use Test::More tests => 16;
 use Data::Dumper;
 use Time::HiRes qw( gettimeofday tv_interval sleep );
+use IO::Socket::INET;
+use MIME::Base64;
 
-alarm(60); # hole test should not take longer than 60 seconds
+alarm(120); # hole test should not take longer than 60 seconds
 
 my $TESTPORT    = 54730;
 my $NR_TST_JOBS = 2000;
@@ -48,13 +50,65 @@ $rate    = int($NR_TST_JOBS / $elapsed);
 ok($elapsed, 'cleared gearman queue in '.$elapsed.' seconds');
 ok($rate > 300, 'clear rate '.$rate.'/s');
 
-# clean up
 `kill $worker_pid`;
+wait_for_pid($worker_pid);
+
+# host checks with results, jobs per second for a single worker with and without async result sending
+for my $async (qw/yes no/) {
+    submit_jobs("host", "type=host\nresult_queue=check_results\nhost_name=bench\ncommand_line=/bin/true\ntimeout=30\n", $NR_TST_JOBS);
+    $t0 = [gettimeofday];
+    system("./mod_gearman_worker --server=localhost:$TESTPORT --debug=0 --min-worker=1 --max-worker=1 --encryption=off --hosts=yes --async_results=$async --daemon --pidfile=./worker.pid --logfile=./worker.log");
+    chomp($worker_pid = `cat ./worker.pid 2>/dev/null`);
+    isnt($worker_pid, '', 'worker running: '.$worker_pid.' (async_results='.$async.')');
+    wait_for_empty_queue("host");
+    $elapsed = tv_interval ( $t0 );
+    $rate    = int($NR_TST_JOBS / $elapsed);
+    ok($elapsed, 'async_results='.$async.': executed '.$NR_TST_JOBS.' host checks in '.$elapsed.' seconds');
+    ok($rate > 100, 'async_results='.$async.': '.$rate.' jobs/s per worker');
+    `kill $worker_pid`;
+    wait_for_pid($worker_pid);
+}
+
+# end to end with result consumer, latency percentiles and cpu per job
+my $report = `./mod_gearman_benchmark --server=localhost:$TESTPORT --workers=2 --rate=200 --warmup=1 --duration=5 --min-rate=150 --format=text`;
+is($?, 0, 'end to end benchmark reached 150 jobs/s') or diag($report);
+like($report, '/^jobs\.lost=0$/m', 'end to end benchmark lost no jobs');
+
+# clean up
 `kill $gearmand_pid`;
 unlink("/tmp/gearmand_bench.log");
 
 exit(0);
 
+#################################################
+# submit background jobs with the gearman binary protocol
+sub submit_jobs {
+    my($queue, $data, $num) = @_;
+    my $sock = IO::Socket::INET->new(PeerAddr => 'localhost', PeerPort => $TESTPORT, Proto => 'tcp') or die("cannot connect to gearmand: $!");
+    my $payload = encode_base64($data, '');
+    for my $x (1..$num) {
+        # SUBMIT_JOB_BG = 18, JOB_CREATED = 8
+        my $body = $queue."\0".$x."\0".$payload;
+        print $sock "\0REQ".pack("NN", 18, length($body)).$body;
+        my $header;
+        read($sock, $header, 12);
+        my($magic, $type, $size) = unpack("a4NN", $header);
+        read($sock, my $handle, $size);
+    }
+    close($sock);
+    return;
+}
+
+#################################################
+sub wait_for_pid {
+    my $pid = shift;
+    for my $x (1..50) {
+        return unless kill(0, $pid);
+        sleep(0.1);
+    }
+    return;
+}
+
 #################################################
 sub wait_for_empty_queue {
     my $queue = shift;
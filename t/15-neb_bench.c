@@ -0,0 +1,1441 @@
+/* synthetic neb driver for the nagios4 module
+ *
+ * loads the neb module into a stub core with synthetic hosts, services,
+ * groups and custom variables, fires NEBCALLBACK_SERVICE_CHECK_DATA events
+ * and measures the cost of handle_svc_check (set_target_queue, macros and
+ * job submission), get_results and the check reaper. Jobs are swallowed by a
+ * null transport unless --server is given. Runs as test with small defaults,
+ * use --help for the benchmark options or 'make neb_benchmark'.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <dlfcn.h>
+#include <time.h>
+#include <t/tap.h>
+
+#include <config.h>
+
+#define USENAGIOS4 1
+#define USENAGIOS  1
+#include "result_thread.h"
+#include "nagios4/nagios.h"
+#include "nagios4/nebmodules.h"
+#include "nagios4/nebmods.h"
+#include "nagios4/nebstructs.h"
+#include "nagios4/nebcallbacks.h"
+#include "nagios4/broker.h"
+#define BROKER_MODULE "mod_gearman_nagios4.o"
+
+#include <worker_dummy_functions.c>
+
+#define BENCH_COMMANDS            10
+
+/* how set_target_queue routed a check */
+#define BENCH_ROUTE_CUSTVAR        0
+#define BENCH_ROUTE_SERVICEGROUP   1
+#define BENCH_ROUTE_HOSTGROUP      2
+#define BENCH_ROUTE_DEFAULT        3
+#define BENCH_ROUTE_LOCAL          4
+#define BENCH_ROUTES               5
+
+static const char *route_names[BENCH_ROUTES] = { "custom_variable", "servicegroup", "hostgroup", "default", "local" };
+
+static const char *host_var_names[]    = { "LOCATION", "OWNER", "SNMPCOMMUNITY", "ADDRESS6", "OS", "RACK", "TEAM", "CONTRACT" };
+static const char *service_var_names[] = { "TIMEOUT", "WARNING", "CRITICAL", "OWNER", "RUNBOOK", "GRAPH" };
+static const char *service_names[]     = { "cpu", "load", "memory", "swap", "disk /", "disk /var", "ping", "ssh",
+                                           "ntp", "procs", "users", "http", "https", "dns", "smtp", "interfaces" };
+
+/* some externals required by the neb module, originally located in the nagios core */
+int service_check_timeout;
+int host_check_timeout;
+int currently_running_service_checks;
+int currently_running_host_checks;
+unsigned long event_broker_options;
+int process_performance_data;
+int log_notifications;
+
+/* object lookup table */
+typedef struct bench_hash_entry {
+    const char              * name1;
+    const char              * name2;
+    void                    * object;
+    struct bench_hash_entry * next;
+} bench_hash_entry_t;
+
+typedef struct bench_hash {
+    bench_hash_entry_t     ** buckets;
+    unsigned int              size;
+} bench_hash_t;
+
+/* fake job handed to get_results */
+typedef struct bench_job {
+    char                    * workload;
+    size_t                    size;
+} bench_job_t;
+
+typedef gearman_task_st *(*bench_add_task_fn)(gearman_client_st *, gearman_task_st *, void *, const char *, const char *, const void *, size_t, gearman_return_t *);
+
+/* options */
+static int          opt_hosts               = 500;
+static int          opt_services            = 10;
+static int          opt_hostgroups          = 50;
+static int          opt_servicegroups       = 20;
+static int          opt_groups_per_host     = 3;
+static int          opt_custom_vars         = 4;
+static int          opt_queue_var_hosts     = 5;
+static int          opt_queue_var_services  = 2;
+static int          opt_route_hostgroups    = 4;
+static int          opt_route_servicegroups = 2;
+static int          opt_local_hostgroups    = 1;
+static long         opt_checks              = 20000;
+static int          opt_rate                = 0;
+static int          opt_result_batch        = 1;
+static int          opt_reaper              = 1000;
+static int          opt_output_size         = 100;
+static unsigned int opt_seed                = 1;
+static char       * opt_server              = NULL;
+static char       * opt_module              = "./"BROKER_MODULE;
+static char       * opt_module_args         = NULL;
+static int          opt_verbose             = 0;
+
+/* synthetic objects */
+static host         * hosts;
+static service      * services;
+static hostgroup    * hostgroups;
+static servicegroup * servicegroups;
+static command      * commands;
+static long           num_services;
+static bench_hash_t   host_table;
+static bench_hash_t   service_table;
+static bench_hash_t   hostgroup_table;
+static bench_hash_t   servicegroup_table;
+static char         * result_output;
+
+/* stub core state */
+static nebcallback  * callback_list[NEBCALLBACK_NUMITEMS];
+static char           macro_args[GM_BUFFERSIZE];
+
+/* transport */
+static char               null_task;
+static bench_job_t        result_job;
+static bench_add_task_fn  next_add_task_low     = NULL;
+static bench_add_task_fn  next_add_task_normal  = NULL;
+static bench_add_task_fn  next_add_task_high    = NULL;
+static void            (* next_give_workload)(gearman_task_st *, const void *, size_t) = NULL;
+static gearman_return_t (* next_run_tasks)(gearman_client_st *) = NULL;
+static char               submitted_queue[GEARMAN_FUNCTION_MAX_SIZE];
+
+/* counters */
+static long          jobs_submitted    = 0;
+static long long     bytes_submitted   = 0;
+static long          overridden        = 0;
+static long          local_checks      = 0;
+static long          failed            = 0;
+static long          misrouted         = 0;
+static long          route_count[BENCH_ROUTES];
+static long          results_injected  = 0;
+static long          results_unreaped  = 0;
+static long          result_packets    = 0;
+static long          result_errors     = 0;
+static long          results_processed = 0;
+static long          results_unknown   = 0;
+static long          reaper_runs       = 0;
+static double        reaper_time       = 0;
+static double        dispatch_elapsed  = 0;
+static double      * dispatch_time;
+static char        * dispatch_route;
+static double      * result_time;
+
+static void print_usage(void);
+static void parse_options(int argc, char **argv);
+static double mono_time(void);
+static int cmp_double(const void *a, const void *b);
+static unsigned int hash_key(const char *name1, const char *name2);
+static void hash_init(bench_hash_t *table, long num);
+static void hash_add(bench_hash_t *table, const char *name1, const char *name2, void *object);
+static void *hash_find(bench_hash_t *table, const char *name1, const char *name2);
+static void hash_free(bench_hash_t *table);
+static void add_custom_variable(customvariablesmember **list, const char *name, char *value);
+static const char *custom_variable(customvariablesmember *list, const char *name);
+static void add_to_objectlist(objectlist **list, void *object);
+static void create_objects(void);
+static void free_objects(void);
+static char *build_module_args(void);
+static int expected_queue(host *hst, service *svc, char *queue, int size);
+static void run_checks(gearman_worker_fn *result_func);
+static void inject_results(gearman_worker_fn *result_func, int *pending, int num);
+static void reap_results(void);
+static void clear_callbacks(void);
+static void report_dist(const char *name, double *values, long num);
+static void report(void);
+static gearman_task_st *bench_add_task(bench_add_task_fn next, gearman_client_st *client, gearman_task_st *task, void *context, const char *queue, const char *uniq, const void *workload, size_t size, gearman_return_t *ret_ptr);
+
+
+int main(int argc, char **argv) {
+    int (*initfunc)(int, char *, void *);
+    int (*deinitfunc)(int, int);
+    gearman_worker_fn *result_func;
+    nebstruct_process_data ps;
+    void *neb_handle;
+    char *nebargs;
+    double start;
+    int result;
+
+    parse_options(argc, argv);
+
+    plan(13);
+
+    /* set some external variables */
+    service_check_timeout            = 60;
+    host_check_timeout               = 30;
+    currently_running_service_checks = 0;
+    currently_running_host_checks    = 0;
+    event_broker_options             = BROKER_EVERYTHING;
+    process_performance_data         = 1;
+    log_notifications                = 1;
+
+    start = mono_time();
+    create_objects();
+    note("objects: %d hosts, %ld services, %d hostgroups, %d servicegroups, %d custom variables per object (%.2fs)\n",
+         opt_hosts, num_services, opt_hostgroups, opt_servicegroups, opt_custom_vars, mono_time() - start);
+
+    /* null transport unless a real gearmand is used */
+    if(opt_server != NULL) {
+        next_add_task_low    = (bench_add_task_fn)dlsym(RTLD_NEXT, "gearman_client_add_task_low_background");
+        next_add_task_normal = (bench_add_task_fn)dlsym(RTLD_NEXT, "gearman_client_add_task_background");
+        next_add_task_high   = (bench_add_task_fn)dlsym(RTLD_NEXT, "gearman_client_add_task_high_background");
+        next_give_workload   = dlsym(RTLD_NEXT, "gearman_task_give_workload");
+        next_run_tasks       = dlsym(RTLD_NEXT, "gearman_client_run_tasks");
+    }
+
+    /* load neb module */
+    neb_handle = dlopen(opt_module, RTLD_LAZY|RTLD_GLOBAL);
+    ok(neb_handle != NULL, "neb module loaded");
+    if(neb_handle == NULL) { BAIL_OUT("cannot load module: %s\n", dlerror()); }
+
+    result_func = (gearman_worker_fn *)dlsym(neb_handle, "get_results");
+    ok(result_func != NULL, "located get_results()");
+    initfunc   = dlsym(neb_handle, "nebmodule_init");
+    deinitfunc = dlsym(neb_handle, "nebmodule_deinit");
+    if(result_func == NULL || initfunc == NULL || deinitfunc == NULL) { BAIL_OUT("cannot load module: %s\n", dlerror()); }
+
+    /* init neb module */
+    nebargs = build_module_args();
+    note("module args: %s\n", nebargs);
+    result = (*initfunc)(NEBMODULE_NORMAL_LOAD, nebargs, neb_handle);
+    ok(result == 0, "run nebmodule_init() -> %d", result);
+    if(result != 0) { BAIL_OUT("nebmodule_init() failed\n"); }
+
+    /* check callbacks are registered when the event loop starts */
+    memset(&ps, 0, sizeof(ps));
+    ps.type = NEBTYPE_PROCESS_EVENTLOOPSTART;
+    gettimeofday(&ps.timestamp, NULL);
+    neb_make_callbacks(NEBCALLBACK_PROCESS_DATA, &ps);
+    ok(callback_list[NEBCALLBACK_SERVICE_CHECK_DATA] != NULL, "service check callback registered");
+
+    run_checks(result_func);
+    report();
+
+    cmp_ok(failed, "==", 0, "callbacks returned no errors (%ld overridden, %ld local)", overridden, local_checks);
+    cmp_ok(misrouted, "==", 0, "checks went to the expected queues");
+    cmp_ok(jobs_submitted, "==", overridden, "every overridden check submitted a job");
+    cmp_ok(result_errors, "==", 0, "get_results accepted all results");
+    cmp_ok(results_processed, "==", results_injected, "all results reached the core");
+    cmp_ok(results_unknown, "==", 0, "no results for unknown services");
+    cmp_ok(currently_running_service_checks, "==", 0, "no service checks left running");
+
+    /* deinit neb module */
+    result = (*deinitfunc)(NEBMODULE_FORCE_UNLOAD, NEBMODULE_NEB_SHUTDOWN);
+    ok(result == 0, "run nebmodule_deinit() -> %d", result);
+    clear_callbacks();
+
+    result = dlclose(neb_handle);
+    ok(result == 0, "dlclose() -> %d", result);
+
+    free(nebargs);
+    free(dispatch_time);
+    free(dispatch_route);
+    free(result_time);
+    free_objects();
+
+    return exit_status();
+}
+
+
+/* print usage */
+static void print_usage() {
+    printf("usage:\n");
+    printf("\n");
+    printf("15_neb_bench [ --hosts=<nr>                 synthetic hosts             ]   (default: 500)\n");
+    printf("             [ --services=<nr>              services per host           ]   (default: 10)\n");
+    printf("             [ --hostgroups=<nr>            hostgroups                  ]   (default: 50)\n");
+    printf("             [ --servicegroups=<nr>         servicegroups               ]   (default: 20)\n");
+    printf("             [ --groups-per-host=<nr>       hostgroups of each host     ]   (default: 3)\n");
+    printf("             [ --custom-vars=<nr>           custom variables per object ]   (default: 4)\n");
+    printf("             [ --queue-var-hosts=<%%>        hosts with queue variable   ]   (default: 5)\n");
+    printf("             [ --queue-var-services=<%%>     services with queue var     ]   (default: 2)\n");
+    printf("             [ --route-hostgroups=<nr>      hostgroups with own queue   ]   (default: 4)\n");
+    printf("             [ --route-servicegroups=<nr>   servicegroups with own queue]   (default: 2)\n");
+    printf("             [ --local-hostgroups=<nr>      local hostgroups            ]   (default: 1)\n");
+    printf("\n");
+    printf("             [ --checks=<nr>                service check events        ]   (default: 20000)\n");
+    printf("             [ --rate=<nr/s>                events per second           ]   (default: 0, unthrottled)\n");
+    printf("             [ --result-batch=<nr>          results per result job      ]   (default: 1)\n");
+    printf("             [ --reaper=<nr>                results per reaper event    ]   (default: 1000)\n");
+    printf("             [ --output-size=<bytes>        plugin output of results    ]   (default: 100)\n");
+    printf("             [ --seed=<nr>                  seed for group memberships  ]   (default: 1)\n");
+    printf("\n");
+    printf("             [ --server=<host:port>         submit jobs to gearmand     ]   (default: null transport)\n");
+    printf("             [ --module=<path>              neb module                  ]   (default: ./%s)\n", BROKER_MODULE);
+    printf("             [ --module-args=<args>         additional module arguments ]\n");
+    printf("             [ -h                           print help                  ]\n");
+    printf("             [ -v                           verbose output              ]\n");
+    printf("\n");
+
+    exit( EXIT_SUCCESS );
+}
+
+
+/* parse command line options */
+static void parse_options(int argc, char **argv) {
+    int opt;
+    static struct option long_options[] = {
+        {"hosts",               required_argument, 0, 'H'},
+        {"services",            required_argument, 0, 'S'},
+        {"hostgroups",          required_argument, 0, 'g'},
+        {"servicegroups",       required_argument, 0, 'G'},
+        {"groups-per-host",     required_argument, 0, 'p'},
+        {"custom-vars",         required_argument, 0, 'c'},
+        {"queue-var-hosts",     required_argument, 0, 'q'},
+        {"queue-var-services",  required_argument, 0, 'Q'},
+        {"route-hostgroups",    required_argument, 0, 'o'},
+        {"route-servicegroups", required_argument, 0, 'O'},
+        {"local-hostgroups",    required_argument, 0, 'l'},
+        {"checks",              required_argument, 0, 'n'},
+        {"rate",                required_argument, 0, 'r'},
+        {"result-batch",        required_argument, 0, 'b'},
+        {"reaper",              required_argument, 0, 'R'},
+        {"output-size",         required_argument, 0, 's'},
+        {"seed",                required_argument, 0, 'x'},
+        {"server",              required_argument, 0, 'j'},
+        {"module",              required_argument, 0, 'm'},
+        {"module-args",         required_argument, 0, 'a'},
+        {"help",                no_argument,       0, 'h'},
+        {"verbose",             no_argument,       0, 'v'},
+        {0, 0, 0, 0}
+    };
+
+    while((opt = getopt_long(argc, argv, "hvH:S:g:G:p:c:q:Q:o:O:l:n:r:b:R:s:x:j:m:a:", long_options, NULL)) != -1) {
+        switch(opt) {
+            case 'h':   print_usage();
+                        break;
+            case 'v':   opt_verbose = 1;
+                        break;
+            case 'H':   opt_hosts = atoi(optarg);
+                        break;
+            case 'S':   opt_services = atoi(optarg);
+                        break;
+            case 'g':   opt_hostgroups = atoi(optarg);
+                        break;
+            case 'G':   opt_servicegroups = atoi(optarg);
+                        break;
+            case 'p':   opt_groups_per_host = atoi(optarg);
+                        break;
+            case 'c':   opt_custom_vars = atoi(optarg);
+                        break;
+            case 'q':   opt_queue_var_hosts = atoi(optarg);
+                        break;
+            case 'Q':   opt_queue_var_services = atoi(optarg);
+                        break;
+            case 'o':   opt_route_hostgroups = atoi(optarg);
+                        break;
+            case 'O':   opt_route_servicegroups = atoi(optarg);
+                        break;
+            case 'l':   opt_local_hostgroups = atoi(optarg);
+                        break;
+            case 'n':   opt_checks = atol(optarg);
+                        break;
+            case 'r':   opt_rate = atoi(optarg);
+                        break;
+            case 'b':   opt_result_batch = atoi(optarg);
+                        break;
+            case 'R':   opt_reaper = atoi(optarg);
+                        break;
+            case 's':   opt_output_size = atoi(optarg);
+                        break;
+            case 'x':   opt_seed = (unsigned int)atoi(optarg);
+                        break;
+            case 'j':   opt_server = optarg;
+                        break;
+            case 'm':   opt_module = optarg;
+                        break;
+            case 'a':   opt_module_args = optarg;
+                        break;
+            default:    print_usage();
+        }
+    }
+
+    if(opt_hosts < 1)           opt_hosts = 1;
+    if(opt_services < 1)        opt_services = 1;
+    if(opt_hostgroups < 1)      opt_hostgroups = 1;
+    if(opt_servicegroups < 1)   opt_servicegroups = 1;
+    if(opt_checks < 1)          opt_checks = 1;
+    if(opt_result_batch < 1)    opt_result_batch = 1;
+    if(opt_result_batch > GM_MULTI_RESULT_MAX) opt_result_batch = GM_MULTI_RESULT_MAX;
+    if(opt_reaper < 1)          opt_reaper = 1;
+    if(opt_output_size < 10)    opt_output_size = 10;
+    if(opt_groups_per_host > opt_hostgroups)          opt_groups_per_host = opt_hostgroups;
+    if(opt_route_hostgroups > opt_hostgroups)         opt_route_hostgroups = opt_hostgroups;
+    if(opt_route_servicegroups > opt_servicegroups)   opt_route_servicegroups = opt_servicegroups;
+    if(opt_local_hostgroups > opt_hostgroups - opt_route_hostgroups)
+        opt_local_hostgroups = opt_hostgroups - opt_route_hostgroups;
+}
+
+
+/* monotonic time in seconds */
+static double mono_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return((double)ts.tv_sec + (double)ts.tv_nsec / 1000000000);
+}
+
+
+/* sort helper */
+static int cmp_double(const void *a, const void *b) {
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+
+/* djb2 over both names */
+static unsigned int hash_key(const char *name1, const char *name2) {
+    unsigned int hash = 5381;
+    while(*name1 != '\0')
+        hash = ((hash << 5) + hash) + (unsigned char)*name1++;
+    if(name2 != NULL) {
+        hash = ((hash << 5) + hash) + ';';
+        while(*name2 != '\0')
+            hash = ((hash << 5) + hash) + (unsigned char)*name2++;
+    }
+    return hash;
+}
+
+
+/* create lookup table with a power of two number of buckets */
+static void hash_init(bench_hash_t *table, long num) {
+    table->size = 64;
+    while(table->size < num)
+        table->size *= 2;
+    table->buckets = gm_calloc(table->size, sizeof(bench_hash_entry_t *));
+}
+
+
+/* add object to lookup table */
+static void hash_add(bench_hash_t *table, const char *name1, const char *name2, void *object) {
+    unsigned int bucket = hash_key(name1, name2) & (table->size - 1);
+    bench_hash_entry_t *entry = gm_malloc(sizeof(bench_hash_entry_t));
+    entry->name1  = name1;
+    entry->name2  = name2;
+    entry->object = object;
+    entry->next   = table->buckets[bucket];
+    table->buckets[bucket] = entry;
+}
+
+
+/* find object in lookup table */
+static void *hash_find(bench_hash_t *table, const char *name1, const char *name2) {
+    bench_hash_entry_t *entry;
+    if(name1 == NULL)
+        return NULL;
+    entry = table->buckets[hash_key(name1, name2) & (table->size - 1)];
+    for(; entry != NULL; entry = entry->next) {
+        if(strcmp(entry->name1, name1))
+            continue;
+        if(name2 != NULL && (entry->name2 == NULL || strcmp(entry->name2, name2)))
+            continue;
+        return entry->object;
+    }
+    return NULL;
+}
+
+
+/* free lookup table */
+static void hash_free(bench_hash_t *table) {
+    bench_hash_entry_t *entry, *next;
+    unsigned int x;
+    for(x = 0; x < table->size; x++) {
+        for(entry = table->buckets[x]; entry != NULL; entry = next) {
+            next = entry->next;
+            free(entry);
+        }
+    }
+    free(table->buckets);
+}
+
+
+/* prepend custom variable, value will be owned by the list */
+static void add_custom_variable(customvariablesmember **list, const char *name, char *value) {
+    customvariablesmember *var = gm_calloc(1, sizeof(customvariablesmember));
+    var->variable_name  = gm_strdup(name);
+    var->variable_value = value;
+    var->next           = *list;
+    *list = var;
+}
+
+
+/* return value of custom variable */
+static const char *custom_variable(customvariablesmember *list, const char *name) {
+    for(; list != NULL; list = list->next) {
+        if(!strcmp(list->variable_name, name))
+            return list->variable_value;
+    }
+    return NULL;
+}
+
+
+/* prepend object to objectlist */
+static void add_to_objectlist(objectlist **list, void *object) {
+    objectlist *item = gm_malloc(sizeof(objectlist));
+    item->object_ptr = object;
+    item->next       = *list;
+    *list = item;
+}
+
+
+/* create synthetic hosts, services, groups and commands */
+static void create_objects() {
+    unsigned int seed = opt_seed;
+    host *hst;
+    service *svc;
+    hostsmember *hmember;
+    servicesmember *smember;
+    servicegroup *sgroup;
+    char *value;
+    char name[64];
+    int i, j, x, g, group_list[GM_LISTSIZE];
+
+    num_services = (long)opt_hosts * opt_services;
+    hash_init(&host_table, opt_hosts);
+    hash_init(&service_table, num_services);
+    hash_init(&hostgroup_table, opt_hostgroups);
+    hash_init(&servicegroup_table, opt_servicegroups);
+
+    commands = gm_calloc(BENCH_COMMANDS, sizeof(command));
+    for(x = 0; x < BENCH_COMMANDS; x++) {
+        commands[x].id = x;
+        gm_asprintf(&commands[x].name, "check_bench_%d", x);
+        gm_asprintf(&commands[x].command_line, "$USER1$/check_bench_%d -H $HOSTADDRESS$ -n '$HOSTNAME$' -s '$SERVICEDESC$' -w $ARG1$ -c $ARG2$ -l '$_HOSTLOCATION$' -t $_SERVICETIMEOUT$", x);
+        if(x > 0)
+            commands[x-1].next = &commands[x];
+    }
+
+    hostgroups = gm_calloc(opt_hostgroups, sizeof(hostgroup));
+    for(x = 0; x < opt_hostgroups; x++) {
+        hostgroups[x].id = x;
+        gm_asprintf(&hostgroups[x].group_name, "hg%03d", x);
+        hostgroups[x].alias = hostgroups[x].group_name;
+        hash_add(&hostgroup_table, hostgroups[x].group_name, NULL, &hostgroups[x]);
+    }
+
+    servicegroups = gm_calloc(opt_servicegroups, sizeof(servicegroup));
+    for(x = 0; x < opt_servicegroups; x++) {
+        servicegroups[x].id = x;
+        gm_asprintf(&servicegroups[x].group_name, "sg%03d", x);
+        servicegroups[x].alias = servicegroups[x].group_name;
+        hash_add(&servicegroup_table, servicegroups[x].group_name, NULL, &servicegroups[x]);
+    }
+
+    hosts    = gm_calloc(opt_hosts, sizeof(host));
+    services = gm_calloc(num_services, sizeof(service));
+    for(i = 0; i < opt_hosts; i++) {
+        hst = &hosts[i];
+        hst->id = i;
+        gm_asprintf(&hst->name, "host%06d", i);
+        hst->display_name  = hst->name;
+        hst->alias         = hst->name;
+        gm_asprintf(&hst->address, "10.%d.%d.%d", (i >> 16) & 255, (i >> 8) & 255, i & 255);
+        hst->max_attempts  = 3;
+        hst->state_type    = HARD_STATE;
+        hst->checks_enabled = TRUE;
+        hst->has_been_checked = TRUE;
+
+        /* queue variable comes last, so the module has to walk all other variables */
+        if((int)(rand_r(&seed) % 100) < opt_queue_var_hosts) {
+            if(rand_r(&seed) % 5 == 0)
+                value = gm_strdup("local");
+            else
+                gm_asprintf(&value, "worker_%d", i % 4);
+            add_custom_variable(&hst->custom_variables, "WORKER", value);
+        }
+        for(x = opt_custom_vars - 1; x >= 0; x--) {
+            if(x < (int)(sizeof(host_var_names) / sizeof(host_var_names[0])))
+                snprintf(name, sizeof(name), "%s", host_var_names[x]);
+            else
+                snprintf(name, sizeof(name), "VAR%d", x);
+            gm_asprintf(&value, "%s value of %s", name, hst->name);
+            add_custom_variable(&hst->custom_variables, name, value);
+        }
+
+        /* a site group plus random groups, like role and os groups */
+        group_list[0] = i % opt_hostgroups;
+        for(j = 1; j < opt_groups_per_host && j < GM_LISTSIZE; j++) {
+            do {
+                g = rand_r(&seed) % opt_hostgroups;
+                for(x = 0; x < j && group_list[x] != g; x++);
+            } while(x < j);
+            group_list[j] = g;
+        }
+        for(j = 0; j < opt_groups_per_host && j < GM_LISTSIZE; j++) {
+            hmember = gm_calloc(1, sizeof(hostsmember));
+            hmember->host_name = hst->name;
+            hmember->host_ptr  = hst;
+            hmember->next      = hostgroups[group_list[j]].members;
+            hostgroups[group_list[j]].members = hmember;
+            add_to_objectlist(&hst->hostgroups_ptr, &hostgroups[group_list[j]]);
+        }
+        hash_add(&host_table, hst->name, NULL, hst);
+
+        for(j = 0; j < opt_services; j++) {
+            svc = &services[(long)i * opt_services + j];
+            svc->id        = i * opt_services + j;
+            svc->host_name = hst->name;
+            svc->host_ptr  = hst;
+            if(j < (int)(sizeof(service_names) / sizeof(service_names[0])))
+                svc->description = gm_strdup(service_names[j]);
+            else
+                gm_asprintf(&svc->description, "%s %d", service_names[j % (sizeof(service_names) / sizeof(service_names[0]))], j);
+            svc->display_name      = svc->description;
+            gm_asprintf(&svc->check_command, "check_bench_%d!%d!%d", j % BENCH_COMMANDS, 80 + j % 10, 90 + j % 10);
+            svc->check_command_ptr = &commands[j % BENCH_COMMANDS];
+            svc->check_interval    = 5;
+            svc->retry_interval    = 1;
+            svc->max_attempts      = 3;
+            svc->current_attempt   = 1;
+            svc->state_type        = HARD_STATE;
+            svc->checks_enabled    = TRUE;
+            svc->has_been_checked  = TRUE;
+
+            if((int)(rand_r(&seed) % 100) < opt_queue_var_services)
+                add_custom_variable(&svc->custom_variables, "WORKER", gm_strdup("worker_services"));
+            for(x = opt_custom_vars - 1; x >= 0; x--) {
+                if(x < (int)(sizeof(service_var_names) / sizeof(service_var_names[0])))
+                    snprintf(name, sizeof(name), "%s", service_var_names[x]);
+                else
+                    snprintf(name, sizeof(name), "VAR%d", x);
+                gm_asprintf(&value, "%d", 10 + x);
+                add_custom_variable(&svc->custom_variables, name, value);
+            }
+
+            /* every other service type has its own servicegroup */
+            if(j % 2 == 0) {
+                sgroup  = &servicegroups[(j / 2) % opt_servicegroups];
+                smember = gm_calloc(1, sizeof(servicesmember));
+                smember->host_name           = svc->host_name;
+                smember->service_description = svc->description;
+                smember->service_ptr         = svc;
+                smember->next                = sgroup->members;
+                sgroup->members = smember;
+                add_to_objectlist(&svc->servicegroups_ptr, sgroup);
+            }
+
+            smember = gm_calloc(1, sizeof(servicesmember));
+            smember->host_name           = svc->host_name;
+            smember->service_description = svc->description;
+            smember->service_ptr         = svc;
+            smember->next                = hst->services;
+            hst->services = smember;
+            hst->total_services++;
+
+            hash_add(&service_table, svc->host_name, svc->description, svc);
+        }
+    }
+
+    /* plugin output of the synthetic results */
+    result_output = gm_malloc(opt_output_size + 1);
+    x = snprintf(result_output, opt_output_size + 1, "OK - synthetic result|time=0.012s;;;0.000000");
+    if(x < opt_output_size)
+        memset(result_output + x, 'x', opt_output_size - x);
+    result_output[opt_output_size] = '\0';
+}
+
+
+/* free synthetic objects */
+static void free_objects() {
+    customvariablesmember *var, *next_var;
+    hostsmember *hmember, *next_hmember;
+    servicesmember *smember, *next_smember;
+    objectlist *item, *next_item;
+    long x;
+
+    for(x = 0; x < num_services; x++) {
+        for(var = services[x].custom_variables; var != NULL; var = next_var) {
+            next_var = var->next;
+            free(var->variable_name);
+            free(var->variable_value);
+            free(var);
+        }
+        for(item = services[x].servicegroups_ptr; item != NULL; item = next_item) {
+            next_item = item->next;
+            free(item);
+        }
+        free(services[x].description);
+        free(services[x].check_command);
+    }
+    for(x = 0; x < opt_hosts; x++) {
+        for(var = hosts[x].custom_variables; var != NULL; var = next_var) {
+            next_var = var->next;
+            free(var->variable_name);
+            free(var->variable_value);
+            free(var);
+        }
+        for(item = hosts[x].hostgroups_ptr; item != NULL; item = next_item) {
+            next_item = item->next;
+            free(item);
+        }
+        for(smember = hosts[x].services; smember != NULL; smember = next_smember) {
+            next_smember = smember->next;
+            free(smember);
+        }
+        free(hosts[x].name);
+        free(hosts[x].address);
+    }
+    for(x = 0; x < opt_hostgroups; x++) {
+        for(hmember = hostgroups[x].members; hmember != NULL; hmember = next_hmember) {
+            next_hmember = hmember->next;
+            free(hmember);
+        }
+        free(hostgroups[x].group_name);
+    }
+    for(x = 0; x < opt_servicegroups; x++) {
+        for(smember = servicegroups[x].members; smember != NULL; smember = next_smember) {
+            next_smember = smember->next;
+            free(smember);
+        }
+        free(servicegroups[x].group_name);
+    }
+    for(x = 0; x < BENCH_COMMANDS; x++) {
+        free(commands[x].name);
+        free(commands[x].command_line);
+    }
+    hash_free(&host_table);
+    hash_free(&service_table);
+    hash_free(&hostgroup_table);
+    hash_free(&servicegroup_table);
+    free(services);
+    free(hosts);
+    free(hostgroups);
+    free(servicegroups);
+    free(commands);
+    free(result_output);
+}
+
+
+/* module arguments for the synthetic group layout */
+static char *build_module_args() {
+    char *args, *tmp;
+    int x;
+
+    gm_asprintf(&args, "server=%s encryption=no result_workers=0 services=yes hosts=no eventhandler=no notifications=no queue_custom_variable=WORKER",
+                opt_server != NULL ? opt_server : "localhost");
+
+    /* groups with the most members are searched last */
+    for(x = 0; x < opt_route_hostgroups; x++) {
+        gm_asprintf(&tmp, "%s%s%s", args, x == 0 ? " hostgroups=" : ",", hostgroups[opt_hostgroups - 1 - x].group_name);
+        free(args);
+        args = tmp;
+    }
+    for(x = 0; x < opt_route_servicegroups; x++) {
+        gm_asprintf(&tmp, "%s%s%s", args, x == 0 ? " servicegroups=" : ",", servicegroups[x].group_name);
+        free(args);
+        args = tmp;
+    }
+    for(x = 0; x < opt_local_hostgroups; x++) {
+        gm_asprintf(&tmp, "%s%s%s", args, x == 0 ? " localhostgroups=" : ",", hostgroups[x].group_name);
+        free(args);
+        args = tmp;
+    }
+    if(opt_module_args != NULL) {
+        gm_asprintf(&tmp, "%s %s", args, opt_module_args);
+        free(args);
+        args = tmp;
+    }
+
+    return args;
+}
+
+
+/* queue the module should choose, based on the object's own group lists
+ * instead of the group member lists used by set_target_queue */
+static int expected_queue(host *hst, service *svc, char *queue, int size) {
+    const char *value = NULL;
+    objectlist *item;
+    int x;
+
+    queue[0] = '\0';
+
+    if(mod_gm_opt->queue_cust_var) {
+        value = custom_variable(svc->custom_variables, mod_gm_opt->queue_cust_var);
+        if(value == NULL)
+            value = custom_variable(hst->custom_variables, mod_gm_opt->queue_cust_var);
+        if(value != NULL) {
+            if(!strcmp(value, "local"))
+                return BENCH_ROUTE_LOCAL;
+            snprintf(queue, size, "%s", value);
+            return BENCH_ROUTE_CUSTVAR;
+        }
+    }
+
+    for(x = 0; mod_gm_opt->local_servicegroups_list[x] != NULL; x++) {
+        for(item = svc->servicegroups_ptr; item != NULL; item = item->next) {
+            if(!strcmp(((servicegroup *)item->object_ptr)->group_name, mod_gm_opt->local_servicegroups_list[x]))
+                return BENCH_ROUTE_LOCAL;
+        }
+    }
+    for(x = 0; mod_gm_opt->local_hostgroups_list[x] != NULL; x++) {
+        for(item = hst->hostgroups_ptr; item != NULL; item = item->next) {
+            if(!strcmp(((hostgroup *)item->object_ptr)->group_name, mod_gm_opt->local_hostgroups_list[x]))
+                return BENCH_ROUTE_LOCAL;
+        }
+    }
+    for(x = 0; mod_gm_opt->servicegroups_list[x] != NULL; x++) {
+        for(item = svc->servicegroups_ptr; item != NULL; item = item->next) {
+            if(!strcmp(((servicegroup *)item->object_ptr)->group_name, mod_gm_opt->servicegroups_list[x])) {
+                snprintf(queue, size, "servicegroup_%s", mod_gm_opt->servicegroups_list[x]);
+                return BENCH_ROUTE_SERVICEGROUP;
+            }
+        }
+    }
+    for(x = 0; mod_gm_opt->hostgroups_list[x] != NULL; x++) {
+        for(item = hst->hostgroups_ptr; item != NULL; item = item->next) {
+            if(!strcmp(((hostgroup *)item->object_ptr)->group_name, mod_gm_opt->hostgroups_list[x])) {
+                snprintf(queue, size, "hostgroup_%s", mod_gm_opt->hostgroups_list[x]);
+                return BENCH_ROUTE_HOSTGROUP;
+            }
+        }
+    }
+    if(mod_gm_opt->services == GM_ENABLED) {
+        snprintf(queue, size, "service");
+        return BENCH_ROUTE_DEFAULT;
+    }
+
+    return BENCH_ROUTE_LOCAL;
+}
+
+
+/* fire service check events, hand results back and reap them */
+static void run_checks(gearman_worker_fn *result_func) {
+    nebstruct_service_check_data data;
+    service *svc;
+    char expected[GEARMAN_FUNCTION_MAX_SIZE];
+    int *pending;
+    int num_pending = 0;
+    int rc, route;
+    double start, due, t1, t2;
+    long x;
+
+    dispatch_time  = gm_malloc(opt_checks * sizeof(double));
+    dispatch_route = gm_malloc(opt_checks);
+    result_time    = gm_malloc(opt_checks * sizeof(double));
+    pending        = gm_malloc(opt_result_batch * sizeof(int));
+
+    start = mono_time();
+    for(x = 0; x < opt_checks; x++) {
+        /* round robin over hosts, each round shifts the service so service types are mixed */
+        svc = &services[(x % opt_hosts) * opt_services + (x + x / opt_hosts) % opt_services];
+
+        if(opt_rate > 0) {
+            due = start + (double)x / opt_rate;
+            t1  = mono_time();
+            if(due > t1)
+                usleep((useconds_t)((due - t1) * 1000000));
+        }
+
+        memset(&data, 0, sizeof(data));
+        data.type                = NEBTYPE_SERVICECHECK_ASYNC_PRECHECK;
+        gettimeofday(&data.timestamp, NULL);
+        data.host_name           = svc->host_name;
+        data.service_description = svc->description;
+        data.check_type          = SERVICE_CHECK_ACTIVE;
+        data.current_attempt     = svc->current_attempt;
+        data.max_attempts        = svc->max_attempts;
+        data.state_type          = svc->state_type;
+        data.state               = svc->current_state;
+        data.timeout             = service_check_timeout;
+        data.command_name        = svc->check_command_ptr->name;
+        data.object_ptr          = svc;
+        svc->next_check          = data.timestamp.tv_sec;
+        submitted_queue[0]       = '\0';
+
+        t1 = mono_time();
+        rc = neb_make_callbacks(NEBCALLBACK_SERVICE_CHECK_DATA, &data);
+        t2 = mono_time();
+        dispatch_time[x] = (t2 - t1) * 1000000;
+
+        route = expected_queue(svc->host_ptr, svc, expected, sizeof(expected));
+        dispatch_route[x] = route;
+        route_count[route]++;
+        if(strcmp(expected, submitted_queue)) {
+            if(opt_verbose || misrouted == 0)
+                diag("%s - %s went to '%s', expected '%s'\n", svc->host_name, svc->description, submitted_queue, expected);
+            misrouted++;
+        }
+
+        if(rc == NEBERROR_CALLBACKOVERRIDE) {
+            overridden++;
+            pending[num_pending++] = svc - services;
+            if(num_pending == opt_result_batch) {
+                inject_results(result_func, pending, num_pending);
+                num_pending = 0;
+            }
+        }
+        else if(rc == NEB_OK && route == BENCH_ROUTE_LOCAL) {
+            /* the core would run this check itself */
+            local_checks++;
+        }
+        else {
+            failed++;
+        }
+    }
+    if(num_pending > 0)
+        inject_results(result_func, pending, num_pending);
+    if(results_unreaped > 0)
+        reap_results();
+    dispatch_elapsed = mono_time() - start;
+
+    free(pending);
+}
+
+
+/* hand results for the given services to get_results like the result worker does */
+static void inject_results(gearman_worker_fn *result_func, int *pending, int num) {
+    char *results[GM_MULTI_RESULT_MAX];
+    char *packet, *crypted;
+    service *svc;
+    size_t result_size;
+    gearman_return_t ret;
+    struct timeval now;
+    double now_f, t1, t2;
+    int x;
+
+    gettimeofday(&now, NULL);
+    now_f = timeval2double(&now);
+    for(x = 0; x < num; x++) {
+        svc = &services[pending[x]];
+        gm_asprintf(&results[x], "host_name=%s\ncore_start_time=%lf\nstart_time=%lf\nfinish_time=%lf\nreturn_code=%i\nexited_ok=%i\nsource=%s\nservice_description=%s\noutput=%s\n\n\n",
+                    svc->host_name,
+                    (double)svc->next_check,
+                    now_f - 0.012,
+                    now_f,
+                    pending[x] % 50 == 0 ? STATE_WARNING : STATE_OK,
+                    TRUE,
+                    "Mod-Gearman Worker @ neb bench",
+                    svc->description,
+                    result_output
+                   );
+    }
+    packet = num > 1 ? build_multi_result(results, num) : results[0];
+    result_job.size     = mod_gm_encrypt(&crypted, packet, mod_gm_opt->transportmode);
+    result_job.workload = crypted;
+
+    t1 = mono_time();
+    result_func((gearman_job_st *)&result_job, NULL, &result_size, &ret);
+    t2 = mono_time();
+    result_time[result_packets++] = (t2 - t1) * 1000000 / num;
+    if(ret != GEARMAN_SUCCESS)
+        result_errors++;
+
+    free(crypted);
+    if(num > 1)
+        free(packet);
+    for(x = 0; x < num; x++)
+        free(results[x]);
+
+    results_injected += num;
+    results_unreaped += num;
+    if(results_unreaped >= opt_reaper)
+        reap_results();
+}
+
+
+/* run the check reaper event which moves results into the core */
+static void reap_results() {
+    nebstruct_timed_event_data ted;
+    double t1;
+
+    memset(&ted, 0, sizeof(ted));
+    ted.type       = NEBTYPE_TIMEDEVENT_EXECUTE;
+    ted.event_type = EVENT_CHECK_REAPER;
+    gettimeofday(&ted.timestamp, NULL);
+    ted.run_time   = ted.timestamp.tv_sec;
+
+    t1 = mono_time();
+    neb_make_callbacks(NEBCALLBACK_TIMED_EVENT_DATA, &ted);
+    reaper_time += mono_time() - t1;
+    reaper_runs++;
+    results_unreaped = 0;
+}
+
+
+/* print one latency distribution in microseconds */
+static void report_dist(const char *name, double *values, long num) {
+    double sum = 0;
+    long x;
+
+    if(num == 0) {
+        note("%-24s num=0\n", name);
+        return;
+    }
+    qsort(values, num, sizeof(double), cmp_double);
+    for(x = 0; x < num; x++)
+        sum += values[x];
+    note("%-24s num=%-8ld mean=%8.2f p50=%8.2f p90=%8.2f p99=%8.2f max=%9.2f us\n",
+         name, num, sum / num,
+         values[(long)(0.50 * (num - 1) + 0.5)],
+         values[(long)(0.90 * (num - 1) + 0.5)],
+         values[(long)(0.99 * (num - 1) + 0.5)],
+         values[num - 1]);
+}
+
+
+/* print benchmark results */
+static void report() {
+    double *values;
+    char name[64];
+    long x, num;
+    int route;
+
+    note("dispatched %ld service checks in %.2fs (%.0f/s), %ld jobs, %lld bytes, %s transport\n",
+         opt_checks, dispatch_elapsed, opt_checks / dispatch_elapsed, jobs_submitted, bytes_submitted,
+         opt_server != NULL ? "gearman" : "null");
+
+    /* per callback, all routes and split by the queue set_target_queue picked */
+    values = gm_malloc(opt_checks * sizeof(double));
+    memcpy(values, dispatch_time, opt_checks * sizeof(double));
+    report_dist("handle_svc_check", values, opt_checks);
+    for(route = 0; route < BENCH_ROUTES; route++) {
+        num = 0;
+        for(x = 0; x < opt_checks; x++) {
+            if(dispatch_route[x] == route)
+                values[num++] = dispatch_time[x];
+        }
+        snprintf(name, sizeof(name), "  %s", route_names[route]);
+        report_dist(name, values, num);
+    }
+    free(values);
+
+    report_dist("get_results per result", result_time, result_packets);
+    note("%-24s num=%-8ld mean=%8.2f us per result (%ld reaper events)\n", "check reaper",
+         results_processed, results_processed > 0 ? reaper_time * 1000000 / results_processed : 0, reaper_runs);
+}
+
+
+/* remove all callbacks, the core does this when a module is unloaded */
+static void clear_callbacks() {
+    nebcallback *cb, *next;
+    int x;
+    for(x = 0; x < NEBCALLBACK_NUMITEMS; x++) {
+        for(cb = callback_list[x]; cb != NULL; cb = next) {
+            next = cb->next;
+            free(cb);
+        }
+        callback_list[x] = NULL;
+    }
+}
+
+
+/* count job and remember its queue, pass it to gearmand if a server is used */
+static gearman_task_st *bench_add_task(bench_add_task_fn next, gearman_client_st *client, gearman_task_st *task, void *context, const char *queue, const char *uniq, const void *workload, size_t size, gearman_return_t *ret_ptr) {
+    jobs_submitted++;
+    bytes_submitted += size;
+    snprintf(submitted_queue, sizeof(submitted_queue), "%s", queue);
+    if(next != NULL)
+        return next(client, task, context, queue, uniq, workload, size, ret_ptr);
+    *ret_ptr = GEARMAN_SUCCESS;
+    return (gearman_task_st *)&null_task;
+}
+
+
+/* libgearman functions, used by add_job_to_queue */
+gearman_task_st *gearman_client_add_task_low_background(gearman_client_st *client, gearman_task_st *task, void *context, const char *queue, const char *uniq, const void *workload, size_t size, gearman_return_t *ret_ptr) {
+    return bench_add_task(next_add_task_low, client, task, context, queue, uniq, workload, size, ret_ptr);
+}
+
+gearman_task_st *gearman_client_add_task_background(gearman_client_st *client, gearman_task_st *task, void *context, const char *queue, const char *uniq, const void *workload, size_t size, gearman_return_t *ret_ptr) {
+    return bench_add_task(next_add_task_normal, client, task, context, queue, uniq, workload, size, ret_ptr);
+}
+
+gearman_task_st *gearman_client_add_task_high_background(gearman_client_st *client, gearman_task_st *task, void *context, const char *queue, const char *uniq, const void *workload, size_t size, gearman_return_t *ret_ptr) {
+    return bench_add_task(next_add_task_high, client, task, context, queue, uniq, workload, size, ret_ptr);
+}
+
+void gearman_task_give_workload(gearman_task_st *task, const void *workload, size_t size) {
+    if(next_give_workload != NULL)
+        next_give_workload(task, workload, size);
+}
+
+gearman_return_t gearman_client_run_tasks(gearman_client_st *client) {
+    if(next_run_tasks != NULL)
+        return next_run_tasks(client);
+    return GEARMAN_SUCCESS;
+}
+
+/* result jobs are never fetched from gearmand, no result worker is running */
+size_t gearman_job_workload_size(const gearman_job_st *job) {
+    return ((const bench_job_t *)job)->size;
+}
+
+const void *gearman_job_workload(const gearman_job_st *job) {
+    return ((const bench_job_t *)job)->workload;
+}
+
+const char *gearman_job_handle(const gearman_job_st *job) {
+    (void) job;
+    return "H:neb_bench:1";
+}
+
+
+/* core log wrapper */
+void write_core_log(char *data);
+void write_core_log(char *data) {
+    printf("logger: %s", data);
+    return;
+}
+
+/* declared in nagios4/logging.h */
+int write_to_all_logs(char *buffer, unsigned long data_type) {
+    (void) data_type;
+    write_core_log(buffer);
+    return OK;
+}
+
+/* declared in nagios4/nebmodules.h */
+int neb_set_module_info(void *handle, int type, char *data) {
+    (void) handle;
+    (void) type;
+    (void) data;
+    return 0;
+}
+
+/* declared in nagios4/nebcallbacks.h, callbacks are sorted by priority */
+int neb_register_callback(int callback_type, void *mod_handle, int priority, int (*callback_func)(int, void *)) {
+    nebcallback *new_callback, **ptr;
+
+    if(callback_func == NULL)
+        return NEBERROR_NOCALLBACKFUNC;
+    if(mod_handle == NULL)
+        return NEBERROR_NOMODULEHANDLE;
+    if(callback_type < 0 || callback_type >= NEBCALLBACK_NUMITEMS)
+        return NEBERROR_CALLBACKBOUNDS;
+
+    new_callback = gm_malloc(sizeof(nebcallback));
+    new_callback->callback_func = (void *)callback_func;
+    new_callback->module_handle = mod_handle;
+    new_callback->priority      = priority;
+    for(ptr = &callback_list[callback_type]; *ptr != NULL && (*ptr)->priority <= priority; ptr = &(*ptr)->next);
+    new_callback->next = *ptr;
+    *ptr = new_callback;
+
+    return OK;
+}
+
+/* declared in nagios4/nebcallbacks.h */
+int neb_deregister_callback(int callback_type, int (*callback_func)(int, void *)) {
+    nebcallback *cb, **ptr;
+
+    if(callback_type < 0 || callback_type >= NEBCALLBACK_NUMITEMS)
+        return NEBERROR_CALLBACKBOUNDS;
+
+    for(ptr = &callback_list[callback_type]; *ptr != NULL; ptr = &(*ptr)->next) {
+        if((*ptr)->callback_func == (void *)callback_func) {
+            cb   = *ptr;
+            *ptr = cb->next;
+            free(cb);
+            return OK;
+        }
+    }
+
+    return NEBERROR_CALLBACKNOTFOUND;
+}
+
+/* declared in nagios4/nebmods.h */
+int neb_make_callbacks(int callback_type, void *data) {
+    int (*callbackfunc)(int, void *);
+    nebcallback *cb;
+    int cbresult = 0;
+
+    if(callback_type < 0 || callback_type >= NEBCALLBACK_NUMITEMS)
+        return ERROR;
+
+    for(cb = callback_list[callback_type]; cb != NULL; cb = cb->next) {
+        callbackfunc = (int (*)(int, void *))cb->callback_func;
+        cbresult = callbackfunc(callback_type, data);
+
+        /* module wants to cancel callbacks to other modules or override the core */
+        if(cbresult == NEBERROR_CALLBACKCANCEL || cbresult == NEBERROR_CALLBACKOVERRIDE)
+            break;
+    }
+
+    return cbresult;
+}
+
+/* declared in nagios4/objects.h */
+struct host *find_host(const char *name) {
+    return hash_find(&host_table, name, NULL);
+}
+
+/* declared in nagios4/objects.h */
+struct service *find_service(const char *host_name, const char *svc_desc) {
+    if(svc_desc == NULL)
+        return NULL;
+    return hash_find(&service_table, host_name, svc_desc);
+}
+
+/* declared in nagios4/objects.h */
+struct hostgroup *find_hostgroup(const char *name) {
+    return hash_find(&hostgroup_table, name, NULL);
+}
+
+/* declared in nagios4/objects.h */
+struct servicegroup *find_servicegroup(const char *name) {
+    return hash_find(&servicegroup_table, name, NULL);
+}
+
+/* declared in nagios4/objects.h */
+struct command *find_command(const char *name) {
+    int x;
+    for(x = 0; name != NULL && x < BENCH_COMMANDS; x++) {
+        if(!strcmp(commands[x].name, name))
+            return &commands[x];
+    }
+    return NULL;
+}
+
+/* declared in nagios4/objects.h */
+struct contact *find_contact(const char *name) {
+    (void) name;
+    return NULL;
+}
+
+/* declared in nagios4/objects.h, the core walks the member list as well */
+int is_host_member_of_hostgroup(struct hostgroup *group, struct host *hst) {
+    hostsmember *member;
+    if(group == NULL || hst == NULL)
+        return FALSE;
+    for(member = group->members; member != NULL; member = member->next) {
+        if(member->host_ptr == hst)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* declared in nagios4/objects.h */
+int is_service_member_of_servicegroup(struct servicegroup *group, struct service *svc) {
+    servicesmember *member;
+    if(group == NULL || svc == NULL)
+        return FALSE;
+    for(member = group->members; member != NULL; member = member->next) {
+        if(member->service_ptr == svc)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* declared in nagios4/macros.h */
+int clear_volatile_macros_r(nagios_macros *mac) {
+    mac->host_ptr            = NULL;
+    mac->service_ptr         = NULL;
+    mac->custom_host_vars    = NULL;
+    mac->custom_service_vars = NULL;
+    memset(mac->argv, 0, sizeof(mac->argv));
+    return OK;
+}
+
+/* declared in nagios4/macros.h */
+int grab_host_macros_r(nagios_macros *mac, host *hst) {
+    mac->host_ptr         = hst;
+    mac->custom_host_vars = hst->custom_variables;
+    return OK;
+}
+
+/* declared in nagios4/macros.h */
+int grab_service_macros_r(nagios_macros *mac, service *svc) {
+    mac->service_ptr         = svc;
+    mac->custom_service_vars = svc->custom_variables;
+    return OK;
+}
+
+/* declared in nagios4/macros.h */
+int grab_contact_macros_r(nagios_macros *mac, contact *cntct) {
+    mac->contact_ptr = cntct;
+    return OK;
+}
+
+/* declared in nagios4/nagios.h, $ARGn$ point into a static buffer as the module never clears them */
+int get_raw_command_line_r(nagios_macros *mac, command *cmd_ptr, char *cmd, char **full_command, int macro_options) {
+    char *ptr, *arg;
+    int x = 0;
+
+    (void) macro_options;
+    memset(mac->argv, 0, sizeof(mac->argv));
+    if(full_command == NULL)
+        return ERROR;
+    *full_command = NULL;
+    if(cmd_ptr == NULL || cmd == NULL)
+        return ERROR;
+
+    *full_command = gm_strdup(cmd_ptr->command_line);
+
+    ptr = strchr(cmd, '!');
+    if(ptr == NULL)
+        return OK;
+    snprintf(macro_args, sizeof(macro_args), "%s", ptr + 1);
+    ptr = macro_args;
+    while(x < MAX_COMMAND_ARGUMENTS && (arg = strsep(&ptr, "!")) != NULL)
+        mac->argv[x++] = arg;
+
+    return OK;
+}
+
+/* resolve the macros used by the synthetic commands, NULL if unknown */
+static const char *macro_value(nagios_macros *mac, const char *name);
+static const char *macro_value(nagios_macros *mac, const char *name) {
+    const char *value;
+    int x;
+
+    if(!strcmp(name, "HOSTNAME"))
+        return mac->host_ptr != NULL ? mac->host_ptr->name : "";
+    if(!strcmp(name, "HOSTADDRESS"))
+        return mac->host_ptr != NULL ? mac->host_ptr->address : "";
+    if(!strcmp(name, "HOSTALIAS"))
+        return mac->host_ptr != NULL ? mac->host_ptr->alias : "";
+    if(!strcmp(name, "SERVICEDESC"))
+        return mac->service_ptr != NULL ? mac->service_ptr->description : "";
+    if(!strcmp(name, "USER1"))
+        return "/usr/lib/nagios/plugins";
+    if(!strncmp(name, "ARG", 3)) {
+        x = atoi(name + 3);
+        if(x < 1 || x > MAX_COMMAND_ARGUMENTS)
+            return NULL;
+        return mac->argv[x-1] != NULL ? mac->argv[x-1] : "";
+    }
+    if(!strncmp(name, "_HOST", 5)) {
+        value = custom_variable(mac->custom_host_vars, name + 5);
+        return value != NULL ? value : "";
+    }
+    if(!strncmp(name, "_SERVICE", 8)) {
+        value = custom_variable(mac->custom_service_vars, name + 8);
+        return value != NULL ? value : "";
+    }
+    return NULL;
+}
+
+/* declared in nagios4/macros.h, unknown macros are kept like the core does */
+int process_macros_r(nagios_macros *mac, char *input_buffer, char **output_buffer, int options) {
+    char buffer[GM_BUFFERSIZE];
+    char name[256];
+    const char *value;
+    char *end;
+    size_t len = 0, size;
+
+    (void) options;
+    if(output_buffer == NULL)
+        return ERROR;
+    *output_buffer = NULL;
+    if(input_buffer == NULL)
+        return ERROR;
+
+    while(*input_buffer != '\0' && len < sizeof(buffer) - 1) {
+        end = NULL;
+        if(*input_buffer == '$')
+            end = strchr(input_buffer + 1, '$');
+        if(end == NULL || (size_t)(end - input_buffer - 1) >= sizeof(name)) {
+            buffer[len++] = *input_buffer++;
+            continue;
+        }
+
+        size = end - input_buffer - 1;
+        memcpy(name, input_buffer + 1, size);
+        name[size] = '\0';
+        value = size == 0 ? "$" : macro_value(mac, name);
+        if(value == NULL) {
+            value = input_buffer;
+            size += 2;
+        } else {
+            size = strlen(value);
+        }
+        if(len + size >= sizeof(buffer))
+            break;
+        memcpy(buffer + len, value, size);
+        len += size;
+        input_buffer = end + 1;
+    }
+    buffer[len] = '\0';
+    *output_buffer = gm_strdup(buffer);
+
+    return OK;
+}
+
+/* declared in nagios4/nagios.h */
+int init_check_result(check_result *info) {
+    if(info == NULL)
+        return ERROR;
+    memset(info, 0, sizeof(check_result));
+    info->object_check_type = HOST_CHECK;
+    info->check_type        = HOST_CHECK_ACTIVE;
+    info->check_options     = CHECK_OPTION_NONE;
+    info->exited_ok         = TRUE;
+    return OK;
+}
+
+/* declared in nagios4/nagios.h */
+int free_check_result(check_result *info) {
+    if(info == NULL)
+        return OK;
+    free(info->host_name);
+    info->host_name = NULL;
+    free(info->service_description);
+    info->service_description = NULL;
+    free(info->output_file);
+    info->output_file = NULL;
+    free(info->output);
+    info->output = NULL;
+    return OK;
+}
+
+/* declared in nagios4/nagios.h, the core looks up the service for every result */
+int process_check_result(check_result *cr) {
+    service *svc = NULL;
+
+    if(cr->object_check_type == SERVICE_CHECK)
+        svc = find_service(cr->host_name, cr->service_description);
+    if(svc == NULL) {
+        results_unknown++;
+        return ERROR;
+    }
+
+    svc->is_executing  = FALSE;
+    svc->current_state = cr->return_code;
+    svc->last_check    = cr->start_time.tv_sec;
+    svc->latency       = cr->latency;
+    currently_running_service_checks--;
+    results_processed++;
+
+    return OK;
+}
+
+/* declared in nagios4/nagios.h */
+int adjust_host_check_attempt(host *hst, int is_active) {
+    (void) hst;
+    (void) is_active;
+    return OK;
+}
+
+/* declared in nagios4/nagios.h */
+const char *notification_reason_name(unsigned int reason_type) {
+    (void) reason_type;
+    return "NORMAL";
+}
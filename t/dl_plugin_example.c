@@ -0,0 +1,47 @@
+/* example shared object plugin, used by t/03-exec_checks.c
+ *
+ * build with: cc -Iinclude -fPIC -shared -o check_example.so t/dl_plugin_example.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mod_gearman_plugin.h"
+
+static int initialized = 0;
+
+static int example_init(void) {
+    initialized = 1;
+    return 0;
+}
+
+/* check_example <rc> [text] */
+static int example_run(int argc, char **argv, int timeout, mod_gearman_plugin_result_t *result) {
+    char buf[256];
+    if(argc < 2 || !initialized)
+        return 1;
+    result->rc = atoi(argv[1]);
+    snprintf(buf, sizeof(buf), "EXAMPLE %s pid %d", argc > 2 ? argv[2] : "ok", (int)getpid());
+    result->output = strdup(buf);
+    snprintf(buf, sizeof(buf), "timeout=%ds", timeout);
+    result->perfdata = strdup(buf);
+    return 0;
+}
+
+static void example_teardown(void) {
+    initialized = 0;
+}
+
+static const mod_gearman_plugin_t example_plugin = {
+    MOD_GEARMAN_PLUGIN_ABI_VERSION,
+    "check_example",
+    0,
+    example_init,
+    example_run,
+    example_teardown
+};
+
+const mod_gearman_plugin_t * mod_gearman_plugin(void) {
+    return &example_plugin;
+}
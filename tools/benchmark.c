@@ -0,0 +1,1129 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/* include header */
+#include "benchmark.h"
+#include "utils.h"
+#include "gearman_utils.h"
+
+#include <dirent.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <worker_dummy_functions.c>
+
+int opt_verbose         = 0;
+int opt_format          = GM_BENCH_FORMAT_JSON;
+int opt_workers         = 4;
+int opt_port            = GM_BENCH_DEFAULT_PORT;
+int opt_runtime         = 0;
+int opt_output_size     = 100;
+double opt_rate         = 500;
+double opt_duration     = 10;
+double opt_warmup       = 2;
+double opt_drain        = 30;
+double opt_min_rate     = 0;
+char * opt_gearmand     = NULL;
+char * opt_server       = NULL;
+char * opt_worker       = "./mod_gearman_worker";
+char * opt_key          = NULL;
+char * opt_output       = NULL;
+char * worker_opts[GM_LISTSIZE];
+int worker_opts_num     = 0;
+char * gearmand_opts[GM_LISTSIZE];
+int gearmand_opts_num   = 0;
+
+char plugin_path[PATH_MAX];
+char log_dir[PATH_MAX];
+char job_queue[GEARMAN_FUNCTION_MAX_SIZE];
+char result_queue[GEARMAN_FUNCTION_MAX_SIZE];
+gm_bench_shared_t * shared = NULL;
+gm_bench_proc_t procs[GM_BENCH_PROCS];
+FILE * report = NULL;
+
+static volatile sig_atomic_t bench_running = TRUE;
+
+/* state of the report printer */
+static const char * report_path[8];
+static int report_first[8];
+static int report_depth = 0;
+
+static void bench_sighandler(int sig);
+static double now_double(void);
+static void wait_seconds(double seconds);
+static char * find_gearmand(void);
+static pid_t start_process(char ** args, char * logfile);
+static pid_t start_function(int (*function)(void));
+static int check_process(gm_bench_proc_t * proc);
+static void stop_process(gm_bench_proc_t * proc);
+static int wait_for_port(char * hostnam, int port, double timeout);
+static int wait_for_workers(char * hostnam, int port, double timeout);
+static void sample_memory(void);
+static void * consume_result(gearman_job_st *job, void *context, size_t *result_size, gearman_return_t *ret_ptr);
+static int cmp_double(const void * a, const void * b);
+static void report_open(const char * name);
+static void report_close(void);
+static void report_key(const char * name);
+static void report_number(const char * name, double value, int valid);
+static void report_string(const char * name, const char * value);
+static void report_dist(const char * name, gm_bench_dist_t * dist);
+
+/* work starts here */
+int main (int argc, char **argv) {
+    int opt, x, fd, rc = 0;
+    long max_samples;
+    double now, next_sample, drain_end, sustained;
+    char * args[GM_LISTSIZE];
+    char buf[GM_BUFFERSIZE];
+    char * host;
+    int port, args_num;
+    static struct option long_options[] = {
+        {"help",          no_argument,       0, 'h'},
+        {"verbose",       no_argument,       0, 'v'},
+        {"version",       no_argument,       0, 'V'},
+        {"plugin",        required_argument, 0, 'P'},
+        {"workers",       required_argument, 0, 'w'},
+        {"rate",          required_argument, 0, 'r'},
+        {"duration",      required_argument, 0, 'd'},
+        {"warmup",        required_argument, 0, 'W'},
+        {"drain",         required_argument, 0, 'D'},
+        {"runtime",       required_argument, 0, 't'},
+        {"output-size",   required_argument, 0, 's'},
+        {"min-rate",      required_argument, 0, 'm'},
+        {"gearmand",      required_argument, 0, 'g'},
+        {"gearmand-opt",  required_argument, 0, 'G'},
+        {"port",          required_argument, 0, 'p'},
+        {"server",        required_argument, 0, 'H'},
+        {"worker",        required_argument, 0, 'b'},
+        {"worker-opt",    required_argument, 0, 'O'},
+        {"key",           required_argument, 0, 'k'},
+        {"format",        required_argument, 0, 'f'},
+        {"output",        required_argument, 0, 'o'},
+        {0, 0, 0, 0}
+    };
+
+    /* plugin mode first, it runs once per job */
+    if(argc == 2 && !strncmp(argv[1], "--plugin=", 9))
+        return(run_plugin(argv[1] + 9));
+
+    mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(mod_gm_opt);
+
+    while((opt = getopt_long(argc, argv, "hvVP:w:r:d:W:D:t:s:m:g:G:p:H:b:O:k:f:o:", long_options, NULL)) != -1) {
+        switch(opt) {
+            case 'h':   print_usage();
+                        break;
+            case 'v':   opt_verbose++;
+                        break;
+            case 'V':   print_version();
+                        break;
+            case 'P':   return(run_plugin(optarg));
+            case 'w':   opt_workers = atoi(optarg);
+                        break;
+            case 'r':   opt_rate = atof(optarg);
+                        break;
+            case 'd':   opt_duration = atof(optarg);
+                        break;
+            case 'W':   opt_warmup = atof(optarg);
+                        break;
+            case 'D':   opt_drain = atof(optarg);
+                        break;
+            case 't':   opt_runtime = atoi(optarg);
+                        break;
+            case 's':   opt_output_size = atoi(optarg);
+                        break;
+            case 'm':   opt_min_rate = atof(optarg);
+                        break;
+            case 'g':   opt_gearmand = optarg;
+                        break;
+            case 'G':   if(gearmand_opts_num < GM_LISTSIZE - 1)
+                            gearmand_opts[gearmand_opts_num++] = optarg;
+                        break;
+            case 'p':   opt_port = atoi(optarg);
+                        break;
+            case 'H':   opt_server = optarg;
+                        break;
+            case 'b':   opt_worker = optarg;
+                        break;
+            case 'O':   if(worker_opts_num < GM_LISTSIZE - 1)
+                            worker_opts[worker_opts_num++] = optarg;
+                        break;
+            case 'k':   opt_key = optarg;
+                        break;
+            case 'f':   if(!strcmp(optarg, "json")) {
+                            opt_format = GM_BENCH_FORMAT_JSON;
+                        } else if(!strcmp(optarg, "text")) {
+                            opt_format = GM_BENCH_FORMAT_TEXT;
+                        } else {
+                            printf("Error - unknown format: `%s'\n\n", optarg);
+                            print_usage();
+                        }
+                        break;
+            case 'o':   opt_output = optarg;
+                        break;
+            case '?':   printf("Error - No such option: `%c'\n\n", optopt);
+                        print_usage();
+                        break;
+        }
+    }
+    if(opt_workers <= 0 || opt_rate <= 0 || opt_duration <= 0 || opt_warmup < 0 || opt_runtime < 0 || opt_output_size < 0) {
+        printf("Error - workers, rate and duration must be positive\n\n");
+        print_usage();
+    }
+
+    /* the report goes to stdout, everything else to stderr */
+    if(opt_output != NULL) {
+        report = fopen(opt_output, "w");
+    } else {
+        fd = dup(STDOUT_FILENO);
+        report = fd >= 0 ? fdopen(fd, "w") : NULL;
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+    if(report == NULL) {
+        fprintf(stderr, "Error - cannot open report: %s\n", strerror(errno));
+        exit( EXIT_FAILURE );
+    }
+    mod_gm_opt->debug_level = opt_verbose;
+    mod_gm_opt->logmode     = GM_LOG_MODE_TOOLS;
+
+    if(opt_key != NULL) {
+        mod_gm_crypt_init(opt_key);
+        mod_gm_opt->transportmode = GM_ENCODE_AND_ENCRYPT;
+    } else {
+        mod_gm_opt->transportmode = GM_ENCODE_ONLY;
+    }
+
+    /* the benchmark binary is the plugin too */
+    x = readlink("/proc/self/exe", plugin_path, sizeof(plugin_path)-1);
+    if(x > 0) {
+        plugin_path[x] = '\0';
+    } else if(realpath(argv[0], plugin_path) == NULL) {
+        fprintf(stderr, "Error - cannot resolve path of %s\n", argv[0]);
+        exit( EXIT_FAILURE );
+    }
+    if(access(opt_worker, X_OK) != 0) {
+        fprintf(stderr, "Error - worker not found: %s\n", opt_worker);
+        exit( EXIT_FAILURE );
+    }
+
+    /* separate queues, so a shared gearmand can be used */
+    snprintf(job_queue,    sizeof(job_queue),    "hostgroup_benchmark_%d", (int)getpid());
+    snprintf(result_queue, sizeof(result_queue), "benchmark_results_%d", (int)getpid());
+
+    snprintf(log_dir, sizeof(log_dir), "/tmp/mod_gearman_benchmark.XXXXXX");
+    if(mkdtemp(log_dir) == NULL) {
+        fprintf(stderr, "Error - cannot create log directory: %s\n", strerror(errno));
+        exit( EXIT_FAILURE );
+    }
+
+    /* one sample per job, results arriving late are counted but not sampled */
+    max_samples = (long)((opt_warmup + opt_duration) * opt_rate * 1.1) + 1000;
+    shared = mmap(NULL, sizeof(gm_bench_shared_t) + max_samples * sizeof(gm_bench_sample_t),
+                  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(shared == MAP_FAILED) {
+        fprintf(stderr, "Error - cannot allocate %ld samples: %s\n", max_samples, strerror(errno));
+        exit( EXIT_FAILURE );
+    }
+    shared->max_samples = max_samples;
+
+    memset(procs, 0, sizeof(procs));
+    procs[GM_BENCH_GEARMAND].name = "gearmand";
+    procs[GM_BENCH_WORKER].name   = "worker";
+    procs[GM_BENCH_INJECTOR].name = "injector";
+    procs[GM_BENCH_CONSUMER].name = "consumer";
+
+    signal(SIGINT,  bench_sighandler);
+    signal(SIGTERM, bench_sighandler);
+    signal(SIGPIPE, SIG_IGN);
+
+    /* start gearmand unless an existing one should be used */
+    if(opt_server == NULL) {
+        opt_gearmand = find_gearmand();
+        if(opt_gearmand == NULL) {
+            fprintf(stderr, "Error - no gearmand found, use --gearmand or --server\n");
+            rc = 1;
+            goto cleanup;
+        }
+        args_num = 0;
+        args[args_num++] = opt_gearmand;
+        snprintf(buf, sizeof(buf), "--port=%d", opt_port);
+        args[args_num++] = gm_strdup(buf);
+        args[args_num++] = "--listen=127.0.0.1";
+        snprintf(buf, sizeof(buf), "--log-file=%s/gearmand.log", log_dir);
+        args[args_num++] = gm_strdup(buf);
+        for(x = 0; x < gearmand_opts_num; x++)
+            args[args_num++] = gearmand_opts[x];
+        args[args_num] = NULL;
+        snprintf(buf, sizeof(buf), "%s/gearmand.out", log_dir);
+        procs[GM_BENCH_GEARMAND].pid = start_process(args, buf);
+        snprintf(buf, sizeof(buf), "127.0.0.1:%d", opt_port);
+        opt_server = gm_strdup(buf);
+    }
+    add_server(&mod_gm_opt->server_num, mod_gm_opt->server_list, opt_server);
+    host = mod_gm_opt->server_list[0]->host;
+    port = mod_gm_opt->server_list[0]->port;
+    if(wait_for_port(host, port, GM_BENCH_START_TIMEOUT) != GM_OK) {
+        fprintf(stderr, "Error - gearmand on %s:%d did not come up\n", host, port);
+        rc = 1;
+        goto cleanup;
+    }
+
+    /* consumer and worker */
+    procs[GM_BENCH_CONSUMER].pid = start_function(run_consumer);
+
+    args_num = 0;
+    args[args_num++] = opt_worker;
+    snprintf(buf, sizeof(buf), "--server=%s:%d", host, port);
+    args[args_num++] = gm_strdup(buf);
+    if(opt_key != NULL) {
+        args[args_num++] = "--encryption=yes";
+        snprintf(buf, sizeof(buf), "--key=%s", opt_key);
+        args[args_num++] = gm_strdup(buf);
+    } else {
+        args[args_num++] = "--encryption=no";
+    }
+    args[args_num++] = "--hosts=no";
+    args[args_num++] = "--services=no";
+    args[args_num++] = "--eventhandler=no";
+    args[args_num++] = "--notifications=no";
+    snprintf(buf, sizeof(buf), "--hostgroups=%s", job_queue + strlen("hostgroup_"));
+    args[args_num++] = gm_strdup(buf);
+    snprintf(buf, sizeof(buf), "--min-worker=%d", opt_workers);
+    args[args_num++] = gm_strdup(buf);
+    snprintf(buf, sizeof(buf), "--max-worker=%d", opt_workers);
+    args[args_num++] = gm_strdup(buf);
+    args[args_num++] = "--plugin_usage_result=yes";
+    args[args_num++] = "--debug=0";
+    snprintf(buf, sizeof(buf), "--logfile=%s/worker.log", log_dir);
+    args[args_num++] = gm_strdup(buf);
+    for(x = 0; x < worker_opts_num; x++)
+        args[args_num++] = worker_opts[x];
+    args[args_num] = NULL;
+    snprintf(buf, sizeof(buf), "%s/worker.out", log_dir);
+    procs[GM_BENCH_WORKER].pid = start_process(args, buf);
+
+    if(wait_for_workers(host, port, GM_BENCH_START_TIMEOUT) != GM_OK) {
+        fprintf(stderr, "Error - workers did not register on %s:%d\n", host, port);
+        rc = 1;
+        goto cleanup;
+    }
+
+    /* run */
+    if(opt_verbose > 0)
+        fprintf(stderr, "running %.0f jobs/s for %.1fs (%.1fs warmup) with %d workers\n", opt_rate, opt_duration + opt_warmup, opt_warmup, opt_workers);
+    shared->start_time = now_double() + 0.1;
+    procs[GM_BENCH_INJECTOR].pid = start_function(run_injector);
+
+    next_sample = 0;
+    drain_end   = 0;
+    while(TRUE) {
+        now = now_double();
+        if(now >= next_sample) {
+            sample_memory();
+            next_sample = now + GM_BENCH_SAMPLE_INTERVAL;
+        }
+        if(bench_running == FALSE)
+            break;
+        if(check_process(&procs[GM_BENCH_WORKER]) != GM_OK || check_process(&procs[GM_BENCH_CONSUMER]) != GM_OK
+           || (procs[GM_BENCH_GEARMAND].pid > 0 && check_process(&procs[GM_BENCH_GEARMAND]) != GM_OK)) {
+            rc = 1;
+            break;
+        }
+        /* wait until all submitted jobs came back */
+        if(check_process(&procs[GM_BENCH_INJECTOR]) != GM_OK) {
+            if(drain_end == 0)
+                drain_end = now + opt_drain;
+            if(shared->received + shared->invalid >= shared->submitted || now >= drain_end)
+                break;
+        }
+        wait_seconds(0.05);
+    }
+
+cleanup:
+    /* stop in the order of the data flow */
+    stop_process(&procs[GM_BENCH_INJECTOR]);
+    stop_process(&procs[GM_BENCH_WORKER]);
+    stop_process(&procs[GM_BENCH_CONSUMER]);
+    stop_process(&procs[GM_BENCH_GEARMAND]);
+
+    for(x = 0; x < GM_BENCH_PROCS; x++) {
+        if(procs[x].exited && procs[x].pid > 0 && procs[x].status != 0 && x != GM_BENCH_GEARMAND && x != GM_BENCH_WORKER) {
+            fprintf(stderr, "Error - %s failed with exit code %d\n", procs[x].name, WIFEXITED(procs[x].status) ? WEXITSTATUS(procs[x].status) : -1);
+            rc = 1;
+        }
+    }
+
+    if(shared->start_time > 0) {
+        sustained = print_report();
+        if(rc == 0 && sustained < opt_min_rate) {
+            fprintf(stderr, "Error - sustained rate %.1f/s is below %.1f/s\n", sustained, opt_min_rate);
+            rc = 2;
+        }
+    }
+    fclose(report);
+
+    /* keep logs for debugging failed runs */
+    if(rc != 1) {
+        snprintf(buf, sizeof(buf), "%s/gearmand.log", log_dir); unlink(buf);
+        snprintf(buf, sizeof(buf), "%s/gearmand.out", log_dir); unlink(buf);
+        snprintf(buf, sizeof(buf), "%s/worker.log", log_dir);   unlink(buf);
+        snprintf(buf, sizeof(buf), "%s/worker.out", log_dir);   unlink(buf);
+    }
+    if(rmdir(log_dir) != 0)
+        fprintf(stderr, "logfiles kept in %s\n", log_dir);
+    return(rc);
+}
+
+
+/* print version */
+void print_version() {
+    printf("mod_gearman_benchmark: version %s\n", GM_VERSION );
+    printf("\n");
+    exit( EXIT_SUCCESS );
+}
+
+
+/* print usage */
+void print_usage() {
+    printf("usage:\n");
+    printf("\n");
+    printf("mod_gearman_benchmark [ --workers=<nr>         worker processes         ]   (default: 4)\n");
+    printf("                      [ --rate=<jobs/s>        submitted jobs           ]   (default: 500)\n");
+    printf("                      [ --duration=<sec>       measured time            ]   (default: 10)\n");
+    printf("                      [ --warmup=<sec>         unmeasured time          ]   (default: 2)\n");
+    printf("                      [ --drain=<sec>          wait for late results    ]   (default: 30)\n");
+    printf("                      [ --runtime=<ms>         plugin runtime           ]   (default: 0)\n");
+    printf("                      [ --output-size=<bytes>  plugin output            ]   (default: 100)\n");
+    printf("                      [ --min-rate=<jobs/s>    exit 2 if not reached    ]\n");
+    printf("\n");
+    printf("                      [ --gearmand=<path>      gearmand binary          ]   (default: search PATH)\n");
+    printf("                      [ --gearmand-opt=<opt>   extra gearmand option    ]   (may be repeated)\n");
+    printf("                      [ --port=<port>          port of local gearmand   ]   (default: %d)\n", GM_BENCH_DEFAULT_PORT);
+    printf("                      [ --server=<host:port>   use a running gearmand   ]\n");
+    printf("                      [ --worker=<path>        mod_gearman_worker       ]   (default: ./mod_gearman_worker)\n");
+    printf("                      [ --worker-opt=<opt>     extra worker option      ]   (may be repeated)\n");
+    printf("                      [ --key=<key>            enable encryption        ]\n");
+    printf("\n");
+    printf("                      [ --format=<format>      json|text                ]   (default: json)\n");
+    printf("                      [ --output=<file>        write report to file     ]   (default: stdout)\n");
+    printf("                      [ -h                     print help               ]\n");
+    printf("                      [ -v                     verbose output           ]\n");
+    printf("                      [ -V                     print version            ]\n");
+    printf("\n");
+
+    exit( EXIT_SUCCESS );
+}
+
+
+/* act as plugin */
+int run_plugin(char * spec) {
+    int runtime = 0, size = 0, len;
+    long seq = 0;
+    char * buf;
+    struct timespec ts;
+
+    sscanf(spec, "%d,%d,%ld", &runtime, &size, &seq);
+    if(runtime > 0) {
+        ts.tv_sec  = runtime / 1000;
+        ts.tv_nsec = (runtime % 1000) * 1000000L;
+        nanosleep(&ts, NULL);
+    }
+
+    len = printf("OK - benchmark job %ld ", seq);
+    if(size > len) {
+        buf = gm_malloc(size - len);
+        memset(buf, 'x', size - len);
+        fwrite(buf, 1, size - len, stdout);
+        free(buf);
+    }
+    printf("\n");
+    return(STATE_OK);
+}
+
+
+/* submit jobs at the configured rate */
+int run_injector() {
+    gearman_client_st client;
+    char ** data;
+    int * failed_jobs;
+    int x, num, failed, size, rc = 0;
+    long seq = 0, due;
+    double now, end;
+
+    if(create_client(mod_gm_opt->server_list, &client) != GM_OK) {
+        fprintf(stderr, "Error - cannot create gearman client\n");
+        return(1);
+    }
+    current_client = &client;
+
+    /* both names plus the numbers and keys of the job */
+    size        = strlen(plugin_path) + strlen(result_queue) + 512;
+    data        = gm_malloc(GM_MAX_BULK_SIZE * sizeof(char *));
+    failed_jobs = gm_malloc(GM_MAX_BULK_SIZE * sizeof(int));
+    for(x = 0; x < GM_MAX_BULK_SIZE; x++)
+        data[x] = NULL;
+
+    end = shared->start_time + opt_warmup + opt_duration;
+    while(bench_running) {
+        now = now_double();
+        if(now >= end)
+            break;
+
+        /* job n is due at start_time + n / rate */
+        due = now < shared->start_time ? 0 : (long)((now - shared->start_time) * opt_rate) + 1;
+        num = due - seq > GM_MAX_BULK_SIZE ? GM_MAX_BULK_SIZE : (int)(due - seq);
+        if(num <= 0) {
+            wait_seconds(shared->start_time + seq / opt_rate - now);
+            continue;
+        }
+
+        /* latency is measured from the due time, a lagging injector counts as latency too */
+        for(x = 0; x < num; x++) {
+            if(data[x] == NULL)
+                data[x] = gm_malloc(size);
+            if(snprintf(data[x], size, "type=host\nresult_queue=%s\nhost_name=benchmark\ntrace_id=%ld\nnext_check=%f\ncore_time=%f\ntimeout=%d\ncommand_line=%s --plugin=%d,%d,%ld\n\n",
+                     result_queue,
+                     seq + x,
+                     shared->start_time + (seq + x) / opt_rate,
+                     shared->start_time + (seq + x) / opt_rate,
+                     opt_runtime / 1000 + 60,
+                     plugin_path,
+                     opt_runtime,
+                     opt_output_size,
+                     seq + x
+                    ) >= size) {
+                fprintf(stderr, "Error - job data does not fit into %d bytes\n", size);
+                rc = 1;
+                break;
+            }
+        }
+        if(rc != 0)
+            break;
+        failed = add_jobs_to_queue(&client, mod_gm_opt->server_list, job_queue, data, num, GM_JOB_PRIO_NORMAL, mod_gm_opt->transportmode, failed_jobs);
+        shared->failed    += failed;
+        shared->submitted += num - failed;
+        seq += num;
+    }
+
+    for(x = 0; x < GM_MAX_BULK_SIZE; x++)
+        free(data[x]);
+    free(data);
+    free(failed_jobs);
+    gearman_client_free(&client);
+    return(rc);
+}
+
+
+/* receive results */
+int run_consumer() {
+    gearman_worker_st worker;
+    gearman_return_t ret;
+
+    if(create_worker(mod_gm_opt->server_list, &worker) != GM_OK
+       || worker_add_function(&worker, result_queue, consume_result) != GM_OK) {
+        fprintf(stderr, "Error - cannot create gearman worker\n");
+        return(1);
+    }
+
+    /* wake up regularly to notice sigterm */
+    gearman_worker_set_timeout(&worker, 500);
+    while(bench_running) {
+        ret = gearman_worker_work(&worker);
+        if(ret != GEARMAN_SUCCESS && ret != GEARMAN_TIMEOUT && bench_running) {
+            GM_LOG( GM_LOG_DEBUG, "consumer: %s\n", gearman_worker_error(&worker) );
+            usleep(100000);
+        }
+    }
+
+    gearman_worker_free(&worker);
+    return(0);
+}
+
+
+/* record a single result */
+static void * consume_result(gearman_job_st *job, void *context, size_t *result_size, gearman_return_t *ret_ptr) {
+    gm_bench_sample_t sample;
+    char * workload, * decrypted_data, * decrypted_data_c;
+    double received, plugin_cpu;
+    size_t wsize;
+
+    received = now_double();
+    (void)context;
+
+    wsize = gearman_job_workload_size(job);
+    workload = gm_malloc(wsize + 1);
+    memcpy(workload, gearman_job_workload(job), wsize);
+    workload[wsize] = '\0';
+
+    decrypted_data = gm_malloc(wsize*2 + 1);
+    decrypted_data_c = decrypted_data;
+    mod_gm_decrypt(&decrypted_data, workload, mod_gm_opt->transportmode);
+    free(workload);
+
+    if(decrypted_data != NULL && parse_bench_result(decrypted_data, &sample, &plugin_cpu) == GM_OK) {
+        sample.received = received;
+        if(shared->received < shared->max_samples)
+            shared->samples[shared->received] = sample;
+        shared->plugin_cpu += plugin_cpu;
+        shared->received++;
+    } else {
+        shared->invalid++;
+    }
+    free(decrypted_data_c);
+
+    *result_size = 0;
+    *ret_ptr     = GEARMAN_SUCCESS;
+    return(NULL);
+}
+
+
+/* parse timestamps from a result */
+int parse_bench_result(char * data, gm_bench_sample_t * sample, double * plugin_cpu) {
+    char *line, *key;
+    double utime, stime;
+
+    memset(sample, 0, sizeof(gm_bench_sample_t));
+    *plugin_cpu = 0;
+
+    while((line = strsep(&data, "\n")) != NULL) {
+        /* output is last and may be long */
+        if(!strncmp(line, "output=", 7))
+            break;
+        key = strsep(&line, "=");
+        if(line == NULL)
+            continue;
+        if(!strcmp(key, "core_start_time"))
+            sample->scheduled = atof(line);
+        else if(!strcmp(key, "pickup_time"))
+            sample->pickup = atof(line);
+        else if(!strcmp(key, "start_time"))
+            sample->start = atof(line);
+        else if(!strcmp(key, "finish_time"))
+            sample->finish = atof(line);
+        else if(!strcmp(key, "sent_time"))
+            sample->sent = atof(line);
+        else if(!strcmp(key, "rusage") && sscanf(line, "%lf,%lf", &utime, &stime) == 2)
+            *plugin_cpu = utime + stime;
+    }
+
+    if(sample->scheduled <= 0 || sample->pickup <= 0 || sample->start <= 0 || sample->finish <= 0 || sample->sent <= 0)
+        return(GM_ERROR);
+    return(GM_OK);
+}
+
+
+/* calculate percentiles */
+void bench_distribution(double * values, long num, gm_bench_dist_t * dist) {
+    memset(dist, 0, sizeof(gm_bench_dist_t));
+    dist->num = num;
+    if(num == 0)
+        return;
+
+    qsort(values, num, sizeof(double), cmp_double);
+    dist->p50 = values[(long)(0.50 * (num - 1) + 0.5)];
+    dist->p90 = values[(long)(0.90 * (num - 1) + 0.5)];
+    dist->p99 = values[(long)(0.99 * (num - 1) + 0.5)];
+    dist->max = values[num - 1];
+}
+
+
+/* print the report */
+double print_report() {
+    gm_bench_sample_t * s;
+    gm_bench_dist_t dist;
+    double * e2e, * queue, * plugin, * result;
+    double window_start, window_end, last = 0, sustained, cpu;
+    long x, num, measured = 0, completed = 0;
+
+    num = shared->received < shared->max_samples ? shared->received : shared->max_samples;
+    e2e    = gm_malloc((num + 1) * sizeof(double));
+    queue  = gm_malloc((num + 1) * sizeof(double));
+    plugin = gm_malloc((num + 1) * sizeof(double));
+    result = gm_malloc((num + 1) * sizeof(double));
+
+    /* only jobs due within the measured time count */
+    window_start = shared->start_time + opt_warmup;
+    window_end   = window_start + opt_duration;
+    for(x = 0; x < num; x++) {
+        s = &shared->samples[x];
+        if(s->received > last)
+            last = s->received;
+        if(s->received >= window_start && s->received < window_end)
+            completed++;
+        if(s->scheduled < window_start || s->scheduled >= window_end)
+            continue;
+        e2e[measured]    = s->received - s->scheduled;
+        queue[measured]  = s->pickup   - s->scheduled;
+        plugin[measured] = s->finish   - s->start;
+        result[measured] = s->received - s->sent;
+        measured++;
+    }
+    sustained = completed / opt_duration;
+
+    report_open(NULL);
+
+    report_open("config");
+    report_number("workers", opt_workers, TRUE);
+    report_number("rate", opt_rate, TRUE);
+    report_number("duration", opt_duration, TRUE);
+    report_number("warmup", opt_warmup, TRUE);
+    report_number("runtime_ms", opt_runtime, TRUE);
+    report_number("output_size", opt_output_size, TRUE);
+    report_string("encryption", opt_key != NULL ? "yes" : "no");
+    report_string("server", opt_server);
+    if(opt_gearmand != NULL)
+        report_string("gearmand", opt_gearmand);
+    report_string("version", GM_VERSION);
+    report_close();
+
+    report_open("jobs");
+    report_number("submitted", shared->submitted, TRUE);
+    report_number("failed", shared->failed, TRUE);
+    report_number("completed", shared->received, TRUE);
+    report_number("invalid", shared->invalid, TRUE);
+    report_number("lost", shared->submitted - shared->received - shared->invalid, TRUE);
+    report_close();
+
+    report_open("throughput");
+    report_number("target", opt_rate, TRUE);
+    report_number("sustained", sustained, TRUE);
+    report_number("overall", shared->received / (last - shared->start_time), last > shared->start_time);
+    report_number("elapsed", last - shared->start_time, last > shared->start_time);
+    report_close();
+
+    report_open("latency_ms");
+    bench_distribution(e2e, measured, &dist);
+    report_dist("end_to_end", &dist);
+    bench_distribution(queue, measured, &dist);
+    report_dist("queue", &dist);
+    bench_distribution(plugin, measured, &dist);
+    report_dist("plugin", &dist);
+    bench_distribution(result, measured, &dist);
+    report_dist("result", &dist);
+    report_close();
+
+    /* the worker reaps its children and plugins, so their cpu time is part of the worker */
+    report_open("cpu_us_per_job");
+    for(x = 0; x < GM_BENCH_PROCS; x++) {
+        cpu = timeval2double(&procs[x].usage.ru_utime) + timeval2double(&procs[x].usage.ru_stime);
+        if(x == GM_BENCH_WORKER)
+            cpu -= shared->plugin_cpu;
+        report_number(procs[x].name, cpu * 1000000 / shared->received, procs[x].exited && shared->received > 0);
+        if(x == GM_BENCH_WORKER)
+            report_number("plugin", shared->plugin_cpu * 1000000 / shared->received, procs[x].exited && shared->received > 0);
+    }
+    report_close();
+
+    report_open("memory_kb");
+    for(x = 0; x < GM_BENCH_PROCS; x++) {
+        if(procs[x].pid <= 0)
+            continue;
+        report_open(procs[x].name);
+        report_number("rss_peak", procs[x].usage.ru_maxrss, procs[x].exited);
+        report_number("rss_total", procs[x].rss_sampled, procs[x].rss_sampled > 0);
+        report_close();
+    }
+    report_close();
+
+    report_close();
+
+    free(e2e);
+    free(queue);
+    free(plugin);
+    free(result);
+    return(sustained);
+}
+
+
+/* stop all loops */
+static void bench_sighandler(int sig) {
+    (void)sig;
+    bench_running = FALSE;
+}
+
+
+/* current time as double */
+static double now_double(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return((double)tv.tv_sec + (double)tv.tv_usec / 1000000);
+}
+
+
+/* sleep, at most 10ms so rates stay accurate */
+static void wait_seconds(double seconds) {
+    if(seconds > 0.01)
+        seconds = 0.01;
+    if(seconds > 0)
+        usleep((useconds_t)(seconds * 1000000));
+}
+
+
+/* search gearmand in PATH and the usual sbin folders */
+static char * find_gearmand(void) {
+    static char path[PATH_MAX];
+    char * dirs, * dir, * ptr;
+    char * fallback[] = { "/usr/sbin", "/usr/local/sbin", "/opt/sbin", NULL };
+    int x;
+
+    if(opt_gearmand != NULL)
+        return(access(opt_gearmand, X_OK) == 0 ? opt_gearmand : NULL);
+
+    if(getenv("PATH") != NULL) {
+        dirs = gm_strdup(getenv("PATH"));
+        ptr  = dirs;
+        while((dir = strsep(&ptr, ":")) != NULL) {
+            snprintf(path, sizeof(path), "%s/gearmand", *dir != '\0' ? dir : ".");
+            if(access(path, X_OK) == 0) {
+                free(dirs);
+                return(path);
+            }
+        }
+        free(dirs);
+    }
+    for(x = 0; fallback[x] != NULL; x++) {
+        snprintf(path, sizeof(path), "%s/gearmand", fallback[x]);
+        if(access(path, X_OK) == 0)
+            return(path);
+    }
+    return(NULL);
+}
+
+
+/* run a binary with output redirected to a logfile */
+static pid_t start_process(char ** args, char * logfile) {
+    pid_t pid;
+    int fd;
+
+    fflush(NULL);
+    pid = fork();
+    if(pid < 0) {
+        fprintf(stderr, "Error - fork failed: %s\n", strerror(errno));
+        return(0);
+    }
+    if(pid == 0) {
+        /* the worker signals its whole process group on shutdown */
+        setpgid(0, 0);
+        signal(SIGINT,  SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        fd = open(logfile, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if(fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        fd = open("/dev/null", O_RDONLY);
+        if(fd >= 0) {
+            dup2(fd, STDIN_FILENO);
+            close(fd);
+        }
+        execv(args[0], args);
+        fprintf(stderr, "exec %s failed: %s\n", args[0], strerror(errno));
+        _exit(127);
+    }
+    if(opt_verbose > 0)
+        fprintf(stderr, "started %s with pid %d\n", args[0], (int)pid);
+    return(pid);
+}
+
+
+/* run a function in a child process */
+static pid_t start_function(int (*function)(void)) {
+    pid_t pid;
+
+    fflush(NULL);
+    pid = fork();
+    if(pid < 0) {
+        fprintf(stderr, "Error - fork failed: %s\n", strerror(errno));
+        return(0);
+    }
+    if(pid == 0)
+        _exit(function());
+    return(pid);
+}
+
+
+/* returns GM_OK while the process is running */
+static int check_process(gm_bench_proc_t * proc) {
+    if(proc->pid <= 0 || proc->exited)
+        return(GM_ERROR);
+    if(wait4(proc->pid, &proc->status, WNOHANG, &proc->usage) == proc->pid) {
+        proc->exited = TRUE;
+        if(bench_running && proc != &procs[GM_BENCH_INJECTOR])
+            fprintf(stderr, "Error - %s exited unexpectedly\n", proc->name);
+        return(GM_ERROR);
+    }
+    return(GM_OK);
+}
+
+
+/* terminate a process and collect its resource usage */
+static void stop_process(gm_bench_proc_t * proc) {
+    double deadline;
+
+    if(proc->pid <= 0 || proc->exited)
+        return;
+
+    kill(proc->pid, SIGTERM);
+    deadline = now_double() + GM_BENCH_STOP_TIMEOUT;
+    while(now_double() < deadline) {
+        if(wait4(proc->pid, &proc->status, WNOHANG, &proc->usage) == proc->pid) {
+            proc->exited = TRUE;
+            return;
+        }
+        usleep(10000);
+    }
+
+    fprintf(stderr, "%s did not stop, killing pid %d\n", proc->name, (int)proc->pid);
+    kill(proc->pid, SIGKILL);
+    if(wait4(proc->pid, &proc->status, 0, &proc->usage) == proc->pid)
+        proc->exited = TRUE;
+}
+
+
+/* wait until gearmand accepts connections */
+static int wait_for_port(char * hostnam, int port, double timeout) {
+    struct addrinfo hints, * res;
+    char service[16];
+    double deadline;
+    int fd, rc = GM_ERROR;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%d", port);
+    if(getaddrinfo(hostnam, service, &hints, &res) != 0)
+        return(GM_ERROR);
+
+    deadline = now_double() + timeout;
+    while(bench_running && now_double() < deadline) {
+        if(procs[GM_BENCH_GEARMAND].pid > 0 && check_process(&procs[GM_BENCH_GEARMAND]) != GM_OK)
+            break;
+        fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        if(fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) == 0) {
+            close(fd);
+            rc = GM_OK;
+            break;
+        }
+        if(fd >= 0)
+            close(fd);
+        usleep(100000);
+    }
+    freeaddrinfo(res);
+    return(rc);
+}
+
+
+/* wait until all workers and the consumer are registered */
+static int wait_for_workers(char * hostnam, int port, double timeout) {
+    mod_gm_server_status_t * stats;
+    char * message, * version;
+    double deadline;
+    int x, workers, consumers;
+
+    deadline = now_double() + timeout;
+    while(bench_running && now_double() < deadline) {
+        if(check_process(&procs[GM_BENCH_WORKER]) != GM_OK || check_process(&procs[GM_BENCH_CONSUMER]) != GM_OK)
+            return(GM_ERROR);
+
+        workers   = 0;
+        consumers = 0;
+        message   = NULL;
+        version   = NULL;
+        stats = gm_malloc(sizeof(mod_gm_server_status_t));
+        stats->function_num = 0;
+        stats->worker_num   = 0;
+        if(get_gearman_server_data(stats, &message, &version, hostnam, port) == STATE_OK) {
+            for(x = 0; x < stats->function_num; x++) {
+                if(!strcmp(stats->function[x]->queue, job_queue))
+                    workers = stats->function[x]->worker;
+                else if(!strcmp(stats->function[x]->queue, result_queue))
+                    consumers = stats->function[x]->worker;
+            }
+        }
+        free_mod_gm_status_server(stats);
+        free(message);
+        free(version);
+
+        if(workers >= opt_workers && consumers > 0)
+            return(GM_OK);
+        usleep(200000);
+    }
+    return(GM_ERROR);
+}
+
+
+/* record rss of all components, includes direct children for the worker */
+static void sample_memory(void) {
+    DIR * dir;
+    struct dirent * entry;
+    FILE * fp;
+    char path[64], line[1024], * ptr;
+    long total[GM_BENCH_PROCS], rss, page_kb;
+    int x, pid, ppid;
+
+    dir = opendir("/proc");
+    if(dir == NULL)
+        return;
+
+    page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    for(x = 0; x < GM_BENCH_PROCS; x++)
+        total[x] = 0;
+
+    while((entry = readdir(dir)) != NULL) {
+        pid = atoi(entry->d_name);
+        if(pid <= 0)
+            continue;
+        snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+        fp = fopen(path, "r");
+        if(fp == NULL)
+            continue;
+        ptr = fgets(line, sizeof(line), fp);
+        fclose(fp);
+        /* the command name may contain spaces */
+        if(ptr == NULL || (ptr = strrchr(line, ')')) == NULL)
+            continue;
+        if(sscanf(ptr + 2, "%*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %*u %*u %ld", &ppid, &rss) != 2)
+            continue;
+        for(x = 0; x < GM_BENCH_PROCS; x++) {
+            if(procs[x].pid > 0 && !procs[x].exited && (pid == procs[x].pid || ppid == procs[x].pid))
+                total[x] += rss * page_kb;
+        }
+    }
+    closedir(dir);
+
+    for(x = 0; x < GM_BENCH_PROCS; x++) {
+        if(total[x] > procs[x].rss_sampled)
+            procs[x].rss_sampled = total[x];
+    }
+}
+
+
+/* qsort compare function for doubles */
+static int cmp_double(const void * a, const void * b) {
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return((da > db) - (da < db));
+}
+
+
+/* start an object, the report itself has no name */
+static void report_open(const char * name) {
+    if(opt_format == GM_BENCH_FORMAT_JSON) {
+        if(report_depth > 0)
+            report_key(name);
+        fprintf(report, "{");
+    }
+    report_depth++;
+    report_path[report_depth]  = name;
+    report_first[report_depth] = TRUE;
+}
+
+
+/* close an object */
+static void report_close(void) {
+    report_depth--;
+    if(opt_format == GM_BENCH_FORMAT_JSON) {
+        fprintf(report, "}");
+        if(report_depth == 0)
+            fprintf(report, "\n");
+    }
+}
+
+
+/* print the key of the next value, text keys contain the full path */
+static void report_key(const char * name) {
+    int x;
+
+    if(opt_format == GM_BENCH_FORMAT_JSON) {
+        if(!report_first[report_depth])
+            fprintf(report, ",");
+        report_first[report_depth] = FALSE;
+        fprintf(report, "\"%s\":", name);
+        return;
+    }
+    for(x = 2; x <= report_depth; x++)
+        fprintf(report, "%s.", report_path[x]);
+    fprintf(report, "%s=", name);
+}
+
+
+/* print a number, invalid numbers are null in json and skipped in text */
+static void report_number(const char * name, double value, int valid) {
+    if(!valid) {
+        if(opt_format != GM_BENCH_FORMAT_JSON)
+            return;
+        report_key(name);
+        fprintf(report, "null");
+        return;
+    }
+    report_key(name);
+    if(value == (double)(long long)value)
+        fprintf(report, "%lld", (long long)value);
+    else
+        fprintf(report, "%.3f", value);
+    if(opt_format != GM_BENCH_FORMAT_JSON)
+        fprintf(report, "\n");
+}
+
+
+/* print a string */
+static void report_string(const char * name, const char * value) {
+    report_key(name);
+    if(opt_format != GM_BENCH_FORMAT_JSON) {
+        fprintf(report, "%s\n", value);
+        return;
+    }
+    fprintf(report, "\"");
+    for(; *value != '\0'; value++) {
+        if(*value == '"' || *value == '\\')
+            fprintf(report, "\\%c", *value);
+        else if((unsigned char)*value < 0x20)
+            fprintf(report, "\\u%04x", *value);
+        else
+            fprintf(report, "%c", *value);
+    }
+    fprintf(report, "\"");
+}
+
+
+/* print a latency distribution in milliseconds */
+static void report_dist(const char * name, gm_bench_dist_t * dist) {
+    report_open(name);
+    report_number("num", dist->num, TRUE);
+    report_number("p50", dist->p50 * 1000, dist->num > 0);
+    report_number("p90", dist->p90 * 1000, dist->num > 0);
+    report_number("p99", dist->p99 * 1000, dist->num > 0);
+    report_number("max", dist->max * 1000, dist->num > 0);
+    report_close();
+}
+
+
+/* core log wrapper */
+void write_core_log(char *data) {
+    printf("core logger is not available for tools: %s", data);
+    return;
+}
@@ -40,12 +40,26 @@ char * opt_expect        = NULL;
 char * opt_unique_id     = NULL;
 int opt_crit_zero_worker = 0;
 int send_async           = 0;
+int opt_probe_jobs       = 0;
+int opt_probe_parallel   = 1;
+double opt_pct_warning[GM_PROBE_PERCENTILES]  = { 0, 0, 0 };
+double opt_pct_critical[GM_PROBE_PERCENTILES] = { 0, 0, 0 };
+double opt_error_warning  = 0;
+double opt_error_critical = 0;
+const double probe_percentiles[GM_PROBE_PERCENTILES] = { 50, 95, 99 };
 
 gm_server_t  * server_list[GM_LISTSIZE];
 int server_list_num = 0;
 
 gearman_client_st client;
 
+static int parse_range(char * range, double * warning, double * critical);
+static int parse_percentile_threshold(char * arg);
+static double probe_time(void);
+static gearman_return_t probe_complete(gearman_task_st * task);
+static gearman_return_t probe_fail(gearman_task_st * task);
+static int cmp_double(const void * a, const void * b);
+
 
 /* work starts here */
 int main (int argc, char **argv) {
@@ -58,7 +72,7 @@ int main (int argc, char **argv) {
     /*
      * and parse command line
      */
-    while((opt = getopt(argc, argv, "vVhaH:t:w:c:W:C:q:s:e:p:u:x")) != -1) {
+    while((opt = getopt(argc, argv, "vVhaH:t:w:c:W:C:q:s:e:p:u:xn:P:T:E:")) != -1) {
         switch(opt) {
             case 'h':   print_usage();
                         break;
@@ -90,6 +104,22 @@ int main (int argc, char **argv) {
                         break;
             case 'x':   opt_crit_zero_worker = 1;
                         break;
+            case 'n':   opt_probe_jobs = atoi(optarg);
+                        break;
+            case 'P':   opt_probe_parallel = atoi(optarg);
+                        if(opt_probe_parallel < 1)
+                            opt_probe_parallel = 1;
+                        break;
+            case 'T':   if(parse_percentile_threshold(optarg) != GM_OK) {
+                            printf("Error - percentile threshold must be p50|p95|p99=<warn>:<crit>, got: `%s'\n\n", optarg);
+                            print_usage();
+                        }
+                        break;
+            case 'E':   if(parse_range(optarg, &opt_error_warning, &opt_error_critical) != GM_OK) {
+                            printf("Error - error rate threshold must be <warn>:<crit>, got: `%s'\n\n", optarg);
+                            print_usage();
+                        }
+                        break;
             case '?':   printf("Error - No such option: `%c'\n\n", optopt);
                         print_usage();
                         break;
@@ -108,10 +138,24 @@ int main (int argc, char **argv) {
         print_usage();
     }
 
+    if(opt_probe_jobs > 0 && opt_send == NULL) {
+        printf("Error - need text (-s) to send as probe job\n\n");
+        print_usage();
+    }
+
+    if(opt_probe_jobs > 0 && send_async) {
+        printf("Error - probe jobs (-n) cannot be sent async (-a)\n\n");
+        print_usage();
+    }
+
     /* set alarm signal handler */
     signal(SIGALRM, alarm_sighandler);
 
-    if(opt_send != NULL ) {
+    if(opt_probe_jobs > 0) {
+        alarm(opt_timeout);
+        result = check_latency(opt_queue, opt_send, opt_expect, opt_probe_jobs, opt_probe_parallel);
+    }
+    else if(opt_send != NULL ) {
         alarm(opt_timeout);
         result = check_worker(opt_queue, opt_send, opt_expect);
     }
@@ -154,6 +198,13 @@ void print_usage() {
     printf("              [ -e=<expect text>             ]\n");
     printf("              [ -a           send async      ]  will ignore -e\n");
     printf("\n");
+    printf("\n");
+    printf("to measure round trip latency, in addition to -q and -s:\n");
+    printf("              [ -n=<number of probe jobs>    ]\n");
+    printf("              [ -P=<parallel probe jobs>     ]  default: %i\n", opt_probe_parallel);
+    printf("              [ -T=p50|p95|p99=<warn>:<crit> ]  seconds, may be repeated\n");
+    printf("              [ -E=<warn>:<crit>             ]  error rate in percent\n");
+    printf("\n");
     printf("              [ -h           print help      ]\n");
     printf("              [ -v           verbose output  ]\n");
     printf("              [ -V           print version   ]\n");
@@ -161,6 +212,7 @@ void print_usage() {
     printf(" - You may set thresholds to 0 to disable them.\n");
     printf(" - You may use -x to enable critical exit if there is no worker for specified queue.\n");
     printf(" - Thresholds are only for server checks, worker checks are availability only\n");
+    printf(" - Probe jobs use the unique id plus a counter, the timeout (-t) applies to all probe jobs together\n");
     printf("\n");
     printf("perfdata format when checking job server:\n");
     printf(" 'queue waiting'=current waiting jobs;warn;crit;0 'queue running'=current running jobs 'queue worker'=current num worker;warn;crit;0\n");
@@ -171,6 +223,9 @@ void print_usage() {
     printf("perfdata format when checking mod gearman worker:\n");
     printf(" worker=10 jobs=1508c\n");
     printf("\n");
+    printf("perfdata format when sending probe jobs:\n");
+    printf(" p50=0.003s;warn;crit;0 p95=0.010s;warn;crit;0 p99=0.021s;warn;crit;0 errors=0%%;warn;crit;0;100 jobs=100\n");
+    printf("\n");
     printf("Note: Job thresholds are per queue not totals.\n");
     printf("\n");
     printf("Examples:\n");
@@ -187,6 +242,11 @@ void print_usage() {
     printf("%%> ./check_gearman -H <job server hostname> -q perfdata -t 10 -x\n");
     printf("check_gearman CRITICAL - Queue perfdata has 155 jobs without any worker. |'perfdata_waiting'=155;10;100;0 'perfdata_running'=0 'perfdata_worker'=0;25;50;0\n");
     printf("\n");
+    printf("Measure latency:\n");
+    printf("\n");
+    printf("%%> ./check_gearman -H <job server hostname> -q worker_<worker hostname> -s check -n 100 -P 10 -T p95=0.5:1 -E 1:5 -t 30\n");
+    printf("check_gearman OK - 100 probe jobs, p50 0.003s, p95 0.010s, p99 0.021s, 0.0%% errors|p50=0.003s;;;0 p95=0.010s;0.5;1;0 p99=0.021s;;;0 errors=0.0%%;1;5;0;100 jobs=100\n");
+    printf("\n");
 
     exit( STATE_UNKNOWN );
 }
@@ -400,6 +460,225 @@ int check_worker(char * queue, char * to_send, char * expect) {
 }
 
 
+/* send probe jobs and report round trip percentiles */
+int check_latency(char * queue, char * to_send, char * expect, int count, int parallel) {
+    gearman_return_t ret;
+    gearman_task_st * task;
+    gm_probe_job_t * probes;
+    double * durations;
+    double values[GM_PROBE_PERCENTILES];
+    double start, error_rate;
+    char uniq[GM_BUFFERSIZE];
+    char message[GM_BUFFERSIZE];
+    char * error = NULL;
+    const char * unique_job_id = opt_unique_id == NULL ? "check" : opt_unique_id;
+    int rc = STATE_OK;
+    int sent, batch, i, x;
+    int failed = 0;
+    int done   = 0;
+
+    /* create client */
+    if ( create_client( server_list, &client ) != GM_OK ) {
+        current_client = &client;
+        printf("%s UNKNOWN - cannot create gearman client\n", PLUGIN_NAME);
+        return( STATE_UNKNOWN );
+    }
+    current_client = &client;
+    gearman_client_set_timeout(&client, (opt_timeout-1)*1000/server_list_num);
+    gearman_client_set_complete_fn(&client, probe_complete);
+    gearman_client_set_fail_fn(&client, probe_fail);
+
+    probes    = gm_malloc(count * sizeof(gm_probe_job_t));
+    durations = gm_malloc(count * sizeof(double));
+    memset(probes, 0, count * sizeof(gm_probe_job_t));
+
+    for(sent = 0; sent < count; sent += batch) {
+        batch = count - sent < parallel ? count - sent : parallel;
+        start = probe_time();
+        for(i = sent; i < sent + batch; i++) {
+            /* gearmand would coalesce concurrent jobs with the same unique id */
+            snprintf(uniq, sizeof(uniq), "%s_%d_%d", unique_job_id, (int)getpid(), i);
+            probes[i].start  = start;
+            probes[i].expect = expect;
+            task = gearman_client_add_task_high(&client, NULL, &probes[i], queue, uniq, (void *)to_send, (size_t)strlen(to_send), &ret);
+            if(task == NULL || ret != GEARMAN_SUCCESS) {
+                probes[i].done   = TRUE;
+                probes[i].failed = TRUE;
+                if(error == NULL)
+                    error = gm_strdup(gearman_client_error(&client));
+            }
+        }
+        ret = gearman_client_run_tasks(&client);
+        if(ret != GEARMAN_SUCCESS && error == NULL)
+            error = gm_strdup(gearman_client_error(&client));
+        for(i = sent; i < sent + batch; i++) {
+            if(!probes[i].done) {
+                probes[i].done   = TRUE;
+                probes[i].failed = TRUE;
+            }
+            if(probes[i].failed)
+                failed++;
+            else
+                durations[done++] = probes[i].duration;
+        }
+        gearman_client_task_free_all(&client);
+    }
+    gearman_client_free(&client);
+
+    error_rate = (double)failed * 100 / count;
+    message[0] = '\0';
+    if(done == 0) {
+        rc = STATE_CRITICAL;
+        if(error == NULL && expect != NULL)
+            snprintf(message, sizeof(message), "%i of %i probe jobs failed: responses did not contain '%s'", failed, count, expect);
+        else
+            snprintf(message, sizeof(message), "%i of %i probe jobs failed%s%s", failed, count, error != NULL ? ": " : "", error != NULL ? error : "");
+    } else {
+        qsort(durations, done, sizeof(double), cmp_double);
+        for(x = 0; x < GM_PROBE_PERCENTILES; x++) {
+            values[x] = percentile(durations, done, probe_percentiles[x]);
+            if(opt_pct_critical[x] > 0 && values[x] >= opt_pct_critical[x])
+                rc = STATE_CRITICAL;
+            else if(opt_pct_warning[x] > 0 && values[x] >= opt_pct_warning[x] && rc == STATE_OK)
+                rc = STATE_WARNING;
+        }
+        if(opt_error_critical > 0 && error_rate >= opt_error_critical)
+            rc = STATE_CRITICAL;
+        else if(opt_error_warning > 0 && error_rate >= opt_error_warning && rc == STATE_OK)
+            rc = STATE_WARNING;
+        snprintf(message, sizeof(message), "%i probe jobs, p50 %.3fs, p95 %.3fs, p99 %.3fs, %.1f%% errors", count, values[0], values[1], values[2], error_rate);
+    }
+
+    /* print plugin name and state */
+    printf("%s ", PLUGIN_NAME);
+    if(rc == STATE_OK)
+        printf("OK - ");
+    if(rc == STATE_WARNING)
+        printf("WARNING - ");
+    if(rc == STATE_CRITICAL)
+        printf("CRITICAL - ");
+    printf("%s", message);
+
+    /* print performance data */
+    printf("|");
+    if(done > 0) {
+        for(x = 0; x < GM_PROBE_PERCENTILES; x++) {
+            printf("p%.0f=%.3fs;", probe_percentiles[x], values[x]);
+            if(opt_pct_warning[x] > 0)
+                printf("%g", opt_pct_warning[x]);
+            printf(";");
+            if(opt_pct_critical[x] > 0)
+                printf("%g", opt_pct_critical[x]);
+            printf(";0 ");
+        }
+    }
+    printf("errors=%.1f%%;", error_rate);
+    if(opt_error_warning > 0)
+        printf("%g", opt_error_warning);
+    printf(";");
+    if(opt_error_critical > 0)
+        printf("%g", opt_error_critical);
+    printf(";0;100 jobs=%i\n", count);
+
+    free(error);
+    free(durations);
+    free(probes);
+    return(rc);
+}
+
+
+/* nearest rank percentile of sorted values */
+double percentile(double * sorted, int num, double pct) {
+    double exact = pct / 100 * num;
+    int rank     = (int)exact;
+    if(num <= 0)
+        return(0);
+    if(rank < exact)
+        rank++;
+    if(rank < 1)
+        rank = 1;
+    if(rank > num)
+        rank = num;
+    return(sorted[rank - 1]);
+}
+
+
+/* parse <warn>:<crit> */
+static int parse_range(char * range, double * warning, double * critical) {
+    char * sep = strchr(range, ':');
+    if(sep == NULL)
+        return(GM_ERROR);
+    *warning  = atof(range);
+    *critical = atof(sep + 1);
+    return(GM_OK);
+}
+
+
+/* parse p95=<warn>:<crit> */
+static int parse_percentile_threshold(char * arg) {
+    int x;
+    char name[8];
+    for(x = 0; x < GM_PROBE_PERCENTILES; x++) {
+        snprintf(name, sizeof(name), "p%.0f=", probe_percentiles[x]);
+        if(!strncmp(arg, name, strlen(name)))
+            return(parse_range(arg + strlen(name), &opt_pct_warning[x], &opt_pct_critical[x]));
+    }
+    return(GM_ERROR);
+}
+
+
+/* current time as double */
+static double probe_time(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return((double)tv.tv_sec + (double)tv.tv_usec / 1000000);
+}
+
+
+/* probe job finished */
+static gearman_return_t probe_complete(gearman_task_st * task) {
+    gm_probe_job_t * probe = (gm_probe_job_t *)gearman_task_context(task);
+    char result[GM_BUFFERSIZE];
+    size_t size;
+
+    if(probe == NULL)
+        return(GEARMAN_SUCCESS);
+    probe->duration = probe_time() - probe->start;
+    probe->done     = TRUE;
+    if(probe->expect != NULL) {
+        size = gearman_task_data_size(task);
+        if(size >= sizeof(result))
+            size = sizeof(result) - 1;
+        if(size > 0)
+            memcpy(result, gearman_task_data(task), size);
+        result[size] = '\0';
+        if(strstr(result, probe->expect) == NULL)
+            probe->failed = TRUE;
+    }
+    return(GEARMAN_SUCCESS);
+}
+
+
+/* probe job failed */
+static gearman_return_t probe_fail(gearman_task_st * task) {
+    gm_probe_job_t * probe = (gm_probe_job_t *)gearman_task_context(task);
+
+    if(probe == NULL)
+        return(GEARMAN_SUCCESS);
+    probe->done   = TRUE;
+    probe->failed = TRUE;
+    return(GEARMAN_SUCCESS);
+}
+
+
+/* sort durations */
+static int cmp_double(const void * a, const void * b) {
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return((da > db) - (da < db));
+}
+
+
 /* core log wrapper */
 void write_core_log(char *data) {
     printf("core logger is not available for tools: %s", data);
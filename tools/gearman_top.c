@@ -24,45 +24,70 @@
 /* include header */
 #include "gearman_top.h"
 #include "utils.h"
-#include "gearman_utils.h"
 
 #include <worker_dummy_functions.c>
 
+#define GM_TOP_QUERY "status\nversion\n"
+
 int opt_verbose     = GM_DISABLED;
 int opt_quiet       = GM_DISABLED;
 int opt_batch       = GM_DISABLED;
+int opt_merge       = GM_DISABLED;
+int opt_format      = GM_TOP_FORMAT_TEXT;
 int con_timeout     = 10;
 double opt_interval = 0;
 
 char * server_list[GM_LISTSIZE];
 int server_list_num = 0;
-char * version_saved = NULL;
+gm_top_server_t * servers[GM_LISTSIZE];
+gm_top_view_t merged;
 WINDOW *w;
 
-void catcher( int );
-void catcher( int sig ) {
-    gm_log( GM_LOG_DEBUG, "catcher(%d)\n", sig );
-    return;
-}
+static double now_double(void);
+static gm_top_server_t * init_server(char * hostnam);
+static int resolve_server(gm_top_server_t * srv);
+static void start_query(gm_top_server_t * srv);
+static void send_query(gm_top_server_t * srv);
+static void read_answer(gm_top_server_t * srv);
+static int answer_complete(const char * buf);
+static void fail_server(gm_top_server_t * srv, const char * fmt, ...);
+static void take_sample(double now);
+static void wait_until(double next_run);
+static int cmp_top_queue(const void * a, const void * b);
+static int skip_queue(gm_top_queue_t * queue);
+static void format_rate(char * buf, size_t size, gm_top_queue_t * queue, double rate);
+static void json_string(const char * str);
+static void json_queues(char * server, gm_top_view_t * view, int * first);
+static void csv_field(const char * str);
+static void csv_queues(double now, char * server, gm_top_view_t * view);
 
 /* work starts here */
 int main (int argc, char **argv) {
     int opt;
     int i;
-    struct sigaction sact;
+    double next_run, now;
+    static struct option long_options[] = {
+        {"help",     no_argument,       0, 'h'},
+        {"verbose",  no_argument,       0, 'v'},
+        {"version",  no_argument,       0, 'V'},
+        {"quiet",    no_argument,       0, 'q'},
+        {"batch",    no_argument,       0, 'b'},
+        {"merge",    no_argument,       0, 'm'},
+        {"host",     required_argument, 0, 'H'},
+        {"server",   required_argument, 0, 's'},
+        {"interval", required_argument, 0, 'i'},
+        {"timeout",  required_argument, 0, 't'},
+        {"format",   required_argument, 0, 'f'},
+        {0, 0, 0, 0}
+    };
 
     mod_gm_opt = gm_malloc(sizeof(mod_gm_opt_t));
     set_default_options(mod_gm_opt);
 
-    sigemptyset( &sact.sa_mask );
-    sact.sa_flags = 0;
-    sact.sa_handler = catcher;
-    sigaction( SIGALRM, &sact, NULL );
-
     /*
      * and parse command line
      */
-    while((opt = getopt(argc, argv, "qvVhH:s:i:b")) != -1) {
+    while((opt = getopt_long(argc, argv, "qvVhH:s:i:bmt:f:", long_options, NULL)) != -1) {
         switch(opt) {
             case 'h':   print_usage();
                         break;
@@ -71,7 +96,8 @@ int main (int argc, char **argv) {
             case 'V':   print_version();
                         break;
             case 's':
-            case 'H':   server_list[server_list_num++] = optarg;
+            case 'H':   if(server_list_num < GM_LISTSIZE - 1)
+                            server_list[server_list_num++] = optarg;
                         break;
             case 'q':   opt_quiet = GM_ENABLED;
                         break;
@@ -79,6 +105,23 @@ int main (int argc, char **argv) {
                         break;
             case 'b':   opt_batch = GM_ENABLED;
                         break;
+            case 'm':   opt_merge = GM_ENABLED;
+                        break;
+            case 't':   con_timeout = atoi(optarg);
+                        if(con_timeout <= 0)
+                            con_timeout = 1;
+                        break;
+            case 'f':   if(!strcmp(optarg, "json")) {
+                            opt_format = GM_TOP_FORMAT_JSON;
+                        } else if(!strcmp(optarg, "csv")) {
+                            opt_format = GM_TOP_FORMAT_CSV;
+                        } else if(!strcmp(optarg, "text")) {
+                            opt_format = GM_TOP_FORMAT_TEXT;
+                        } else {
+                            printf("Error - unknown format: `%s'\n\n", optarg);
+                            print_usage();
+                        }
+                        break;
             case '?':   printf("Error - No such option: `%c'\n\n", optopt);
                         print_usage();
                         break;
@@ -90,51 +133,63 @@ int main (int argc, char **argv) {
         server_list[server_list_num++] = "localhost";
     server_list[server_list_num] = NULL;
 
+    /* json and csv only make sense without curses */
+    if(opt_format != GM_TOP_FORMAT_TEXT)
+        opt_batch = GM_ENABLED;
+
+    for(i=0;i<server_list_num;i++)
+        servers[i] = init_server(server_list[i]);
+    memset(&merged, 0, sizeof(merged));
+
     signal(SIGINT, clean_exit);
     signal(SIGTERM,clean_exit);
+    signal(SIGPIPE,SIG_IGN);
 
-    /* in batch mode, print stats once and exit */
     if(opt_batch == GM_ENABLED) {
-        if(opt_interval > 0) {
-            while(1) {
-                for(i=0;i<server_list_num;i++) {
-                    alarm(con_timeout);
-                    print_stats(server_list[i]);
-                    alarm(0);
-                }
-                usleep(opt_interval);
-            }
-        } else {
-            for(i=0;i<server_list_num;i++) {
-                alarm(con_timeout);
-                print_stats(server_list[i]);
-                alarm(0);
-            }
-        }
-        clean_exit(0);
+        if(opt_format == GM_TOP_FORMAT_CSV)
+            printf("time,server,queue,worker,waiting,running,waiting_delta_per_s\n");
+    } else {
+        if(opt_interval <= 0)
+            opt_interval = 1000000;
+
+        /* init curses */
+        w = initscr();
+        cbreak();
+        nodelay(w, TRUE);
+        noecho();
     }
 
-    if(opt_interval <= 0)
-        opt_interval = 1000000;
-
-    /* init curses */
-    w = initscr();
-    cbreak();
-    nodelay(w, TRUE);
-    noecho();
-
-    /* print stats in a loop */
+    /* print stats in a loop, in batch mode without interval print stats once and exit */
+    next_run = now_double();
     while(1) {
-        if(getch() == 'q')
-            clean_exit(0);
-        if(opt_batch == GM_DISABLED)
-            erase(); /* clear screen */
-        for(i=0;i<server_list_num;i++) {
-            alarm(con_timeout);
-            print_stats(server_list[i]);
-            alarm(0);
+        poll_servers(servers, server_list_num, con_timeout);
+        now = now_double();
+        take_sample(now);
+
+        if(opt_format == GM_TOP_FORMAT_JSON) {
+            print_json(now);
+        } else if(opt_format == GM_TOP_FORMAT_CSV) {
+            print_csv(now);
+        } else {
+            if(opt_batch == GM_DISABLED)
+                erase(); /* clear screen */
+            print_text(now);
+            refresh();
+        }
+        if(opt_batch == GM_ENABLED) {
+            fflush(stdout);
+            if(ferror(stdout))
+                clean_exit(0);
         }
-        usleep(opt_interval);
+
+        if(opt_interval <= 0)
+            break;
+
+        /* schedule by absolute time, so slow servers do not make the interval drift */
+        next_run += opt_interval / 1000000;
+        if(next_run < now)
+            next_run = now;
+        wait_until(next_run);
     }
 
     clean_exit(0);
@@ -161,10 +216,13 @@ void print_version() {
 void print_usage() {
     printf("usage:\n");
     printf("\n");
-    printf("gearman_top   [ -H <hostname>[:port]           ]\n");
-    printf("              [ -i <sec>       seconds         ]\n");
+    printf("gearman_top   [ -H <hostname>[:port]           ]   (may be repeated)\n");
+    printf("              [ -i <sec>       seconds         ]   (fractions allowed)\n");
+    printf("              [ -t <sec>       timeout         ]\n");
     printf("              [ -q             quiet mode      ]\n");
+    printf("              [ -m             merge servers   ]\n");
     printf("              [ -b             batch mode      ]\n");
+    printf("              [ -f <format>    text|json|csv   ]   (implies batch mode)\n");
     printf("\n");
     printf("              [ -h             print help      ]\n");
     printf("              [ -v             verbose output  ]\n");
@@ -175,96 +233,660 @@ void print_usage() {
 }
 
 
-/* print stats */
-void print_stats(char * hostnam) {
+/* current time as double */
+static double now_double(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return((double)tv.tv_sec + (double)tv.tv_usec / 1000000);
+}
+
+
+/* create server structure from host[:port] */
+static gm_top_server_t * init_server(char * hostnam) {
+    gm_top_server_t * srv;
     char * hst    = gm_strdup(hostnam);
     char * hst_c  = hst;
     char * server = NULL;
     char * port_c = NULL;
-    char * message = NULL;
-    char * version = NULL;
-    char format1[GM_BUFFERSIZE];
-    char format2[GM_BUFFERSIZE];
-    char cur_time[GM_BUFFERSIZE];
-    mod_gm_server_status_t *stats;
-    int port = GM_SERVER_DEFAULT_PORT;
-    int rc;
-    int x;
-    int max_length = 12;
-    int found      = 0;
-    struct tm now;
-    time_t t;
+    char name[GM_BUFFERSIZE];
 
-    gm_log( GM_LOG_DEBUG, "print_stats()\n");
+    srv = gm_malloc(sizeof(gm_top_server_t));
+    memset(srv, 0, sizeof(gm_top_server_t));
+    srv->fd    = -1;
+    srv->port  = GM_SERVER_DEFAULT_PORT;
+    srv->state = GM_TOP_STATE_IDLE;
+    srv->buf   = gm_malloc(GM_BUFFERSIZE);
 
     server = strsep(&hst, ":");
     port_c = strsep(&hst, "\x0");
     if(port_c != NULL)
-        port = atoi(port_c);
+        srv->port = atoi(port_c);
+    srv->host = gm_strdup(server);
+    snprintf(name, sizeof(name), "%s:%i", srv->host, srv->port);
+    srv->name = gm_strdup(name);
+    free(hst_c);
+
+    return(srv);
+}
 
-    /* get stats */
-    stats = (mod_gm_server_status_t*)gm_malloc(sizeof(mod_gm_server_status_t));
-    stats->function_num = 0;
-    stats->worker_num   = 0;
-    rc = get_gearman_server_data(stats, &message, &version, server, port);
 
-    t   = time(NULL);
-    now = *(localtime(&t));
-    strftime(cur_time, sizeof(cur_time), "%Y-%m-%d %H:%M:%S", &now );
+/* resolve address once, it is only looked up again after errors */
+static int resolve_server(gm_top_server_t * srv) {
+    struct addrinfo hints;
+    char port_str[6];
+    int rc;
 
-    my_printf("%s  -  %s:%i", cur_time, server, port );
-    if(version != NULL && strcmp(version, "") != 0) {
-        if(version_saved != NULL)
-            free(version_saved);
-        version_saved = gm_strdup(version);
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port_str, sizeof(port_str), "%d", srv->port);
+
+    rc = getaddrinfo(srv->host, port_str, &hints, &srv->addr);
+    if(rc != 0) {
+        srv->addr = NULL;
+        fail_server(srv, "%s", gai_strerror(rc));
+        return(GM_ERROR);
     }
+    return(GM_OK);
+}
+
+
+/* start non-blocking connect */
+static void start_query(gm_top_server_t * srv) {
+    int flags;
+
+    srv->len    = 0;
+    srv->buf[0] = '\0';
+    srv->error[0] = '\0';
+
+    if(srv->addr == NULL && resolve_server(srv) != GM_OK)
+        return;
+
+    srv->fd = socket(srv->addr->ai_family, SOCK_STREAM, srv->addr->ai_protocol);
+    if(srv->fd < 0) {
+        fail_server(srv, "socket creation failed: %s", strerror(errno));
+        return;
+    }
+    flags = fcntl(srv->fd, F_GETFL, 0);
+    fcntl(srv->fd, F_SETFL, flags | O_NONBLOCK);
+
+    if(connect(srv->fd, srv->addr->ai_addr, srv->addr->ai_addrlen) == 0) {
+        send_query(srv);
+        return;
+    }
+    if(errno == EINPROGRESS) {
+        srv->state = GM_TOP_STATE_CONNECTING;
+        return;
+    }
+    fail_server(srv, "failed to connect to address %s and port %d: %s", srv->host, srv->port, strerror(errno));
+    return;
+}
+
+
+/* send admin commands, they easily fit into the socket buffer */
+static void send_query(gm_top_server_t * srv) {
+    ssize_t n;
+
+    gm_log( GM_LOG_TRACE, "sending '%s' to %s\n", GM_TOP_QUERY, srv->name );
+    n = write(srv->fd, GM_TOP_QUERY, strlen(GM_TOP_QUERY));
+    if(n != (ssize_t)strlen(GM_TOP_QUERY)) {
+        fail_server(srv, "failed to send to %s - %s", srv->name, n < 0 ? strerror(errno) : "short write");
+        return;
+    }
+    srv->state = GM_TOP_STATE_READING;
+    return;
+}
 
-    if(version_saved != NULL && strcmp(version_saved, "") != 0)
-        my_printf("  -  v%s", version_saved );
-    my_printf("\n\n");
 
-    if( rc == STATE_OK ) {
-        for(x=0; x<stats->function_num;x++) {
-            if(opt_quiet == GM_ENABLED && stats->function[x]->worker == 0 && stats->function[x]->total == 0)
+/* read available data and check if the answer is complete */
+static void read_answer(gm_top_server_t * srv) {
+    ssize_t n;
+
+    n = read(srv->fd, srv->buf + srv->len, GM_BUFFERSIZE - 1 - srv->len);
+    if(n < 0) {
+        if(errno == EAGAIN || errno == EINTR)
+            return;
+        fail_server(srv, "error reading from %s - %s", srv->name, strerror(errno));
+        return;
+    }
+    srv->len += n;
+    srv->buf[srv->len] = '\0';
+    if(n == 0 || answer_complete(srv->buf)) {
+        gm_log( GM_LOG_TRACE, "got answer from %s:\n%s\n", srv->name, srv->buf);
+        close(srv->fd);
+        srv->fd    = -1;
+        srv->state = GM_TOP_STATE_DONE;
+        return;
+    }
+    if(srv->len >= GM_BUFFERSIZE - 1)
+        fail_server(srv, "answer from %s is too large", srv->name);
+    return;
+}
+
+
+/* answer is complete after the status terminator and the version line */
+static int answer_complete(const char * buf) {
+    const char * end;
+
+    if(!strncmp(buf, ".\n", 2)) {
+        end = buf + 2;
+    } else {
+        end = strstr(buf, "\n.\n");
+        if(end == NULL)
+            return(FALSE);
+        end += 3;
+    }
+    return(strchr(end, '\n') != NULL);
+}
+
+
+/* close connection and remember error */
+static void fail_server(gm_top_server_t * srv, const char * fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(srv->error, sizeof(srv->error), fmt, ap);
+    va_end(ap);
+    gm_log( GM_LOG_DEBUG, "%s: %s\n", srv->name, srv->error);
+
+    if(srv->fd >= 0)
+        close(srv->fd);
+    srv->fd    = -1;
+    srv->state = GM_TOP_STATE_FAILED;
+
+    /* look up the address again next time */
+    if(srv->addr != NULL)
+        freeaddrinfo(srv->addr);
+    srv->addr = NULL;
+    return;
+}
+
+
+/* query all servers in parallel */
+void poll_servers(gm_top_server_t ** srvs, int num, int timeout) {
+    struct pollfd fds[GM_LISTSIZE];
+    int idx[GM_LISTSIZE];
+    int i, n, rc, err;
+    socklen_t len;
+    double deadline = now_double() + timeout;
+    double remaining;
+
+    gm_log( GM_LOG_DEBUG, "poll_servers()\n");
+
+    for(i=0;i<num;i++)
+        start_query(srvs[i]);
+
+    while(1) {
+        n = 0;
+        for(i=0;i<num;i++) {
+            if(srvs[i]->state != GM_TOP_STATE_CONNECTING && srvs[i]->state != GM_TOP_STATE_READING)
                 continue;
-            if((int)strlen(stats->function[x]->queue) > max_length) {
-                max_length = (int)strlen(stats->function[x]->queue);
-            }
+            fds[n].fd      = srvs[i]->fd;
+            fds[n].events  = srvs[i]->state == GM_TOP_STATE_CONNECTING ? POLLOUT : POLLIN;
+            fds[n].revents = 0;
+            idx[n]         = i;
+            n++;
         }
-        snprintf(format1, sizeof(format1), " %%-%is | %%16s | %%12s | %%12s\n", max_length);
-        snprintf(format2, sizeof(format2), " %%-%is |%%16i  |%%12i  |%%12i \n", max_length);
-        my_printf(format1, "Queue Name", "Worker Available", "Jobs Waiting", "Jobs Running");
-        for(x=0; x < max_length + 51; x++)
-            my_printf("-");
-        my_printf("\n");
-        for(x=0; x<stats->function_num;x++) {
-            if(opt_quiet == GM_ENABLED && stats->function[x]->worker == 0 && stats->function[x]->total == 0)
+        if(n == 0)
+            break;
+
+        remaining = deadline - now_double();
+        if(remaining <= 0) {
+            for(i=0;i<n;i++)
+                fail_server(srvs[idx[i]], "timeout while waiting for %s", srvs[idx[i]]->name);
+            break;
+        }
+
+        rc = poll(fds, n, (int)(remaining * 1000) + 1);
+        if(rc < 0) {
+            if(errno == EINTR)
                 continue;
-            my_printf(format2, stats->function[x]->queue, stats->function[x]->worker, stats->function[x]->waiting, stats->function[x]->running);
-            found++;
+            for(i=0;i<n;i++)
+                fail_server(srvs[idx[i]], "poll failed: %s", strerror(errno));
+            break;
+        }
+
+        for(i=0;i<n;i++) {
+            if(fds[i].revents == 0)
+                continue;
+            if(srvs[idx[i]]->state == GM_TOP_STATE_CONNECTING) {
+                err = 0;
+                len = sizeof(err);
+                if(getsockopt(fds[i].fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+                    err = errno;
+                if(err != 0) {
+                    fail_server(srvs[idx[i]], "failed to connect to address %s and port %d: %s", srvs[idx[i]]->host, srvs[idx[i]]->port, strerror(err));
+                    continue;
+                }
+                send_query(srvs[idx[i]]);
+            } else {
+                read_answer(srvs[idx[i]]);
+            }
+        }
+    }
+    return;
+}
+
+
+/* parse answers and update all views */
+static void take_sample(double now) {
+    mod_gm_server_status_t *stats;
+    char version[GM_TOP_VERSION_SIZE];
+    gm_top_server_t * srv;
+    int unchanged = TRUE;
+    int i;
+
+    view_begin_sample(&merged);
+    for(i=0;i<server_list_num;i++) {
+        srv = servers[i];
+        view_begin_sample(&srv->view);
+        if(srv->state != GM_TOP_STATE_DONE) {
+            view_end_sample(&srv->view, now, FALSE);
+            continue;
+        }
+
+        stats = (mod_gm_server_status_t*)gm_malloc(sizeof(mod_gm_server_status_t));
+        stats->function_num = 0;
+        stats->worker_num   = 0;
+        version[0] = '\0';
+        if(parse_gearman_server_data(stats, srv->buf, version, sizeof(version)) == GM_OK) {
+            if(version[0] != '\0')
+                snprintf(srv->version, sizeof(srv->version), "%s", version);
+            view_add_stats(&srv->view, stats);
+            view_add_stats(&merged, stats);
+            view_end_sample(&srv->view, now, TRUE);
+        } else {
+            snprintf(srv->error, sizeof(srv->error), "got no valid data from %s", srv->name);
+            srv->state = GM_TOP_STATE_FAILED;
+            view_end_sample(&srv->view, now, FALSE);
+        }
+        free_mod_gm_status_server(stats);
+    }
+
+    /* a server going away would look like a drained queue */
+    for(i=0;i<server_list_num;i++) {
+        srv = servers[i];
+        if(srv->was_ok != (srv->state == GM_TOP_STATE_DONE))
+            unchanged = FALSE;
+        srv->was_ok = (srv->state == GM_TOP_STATE_DONE);
+    }
+    view_end_sample(&merged, now, unchanged);
+    return;
+}
+
+
+/* wait for the next sample, quit on 'q' in curses mode */
+static void wait_until(double next_run) {
+    struct pollfd pfd;
+    double remaining;
+
+    while((remaining = next_run - now_double()) > 0) {
+        if(opt_batch == GM_ENABLED) {
+            usleep(remaining * 1000000);
+            return;
         }
-        if(found == 0) {
-            for(x=0; x < max_length + 25; x++) {
-                my_printf(" ");
+        pfd.fd      = STDIN_FILENO;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        if(poll(&pfd, 1, (int)(remaining * 1000) + 1) > 0) {
+            int ch = getch();
+            if(ch == 'q')
+                clean_exit(0);
+            if(ch == ERR) {
+                /* stdin closed or not readable, sleep instead */
+                usleep(remaining * 1000000);
+                return;
             }
-            my_printf("no queues found\n");
         }
-        for(x=0; x < max_length + 51; x++)
-            my_printf("-");
+    }
+    /* servers may take longer than the interval */
+    if(opt_batch == GM_DISABLED && getch() == 'q')
+        clean_exit(0);
+    return;
+}
+
+
+/* reset queue counters before a new sample */
+void view_begin_sample(gm_top_view_t * view) {
+    int x;
+    for(x=0; x<view->queue_num;x++) {
+        view->queue[x]->seen    = FALSE;
+        view->queue[x]->worker  = 0;
+        view->queue[x]->waiting = 0;
+        view->queue[x]->running = 0;
+    }
+    return;
+}
+
+
+/* add counters of all queues of one server */
+void view_add_stats(gm_top_view_t * view, mod_gm_server_status_t * stats) {
+    gm_top_queue_t * queue;
+    int x, y;
+
+    for(x=0; x<stats->function_num;x++) {
+        queue = NULL;
+        for(y=0; y<view->queue_num;y++) {
+            if(!strcmp(view->queue[y]->name, stats->function[x]->queue)) {
+                queue = view->queue[y];
+                break;
+            }
+        }
+        if(queue == NULL) {
+            if(view->queue_num >= GM_LISTSIZE)
+                continue;
+            queue = gm_malloc(sizeof(gm_top_queue_t));
+            memset(queue, 0, sizeof(gm_top_queue_t));
+            queue->name = gm_strdup(stats->function[x]->queue);
+            view->queue[view->queue_num++] = queue;
+            qsort(view->queue, view->queue_num, sizeof(gm_top_queue_t*), cmp_top_queue);
+        }
+        queue->seen     = TRUE;
+        queue->worker  += stats->function[x]->worker;
+        queue->waiting += stats->function[x]->waiting;
+        queue->running += stats->function[x]->running;
+    }
+    return;
+}
+
+
+/* calculate change of waiting jobs and append to history
+ *
+ * gearmand only reports the current queue length, so this is the
+ * change between two samples and not the throughput: a queue which
+ * runs thousands of jobs per second in a steady state shows zero.
+ */
+void view_end_sample(gm_top_view_t * view, double now, int valid) {
+    gm_top_queue_t * queue;
+    double dt = now - view->last_sample;
+    int x;
+
+    for(x=0; x<view->queue_num;x++) {
+        queue = view->queue[x];
+        if(!queue->seen) {
+            queue->has_prev = FALSE;
+            queue->has_rate = FALSE;
+            continue;
+        }
+        if(valid && queue->has_prev && view->last_sample > 0 && dt > 0) {
+            queue->waiting_delta = (queue->waiting - queue->prev_waiting) / dt;
+            queue->has_rate      = TRUE;
+        } else {
+            queue->has_rate      = FALSE;
+        }
+        queue->has_prev     = valid;
+        queue->prev_waiting = queue->waiting;
+
+        queue->history[queue->history_pos] = queue->waiting;
+        queue->history_pos = (queue->history_pos + 1) % GM_TOP_HISTORY;
+        if(queue->history_num < GM_TOP_HISTORY)
+            queue->history_num++;
+    }
+    view->last_sample = now;
+    return;
+}
+
+
+/* render waiting jobs history, scaled to the maximum of the window */
+void sparkline(gm_top_queue_t * queue, char * buf) {
+    const char * levels = "_.:-=+*#";
+    int max = 0;
+    int x, val;
+    int start = queue->history_pos - queue->history_num + GM_TOP_HISTORY;
+
+    for(x=0; x<queue->history_num;x++) {
+        val = queue->history[(start + x) % GM_TOP_HISTORY];
+        if(val > max)
+            max = val;
+    }
+    for(x=0; x<queue->history_num;x++) {
+        val = queue->history[(start + x) % GM_TOP_HISTORY];
+        if(val <= 0 || max == 0)
+            buf[x] = levels[0];
+        else
+            buf[x] = levels[1 + (val * 6) / max];
+    }
+    buf[queue->history_num] = '\0';
+    return;
+}
+
+
+/* sort queues by name */
+static int cmp_top_queue(const void * a, const void * b) {
+    const gm_top_queue_t * qa = *(gm_top_queue_t * const *)a;
+    const gm_top_queue_t * qb = *(gm_top_queue_t * const *)b;
+    return(strcmp(qa->name, qb->name));
+}
+
+
+/* queues which are not printed */
+static int skip_queue(gm_top_queue_t * queue) {
+    if(!queue->seen)
+        return(TRUE);
+    if(opt_quiet == GM_ENABLED && queue->worker == 0 && queue->waiting == 0 && queue->running == 0)
+        return(TRUE);
+    return(FALSE);
+}
+
+
+/* format rate or placeholder if there is no previous sample */
+static void format_rate(char * buf, size_t size, gm_top_queue_t * queue, double rate) {
+    if(queue->has_rate)
+        snprintf(buf, size, "%+.1f", rate);
+    else
+        snprintf(buf, size, "%s", "-");
+    return;
+}
+
+
+/* print tables */
+void print_text(double now) {
+    char cur_time[32];
+    char title[GM_BUFFERSIZE];
+    struct tm tm_now;
+    time_t t = (time_t)now;
+    gm_top_server_t * srv;
+    int i, ok = 0;
+
+    tm_now = *(localtime(&t));
+    strftime(cur_time, sizeof(cur_time), "%Y-%m-%d %H:%M:%S", &tm_now );
+
+    if(opt_merge == GM_ENABLED) {
+        for(i=0;i<server_list_num;i++)
+            if(servers[i]->state == GM_TOP_STATE_DONE)
+                ok++;
+        snprintf(title, sizeof(title), "%s  -  %i/%i servers", cur_time, ok, server_list_num);
+        my_printf("%s\n", title);
+        for(i=0;i<server_list_num;i++)
+            if(servers[i]->state != GM_TOP_STATE_DONE)
+                my_printf(" %s: %s\n", servers[i]->name, servers[i]->error);
         my_printf("\n");
+        print_view(&merged);
+        return;
     }
-    else {
-        my_printf(" %s\n", message);
+
+    for(i=0;i<server_list_num;i++) {
+        srv = servers[i];
+        my_printf("%s  -  %s", cur_time, srv->name);
+        if(srv->version[0] != '\0')
+            my_printf("  -  v%s", srv->version );
+        my_printf("\n\n");
+        if(srv->state == GM_TOP_STATE_DONE)
+            print_view(&srv->view);
+        else
+            my_printf(" %s\n", srv->error);
     }
-    refresh();
+    return;
+}
 
-    free(hst_c);
-    free(message);
-    free(version);
-    free_mod_gm_status_server(stats);
+
+/* print table of one view */
+void print_view(gm_top_view_t * view) {
+    char format1[GM_BUFFERSIZE];
+    char format2[GM_BUFFERSIZE];
+    char delta[32];
+    char history[GM_TOP_HISTORY+1];
+    int x;
+    int max_length = 12;
+    int found      = 0;
+    int width;
+
+    for(x=0; x<view->queue_num;x++) {
+        if(skip_queue(view->queue[x]))
+            continue;
+        if((int)strlen(view->queue[x]->name) > max_length) {
+            max_length = (int)strlen(view->queue[x]->name);
+        }
+    }
+    width = max_length + 51 + 19 + GM_TOP_HISTORY;
+    snprintf(format1, sizeof(format1), " %%-%is | %%16s | %%12s | %%12s | %%13s | %%s\n", max_length);
+    snprintf(format2, sizeof(format2), " %%-%is |%%16i  |%%12i  |%%12i  |%%13s  | %%s\n", max_length);
+    my_printf(format1, "Queue Name", "Worker Available", "Jobs Waiting", "Jobs Running", "Waiting Chg/s", "History");
+    for(x=0; x < width; x++)
+        my_printf("-");
+    my_printf("\n");
+    for(x=0; x<view->queue_num;x++) {
+        if(skip_queue(view->queue[x]))
+            continue;
+        format_rate(delta, sizeof(delta), view->queue[x], view->queue[x]->waiting_delta);
+        sparkline(view->queue[x], history);
+        my_printf(format2, view->queue[x]->name, view->queue[x]->worker, view->queue[x]->waiting, view->queue[x]->running, delta, history);
+        found++;
+    }
+    if(found == 0) {
+        for(x=0; x < max_length + 25; x++) {
+            my_printf(" ");
+        }
+        my_printf("no queues found\n");
+    }
+    for(x=0; x < width; x++)
+        my_printf("-");
+    my_printf("\n");
+    return;
+}
+
+
+/* print quoted json string */
+static void json_string(const char * str) {
+    putchar('"');
+    for(; *str != '\0'; str++) {
+        if(*str == '"' || *str == '\\')
+            printf("\\%c", *str);
+        else if((unsigned char)*str < 0x20)
+            printf("\\u%04x", (unsigned char)*str);
+        else
+            putchar(*str);
+    }
+    putchar('"');
+    return;
+}
+
+
+/* print queues of one view as json objects */
+static void json_queues(char * server, gm_top_view_t * view, int * first) {
+    gm_top_queue_t * queue;
+    int x;
+
+    for(x=0; x<view->queue_num;x++) {
+        queue = view->queue[x];
+        if(skip_queue(queue))
+            continue;
+        printf("%s{\"server\":", *first ? "" : ",");
+        json_string(server);
+        printf(",\"queue\":");
+        json_string(queue->name);
+        printf(",\"worker\":%i,\"waiting\":%i,\"running\":%i", queue->worker, queue->waiting, queue->running);
+        if(queue->has_rate)
+            printf(",\"waiting_delta_per_s\":%.3f}", queue->waiting_delta);
+        else
+            printf(",\"waiting_delta_per_s\":null}");
+        *first = FALSE;
+    }
     return;
 }
 
+
+/* print one sample as single line json object */
+void print_json(double now) {
+    gm_top_server_t * srv;
+    int i, first = TRUE;
+
+    printf("{\"time\":%.3f,\"servers\":[", now);
+    for(i=0;i<server_list_num;i++) {
+        srv = servers[i];
+        printf("%s{\"server\":", i == 0 ? "" : ",");
+        json_string(srv->name);
+        printf(",\"ok\":%s,\"version\":", srv->state == GM_TOP_STATE_DONE ? "true" : "false");
+        json_string(srv->version);
+        if(srv->state != GM_TOP_STATE_DONE) {
+            printf(",\"error\":");
+            json_string(srv->error);
+        }
+        printf("}");
+    }
+    printf("],\"queues\":[");
+    for(i=0;i<server_list_num;i++)
+        json_queues(servers[i]->name, &servers[i]->view, &first);
+    if(server_list_num > 1 || opt_merge == GM_ENABLED)
+        json_queues("*", &merged, &first);
+    printf("]}\n");
+    return;
+}
+
+
+/* print csv field, quoted if required */
+static void csv_field(const char * str) {
+    if(strpbrk(str, ",\"\n") == NULL) {
+        printf("%s", str);
+        return;
+    }
+    putchar('"');
+    for(; *str != '\0'; str++) {
+        if(*str == '"')
+            putchar('"');
+        putchar(*str);
+    }
+    putchar('"');
+    return;
+}
+
+
+/* print queues of one view as csv rows */
+static void csv_queues(double now, char * server, gm_top_view_t * view) {
+    gm_top_queue_t * queue;
+    int x;
+
+    for(x=0; x<view->queue_num;x++) {
+        queue = view->queue[x];
+        if(skip_queue(queue))
+            continue;
+        printf("%.3f,", now);
+        csv_field(server);
+        putchar(',');
+        csv_field(queue->name);
+        printf(",%i,%i,%i,", queue->worker, queue->waiting, queue->running);
+        if(queue->has_rate)
+            printf("%.3f\n", queue->waiting_delta);
+        else
+            printf("\n");
+    }
+    return;
+}
+
+
+/* print one sample as csv, the header is printed once on startup */
+void print_csv(double now) {
+    int i;
+
+    for(i=0;i<server_list_num;i++)
+        csv_queues(now, servers[i]->name, &servers[i]->view);
+    if(server_list_num > 1 || opt_merge == GM_ENABLED)
+        csv_queues(now, "*", &merged);
+    return;
+}
+
+
 /* print curses or normal depending on batch mode setting */
 void my_printf(const char *fmt, ...) {
     va_list ap;
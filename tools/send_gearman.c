@@ -23,6 +23,8 @@
 
 /* include header */
 #include "send_gearman.h"
+#include "send_gearman_daemon.h"
+#include "send_gearman_import.h"
 #include "utils.h"
 #include "gearman_utils.h"
 
@@ -30,7 +32,14 @@
 
 gearman_client_st client;
 gearman_client_st client_dup;
-int results_sent = 0;
+int results_sent   = 0;
+int results_failed = 0;
+
+/* results waiting for the next bulk round trip */
+char ** bulk_results   = NULL;
+int bulk_num           = 0;
+int bulk_first_line    = 0;
+int bulk_batches       = 0;
 
 /* work starts here */
 int main (int argc, char **argv) {
@@ -72,9 +81,19 @@ int main (int argc, char **argv) {
     }
     current_client_dup = &client_dup;
 
+    /* send files from a spool directory */
+    if(mod_gm_opt->import_dir != NULL) {
+        rc = run_importer();
+    }
+    /* forward results until terminated */
+    else if(mod_gm_opt->daemon_mode == GM_ENABLED) {
+        rc = run_daemon();
+    }
     /* send result message */
-    signal(SIGALRM, alarm_sighandler);
-    rc = send_result();
+    else {
+        signal(SIGALRM, alarm_sighandler);
+        rc = send_result();
+    }
 
     gearman_client_free( &client );
     if( mod_gm_opt->dupserver_num )
@@ -146,6 +165,30 @@ int verify_options(mod_gm_opt_t *opt) {
         }
     }
 
+    /* importer runs on its own */
+    if(opt->import_dir != NULL) {
+        if(opt->daemon_listen_num > 0 || opt->nsca_listen_num > 0) {
+            printf("--import_dir cannot be combined with --daemon_listen or --nsca_listen\n");
+            return(GM_ERROR);
+        }
+        if(opt->host != NULL) {
+            printf("--host cannot be used with --import_dir\n");
+            return(GM_ERROR);
+        }
+    }
+
+    /* daemon needs something to listen on */
+    else if(opt->daemon_mode == GM_ENABLED) {
+        if(opt->daemon_listen_num == 0 && opt->nsca_listen_num == 0) {
+            printf("daemon mode requires at least one --daemon_listen=..., --nsca_listen=... or --import_dir=...\n");
+            return(GM_ERROR);
+        }
+        if(opt->host != NULL) {
+            printf("--host cannot be used in daemon mode\n");
+            return(GM_ERROR);
+        }
+    }
+
     if ( mod_gm_opt->result_queue == NULL )
         mod_gm_opt->result_queue = GM_DEFAULT_RESULT_QUEUE;
 
@@ -179,6 +222,21 @@ void print_usage() {
     printf("             [ --message|-m=<pluginoutput>  ]\n");
     printf("             [ --returncode|-r=<returncode> ]\n");
     printf("\n");
+    printf("for sending many results from stdin:\n");
+    printf("             [ --bulk_size=<nr>             ]\n");
+    printf("             [ --result_batch_size=<nr>     ]\n");
+    printf("\n");
+    printf("for forwarding results from sockets:\n");
+    printf("             [ --daemon                     ]\n");
+    printf("             [ --daemon_listen=<address>    ]\n");
+    printf("             [ --nsca_listen=<address>      ]\n");
+    printf("             [ --daemon_buffer_size=<nr>    ]\n");
+    printf("             [ --daemon_spool_dir=<dir>     ]\n");
+    printf("\n");
+    printf("for sending result files from a directory:\n");
+    printf("             [ --import_dir=<dir>           ]\n");
+    printf("             [ --daemon                     ]\n");
+    printf("\n");
     printf("for sending active checks:\n");
     printf("             [ --active                     ]\n");
     printf("             [ --starttime=<unixtime>       ]\n");
@@ -206,8 +264,8 @@ void print_usage() {
 
 /* send message to job server */
 int send_result() {
-    char *ptr1, *ptr2, *ptr3, *ptr4;
     char buffer[GM_BUFFERSIZE];
+    int line_num = 0;
 
     gm_log( GM_LOG_TRACE, "send_result()\n" );
 
@@ -218,58 +276,43 @@ int send_result() {
 
     /* multiple results */
     if(mod_gm_opt->host == NULL) {
+        if(mod_gm_opt->bulk_size > 0)
+            bulk_results = gm_malloc(mod_gm_opt->bulk_size * sizeof(char *));
         while(fgets(buffer,sizeof(buffer)-1,stdin)) {
+            line_num++;
             if(feof(stdin))
                 break;
 
             /* disable alarm */
             alarm(0);
 
-            /* read host_name */
-            ptr1=strtok(buffer,mod_gm_opt->delimiter);
-            if(ptr1==NULL)
-                continue;
-
-            /* get the service description or return code */
-            ptr2=strtok(NULL,mod_gm_opt->delimiter);
-            if(ptr2==NULL)
-                continue;
-
-            /* get the return code or plugin output */
-            ptr3=strtok(NULL,mod_gm_opt->delimiter);
-            if(ptr3==NULL)
+            if(parse_result_line(buffer) != GM_OK)
                 continue;
 
-            /* get the plugin output - if NULL, this is a host check result */
-            ptr4=strtok(NULL,"\n");
-
-            free(mod_gm_opt->host);
-            if(mod_gm_opt->service != NULL) {
-                free(mod_gm_opt->service);
-                mod_gm_opt->service = NULL;
+            if(bulk_results != NULL) {
+                if(bulk_num == 0)
+                    bulk_first_line = line_num;
+                bulk_results[bulk_num++] = build_result();
+                if(bulk_num >= mod_gm_opt->bulk_size)
+                    flush_bulk_results(line_num);
             }
-            free(mod_gm_opt->message);
-
-            /* host result */
-            if(ptr4 == NULL) {
-                mod_gm_opt->host        = gm_strdup(ptr1);
-                mod_gm_opt->return_code = atoi(ptr2);
-                mod_gm_opt->message     = gm_strdup(ptr3);
-            } else {
-                /* service result */
-                mod_gm_opt->host        = gm_strdup(ptr1);
-                mod_gm_opt->service     = gm_strdup(ptr2);
-                mod_gm_opt->return_code = atoi(ptr3);
-                mod_gm_opt->message     = gm_strdup(ptr4);
-            }
-            if(submit_result() == STATE_OK) {
+            else if(submit_result() == STATE_OK) {
                 results_sent++;
             } else {
                 printf("failed to send result!\n");
                 return(STATE_UNKNOWN);
             }
         }
+        if(bulk_results != NULL) {
+            flush_bulk_results(line_num);
+            free(bulk_results);
+            bulk_results = NULL;
+        }
         printf("%d data packet(s) sent to host successfully.\n",results_sent);
+        if(results_failed > 0) {
+            printf("%d data packet(s) failed.\n",results_failed);
+            return(STATE_UNKNOWN);
+        }
         return(STATE_OK);
     }
     /* multi line plugin output */
@@ -283,15 +326,58 @@ int send_result() {
     return(submit_result());
 }
 
-/* submit result */
-int submit_result() {
+/* parse a delimited result line into the current options */
+int parse_result_line(char *line) {
+    char *ptr1, *ptr2, *ptr3, *ptr4;
+
+    /* read host_name */
+    ptr1=strtok(line,mod_gm_opt->delimiter);
+    if(ptr1==NULL)
+        return(GM_ERROR);
+
+    /* get the service description or return code */
+    ptr2=strtok(NULL,mod_gm_opt->delimiter);
+    if(ptr2==NULL)
+        return(GM_ERROR);
+
+    /* get the return code or plugin output */
+    ptr3=strtok(NULL,mod_gm_opt->delimiter);
+    if(ptr3==NULL)
+        return(GM_ERROR);
+
+    /* get the plugin output - if NULL, this is a host check result */
+    ptr4=strtok(NULL,"\n");
+
+    free(mod_gm_opt->host);
+    if(mod_gm_opt->service != NULL) {
+        free(mod_gm_opt->service);
+        mod_gm_opt->service = NULL;
+    }
+    free(mod_gm_opt->message);
+
+    /* host result */
+    if(ptr4 == NULL) {
+        mod_gm_opt->host        = gm_strdup(ptr1);
+        mod_gm_opt->return_code = atoi(ptr2);
+        mod_gm_opt->message     = gm_strdup(ptr3);
+    } else {
+        /* service result */
+        mod_gm_opt->host        = gm_strdup(ptr1);
+        mod_gm_opt->service     = gm_strdup(ptr2);
+        mod_gm_opt->return_code = atoi(ptr3);
+        mod_gm_opt->message     = gm_strdup(ptr4);
+    }
+    return(GM_OK);
+}
+
+/* build result payload from the current options */
+char * build_result() {
     char * buf;
-    char * temp_buffer;
     char * result;
     struct timeval now;
     struct timeval starttime;
     struct timeval finishtime;
-    int resultsize;
+    int resultsize, len;
 
     gettimeofday(&now, NULL);
     if(mod_gm_opt->has_starttime == FALSE) {
@@ -314,13 +400,11 @@ int submit_result() {
     /* escape newline */
     buf = gm_escape_newlines(mod_gm_opt->message, GM_DISABLED);
     free(mod_gm_opt->message);
-    mod_gm_opt->message = gm_strdup(buf);
-    free(buf);
+    mod_gm_opt->message = buf;
 
-    gm_log( GM_LOG_TRACE, "queue: %s\n", mod_gm_opt->result_queue );
-    resultsize = sizeof(char) * strlen(mod_gm_opt->message) + GM_BUFFERSIZE;
+    resultsize = strlen(mod_gm_opt->message) + (mod_gm_opt->service != NULL ? strlen(mod_gm_opt->service) : 0) + GM_BUFFERSIZE;
     result = gm_malloc(resultsize);
-    snprintf( result, resultsize-1, "type=%s\nhost_name=%s\nstart_time=%lf\nfinish_time=%lf\nlatency=%lf\nreturn_code=%i\nsource=send_gearman\n",
+    len = snprintf( result, resultsize-1, "type=%s\nhost_name=%s\nstart_time=%lf\nfinish_time=%lf\nlatency=%lf\nreturn_code=%i\nsource=send_gearman\n",
               mod_gm_opt->active == GM_ENABLED ? "active" : "passive",
               mod_gm_opt->host,
               timeval2double(&starttime),
@@ -329,25 +413,24 @@ int submit_result() {
               mod_gm_opt->return_code
             );
 
-    temp_buffer = gm_malloc(resultsize);
-    if(mod_gm_opt->service != NULL) {
-        temp_buffer[0]='\x0';
-        strcat(temp_buffer, "service_description=");
-        strcat(temp_buffer, mod_gm_opt->service);
-        strcat(temp_buffer, "\n");
-        strcat(result, temp_buffer);
-    }
+    if(mod_gm_opt->service != NULL)
+        len += snprintf( result+len, resultsize-len, "service_description=%s\n", mod_gm_opt->service );
 
-    if(mod_gm_opt->message != NULL) {
-        temp_buffer[0]='\x0';
-        strcat(temp_buffer, "output=");
-        strcat(temp_buffer, mod_gm_opt->message);
-        strcat(temp_buffer, "\n");
-        strcat(result, temp_buffer);
-    }
-    strcat(result, "\n");
+    if(mod_gm_opt->message != NULL)
+        len += snprintf( result+len, resultsize-len, "output=%s\n", mod_gm_opt->message );
+    snprintf( result+len, resultsize-len, "\n" );
 
     gm_log( GM_LOG_TRACE, "data:\n%s\n", result);
+    return(result);
+}
+
+
+/* submit result */
+int submit_result() {
+    char * result;
+
+    gm_log( GM_LOG_TRACE, "queue: %s\n", mod_gm_opt->result_queue );
+    result = build_result();
 
     if(add_job_to_queue( &client,
                          mod_gm_opt->server_list,
@@ -382,15 +465,81 @@ int submit_result() {
     else {
         gm_log( GM_LOG_TRACE, "send_result_back() finished unsuccessfully\n" );
         free(result);
-        free(temp_buffer);
         return( STATE_UNKNOWN );
     }
     free(result);
-    free(temp_buffer);
     return( STATE_OK );
 }
 
 
+/* send all queued results with one round trip and report failures of this batch */
+int flush_bulk_results(int last_line) {
+    int failed_results[GM_MAX_BULK_SIZE];
+    int failed;
+    int x;
+
+    if(bulk_num == 0)
+        return(0);
+    bulk_batches++;
+
+    failed = send_bulk_results(bulk_results, bulk_num, failed_results);
+    if(failed > 0)
+        printf("batch %d (lines %d-%d): %d of %d result(s) failed: %s\n", bulk_batches, bulk_first_line, last_line, failed, bulk_num, gearman_client_error(&client));
+    results_sent   += bulk_num - failed;
+    results_failed += failed;
+
+    for(x = 0; x < bulk_num; x++)
+        free(bulk_results[x]);
+    bulk_num = 0;
+    return(failed);
+}
+
+
+/* send a list of results with one round trip and mark the failed ones */
+int send_bulk_results(char ** results, int num, int * failed_results) {
+    char * packets[GM_MAX_BULK_SIZE];
+    int packet_size[GM_MAX_BULK_SIZE];
+    int failed_packets[GM_MAX_BULK_SIZE];
+    int per_packet = mod_gm_opt->result_batch_size > 1 ? mod_gm_opt->result_batch_size : 1;
+    int packet_num = 0;
+    int failed     = 0;
+    int x, y, first;
+
+    if(num > GM_MAX_BULK_SIZE)
+        num = GM_MAX_BULK_SIZE;
+
+    /* optionally pack several results into one job, like the worker does */
+    for(x = 0; x < num; x += per_packet) {
+        packet_size[packet_num] = num - x < per_packet ? num - x : per_packet;
+        if(packet_size[packet_num] > 1)
+            packets[packet_num] = build_multi_result(&results[x], packet_size[packet_num]);
+        else
+            packets[packet_num] = gm_strdup(results[x]);
+        packet_num++;
+    }
+
+    add_jobs_to_queue(&client, mod_gm_opt->server_list, mod_gm_opt->result_queue, packets, packet_num,
+                      GM_JOB_PRIO_NORMAL, mod_gm_opt->transportmode, failed_packets);
+    first = 0;
+    for(x = 0; x < packet_num; x++) {
+        for(y = first; y < first + packet_size[x]; y++)
+            failed_results[y] = failed_packets[x];
+        if(failed_packets[x])
+            failed += packet_size[x];
+        first += packet_size[x];
+    }
+    if( mod_gm_opt->dupserver_num ) {
+        if(add_jobs_to_queue(&client_dup, mod_gm_opt->dupserver_list, mod_gm_opt->result_queue, packets, packet_num,
+                             GM_JOB_PRIO_NORMAL, mod_gm_opt->transportmode, failed_packets) > 0)
+            gm_log( GM_LOG_TRACE, "send_bulk_results() finished unsuccessfully for duplicate server\n" );
+    }
+
+    for(x = 0; x < packet_num; x++)
+        free(packets[x]);
+    return(failed);
+}
+
+
 /* called when check runs into timeout */
 void alarm_sighandler(int sig) {
     gm_log( GM_LOG_TRACE, "alarm_sighandler(%i)\n", sig );
@@ -0,0 +1,743 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/* include header */
+#include "send_gearman.h"
+#include "send_gearman_daemon.h"
+#include "utils.h"
+#include "gearman_utils.h"
+
+extern gearman_client_st client;
+
+static volatile sig_atomic_t daemon_running = TRUE;
+
+static gm_result_queue_t  queue;
+static gm_daemon_client_t clients[GM_DAEMON_MAX_CLIENTS];
+static int                client_num = 0;
+static int                listen_fd[GM_LISTSIZE*2];
+static int                listen_type[GM_LISTSIZE*2];
+static char             * listen_path[GM_LISTSIZE*2];
+static int                listen_num = 0;
+
+/* results which did not fit into memory, read back in order once gearmand is reachable again */
+static FILE             * spool_out      = NULL;
+static char             * spool_out_name = NULL;
+static FILE             * spool_in       = NULL;
+static char             * spool_in_name  = NULL;
+static int                spool_active   = FALSE;
+static int                spool_seq      = 0;
+
+static int                forward_failed    = FALSE;
+static long               results_received  = 0;
+static long               results_forwarded = 0;
+static long               results_spooled   = 0;
+static long               results_dropped   = 0;
+
+static void daemon_sighandler(int sig);
+static int open_listeners(void);
+static void close_listeners(void);
+static void accept_client(int listener);
+static int read_client(gm_daemon_client_t *c);
+static void process_client(gm_daemon_client_t *c);
+static void add_line_result(char *line);
+static void consume_client(gm_daemon_client_t *c, int len);
+static void close_client(gm_daemon_client_t *c);
+static int can_accept(void);
+static void enqueue_result(char *result);
+static int forward_results(int batch);
+static int spool_open_next(void);
+static void spool_close_in(void);
+static int spool_filter(const struct dirent *entry);
+
+/* listen for results and forward them until terminated */
+int run_daemon() {
+    struct pollfd pfds[GM_LISTSIZE*2 + GM_DAEMON_MAX_CLIENTS];
+    int nfds, x, y, timeout, batch, backoff = 0;
+    time_t now, next_try = 0;
+
+    gm_log( GM_LOG_TRACE, "run_daemon()\n" );
+
+    /* timestamps are useful for a long running process */
+    mod_gm_opt->logmode = GM_LOG_MODE_STDOUT;
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    batch = mod_gm_opt->bulk_size > 0 ? mod_gm_opt->bulk_size : GM_DAEMON_DEFAULT_BATCH;
+    queue.size  = mod_gm_opt->daemon_buffer_size;
+    queue.items = gm_malloc(queue.size * sizeof(char *));
+    queue.head  = 0;
+    queue.count = 0;
+
+    if(open_listeners() != GM_OK) {
+        close_listeners();
+        free(queue.items);
+        return(STATE_UNKNOWN);
+    }
+
+    signal(SIGTERM, daemon_sighandler);
+    signal(SIGINT,  daemon_sighandler);
+    signal(SIGPIPE, SIG_IGN);
+    srand(time(NULL) ^ getpid());
+
+    /* results left over from the last run */
+    if(mod_gm_opt->daemon_spool_dir != NULL) {
+        if(spool_open_next() == GM_OK) {
+            gm_log( GM_LOG_INFO, "found spooled results in %s\n", mod_gm_opt->daemon_spool_dir );
+            spool_active = TRUE;
+        }
+    }
+
+    gm_log( GM_LOG_INFO, "send_gearman daemon started, buffer: %d results, batch: %d results, spool: %s\n",
+            queue.size, batch, mod_gm_opt->daemon_spool_dir != NULL ? mod_gm_opt->daemon_spool_dir : "disabled" );
+
+    while(daemon_running) {
+        /* refill the buffer from disk */
+        if(spool_active && queue.count < queue.size / 2)
+            spool_replay(&queue);
+
+        /* stop reading from clients if there is no space left, they will block in write */
+        nfds = 0;
+        for(x = 0; x < listen_num; x++) {
+            pfds[nfds].fd      = listen_fd[x];
+            pfds[nfds].events  = client_num < GM_DAEMON_MAX_CLIENTS ? POLLIN : 0;
+            pfds[nfds].revents = 0;
+            nfds++;
+        }
+        for(x = 0; x < client_num; x++) {
+            pfds[nfds].fd      = clients[x].fd;
+            pfds[nfds].events  = can_accept() && !clients[x].eof ? POLLIN : 0;
+            pfds[nfds].revents = 0;
+            nfds++;
+        }
+
+        now     = time(NULL);
+        timeout = 1000;
+        if(queue.count > 0)
+            timeout = now >= next_try ? 0 : (next_try - now) * 1000;
+
+        if(poll(pfds, nfds, timeout) < 0) {
+            if(errno == EINTR)
+                continue;
+            gm_log( GM_LOG_ERROR, "poll failed: %s\n", strerror(errno) );
+            break;
+        }
+
+        for(x = 0; x < listen_num; x++) {
+            if(pfds[x].revents & POLLIN)
+                accept_client(x);
+        }
+
+        /* new clients have been appended and are not part of this poll round */
+        for(x = 0; x < nfds - listen_num; x++) {
+            if(pfds[listen_num + x].revents != 0 && read_client(&clients[x]) != GM_OK)
+                clients[x].eof = TRUE;
+        }
+        for(x = 0; x < client_num; x++)
+            process_client(&clients[x]);
+
+        /* remove finished clients */
+        for(x = 0, y = 0; x < client_num; x++) {
+            if(clients[x].fd == -1)
+                continue;
+            clients[y++] = clients[x];
+        }
+        client_num = y;
+
+        if(queue.count > 0 && time(NULL) >= next_try) {
+            if(forward_results(batch) > 0) {
+                backoff  = backoff == 0 ? 1 : backoff * 2;
+                if(backoff > GM_DAEMON_MAX_BACKOFF)
+                    backoff = GM_DAEMON_MAX_BACKOFF;
+                next_try = time(NULL) + backoff;
+            } else {
+                backoff  = 0;
+                next_try = 0;
+            }
+        }
+
+        if(spool_out != NULL)
+            fflush(spool_out);
+    }
+
+    gm_log( GM_LOG_INFO, "send_gearman daemon shutting down\n" );
+    close_listeners();
+    for(x = 0; x < client_num; x++) {
+        process_client(&clients[x]);
+        if(clients[x].fd != -1)
+            close_client(&clients[x]);
+    }
+    client_num = 0;
+
+    /* one last try, keep everything else for the next start */
+    while(queue.count > 0 && forward_results(batch) == 0)
+        ;
+    if(mod_gm_opt->daemon_spool_dir != NULL) {
+        spool_save(&queue);
+    }
+    else if(queue.count > 0) {
+        gm_log( GM_LOG_ERROR, "%d result(s) could not be sent and are lost\n", queue.count );
+        results_dropped += queue.count;
+    }
+    while(queue.count > 0)
+        free(result_queue_pop(&queue));
+    free(queue.items);
+
+    gm_log( GM_LOG_INFO, "received: %ld, forwarded: %ld, spooled: %ld, dropped: %ld\n",
+            results_received, results_forwarded, results_spooled, results_dropped );
+
+    return(results_dropped > 0 ? STATE_UNKNOWN : STATE_OK);
+}
+
+
+/* stop the main loop */
+static void daemon_sighandler(int sig) {
+    (void)sig;
+    daemon_running = FALSE;
+}
+
+
+/* open all configured sockets */
+static int open_listeners() {
+    int x;
+
+    for(x = 0; x < mod_gm_opt->daemon_listen_num + mod_gm_opt->nsca_listen_num; x++) {
+        char * address;
+        if(x < mod_gm_opt->daemon_listen_num) {
+            address = mod_gm_opt->daemon_listen[x];
+            listen_type[listen_num] = GM_DAEMON_LINE;
+        } else {
+            address = mod_gm_opt->nsca_listen[x - mod_gm_opt->daemon_listen_num];
+            listen_type[listen_num] = GM_DAEMON_NSCA;
+        }
+        listen_fd[listen_num] = gm_net_listen(address, &listen_path[listen_num]);
+        if(listen_fd[listen_num] < 0)
+            return(GM_ERROR);
+        gm_log( GM_LOG_INFO, "listening on %s (%s)\n", address, listen_type[listen_num] == GM_DAEMON_NSCA ? "nsca" : "line" );
+        listen_num++;
+    }
+    return(GM_OK);
+}
+
+
+/* close sockets and remove unix socket files */
+static void close_listeners() {
+    int x;
+    for(x = 0; x < listen_num; x++) {
+        close(listen_fd[x]);
+        if(listen_path[x] != NULL) {
+            unlink(listen_path[x]);
+            free(listen_path[x]);
+        }
+    }
+    listen_num = 0;
+}
+
+
+/* accept a new client, nsca clients expect the init packet first */
+static void accept_client(int listener) {
+    unsigned char init[GM_NSCA_INIT_PACKET_SIZE];
+    uint32_t timestamp;
+    int fd, x;
+
+    fd = accept(listen_fd[listener], NULL, NULL);
+    if(fd < 0)
+        return;
+    if(client_num >= GM_DAEMON_MAX_CLIENTS) {
+        close(fd);
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    /* iv is only used by encryption, which is not supported */
+    if(listen_type[listener] == GM_DAEMON_NSCA) {
+        for(x = 0; x < 128; x++)
+            init[x] = rand() & 0xff;
+        timestamp = htonl((uint32_t)time(NULL));
+        memcpy(init+128, &timestamp, 4);
+        if(write(fd, init, GM_NSCA_INIT_PACKET_SIZE) != GM_NSCA_INIT_PACKET_SIZE) {
+            close(fd);
+            return;
+        }
+    }
+
+    clients[client_num].fd   = fd;
+    clients[client_num].type = listen_type[listener];
+    clients[client_num].size = GM_BUFFERSIZE;
+    clients[client_num].buf  = gm_malloc(clients[client_num].size + 1);
+    clients[client_num].len  = 0;
+    clients[client_num].eof  = FALSE;
+    client_num++;
+    gm_log( GM_LOG_DEBUG, "client %d connected\n", fd );
+}
+
+
+/* read available data from a client */
+static int read_client(gm_daemon_client_t *c) {
+    ssize_t n;
+
+    if(c->size - c->len < 4096) {
+        if(c->size >= GM_MAX_OUTPUT) {
+            gm_log( GM_LOG_ERROR, "client %d sent more than %d bytes without a complete result, closing connection\n", c->fd, GM_MAX_OUTPUT );
+            c->len = 0;
+            return(GM_ERROR);
+        }
+        c->size *= 2;
+        c->buf   = gm_realloc(c->buf, c->size + 1);
+    }
+
+    n = read(c->fd, c->buf + c->len, c->size - c->len);
+    if(n > 0) {
+        c->len += n;
+        return(GM_OK);
+    }
+    if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return(GM_OK);
+    return(GM_ERROR);
+}
+
+
+/* turn complete lines or packets into results */
+static void process_client(gm_daemon_client_t *c) {
+    char *start, *end;
+    int offset = 0, size;
+
+    if(c->fd == -1)
+        return;
+
+    if(c->type == GM_DAEMON_LINE) {
+        start = c->buf;
+        while(can_accept() && (end = memchr(start, '\n', c->buf + c->len - start)) != NULL) {
+            *end = '\0';
+            add_line_result(start);
+            start = end + 1;
+        }
+        /* the last line may come without newline */
+        if(c->eof && can_accept() && start < c->buf + c->len) {
+            c->buf[c->len] = '\0';
+            add_line_result(start);
+            start = c->buf + c->len;
+        }
+        offset = start - c->buf;
+    }
+    else {
+        while(can_accept() && c->len - offset >= GM_NSCA_PACKET_SIZE) {
+            size = nsca_packet_size((unsigned char *)c->buf + offset, c->len - offset);
+            if(size == 0)
+                break;
+            if(size < 0 || parse_nsca_packet((unsigned char *)c->buf + offset, size) != GM_OK) {
+                gm_log( GM_LOG_ERROR, "client %d sent an invalid nsca packet, closing connection\n", c->fd );
+                close_client(c);
+                return;
+            }
+            results_received++;
+            enqueue_result(build_result());
+            mod_gm_opt->has_starttime  = FALSE;
+            mod_gm_opt->has_finishtime = FALSE;
+            offset += size;
+        }
+    }
+    consume_client(c, offset);
+
+    /* anything left while there is space is an incomplete packet */
+    if(c->eof && (c->len == 0 || can_accept())) {
+        if(c->len > 0)
+            gm_log( GM_LOG_ERROR, "client %d disconnected with an incomplete or invalid nsca packet\n", c->fd );
+        close_client(c);
+    }
+}
+
+
+/* parse a result line and queue the result */
+static void add_line_result(char *line) {
+    if(*line == '\0' || parse_result_line(line) != GM_OK)
+        return;
+    results_received++;
+    enqueue_result(build_result());
+}
+
+
+/* remove processed data from the client buffer */
+static void consume_client(gm_daemon_client_t *c, int len) {
+    if(len <= 0)
+        return;
+    memmove(c->buf, c->buf + len, c->len - len);
+    c->len -= len;
+}
+
+
+/* close client connection, the slot is removed later */
+static void close_client(gm_daemon_client_t *c) {
+    gm_log( GM_LOG_DEBUG, "client %d disconnected\n", c->fd );
+    close(c->fd);
+    free(c->buf);
+    c->buf = NULL;
+    c->fd  = -1;
+}
+
+
+/* return size of the nsca packet at the start of the buffer, 0 if incomplete or -1 if invalid */
+int nsca_packet_size(unsigned char *packet, int len) {
+    int sizes[2] = { GM_NSCA_PACKET_SIZE, GM_NSCA_LARGE_PACKET_SIZE };
+    uint32_t crc;
+    int x;
+
+    memcpy(&crc, packet+4, 4);
+    crc = ntohl(crc);
+    for(x = 0; x < 2; x++) {
+        if(len < sizes[x])
+            return(0);
+        memset(packet+4, 0, 4);
+        if(nsca_crc32(packet, sizes[x]) == crc) {
+            crc = htonl(crc);
+            memcpy(packet+4, &crc, 4);
+            return(sizes[x]);
+        }
+        crc = htonl(crc);
+        memcpy(packet+4, &crc, 4);
+        crc = ntohl(crc);
+    }
+    return(-1);
+}
+
+
+/* verify a send_nsca data packet and store the result in the options */
+int parse_nsca_packet(unsigned char *packet, int size) {
+    int16_t version, return_code;
+    uint32_t crc, timestamp;
+    int output_size;
+
+    if(size != GM_NSCA_PACKET_SIZE && size != GM_NSCA_LARGE_PACKET_SIZE)
+        return(GM_ERROR);
+    output_size = size - 208;
+
+    memcpy(&version, packet, 2);
+    if(ntohs(version) != GM_NSCA_PACKET_VERSION)
+        return(GM_ERROR);
+
+    memcpy(&crc, packet+4, 4);
+    memset(packet+4, 0, 4);
+    if(nsca_crc32(packet, size) != ntohl(crc))
+        return(GM_ERROR);
+
+    memcpy(&timestamp, packet+8, 4);
+    memcpy(&return_code, packet+12, 2);
+
+    /* fields are zero padded, but do not trust the sender */
+    packet[14+63]             = '\0';
+    packet[78+127]            = '\0';
+    packet[206+output_size-1] = '\0';
+    if(packet[14] == '\0')
+        return(GM_ERROR);
+
+    free(mod_gm_opt->host);
+    free(mod_gm_opt->service);
+    free(mod_gm_opt->message);
+    mod_gm_opt->host        = gm_strdup((char *)packet+14);
+    mod_gm_opt->service     = packet[78] != '\0' ? gm_strdup((char *)packet+78) : NULL;
+    mod_gm_opt->message     = gm_strdup((char *)packet+206);
+    mod_gm_opt->return_code = (int16_t)ntohs(return_code);
+
+    mod_gm_opt->starttime.tv_sec   = ntohl(timestamp);
+    mod_gm_opt->starttime.tv_usec  = 0;
+    mod_gm_opt->finishtime         = mod_gm_opt->starttime;
+    mod_gm_opt->has_starttime      = TRUE;
+    mod_gm_opt->has_finishtime     = TRUE;
+
+    return(GM_OK);
+}
+
+
+/* calculate crc32 like nsca does */
+unsigned long nsca_crc32(const unsigned char *data, int size) {
+    static uint32_t table[256];
+    static int initialized = FALSE;
+    uint32_t crc, c;
+    int x, y;
+
+    if(!initialized) {
+        for(x = 0; x < 256; x++) {
+            c = x;
+            for(y = 0; y < 8; y++)
+                c = c & 1 ? (c >> 1) ^ 0xEDB88320 : c >> 1;
+            table[x] = c;
+        }
+        initialized = TRUE;
+    }
+
+    crc = 0xFFFFFFFF;
+    for(x = 0; x < size; x++)
+        crc = (crc >> 8) ^ table[(crc ^ data[x]) & 0xff];
+    return(crc ^ 0xFFFFFFFF);
+}
+
+
+/* is there space for another result */
+static int can_accept() {
+    return(mod_gm_opt->daemon_spool_dir != NULL || queue.count < queue.size);
+}
+
+
+/* keep result in memory or on disk once memory is full, spooled results keep their order */
+static void enqueue_result(char *result) {
+    if(mod_gm_opt->daemon_spool_dir != NULL && (spool_active || queue.count >= queue.size)) {
+        if(spool_write(result) == GM_OK) {
+            spool_active = TRUE;
+            free(result);
+            return;
+        }
+    }
+    if(result_queue_push(&queue, result) != GM_OK) {
+        results_dropped++;
+        free(result);
+    }
+}
+
+
+/* send one batch, failed results are put back in front of the queue */
+static int forward_results(int batch) {
+    char * results[GM_MAX_BULK_SIZE];
+    int failed_results[GM_MAX_BULK_SIZE];
+    int num = 0, failed, x;
+
+    while(num < batch && (results[num] = result_queue_pop(&queue)) != NULL)
+        num++;
+    if(num == 0)
+        return(0);
+
+    failed = send_bulk_results(results, num, failed_results);
+    for(x = num - 1; x >= 0; x--) {
+        if(failed_results[x])
+            result_queue_push_front(&queue, results[x]);
+        else
+            free(results[x]);
+    }
+    results_forwarded += num - failed;
+
+    /* only log state changes */
+    if(failed > 0 && !forward_failed)
+        gm_log( GM_LOG_ERROR, "forwarding results failed: %s, keeping %d result(s)\n", gearman_client_error(&client), queue.count );
+    if(failed == 0 && forward_failed)
+        gm_log( GM_LOG_INFO, "forwarding results resumed\n" );
+    forward_failed = failed > 0;
+
+    return(failed);
+}
+
+
+/* append result to the current spool file */
+int spool_write(char *result) {
+    int len;
+
+    if(spool_out == NULL) {
+        len = strlen(mod_gm_opt->daemon_spool_dir) + 64;
+        spool_out_name = gm_malloc(len);
+        snprintf(spool_out_name, len, "%s/%010ld-%05d-%06d.spool", mod_gm_opt->daemon_spool_dir, (long)time(NULL), (int)getpid(), spool_seq++);
+        spool_out = fopen(spool_out_name, "a");
+        if(spool_out == NULL) {
+            gm_log( GM_LOG_ERROR, "cannot open spool file %s: %s\n", spool_out_name, strerror(errno) );
+            free(spool_out_name);
+            spool_out_name = NULL;
+            return(GM_ERROR);
+        }
+        gm_log( GM_LOG_DEBUG, "spooling results to %s\n", spool_out_name );
+    }
+
+    if(fprintf(spool_out, "%d\n%s", (int)strlen(result), result) < 0) {
+        gm_log( GM_LOG_ERROR, "cannot write spool file %s: %s\n", spool_out_name, strerror(errno) );
+        return(GM_ERROR);
+    }
+    results_spooled++;
+    return(GM_OK);
+}
+
+
+/* open the oldest spool file for reading */
+static int spool_open_next() {
+    struct dirent **list;
+    int num, x, len;
+
+    num = scandir(mod_gm_opt->daemon_spool_dir, &list, spool_filter, alphasort);
+    if(num <= 0) {
+        if(num == 0)
+            free(list);
+        return(GM_ERROR);
+    }
+
+    len = strlen(mod_gm_opt->daemon_spool_dir) + strlen(list[0]->d_name) + 2;
+    spool_in_name = gm_malloc(len);
+    snprintf(spool_in_name, len, "%s/%s", mod_gm_opt->daemon_spool_dir, list[0]->d_name);
+    for(x = 0; x < num; x++)
+        free(list[x]);
+    free(list);
+
+    /* start a new file for results arriving from now on */
+    if(spool_out != NULL && !strcmp(spool_in_name, spool_out_name)) {
+        fclose(spool_out);
+        spool_out = NULL;
+        free(spool_out_name);
+        spool_out_name = NULL;
+    }
+
+    spool_in = fopen(spool_in_name, "r");
+    if(spool_in == NULL) {
+        gm_log( GM_LOG_ERROR, "cannot read spool file %s: %s\n", spool_in_name, strerror(errno) );
+        free(spool_in_name);
+        spool_in_name = NULL;
+        return(GM_ERROR);
+    }
+    return(GM_OK);
+}
+
+
+/* close and remove the completely read spool file */
+static void spool_close_in() {
+    fclose(spool_in);
+    unlink(spool_in_name);
+    free(spool_in_name);
+    spool_in      = NULL;
+    spool_in_name = NULL;
+}
+
+
+/* move spooled results back into memory */
+void spool_replay(gm_result_queue_t *q) {
+    char line[32];
+    char * result;
+    int len;
+
+    while(q->count < q->size) {
+        if(spool_in == NULL && spool_open_next() != GM_OK) {
+            /* everything is read, or the spool is unreadable and needs an admin */
+            spool_active = FALSE;
+            return;
+        }
+        if(fgets(line, sizeof(line), spool_in) == NULL) {
+            spool_close_in();
+            continue;
+        }
+        len = atoi(line);
+        if(len <= 0 || len > GM_MAX_OUTPUT) {
+            gm_log( GM_LOG_ERROR, "spool file %s is corrupt, skipping the rest of it\n", spool_in_name );
+            spool_close_in();
+            continue;
+        }
+        result = gm_malloc(len + 1);
+        if(fread(result, 1, len, spool_in) != (size_t)len) {
+            gm_log( GM_LOG_ERROR, "spool file %s is truncated, skipping the rest of it\n", spool_in_name );
+            free(result);
+            spool_close_in();
+            continue;
+        }
+        result[len] = '\0';
+        result_queue_push(q, result);
+    }
+}
+
+
+/* write buffered results and the unread rest of the spool to a file which is read first on the next start */
+void spool_save(gm_result_queue_t *q) {
+    char buffer[GM_BUFFERSIZE];
+    char * name;
+    FILE * fp;
+    size_t n;
+    int len, saved = 0;
+
+    if(q->count > 0 || spool_in != NULL) {
+        len  = strlen(mod_gm_opt->daemon_spool_dir) + 64;
+        name = gm_malloc(len);
+        snprintf(name, len, "%s/%010d-%05d-%06d.spool", mod_gm_opt->daemon_spool_dir, 0, (int)getpid(), spool_seq++);
+        fp = fopen(name, "w");
+        if(fp == NULL) {
+            gm_log( GM_LOG_ERROR, "cannot open spool file %s: %s, %d result(s) lost\n", name, strerror(errno), q->count );
+            results_dropped += q->count;
+            free(name);
+            return;
+        }
+        while(q->count > 0) {
+            char * result = result_queue_pop(q);
+            fprintf(fp, "%d\n%s", (int)strlen(result), result);
+            free(result);
+            saved++;
+        }
+        if(spool_in != NULL) {
+            while((n = fread(buffer, 1, sizeof(buffer), spool_in)) > 0)
+                fwrite(buffer, 1, n, fp);
+            spool_close_in();
+        }
+        if(fclose(fp) != 0) {
+            gm_log( GM_LOG_ERROR, "cannot write spool file %s: %s\n", name, strerror(errno) );
+            results_dropped += saved;
+        }
+        else if(saved > 0) {
+            gm_log( GM_LOG_INFO, "saved %d result(s) to %s\n", saved, name );
+        }
+        free(name);
+    }
+
+    if(spool_out != NULL) {
+        fclose(spool_out);
+        free(spool_out_name);
+        spool_out      = NULL;
+        spool_out_name = NULL;
+    }
+}
+
+
+/* only spool files */
+static int spool_filter(const struct dirent *entry) {
+    int len = strlen(entry->d_name);
+    return(len > 6 && !strcmp(entry->d_name + len - 6, ".spool"));
+}
+
+
+/* append a result to the queue */
+int result_queue_push(gm_result_queue_t *q, char *result) {
+    if(q->count >= q->size)
+        return(GM_ERROR);
+    q->items[(q->head + q->count) % q->size] = result;
+    q->count++;
+    return(GM_OK);
+}
+
+
+/* put a result back in front of the queue */
+int result_queue_push_front(gm_result_queue_t *q, char *result) {
+    if(q->count >= q->size)
+        return(GM_ERROR);
+    q->head = (q->head + q->size - 1) % q->size;
+    q->items[q->head] = result;
+    q->count++;
+    return(GM_OK);
+}
+
+
+/* remove the oldest result from the queue */
+char * result_queue_pop(gm_result_queue_t *q) {
+    char * result;
+    if(q->count == 0)
+        return(NULL);
+    result  = q->items[q->head];
+    q->head = (q->head + 1) % q->size;
+    q->count--;
+    return(result);
+}
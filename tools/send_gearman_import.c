@@ -0,0 +1,592 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/* include header */
+#include "send_gearman.h"
+#include "send_gearman_import.h"
+#include "utils.h"
+#include "gearman_utils.h"
+
+extern gearman_client_st client;
+extern int results_sent;
+extern int results_failed;
+
+static volatile sig_atomic_t import_running = TRUE;
+
+/* do not read new files until this time after gearmand failed */
+static time_t import_paused_until = 0;
+
+static void import_sighandler(int sig);
+static int import_scan(gm_import_batch_t *batch);
+static void import_add_result(gm_import_batch_t *batch);
+static void import_reset_result(int active);
+static int import_filter(const struct dirent *entry);
+static int import_has_marker(char *path);
+static void import_remove_marker(char *path);
+static void import_keep_result(gm_import_file_t *file, char *result);
+static int import_close_retry(gm_import_file_t *file, int replace);
+static char * import_unescape(char *text);
+#ifdef GM_INOTIFY_IMPORT
+static int import_events(gm_import_batch_t *batch, int fd);
+#endif
+
+/* send all files from the import directory, keep watching in daemon mode */
+int run_importer() {
+    gm_import_batch_t batch;
+    struct pollfd pfd;
+    time_t next_scan = 0;
+    int x, timeout;
+#ifdef GM_INOTIFY_IMPORT
+    int fd = -1;
+#endif
+
+    gm_log( GM_LOG_TRACE, "run_importer()\n" );
+
+    batch.size        = mod_gm_opt->bulk_size > 0 ? mod_gm_opt->bulk_size : GM_IMPORT_DEFAULT_BATCH;
+    batch.results     = gm_malloc(batch.size * sizeof(char *));
+    batch.result_file = gm_malloc(batch.size * sizeof(int));
+    /* every queued file has results in the batch, except the one being read and one left from the last flush */
+    batch.files       = gm_malloc((batch.size + 2) * sizeof(gm_import_file_t));
+    batch.num         = 0;
+    batch.file_num    = 0;
+
+    /* one pass over the directory, replaces a cron job */
+    if(mod_gm_opt->daemon_mode != GM_ENABLED) {
+        import_scan(&batch);
+        import_flush(&batch);
+    }
+    else {
+        mod_gm_opt->logmode = GM_LOG_MODE_STDOUT;
+        setvbuf(stdout, NULL, _IOLBF, 0);
+        signal(SIGTERM, import_sighandler);
+        signal(SIGINT,  import_sighandler);
+
+        pfd.fd     = -1;
+        pfd.events = POLLIN;
+#ifdef GM_INOTIFY_IMPORT
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(fd < 0 || inotify_add_watch(fd, mod_gm_opt->import_dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            gm_log( GM_LOG_ERROR, "cannot watch %s: %s\n", mod_gm_opt->import_dir, strerror(errno) );
+            if(fd >= 0)
+                close(fd);
+            free(batch.results);
+            free(batch.result_file);
+            free(batch.files);
+            return(STATE_UNKNOWN);
+        }
+        pfd.fd = fd;
+#endif
+        gm_log( GM_LOG_INFO, "importing results from %s, batch: %d results\n", mod_gm_opt->import_dir, batch.size );
+
+        while(import_running) {
+            /* retry failed files as soon as the pause is over */
+            if(import_paused_until > 0 && time(NULL) >= import_paused_until) {
+                import_paused_until = 0;
+                next_scan = 0;
+            }
+            if(time(NULL) >= next_scan) {
+                import_scan(&batch);
+                import_flush(&batch);
+                next_scan = time(NULL) + (pfd.fd >= 0 ? GM_IMPORT_RESCAN_INTERVAL : GM_IMPORT_POLL_INTERVAL);
+            }
+
+            timeout = ((import_paused_until > 0 && import_paused_until < next_scan ? import_paused_until : next_scan) - time(NULL)) * 1000;
+            if(poll(&pfd, pfd.fd >= 0 ? 1 : 0, timeout > 0 ? timeout : 0) < 0) {
+                if(errno == EINTR)
+                    continue;
+                gm_log( GM_LOG_ERROR, "poll failed: %s\n", strerror(errno) );
+                break;
+            }
+#ifdef GM_INOTIFY_IMPORT
+            if(pfd.revents & POLLIN) {
+                /* missed events, fall back to a full scan */
+                if(import_events(&batch, fd) != GM_OK)
+                    next_scan = 0;
+                import_flush(&batch);
+            }
+#endif
+        }
+#ifdef GM_INOTIFY_IMPORT
+        close(fd);
+#endif
+        gm_log( GM_LOG_INFO, "sent: %d, failed: %d\n", results_sent, results_failed );
+    }
+
+    for(x = 0; x < batch.file_num; x++) {
+        import_close_retry(&batch.files[x], FALSE);
+        free(batch.files[x].path);
+    }
+    free(batch.results);
+    free(batch.result_file);
+    free(batch.files);
+
+    if(mod_gm_opt->daemon_mode != GM_ENABLED) {
+        printf("%d data packet(s) sent to host successfully.\n", results_sent);
+        if(results_failed > 0) {
+            printf("%d data packet(s) failed.\n", results_failed);
+            return(STATE_UNKNOWN);
+        }
+    }
+    return(STATE_OK);
+}
+
+
+/* stop watching */
+static void import_sighandler(int sig) {
+    (void)sig;
+    import_running = FALSE;
+}
+
+
+/* read all files of the import directory, in name order */
+static int import_scan(gm_import_batch_t *batch) {
+    struct dirent **list;
+    struct stat st;
+    char * path;
+    time_t now = time(NULL);
+    int num, x, len, files = 0;
+
+    if(now < import_paused_until)
+        return(0);
+
+    num = scandir(mod_gm_opt->import_dir, &list, import_filter, alphasort);
+    if(num < 0) {
+        gm_log( GM_LOG_ERROR, "cannot read %s: %s\n", mod_gm_opt->import_dir, strerror(errno) );
+        return(0);
+    }
+    for(x = 0; x < num; x++) {
+        len  = strlen(mod_gm_opt->import_dir) + strlen(list[x]->d_name) + 2;
+        path = gm_malloc(len);
+        snprintf(path, len, "%s/%s", mod_gm_opt->import_dir, list[x]->d_name);
+
+        /* marker files without their checkresult file are left over */
+        if(len > 4 && !strcmp(path + len - 4, ".ok")) {
+            path[len-4] = '\0';
+            if(access(path, F_OK) != 0) {
+                path[len-4] = '.';
+                unlink(path);
+            }
+        }
+        /* files written right now are picked up by the next event or scan */
+        else if(time(NULL) >= import_paused_until
+                && stat(path, &st) == 0 && S_ISREG(st.st_mode) && st.st_mtime < now) {
+            if(import_file(batch, path) >= 0)
+                files++;
+        }
+        free(path);
+        free(list[x]);
+    }
+    free(list);
+    gm_log( GM_LOG_DEBUG, "scanned %s: %d file(s)\n", mod_gm_opt->import_dir, files );
+    return(files);
+}
+
+
+#ifdef GM_INOTIFY_IMPORT
+/* read files announced by inotify, returns GM_ERROR if events were lost */
+static int import_events(gm_import_batch_t *batch, int fd) {
+    char buffer[GM_BUFFERSIZE] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    struct dirent entry;
+    char * path;
+    ssize_t n;
+    char * ptr;
+    int len, rc = GM_OK;
+
+    while((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        for(ptr = buffer; ptr < buffer + n; ptr += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *)ptr;
+            if(event->mask & IN_Q_OVERFLOW)
+                rc = GM_ERROR;
+            if(event->len == 0 || strlen(event->name) >= sizeof(entry.d_name))
+                continue;
+            strcpy(entry.d_name, event->name);
+            if(!import_filter(&entry))
+                continue;
+
+            /* paused after errors, the next scan picks the file up */
+            if(time(NULL) < import_paused_until)
+                continue;
+
+            len  = strlen(mod_gm_opt->import_dir) + strlen(event->name) + 2;
+            path = gm_malloc(len);
+            snprintf(path, len, "%s/%s", mod_gm_opt->import_dir, event->name);
+            if(len > 4 && !strcmp(path + len - 4, ".ok")) {
+                /* checkresult files are skipped until their marker exists */
+                path[len-4] = '\0';
+                if(access(path, F_OK) != 0) {
+                    path[len-4] = '.';
+                    unlink(path);
+                } else {
+                    import_file(batch, path);
+                }
+            } else {
+                import_file(batch, path);
+            }
+            free(path);
+        }
+    }
+    return(rc);
+}
+#endif
+
+
+/* read all results of a file into the batch, sends full batches */
+int import_file(gm_import_batch_t *batch, char *path) {
+    gm_import_file_t *file;
+    FILE * fp;
+    char * line = NULL;
+    char * key;
+    size_t size = 0;
+    ssize_t len;
+    int format = GM_IMPORT_FORMAT_UNKNOWN;
+    int active = mod_gm_opt->active;
+    int have_host = FALSE;
+    int results = 0;
+
+    fp = fopen(path, "r");
+    if(fp == NULL) {
+        /* already sent, happens when an event and a scan see the same file */
+        if(errno != ENOENT)
+            gm_log( GM_LOG_ERROR, "cannot read %s: %s\n", path, strerror(errno) );
+        return(-1);
+    }
+
+    file = &batch->files[batch->file_num++];
+    file->path     = gm_strdup(path);
+    file->results  = 0;
+    file->failed   = 0;
+    file->complete = FALSE;
+    file->retry    = NULL;
+    import_reset_result(active);
+
+    while((len = getline(&line, &size, fp)) > 0) {
+        if(line[len-1] == '\n')
+            line[--len] = '\0';
+        if(len > 0 && line[len-1] == '\r')
+            line[--len] = '\0';
+        if(len == 0 || line[0] == '#')
+            continue;
+
+        /* checkresult files consist of key=value lines */
+        if(format == GM_IMPORT_FORMAT_UNKNOWN) {
+            for(key = line; *key == '_' || (*key >= 'a' && *key <= 'z'); key++)
+                ;
+            format = (*key == '=' && key != line) ? GM_IMPORT_FORMAT_CHECKRESULT : GM_IMPORT_FORMAT_LINE;
+            if(format == GM_IMPORT_FORMAT_CHECKRESULT && !import_has_marker(path))
+                break;
+        }
+
+        if(format == GM_IMPORT_FORMAT_LINE) {
+            if(parse_result_line(line) == GM_OK) {
+                import_add_result(batch);
+                results++;
+                import_reset_result(active);
+            }
+            continue;
+        }
+
+        /* every host_name starts a new result */
+        if(!strncmp(line, "host_name=", 10)) {
+            if(have_host) {
+                import_add_result(batch);
+                results++;
+                import_reset_result(active);
+            }
+            have_host = TRUE;
+        }
+        parse_checkresult_line(line);
+    }
+    if(have_host) {
+        import_add_result(batch);
+        results++;
+        import_reset_result(active);
+    }
+    free(line);
+    fclose(fp);
+    mod_gm_opt->active = active;
+
+    /* core writes the .ok marker once a checkresult file is complete, until then it may be partial or empty */
+    if(format != GM_IMPORT_FORMAT_LINE && !import_has_marker(path)) {
+        gm_log( GM_LOG_DEBUG, "skipping %s until its .ok marker exists\n", path );
+        import_reset_result(active);
+        free(file->path);
+        batch->file_num--;
+        return(-1);
+    }
+
+    /* the file may have moved to another slot while sending full batches */
+    file = &batch->files[batch->file_num-1];
+    file->complete = TRUE;
+
+    /* cannot be sent ever, keep it for inspection but do not try again */
+    if(results == 0) {
+        char * invalid = gm_malloc(strlen(path) + 9);
+        sprintf(invalid, "%s.invalid", path);
+        gm_log( GM_LOG_ERROR, "no results found in %s, renamed to %s\n", path, invalid );
+        rename(path, invalid);
+        free(invalid);
+        free(file->path);
+        batch->file_num--;
+    }
+    return(results);
+}
+
+
+/* store a key=value line of a checkresult file in the options */
+int parse_checkresult_line(char *line) {
+    char * value = strchr(line, '=');
+
+    if(value == NULL)
+        return(GM_ERROR);
+    *value++ = '\0';
+
+    if(!strcmp(line, "host_name")) {
+        free(mod_gm_opt->host);
+        mod_gm_opt->host = gm_strdup(value);
+    }
+    else if(!strcmp(line, "service_description")) {
+        free(mod_gm_opt->service);
+        mod_gm_opt->service = gm_strdup(value);
+    }
+    else if(!strcmp(line, "output")) {
+        free(mod_gm_opt->message);
+        mod_gm_opt->message = gm_strdup(import_unescape(value));
+    }
+    else if(!strcmp(line, "return_code")) {
+        mod_gm_opt->return_code = atoi(value);
+    }
+    else if(!strcmp(line, "check_type")) {
+        mod_gm_opt->active = atoi(value) == 0 ? GM_ENABLED : GM_DISABLED;
+    }
+    else if(!strcmp(line, "start_time")) {
+        string2timeval(value, &mod_gm_opt->starttime);
+        mod_gm_opt->has_starttime = TRUE;
+    }
+    else if(!strcmp(line, "finish_time")) {
+        string2timeval(value, &mod_gm_opt->finishtime);
+        mod_gm_opt->has_finishtime = TRUE;
+    }
+    else if(!strcmp(line, "latency")) {
+        string2timeval(value, &mod_gm_opt->latency);
+        mod_gm_opt->has_latency = TRUE;
+    }
+    else {
+        return(GM_ERROR);
+    }
+    return(GM_OK);
+}
+
+
+/* queue the result from the options for the current file */
+static void import_add_result(gm_import_batch_t *batch) {
+    if(mod_gm_opt->message == NULL)
+        mod_gm_opt->message = gm_strdup("");
+    batch->result_file[batch->num] = batch->file_num - 1;
+    batch->results[batch->num++]   = build_result();
+    batch->files[batch->file_num-1].results++;
+    if(batch->num >= batch->size)
+        import_flush(batch);
+}
+
+
+/* forget the previous result */
+static void import_reset_result(int active) {
+    free(mod_gm_opt->host);
+    free(mod_gm_opt->service);
+    free(mod_gm_opt->message);
+    mod_gm_opt->host           = NULL;
+    mod_gm_opt->service        = NULL;
+    mod_gm_opt->message        = NULL;
+    mod_gm_opt->return_code    = 0;
+    mod_gm_opt->active         = active;
+    mod_gm_opt->has_starttime  = FALSE;
+    mod_gm_opt->has_finishtime = FALSE;
+    mod_gm_opt->has_latency    = FALSE;
+}
+
+
+/* send the batch and remove all completely sent files */
+int import_flush(gm_import_batch_t *batch) {
+    int * failed_results;
+    int failed = 0;
+    int x, keep = 0;
+
+    if(batch->num > 0) {
+        failed_results = gm_malloc(batch->num * sizeof(int));
+        failed = send_bulk_results(batch->results, batch->num, failed_results);
+        for(x = 0; x < batch->num; x++) {
+            if(failed_results[x])
+                import_keep_result(&batch->files[batch->result_file[x]], batch->results[x]);
+            free(batch->results[x]);
+        }
+        free(failed_results);
+        results_sent   += batch->num - failed;
+        results_failed += failed;
+        batch->num      = 0;
+
+        /* give gearmand some time, files stay in place until then */
+        if(failed > 0) {
+            import_paused_until = time(NULL) + GM_IMPORT_RESCAN_INTERVAL;
+            gm_log( GM_LOG_ERROR, "%d result(s) could not be sent: %s\n", failed, gearman_client_error(&client) );
+        }
+    }
+
+    /* only the file currently read can be incomplete */
+    for(x = 0; x < batch->file_num; x++) {
+        gm_import_file_t *file = &batch->files[x];
+        if(!file->complete) {
+            batch->files[keep++] = *file;
+            continue;
+        }
+        if(file->failed == 0) {
+            unlink(file->path);
+            import_remove_marker(file->path);
+        } else if(import_close_retry(file, TRUE) == GM_OK) {
+            gm_log( GM_LOG_DEBUG, "rewrote %s with %d of %d result(s) which failed\n", file->path, file->failed, file->results );
+        } else {
+            gm_log( GM_LOG_DEBUG, "keeping %s, %d of %d result(s) failed\n", file->path, file->failed, file->results );
+        }
+        free(file->path);
+    }
+    batch->file_num = keep;
+    return(failed);
+}
+
+
+/* write a result which could not be sent to the retry file of its file */
+static void import_keep_result(gm_import_file_t *file, char *result) {
+    char * tmp;
+    char * host;
+    char * rest;
+
+    if(file->failed++ == 0) {
+        tmp = gm_malloc(strlen(file->path) + 5);
+        sprintf(tmp, "%s.tmp", file->path);
+        file->retry = fopen(tmp, "w");
+        if(file->retry == NULL)
+            gm_log( GM_LOG_ERROR, "cannot write %s: %s\n", tmp, strerror(errno) );
+        free(tmp);
+    }
+    if(file->retry == NULL)
+        return;
+
+    /* results are split at host_name, so the type has to follow it as check_type */
+    host = strchr(result, '\n');
+    rest = host != NULL ? strchr(host + 1, '\n') : NULL;
+    if(strncmp(result, "type=", 5) || rest == NULL) {
+        fprintf(file->retry, "%s\n", result);
+        return;
+    }
+    fprintf(file->retry, "%.*s\ncheck_type=%d\n%s", (int)(rest - host - 1), host + 1, strncmp(result, "type=passive", 12) ? 0 : 1, rest + 1);
+}
+
+
+/* close the retry file, either replace the original file with it or drop it */
+static int import_close_retry(gm_import_file_t *file, int replace) {
+    char * tmp;
+    char * marker;
+    FILE * fp;
+    int rc = GM_ERROR;
+
+    if(file->retry == NULL)
+        return(GM_ERROR);
+
+    tmp = gm_malloc(strlen(file->path) + 5);
+    sprintf(tmp, "%s.tmp", file->path);
+    if(ferror(file->retry))
+        replace = FALSE;
+    if(fclose(file->retry) != 0)
+        replace = FALSE;
+    file->retry = NULL;
+
+    if(replace) {
+        /* the retry file is a checkresult file, which is only read with its marker */
+        marker = gm_malloc(strlen(file->path) + 4);
+        sprintf(marker, "%s.ok", file->path);
+        fp = fopen(marker, "a");
+        if(fp != NULL && fclose(fp) == 0 && rename(tmp, file->path) == 0)
+            rc = GM_OK;
+        else
+            gm_log( GM_LOG_ERROR, "cannot replace %s: %s\n", file->path, strerror(errno) );
+        free(marker);
+    }
+    if(rc != GM_OK)
+        unlink(tmp);
+    free(tmp);
+    return(rc);
+}
+
+
+/* undo the newline escaping of checkresult files in place, build_result escapes again */
+static char * import_unescape(char *text) {
+    char *src, *dst;
+    for(src = text, dst = text; *src != '\0'; src++) {
+        if(*src == '\\' && src[1] == 'n') {
+            *dst++ = '\n';
+            src++;
+        }
+        else if(*src == '\\' && src[1] == '\\') {
+            *dst++ = '\\';
+            src++;
+        }
+        else {
+            *dst++ = *src;
+        }
+    }
+    *dst = '\0';
+    return(text);
+}
+
+
+/* does the .ok marker core writes next to complete checkresult files exist */
+static int import_has_marker(char *path) {
+    char * marker = gm_malloc(strlen(path) + 4);
+    int rc;
+    sprintf(marker, "%s.ok", path);
+    rc = access(marker, F_OK) == 0;
+    free(marker);
+    return(rc);
+}
+
+
+/* remove the .ok marker core writes next to checkresult files */
+static void import_remove_marker(char *path) {
+    char * marker = gm_malloc(strlen(path) + 4);
+    sprintf(marker, "%s.ok", path);
+    unlink(marker);
+    free(marker);
+}
+
+
+/* skip hidden, temporary, invalid and marker files */
+static int import_filter(const struct dirent *entry) {
+    int len = strlen(entry->d_name);
+    if(entry->d_name[0] == '.')
+        return(FALSE);
+    if(len > 4 && !strcmp(entry->d_name + len - 4, ".tmp"))
+        return(FALSE);
+    if(len > 8 && !strcmp(entry->d_name + len - 8, ".invalid"))
+        return(FALSE);
+    return(TRUE);
+}
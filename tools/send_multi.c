@@ -199,90 +199,38 @@ void print_usage() {
 }
 
 
-/* send message to job server */
-int send_result() {
-    char * buf;
-    char temp_buffer1[GM_BUFFERSIZE];
-    char temp_buffer2[GM_BUFFERSIZE];
+/* send all child results with a single round trip */
+int send_results(char ** results, int num) {
+    int * failed_jobs;
+    int failed = 0;
+    int x, batch;
 
-    gm_log( GM_LOG_TRACE, "send_result()\n" );
+    gm_log( GM_LOG_TRACE, "send_results(%d)\n", num );
 
     if(mod_gm_opt->result_queue == NULL) {
         printf( "got no result queue, please use --result_queue=...\n" );
-        return(GM_ERROR);
+        return(num);
     }
+    if(num == 0)
+        return(0);
 
-    /* escape newline */
-    buf = gm_escape_newlines(mod_gm_opt->message, GM_DISABLED);
-    free(mod_gm_opt->message);
-    mod_gm_opt->message = gm_malloc(GM_BUFFERSIZE);
-    snprintf(mod_gm_opt->message, GM_BUFFERSIZE, "%s", buf);
-    free(buf);
-
-    gm_log( GM_LOG_TRACE, "queue: %s\n", mod_gm_opt->result_queue );
-    temp_buffer1[0]='\x0';
-    snprintf( temp_buffer1, sizeof( temp_buffer1 )-1, "type=%s\nhost_name=%s\nstart_time=%lf\nfinish_time=%lf\nreturn_code=%i\nsource=send_multi\n",
-              mod_gm_opt->active == GM_ENABLED ? "active" : "passive",
-              mod_gm_opt->host,
-              timeval2double(&mod_gm_opt->starttime),
-              timeval2double(&mod_gm_opt->finishtime),
-              mod_gm_opt->return_code
-            );
-
-    if(mod_gm_opt->service != NULL) {
-        temp_buffer2[0]='\x0';
-        strncat(temp_buffer2, "service_description=", (sizeof(temp_buffer2)-1));
-        strncat(temp_buffer2, mod_gm_opt->service, (sizeof(temp_buffer2)-1));
-        strncat(temp_buffer2, "\n", (sizeof(temp_buffer2)-1));
-        strncat(temp_buffer1, temp_buffer2, (sizeof(temp_buffer1)-1));
-    }
-
-    if(mod_gm_opt->message != NULL) {
-        temp_buffer2[0]='\x0';
-        strncat(temp_buffer2, "output=", (sizeof(temp_buffer2)-1));
-        strncat(temp_buffer2, mod_gm_opt->message, (sizeof(temp_buffer2)-1));
-        strncat(temp_buffer2, "\n", (sizeof(temp_buffer2)-1));
-        strncat(temp_buffer1, temp_buffer2, (sizeof(temp_buffer1)-1));
-    }
-    strncat(temp_buffer1, "\n", (sizeof(temp_buffer1)-2));
-
-    gm_log( GM_LOG_TRACE, "data:\n%s\n", temp_buffer1);
-
-    if(add_job_to_queue( &client,
-                         mod_gm_opt->server_list,
-                         mod_gm_opt->result_queue,
-                         NULL,
-                         temp_buffer1,
-                         GM_JOB_PRIO_NORMAL,
-                         GM_DEFAULT_JOB_RETRIES,
-                         mod_gm_opt->transportmode,
-                         TRUE
-                        ) == GM_OK) {
-        gm_log( GM_LOG_TRACE, "send_result_back() finished successfully\n" );
+    /* one round trip, very large inputs are split to limit the memory used by pending tasks */
+    failed_jobs = gm_malloc(GM_MAX_BULK_SIZE * sizeof(int));
+    for(x = 0; x < num; x += GM_MAX_BULK_SIZE) {
+        batch   = num - x < GM_MAX_BULK_SIZE ? num - x : GM_MAX_BULK_SIZE;
+        failed += add_jobs_to_queue( &client, mod_gm_opt->server_list, mod_gm_opt->result_queue, results+x, batch,
+                                     GM_JOB_PRIO_NORMAL, mod_gm_opt->transportmode, failed_jobs );
 
         if( mod_gm_opt->dupserver_num ) {
-            if(add_job_to_queue( &client,
-                                 mod_gm_opt->dupserver_list,
-                                 mod_gm_opt->result_queue,
-                                 NULL,
-                                 temp_buffer1,
-                                 GM_JOB_PRIO_NORMAL,
-                                 GM_DEFAULT_JOB_RETRIES,
-                                 mod_gm_opt->transportmode,
-                                 TRUE
-                        ) == GM_OK) {
-                gm_log( GM_LOG_TRACE, "send_result_back() finished successfully for duplicate server.\n" );
-            }
-            else {
-                gm_log( GM_LOG_TRACE, "send_result_back() finished unsuccessfully for duplicate server\n" );
+            if(add_jobs_to_queue( &client_dup, mod_gm_opt->dupserver_list, mod_gm_opt->result_queue, results+x, batch,
+                                  GM_JOB_PRIO_NORMAL, mod_gm_opt->transportmode, failed_jobs ) > 0) {
+                gm_log( GM_LOG_TRACE, "send_results() finished unsuccessfully for duplicate server\n" );
             }
         }
     }
-    else {
-        gm_log( GM_LOG_TRACE, "send_result_back() finished unsuccessfully\n" );
-        return(GM_ERROR);
-    }
-    return(GM_OK);
+    gm_log( GM_LOG_TRACE, "send_results() %d of %d results failed\n", failed, num );
+    free(failed_jobs);
+    return(failed);
 }
 
 /* called when check runs into timeout */
@@ -302,224 +250,45 @@ void print_version() {
     exit( STATE_UNKNOWN );
 }
 
+/* read xml data from stream and send all child checks */
 int read_multi_stream(FILE *stream) {
-    char buffer[GM_BUFFERSIZE+1];
-    unsigned long buflen=0L;
-    unsigned long bytes_read=0L;
-    char *bufstart=NULL;
-    char *bufend=NULL;
-    int count=0;
-    struct timeval end_time;
+    char buffer[GM_BUFFERSIZE];
+    gm_multi_parser_t parser;
+    size_t bytes_read;
+    int count, x;
 
-    gettimeofday(&end_time, NULL);
+    memset(&parser, 0, sizeof(parser));
+    gettimeofday(&parser.end_time, NULL);
 
     do {
-        /* opening tag <CHILD> found? read from buffer start with maximum buffer len */
-        if ((bufstart=(char *)memmem(buffer,buflen,"<CHILD>",strlen("<CHILD>"))) != NULL) {
-
-            /* closing tag </CHILD> found? read after <CHILD> with rest of buffer len */
-            if ((bufend=(char *)memmem(bufstart,buflen-(bufstart-buffer),"</CHILD>",strlen("</CHILD>"))) != NULL) {
-
-                gm_log( GM_LOG_TRACE, "\tXML chunk %d found: buffer position %3d-%3d length %d bytes\n", count, bufstart-buffer, bufend-buffer, bufend-bufstart);
-                /* count valid chunks */
-                count++;
-
-                /* identify CHILD chunk */
-                bufstart+=strlen("<CHILD>");
-
-                /* if valid check_multi chunk found, send the result*/
-                if (read_child_check(bufstart,bufend,&end_time)) {
-                    if (send_result() == GM_ERROR) {
-                        count--;
-                    }
-                } else {
-                    count--;
-                }
-
-                /* shift input rest to buffer start, create space for subsequent reads */
-                memmove(buffer,bufend+strlen("</CHILD>"),buflen-(bufend+strlen("</CHILD>")-buffer));
-                buflen-=bufend+strlen("</CHILD>")-buffer;
-
-            /* start <CHILD> tag found, but no closing tag </CHILD>, buffer too small? */
-            } else {
-                buflen=0L;
-                printf("send_multi UNKNOWN: no closing tag </CHILD> within buffer, buffer size too small? discarding buffer, %ld bytes now\n", buflen);
-                return -STATE_UNKNOWN;
-            }
-            gm_log( GM_LOG_TRACE, "\tbuflen after XML chunk parsing:%ld\n", buflen);
-
-        /* neither <CHILD> nor </CHILD> found, discard buffer */
-        } else {
-
-            /* no chunks found? then check for message in STDIN */
-            if (!count) {
-                unsigned long i;
-                /* check buffer for ASCII characters */
-                for (i=0; i<buflen && buffer[i] && isascii(buffer[i]); i++)
-                    ;
-                /* ASCIIZ string? then print messages */
-                if (buffer[i] == '\0' && i) {
-                    printf("send_multi UNKNOWN: error msg in input buffer: %s\n", buffer);
-                    return -STATE_UNKNOWN;
-                }
-            }
-
-            /* discard whole buffer but continue */
-            buflen=0L;
-            gm_log( GM_LOG_TRACE, "Error: no starting tag <CHILD> within buffer - discarding buffer, buflen now %ld bytes\n", buflen);
-        }
-
-        gm_log( GM_LOG_TRACE, "\ttrying to fill up buffer with %ld bytes from offset %ld\n", GM_BUFFERSIZE-buflen, buflen);
-
-        /* read one block of data, or less bytes, if there is still data left */
+        /* read one block of data */
         alarm(mod_gm_opt->timeout);
-        if ((bytes_read=fread(buffer+buflen, 1, GM_BUFFERSIZE-buflen, stream)) == 0L) {
-
-            /* break if zero read was caused by an error */
-            if (!feof(stream)) {
-                perror("fread");
-                return -STATE_CRITICAL;
-            }
-        } else {
-
-            /* adjust block len */
-            buflen+=bytes_read;
-        }
-        gm_log( GM_LOG_TRACE, "\tread %ld bytes, %ld bytes remaining in buffer\n", bytes_read, buflen);
-    } while (buflen > 0);
-    buffer[buflen] = '\0';
-    return count;
-}
-
-int read_child_check(char *bufstart, char *bufend, struct timeval * end_time) {
-    char *attribute  = NULL;
-    char *attribute2 = NULL;
-    char *attribute3 = NULL;
-    char *error      = NULL;
-    char temp_buffer[GM_BUFFERSIZE];
-    double end_time_d;
-    struct timeval start_time;
-
-    /* child check number */
-    if ((attribute=read_multi_attribute(bufstart,bufend,"no")) == NULL) {
-        return 0;
-    } else {
-        /* skip parent check */
-        if (!strcmp(attribute,"0")) {
-            return 0;
+        bytes_read = fread(buffer, 1, sizeof(buffer), stream);
+        if(bytes_read == 0 && ferror(stream)) {
+            perror("fread");
+            free_multi_parser(&parser);
+            return -STATE_CRITICAL;
         }
-        gm_log( GM_LOG_TRACE, "child check: %d\n", atoi(attribute));
-    }
-
-    /* service description */
-    if ((attribute=read_multi_attribute(bufstart,bufend,"name")) == NULL)
-        return 0;
-    mod_gm_opt->service=gm_strdup(attribute);
-    gm_log( GM_LOG_TRACE, "service_description: %s\n", mod_gm_opt->service);
-
-    /* return code */
-    if ((attribute=read_multi_attribute(bufstart,bufend,"rc")) == NULL)
-        return 0;
-    mod_gm_opt->return_code=atoi(attribute);
-    gm_log( GM_LOG_TRACE, "mod_gm_opt->return_code: %d\n", mod_gm_opt->return_code);
-
-    /* runtime */
-    if ((attribute=read_multi_attribute(bufstart,bufend,"runtime")) == NULL)
-        return 0;
-    end_time_d   = timeval2double(end_time);
-    double2timeval(end_time_d - atof(attribute), &start_time);
-
-    mod_gm_opt->starttime.tv_sec  = start_time.tv_sec;
-    mod_gm_opt->starttime.tv_usec = start_time.tv_usec;
-    gm_log( GM_LOG_TRACE, "starttime: %lf\n", timeval2double(&mod_gm_opt->starttime));
-
-    /* end time is the execution time of send_multi itself */
-    mod_gm_opt->finishtime.tv_sec  = end_time->tv_sec;
-    mod_gm_opt->finishtime.tv_usec = end_time->tv_usec;
-    gm_log( GM_LOG_TRACE, "endtime: %lf\n", timeval2double(&mod_gm_opt->finishtime));
-
-    /* message */
-    if ((attribute=read_multi_attribute(bufstart,bufend,"output")) == NULL)
-        return 0;
-
-    /* stderr */
-    if ((error=read_multi_attribute(bufstart,bufend,"error")) == NULL) {
-        return 0;
-    /* if error found: 'error' -> ' [error]' */
-    } else if (*error) {
-        *(--error)='[';
-        *(--error)=' ';
-        strcat(error,"]");
-    }
-
-    /* performance data with multi headers */
-    if ((attribute2=read_multi_attribute(bufstart,bufend,"performance")) == NULL) {
-        snprintf( temp_buffer, sizeof( temp_buffer )-1, "%s%s", decode_xml(attribute), decode_xml(error));
-    } else if ((attribute3=read_multi_attribute(bufstart,bufend,"pplugin")) == NULL) {
-        return 0;
-    } else {
-        attribute2 = trim(attribute2);
-        attribute2 = decode_xml(attribute2);
-
-        /* do we have a single quote performance label?
-           then single quote the whole multi header */
-        if (*attribute2 == '\'') {
-            attribute2++;
-            snprintf( temp_buffer, sizeof( temp_buffer )-1, "%s%s|\'%s::%s::%s", decode_xml(attribute), decode_xml(error), mod_gm_opt->service, decode_xml(attribute3), decode_xml(attribute2));
-        /* normal header without single quotes */
-        } else {
-            snprintf( temp_buffer, sizeof( temp_buffer )-1, "%s%s|%s::%s::%s", decode_xml(attribute), decode_xml(error), mod_gm_opt->service, decode_xml(attribute3), decode_xml(attribute2));
+        gm_log( GM_LOG_TRACE, "\tread %ld bytes\n", bytes_read);
+        parse_multi_data(&parser, buffer, bytes_read);
+    } while(bytes_read > 0);
+    alarm(0);
+
+    /* no xml at all, check_multi printed an error message instead */
+    if(parser.num == 0 && parser.tags == 0 && parser.preview_len > 0) {
+        parser.preview[parser.preview_len] = '\0';
+        for(x = 0; x < parser.preview_len && isascii(parser.preview[x]); x++)
+            ;
+        if(x == parser.preview_len) {
+            printf("send_multi UNKNOWN: error msg in input buffer: %s\n", parser.preview);
+            free_multi_parser(&parser);
+            return -STATE_UNKNOWN;
         }
     }
-    mod_gm_opt->message=gm_strdup(temp_buffer);
-    gm_log( GM_LOG_TRACE, "mod_gm_opt->message: %s\n", mod_gm_opt->message);
-
-    return 1;
-}
 
-char *read_multi_attribute(char *bufstart, char *bufend, char *element) {
-    char start_element[GM_BUFFERSIZE], end_element[GM_BUFFERSIZE];
-    sprintf(start_element, "<%s>", element);
-    sprintf(end_element, "</%s>", element);
-
-    if ((bufstart=(char *)memmem(bufstart,bufend-bufstart,start_element,strlen(start_element))) == NULL) {
-        gm_log( GM_LOG_TRACE, "\tread_multi_attribute: start element \'%s\' not found\n", start_element);
-        return NULL;
-    }
-    bufstart+=strlen(start_element);
-    if ((bufend=(char *)memmem(bufstart,bufend-bufstart,end_element,strlen(end_element))) == NULL) {
-        gm_log( GM_LOG_TRACE, "\tread_multi_attribute: end element \'%s\' not found\n", end_element);
-        return NULL;
-    }
-    *bufend='\0';
-    return bufstart;
-}
-
-char *decode_xml(char *string) {
-    struct decode{
-            char c;
-            char *enc_string;
-    } dtab[] = {
-            { '>',  "&gt;"   },
-            { '<',  "&lt;"   },
-            { '&',  "&amp;"  },
-            { '\'', "&#039;" },
-            { '|',  "&#124;" },
-    };
-    int i;
-    char *found;
-
-    /* foreach XML decode pair */
-    for (i=0; i<(int)(sizeof(dtab)/sizeof(struct decode)); i++) {
-    /* while XML encoding strings found */
-        while ((found=strstr(string, dtab[i].enc_string)) != NULL) {
-            /* replace string with character */
-            *found=dtab[i].c;
-            /* shift rest of string after character */
-            strcpy(found+1, found+strlen(dtab[i].enc_string));
-        }
-    }
-    return string;
+    count = parser.num - send_results(parser.results, parser.num);
+    free_multi_parser(&parser);
+    return count;
 }
 
 
@@ -0,0 +1,283 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ * Copyright (c) 2010 Matthias Flacke - matthias.flacke@gmx.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+/* include header */
+#include "send_multi_parser.h"
+#include "utils.h"
+
+/* feed a chunk of xml into the parser, children are collected as soon as they are complete */
+void parse_multi_data(gm_multi_parser_t *p, const char *data, size_t len) {
+    const char *end = data + len;
+    const char *next;
+    int x;
+
+    /* keep the start of the input for error messages */
+    if(p->tags == 0 && p->preview_len < GM_MULTI_PREVIEW_SIZE) {
+        x = (int)len < GM_MULTI_PREVIEW_SIZE - p->preview_len ? (int)len : GM_MULTI_PREVIEW_SIZE - p->preview_len;
+        memcpy(p->preview + p->preview_len, data, x);
+        p->preview_len += x;
+    }
+
+    while(data < end) {
+        if(!p->in_tag) {
+            /* copy text up to the next tag in one go */
+            next = memchr(data, '<', end - data);
+            if(next == NULL)
+                next = end;
+            if(p->field >= 0)
+                append_multi_value(p, p->field, data, next - data);
+            data = next;
+            if(data < end) {
+                p->in_tag  = TRUE;
+                p->tag_len = 0;
+                data++;
+            }
+            continue;
+        }
+
+        /* collect the tag name, attributes are not used */
+        next = memchr(data, '>', end - data);
+        if(next == NULL)
+            next = end;
+        x = next - data;
+        if(p->tag_len + x > GM_MULTI_TAG_SIZE - 1)
+            x = GM_MULTI_TAG_SIZE - 1 - p->tag_len;
+        memcpy(p->tag + p->tag_len, data, x);
+        p->tag_len += x;
+        data = next;
+        if(data < end) {
+            p->tag[p->tag_len] = '\0';
+            p->in_tag = FALSE;
+            handle_multi_tag(p);
+            data++;
+        }
+    }
+}
+
+
+/* open or close a child or one of its fields */
+void handle_multi_tag(gm_multi_parser_t *p) {
+    static const char *fields[GM_MULTI_FIELDS] = { "no", "name", "rc", "runtime", "output", "error", "performance", "pplugin" };
+    char *name = p->tag;
+    char *result;
+    int closing = FALSE, empty = FALSE;
+    int x;
+
+    p->tags++;
+    if(*name == '/') {
+        closing = TRUE;
+        name++;
+    }
+    if(p->tag_len > 0 && p->tag[p->tag_len-1] == '/') {
+        empty = TRUE;
+        p->tag[p->tag_len-1] = '\0';
+    }
+    name[strcspn(name, " \t\r\n")] = '\0';
+
+    if(!strcmp(name, "CHILD")) {
+        if(!closing) {
+            p->in_child = TRUE;
+            p->field    = -1;
+            for(x = 0; x < GM_MULTI_FIELDS; x++) {
+                p->found[x]     = FALSE;
+                p->value_len[x] = 0;
+            }
+        }
+        else if(p->in_child) {
+            p->in_child = FALSE;
+            p->field    = -1;
+            result = build_child_result(p);
+            if(result != NULL) {
+                if(p->num == p->size) {
+                    p->size    = p->size == 0 ? 64 : p->size * 2;
+                    p->results = gm_realloc(p->results, p->size * sizeof(char *));
+                }
+                p->results[p->num++] = result;
+            }
+        }
+        return;
+    }
+
+    /* nested elements are part of the field value, not handled */
+    if(!p->in_child)
+        return;
+    if(closing) {
+        if(p->field >= 0 && !strcmp(name, fields[p->field]))
+            p->field = -1;
+        return;
+    }
+    if(p->field >= 0)
+        return;
+    for(x = 0; x < GM_MULTI_FIELDS; x++) {
+        if(!strcmp(name, fields[x])) {
+            p->found[x]     = TRUE;
+            p->value_len[x] = 0;
+            append_multi_value(p, x, "", 0);
+            if(!empty)
+                p->field = x;
+            return;
+        }
+    }
+}
+
+
+/* append raw text to a field */
+void append_multi_value(gm_multi_parser_t *p, int field, const char *data, size_t len) {
+    if(p->value_len[field] + len > GM_MAX_OUTPUT)
+        len = GM_MAX_OUTPUT - p->value_len[field];
+    if(p->value_len[field] + (int)len + 1 > p->value_size[field]) {
+        while(p->value_len[field] + (int)len + 1 > p->value_size[field])
+            p->value_size[field] = p->value_size[field] == 0 ? 256 : p->value_size[field] * 2;
+        p->value[field] = gm_realloc(p->value[field], p->value_size[field]);
+    }
+    memcpy(p->value[field] + p->value_len[field], data, len);
+    p->value_len[field] += len;
+    p->value[field][p->value_len[field]] = '\0';
+}
+
+
+/* create the result payload of a complete child, returns NULL for the parent and incomplete children */
+char * build_child_result(gm_multi_parser_t *p) {
+    struct timeval start_time;
+    char *service, *output, *error, *performance, *pplugin;
+    char *message, *buf, *result;
+    int size, len;
+
+    /* child check number, skip parent check */
+    if(!p->found[GM_MULTI_NO] || !strcmp(p->value[GM_MULTI_NO], "0"))
+        return NULL;
+    gm_log( GM_LOG_TRACE, "child check: %d\n", atoi(p->value[GM_MULTI_NO]));
+
+    if(!p->found[GM_MULTI_NAME] || !p->found[GM_MULTI_RC] || !p->found[GM_MULTI_RUNTIME]
+       || !p->found[GM_MULTI_OUTPUT] || !p->found[GM_MULTI_ERROR])
+        return NULL;
+    if(p->found[GM_MULTI_PERFORMANCE] && !p->found[GM_MULTI_PPLUGIN])
+        return NULL;
+
+    service = decode_xml(p->value[GM_MULTI_NAME]);
+    output  = decode_xml(p->value[GM_MULTI_OUTPUT]);
+    error   = decode_xml(p->value[GM_MULTI_ERROR]);
+
+    /* start time is calculated from the runtime, end time is the execution time of send_multi itself */
+    double2timeval(timeval2double(&p->end_time) - atof(p->value[GM_MULTI_RUNTIME]), &start_time);
+
+    /* output, ' [error]' and performance data with multi headers */
+    size    = strlen(output) + strlen(error) + strlen(service) + 16;
+    if(p->found[GM_MULTI_PERFORMANCE])
+        size += p->value_len[GM_MULTI_PERFORMANCE] + p->value_len[GM_MULTI_PPLUGIN];
+    message = gm_malloc(size);
+    len     = snprintf(message, size, *error ? "%s [%s]" : "%s%s", output, error);
+    if(p->found[GM_MULTI_PERFORMANCE]) {
+        performance = decode_xml(trim(p->value[GM_MULTI_PERFORMANCE]));
+        pplugin     = decode_xml(p->value[GM_MULTI_PPLUGIN]);
+
+        /* do we have a single quote performance label?
+           then single quote the whole multi header */
+        if(*performance == '\'')
+            snprintf(message+len, size-len, "|'%s::%s::%s", service, pplugin, performance+1);
+        else
+            snprintf(message+len, size-len, "|%s::%s::%s", service, pplugin, performance);
+    }
+
+    /* escape newline */
+    buf = gm_escape_newlines(message, GM_DISABLED);
+    free(message);
+
+    size   = strlen(buf) + strlen(service) + strlen(mod_gm_opt->host) + GM_BUFFERSIZE;
+    result = gm_malloc(size);
+    snprintf( result, size, "type=%s\nhost_name=%s\nstart_time=%lf\nfinish_time=%lf\nreturn_code=%i\nsource=send_multi\nservice_description=%s\noutput=%s\n\n",
+              mod_gm_opt->active == GM_ENABLED ? "active" : "passive",
+              mod_gm_opt->host,
+              timeval2double(&start_time),
+              timeval2double(&p->end_time),
+              atoi(p->value[GM_MULTI_RC]),
+              service,
+              buf
+            );
+    free(buf);
+
+    gm_log( GM_LOG_TRACE, "data:\n%s\n", result);
+    return result;
+}
+
+
+/* free parser buffers and collected results */
+void free_multi_parser(gm_multi_parser_t *p) {
+    int x;
+    for(x = 0; x < GM_MULTI_FIELDS; x++)
+        free(p->value[x]);
+    for(x = 0; x < p->num; x++)
+        free(p->results[x]);
+    free(p->results);
+}
+
+
+/* decode xml entities in place with a single pass */
+char *decode_xml(char *string) {
+    struct decode{
+            char c;
+            char *enc_string;
+    } dtab[] = {
+            { '>',  "&gt;"   },
+            { '<',  "&lt;"   },
+            { '&',  "&amp;"  },
+            { '"',  "&quot;" },
+            { '\'', "&apos;" },
+    };
+    char *src = string;
+    char *dst = string;
+    char *end;
+    long code;
+    int i, len;
+
+    while(*src != '\0') {
+        if(*src == '&') {
+            /* numeric character references like &#039; or &#x7C; */
+            if(src[1] == '#') {
+                if(src[2] == 'x' || src[2] == 'X')
+                    code = strtol(src+3, &end, 16);
+                else
+                    code = strtol(src+2, &end, 10);
+                if(*end == ';' && end > src+2 && code > 0 && code < 128) {
+                    *dst++ = (char)code;
+                    src    = end + 1;
+                    continue;
+                }
+            }
+            for (i=0; i<(int)(sizeof(dtab)/sizeof(struct decode)); i++) {
+                len = strlen(dtab[i].enc_string);
+                if(!strncmp(src, dtab[i].enc_string, len)) {
+                    *dst++ = dtab[i].c;
+                    src   += len;
+                    break;
+                }
+            }
+            if(i < (int)(sizeof(dtab)/sizeof(struct decode)))
+                continue;
+        }
+        *dst++ = *src++;
+    }
+    *dst = '\0';
+    return string;
+}
@@ -0,0 +1,242 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "config.h"
+#include "cpu_affinity.h"
+#include "utils.h"
+
+#include <dirent.h>
+#include <sys/syscall.h>
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+int worker_numa_node = -1;
+
+static int compare_int(const void *a, const void *b);
+static int bind_memory_to_node(int node);
+
+
+/* parse kernel cpu list */
+int parse_cpulist(char *list, cpu_set_t *set) {
+    char *ptr = list, *end;
+    long from, to, cpu;
+
+    CPU_ZERO(set);
+    while(ptr != NULL && *ptr != '\0') {
+        from = strtol(ptr, &end, 10);
+        if(end == ptr)
+            break;
+        to = from;
+        ptr = end;
+        if(*ptr == '-') {
+            ptr++;
+            to = strtol(ptr, &end, 10);
+            if(end == ptr)
+                break;
+            ptr = end;
+        }
+        for(cpu = from; cpu <= to && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, set);
+        while(*ptr == ',' || *ptr == ' ' || *ptr == '\n')
+            ptr++;
+    }
+    return CPU_COUNT(set);
+}
+
+
+/* get numa nodes with the cpus we may use */
+int get_numa_nodes(int *nodes, cpu_set_t *cpus, int max) {
+    cpu_set_t allowed, node_cpus;
+    char path[GM_BUFFERSIZE], list[GM_BUFFERSIZE];
+    struct dirent *entry;
+    DIR *dir;
+    FILE *fp;
+    int x, num = 0;
+
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return 0;
+
+    dir = opendir(GM_SYSFS_NODE_DIR);
+    if(dir != NULL) {
+        while((entry = readdir(dir)) != NULL && num < max) {
+            if(strncmp(entry->d_name, "node", 4) || entry->d_name[4] < '0' || entry->d_name[4] > '9')
+                continue;
+            nodes[num++] = atoi(entry->d_name+4);
+        }
+        closedir(dir);
+    }
+    qsort(nodes, num, sizeof(int), compare_int);
+
+    /* keep only nodes with usable cpus */
+    for(x = 0; x < num;) {
+        snprintf(path, sizeof(path), "%s/node%d/cpulist", GM_SYSFS_NODE_DIR, nodes[x]);
+        list[0] = '\0';
+        fp = fopen(path, "r");
+        if(fp != NULL) {
+            if(fgets(list, sizeof(list), fp) == NULL)
+                list[0] = '\0';
+            fclose(fp);
+        }
+        parse_cpulist(list, &node_cpus);
+        CPU_AND(&cpus[x], &node_cpus, &allowed);
+        if(CPU_COUNT(&cpus[x]) == 0) {
+            memmove(&nodes[x], &nodes[x+1], (num-x-1) * sizeof(int));
+            num--;
+            continue;
+        }
+        x++;
+    }
+
+    /* no numa information available */
+    if(num == 0 && max > 0) {
+        nodes[0] = 0;
+        cpus[0]  = allowed;
+        num      = 1;
+    }
+
+    return num;
+}
+
+
+/* pin worker round robin */
+int set_worker_affinity(int worker_nr) {
+    int nodes[GM_MAX_NUMA_NODES];
+    cpu_set_t cpus[GM_MAX_NUMA_NODES];
+    cpu_set_t target;
+    int num, x, cpu, nr;
+
+    worker_numa_node = -1;
+    if(mod_gm_opt->cpu_affinity == GM_CPU_AFFINITY_NONE)
+        return GM_OK;
+
+    num = get_numa_nodes(nodes, cpus, GM_MAX_NUMA_NODES);
+    if(num == 0) {
+        gm_log( GM_LOG_ERROR, "cannot get cpu topology: %s\n", strerror(errno));
+        return GM_ERROR;
+    }
+
+    /* worker alternate between nodes, so every node gets worker early */
+    x = worker_nr % num;
+    worker_numa_node = nodes[x];
+    if(mod_gm_opt->cpu_affinity == GM_CPU_AFFINITY_NODE) {
+        target = cpus[x];
+    }
+    else {
+        CPU_ZERO(&target);
+        nr = (worker_nr / num) % CPU_COUNT(&cpus[x]);
+        for(cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if(CPU_ISSET(cpu, &cpus[x]) && nr-- == 0) {
+                CPU_SET(cpu, &target);
+                break;
+            }
+        }
+    }
+
+    if(sched_setaffinity(0, sizeof(target), &target) != 0) {
+        gm_log( GM_LOG_ERROR, "sched_setaffinity failed: %s\n", strerror(errno));
+        worker_numa_node = -1;
+        return GM_ERROR;
+    }
+    GM_LOG( GM_LOG_DEBUG, "worker %d pinned to %d cpu(s) on numa node %d\n", worker_nr, CPU_COUNT(&target), worker_numa_node);
+
+    if(mod_gm_opt->cpu_affinity_mbind == GM_ENABLED && num > 1)
+        return bind_memory_to_node(worker_numa_node);
+
+    return GM_OK;
+}
+
+
+/* warn about queues which would never be served */
+int verify_cpu_affinity() {
+    int nodes[GM_MAX_NUMA_NODES];
+    cpu_set_t cpus[GM_MAX_NUMA_NODES];
+    int num, x, y, problems = 0;
+
+    if(mod_gm_opt->queue_node_num == 0)
+        return 0;
+    if(mod_gm_opt->cpu_affinity == GM_CPU_AFFINITY_NONE) {
+        gm_log( GM_LOG_INFO, "queue_node has no effect without cpu_affinity\n");
+        return 0;
+    }
+
+    num = get_numa_nodes(nodes, cpus, GM_MAX_NUMA_NODES);
+    for(x = 0; x < mod_gm_opt->queue_node_num; x++) {
+        for(y = 0; y < num; y++) {
+            if(nodes[y] == mod_gm_opt->queue_node_ids[x])
+                break;
+        }
+        if(y == num) {
+            gm_log( GM_LOG_ERROR, "queue %s is mapped to numa node %d, which has no usable cpus\n", mod_gm_opt->queue_node_list[x], mod_gm_opt->queue_node_ids[x]);
+            problems++;
+        }
+    }
+    if(mod_gm_opt->min_worker < num) {
+        gm_log( GM_LOG_INFO, "min-worker is lower than the number of numa nodes (%d), queues mapped to a node may not be served all the time\n", num);
+        problems++;
+    }
+
+    return problems;
+}
+
+
+/* may this worker serve the queue */
+int queue_allowed_on_worker(char *queue) {
+    int x;
+
+    if(worker_numa_node == -1)
+        return TRUE;
+    for(x = 0; x < mod_gm_opt->queue_node_num; x++) {
+        if(!strcmp(mod_gm_opt->queue_node_list[x], queue))
+            return mod_gm_opt->queue_node_ids[x] == worker_numa_node;
+    }
+    return TRUE;
+}
+
+
+/* allocate new memory of this process and its children on the node only */
+static int bind_memory_to_node(int node) {
+    unsigned long mask[GM_MAX_NUMA_NODES / (8 * sizeof(unsigned long)) + 1];
+
+    if(node < 0 || node >= GM_MAX_NUMA_NODES)
+        return GM_ERROR;
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+#ifdef SYS_set_mempolicy
+    if(syscall(SYS_set_mempolicy, MPOL_BIND, mask, sizeof(mask) * 8) != 0) {
+        gm_log( GM_LOG_ERROR, "set_mempolicy failed: %s\n", strerror(errno));
+        return GM_ERROR;
+    }
+    return GM_OK;
+#else
+    gm_log( GM_LOG_ERROR, "binding memory to numa nodes is not supported on this system\n");
+    return GM_ERROR;
+#endif
+}
+
+
+/* compare two ints for qsort */
+static int compare_int(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
@@ -0,0 +1,108 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "config.h"
+#include "job_window.h"
+#include "utils.h"
+
+static gm_window_job_t *window_head = NULL;
+static int              window_size = 0;
+
+static int same_check(gm_job_t *a, gm_job_t *b);
+
+
+/* deadline of a job, only used for ordering */
+double job_deadline(gm_job_t *job) {
+    int timeout = job->timeout > 0 ? job->timeout : mod_gm_opt->job_timeout;
+
+    /* forced checks run first, in the order they arrived */
+    if(job->check_options & GM_CHECK_OPTION_FORCE_EXECUTION)
+        return 0;
+    return timeval2double(&job->next_check) + timeout;
+}
+
+
+/* add job, sorted by deadline */
+gm_job_t *job_window_add(gm_job_t *job) {
+    gm_window_job_t *entry, **prev;
+    gm_job_t *superseded;
+
+    /* only the latest check of a host or service matters */
+    for(prev = &window_head; *prev != NULL; prev = &(*prev)->next) {
+        if(!same_check((*prev)->job, job))
+            continue;
+        if(mod_gm_time_compare(&job->next_check, &(*prev)->job->next_check) < 0)
+            return job;
+        entry      = *prev;
+        superseded = entry->job;
+        *prev      = entry->next;
+        free(entry);
+        window_size--;
+        job_window_add(job);
+        return superseded;
+    }
+
+    entry           = gm_malloc(sizeof(gm_window_job_t));
+    entry->job      = job;
+    entry->deadline = job_deadline(job);
+    for(prev = &window_head; *prev != NULL && (*prev)->deadline <= entry->deadline; prev = &(*prev)->next)
+        ;
+    entry->next = *prev;
+    *prev       = entry;
+    window_size++;
+
+    return NULL;
+}
+
+
+/* remove job with earliest deadline */
+gm_job_t *job_window_next() {
+    gm_window_job_t *entry = window_head;
+    gm_job_t *job;
+
+    if(entry == NULL)
+        return NULL;
+    window_head = entry->next;
+    window_size--;
+    job = entry->job;
+    free(entry);
+    return job;
+}
+
+
+/* number of prefetched jobs */
+int job_window_size() {
+    return window_size;
+}
+
+
+/* do both jobs check the same host or service */
+static int same_check(gm_job_t *a, gm_job_t *b) {
+    if(a->type == NULL || b->type == NULL || strcmp(a->type, b->type))
+        return FALSE;
+    if(a->host_name == NULL || b->host_name == NULL || strcmp(a->host_name, b->host_name))
+        return FALSE;
+    if(a->service_description == NULL || b->service_description == NULL)
+        return a->service_description == b->service_description;
+    return !strcmp(a->service_description, b->service_description);
+}
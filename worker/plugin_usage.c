@@ -0,0 +1,219 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "config.h"
+#include "plugin_usage.h"
+#include "utils.h"
+
+#include <ctype.h>
+#include <sys/mman.h>
+
+static gm_plugin_usage_table_t *usage_table = NULL;
+
+static int compare_plugin_usage(const void *a, const void *b);
+
+
+/* create shared table */
+int init_plugin_usage() {
+    pthread_mutexattr_t mattr;
+
+    if(usage_table != NULL)
+        return GM_OK;
+
+    usage_table = mmap(NULL, sizeof(gm_plugin_usage_table_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(usage_table == MAP_FAILED) {
+        gm_log( GM_LOG_ERROR, "cannot create plugin usage table: %s\n", strerror(errno));
+        usage_table = NULL;
+        return GM_ERROR;
+    }
+    memset(usage_table, 0, sizeof(gm_plugin_usage_table_t));
+
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&usage_table->mutex, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+
+    return GM_OK;
+}
+
+
+/* unmap shared table */
+void free_plugin_usage() {
+    if(usage_table == NULL)
+        return;
+    munmap(usage_table, sizeof(gm_plugin_usage_table_t));
+    usage_table = NULL;
+}
+
+
+/* get basename of the plugin */
+char *plugin_usage_name(char *command_line, char *name, int size) {
+    char *start, *c;
+    int len;
+
+    start = command_line;
+    while(1) {
+        while(*start == ' ' || *start == '\t')
+            start++;
+        /* skip variable assignments */
+        for(c = start; *c == '_' || isalnum((unsigned char)*c); c++)
+            ;
+        if(c == start || *c != '=' || isdigit((unsigned char)*start))
+            break;
+        while(*c != '\0' && *c != ' ' && *c != '\t')
+            c++;
+        start = c;
+    }
+
+    for(c = start; *c != '\0' && *c != ' ' && *c != '\t'; c++) {
+        if(*c == '/')
+            start = c+1;
+    }
+    len = c - start;
+    if(len == 0) {
+        snprintf(name, size, "(unknown)");
+        return name;
+    }
+    if(len >= size)
+        len = size - 1;
+    memcpy(name, start, len);
+    name[len] = '\0';
+    return name;
+}
+
+
+/* add usage of an executed command */
+void add_plugin_usage(char *command_line, struct rusage *usage) {
+    char name[GM_PLUGIN_USAGE_NAME];
+    gm_plugin_usage_t *entry = NULL;
+    int x;
+
+    if(usage_table == NULL || command_line == NULL)
+        return;
+
+    plugin_usage_name(command_line, name, sizeof(name));
+
+    if(pthread_mutex_lock(&usage_table->mutex) == EOWNERDEAD)
+        pthread_mutex_consistent(&usage_table->mutex);
+    for(x = 0; x < usage_table->used; x++) {
+        if(!strcmp(usage_table->entries[x].name, name)) {
+            entry = &usage_table->entries[x];
+            break;
+        }
+    }
+    if(entry == NULL) {
+        /* last slot collects everything which does not fit anymore */
+        if(usage_table->used == GM_PLUGIN_USAGE_SLOTS) {
+            entry = &usage_table->entries[GM_PLUGIN_USAGE_SLOTS - 1];
+        } else {
+            if(usage_table->used == GM_PLUGIN_USAGE_SLOTS - 1)
+                snprintf(name, sizeof(name), "(other)");
+            entry = &usage_table->entries[usage_table->used++];
+            snprintf(entry->name, sizeof(entry->name), "%s", name);
+        }
+    }
+
+    entry->count++;
+    entry->utime_usec += (unsigned long long)usage->ru_utime.tv_sec * 1000000 + usage->ru_utime.tv_usec;
+    entry->stime_usec += (unsigned long long)usage->ru_stime.tv_sec * 1000000 + usage->ru_stime.tv_usec;
+    if(usage->ru_maxrss > entry->maxrss)
+        entry->maxrss = usage->ru_maxrss;
+    entry->maxrss_sum += usage->ru_maxrss;
+    entry->nvcsw      += usage->ru_nvcsw;
+    entry->nivcsw     += usage->ru_nivcsw;
+    pthread_mutex_unlock(&usage_table->mutex);
+}
+
+
+/* print usage table, sorted by cpu time */
+int format_plugin_usage(char *buf, int size) {
+    gm_plugin_usage_t *entries;
+    int x, used, len = 0;
+
+    buf[0] = '\0';
+    if(usage_table == NULL)
+        return 0;
+
+    entries = gm_malloc(sizeof(usage_table->entries));
+    if(pthread_mutex_lock(&usage_table->mutex) == EOWNERDEAD)
+        pthread_mutex_consistent(&usage_table->mutex);
+    used = usage_table->used;
+    memcpy(entries, usage_table->entries, used * sizeof(gm_plugin_usage_t));
+    pthread_mutex_unlock(&usage_table->mutex);
+
+    qsort(entries, used, sizeof(gm_plugin_usage_t), compare_plugin_usage);
+    for(x = 0; x < used && len < size; x++) {
+        len += snprintf(buf+len, size-len, "%s count=%lu user=%.3fs sys=%.3fs avg_cpu=%.3fs max_rss=%ldkB avg_rss=%llukB vcsw=%llu ivcsw=%llu\n",
+                        entries[x].name,
+                        entries[x].count,
+                        (double)entries[x].utime_usec / 1000000,
+                        (double)entries[x].stime_usec / 1000000,
+                        (double)(entries[x].utime_usec + entries[x].stime_usec) / 1000000 / entries[x].count,
+                        entries[x].maxrss,
+                        entries[x].maxrss_sum / entries[x].count,
+                        entries[x].nvcsw,
+                        entries[x].nivcsw);
+    }
+    free(entries);
+    return used;
+}
+
+
+/* write usage table to the log from time to time */
+void dump_plugin_usage(int interval) {
+    static time_t last_dump = 0;
+    char *buf, *line, *next;
+    time_t now = time(NULL);
+
+    if(interval <= 0 || usage_table == NULL)
+        return;
+    if(last_dump == 0)
+        last_dump = now;
+    if(now - last_dump < interval)
+        return;
+    last_dump = now;
+
+    buf = gm_malloc(GM_BUFFERSIZE);
+    if(format_plugin_usage(buf, GM_BUFFERSIZE) > 0) {
+        gm_log( GM_LOG_INFO, "plugin usage:\n");
+        for(line = buf; line != NULL && *line != '\0'; line = next) {
+            next = strchr(line, '\n');
+            if(next != NULL)
+                *next++ = '\0';
+            gm_log( GM_LOG_INFO, "  %s\n", line);
+        }
+    }
+    free(buf);
+}
+
+
+/* sort by cpu time, highest first */
+static int compare_plugin_usage(const void *a, const void *b) {
+    const gm_plugin_usage_t *ua = a, *ub = b;
+    unsigned long long ca = ua->utime_usec + ua->stime_usec;
+    unsigned long long cb = ub->utime_usec + ub->stime_usec;
+    if(ca == cb)
+        return strcmp(ua->name, ub->name);
+    return ca < cb ? 1 : -1;
+}
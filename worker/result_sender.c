@@ -0,0 +1,312 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "config.h"
+#include "result_sender.h"
+#include "utils.h"
+#include "gearman_utils.h"
+#include "worker_metrics.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <time.h>
+
+static pthread_t          sender_thread;
+static pthread_mutex_t    sender_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t     sender_cond  = PTHREAD_COND_INITIALIZER;
+static gearman_client_st  sender_client;
+static gm_queued_result_t *sender_head = NULL;
+static gm_queued_result_t *sender_tail = NULL;
+static int                sender_queued  = 0;
+static int                sender_running = FALSE;
+static int                sender_stop    = FALSE;
+static volatile sig_atomic_t sender_stop_requested = FALSE;
+static volatile sig_atomic_t sender_idle           = TRUE;
+
+/* options used by the thread, the worker replaces mod_gm_opt on reloads */
+static gm_server_t      * sender_server_list[GM_LISTSIZE];
+static int                sender_server_num    = 0;
+static int                sender_batch_size    = 1;
+static int                sender_batch_wait    = 0;
+static int                sender_transportmode = GM_ENCODE_ONLY;
+
+static void send_result_batch(gm_queued_result_t *batch);
+static void wait_for_more_results(void);
+static void free_sender_options(void);
+
+
+/* start background sender */
+int start_result_sender() {
+    int x;
+
+    if(sender_running == TRUE)
+        return GM_OK;
+
+    for(x = 0; x < mod_gm_opt->server_num; x++) {
+        sender_server_list[x]       = gm_malloc(sizeof(gm_server_t));
+        sender_server_list[x]->host = gm_strdup(mod_gm_opt->server_list[x]->host);
+        sender_server_list[x]->port = mod_gm_opt->server_list[x]->port;
+    }
+    for(; x < GM_LISTSIZE; x++)
+        sender_server_list[x] = NULL;
+    sender_server_num    = mod_gm_opt->server_num;
+    sender_batch_size    = mod_gm_opt->result_batch_size;
+    sender_batch_wait    = mod_gm_opt->result_batch_wait;
+    sender_transportmode = mod_gm_opt->transportmode;
+
+    if(create_client(sender_server_list, &sender_client) != GM_OK) {
+        gm_log( GM_LOG_ERROR, "cannot start client for result sender\n" );
+        free_sender_options();
+        return GM_ERROR;
+    }
+
+    sender_stop           = FALSE;
+    sender_stop_requested = FALSE;
+    sender_idle           = TRUE;
+    if(pthread_create(&sender_thread, NULL, result_sender_loop, NULL) != 0) {
+        gm_log( GM_LOG_ERROR, "cannot start result sender thread: %s\n", strerror(errno));
+        gearman_client_free(&sender_client);
+        free_sender_options();
+        return GM_ERROR;
+    }
+    sender_running   = TRUE;
+    gm_result_sender = queue_result;
+    GM_LOG( GM_LOG_TRACE, "started result sender thread\n" );
+
+    return GM_OK;
+}
+
+
+/* flush queue and stop background sender */
+void stop_result_sender() {
+    if(sender_running == FALSE)
+        return;
+
+    /* send remaining results synchronously from now on */
+    gm_result_sender = NULL;
+
+    pthread_mutex_lock(&sender_mutex);
+    sender_stop = TRUE;
+    pthread_cond_signal(&sender_cond);
+    pthread_mutex_unlock(&sender_mutex);
+
+    pthread_join(sender_thread, NULL);
+    gearman_client_free(&sender_client);
+    free_sender_options();
+    sender_running = FALSE;
+    GM_LOG( GM_LOG_TRACE, "stopped result sender thread\n" );
+
+    return;
+}
+
+
+/* stop queueing new results, the thread keeps sending queued ones */
+void request_result_sender_stop() {
+    gm_result_sender      = NULL;
+    sender_stop_requested = TRUE;
+    return;
+}
+
+
+/* wait till all queued results have been sent */
+int wait_result_sender_idle(int msec) {
+    struct timespec delay;
+
+    if(sender_running == FALSE)
+        return TRUE;
+
+    delay.tv_sec  = 0;
+    delay.tv_nsec = 10000000;
+    while(sender_idle == FALSE && msec > 0) {
+        nanosleep(&delay, NULL);
+        msec -= 10;
+    }
+
+    return(sender_idle == TRUE ? TRUE : FALSE);
+}
+
+
+/* add result to send queue */
+int queue_result(char *queue, char *data) {
+    gm_queued_result_t *result;
+
+    pthread_mutex_lock(&sender_mutex);
+    if(sender_stop == TRUE || sender_queued >= GM_RESULT_SENDER_MAX_QUEUE) {
+        pthread_mutex_unlock(&sender_mutex);
+        return GM_ERROR;
+    }
+
+    result        = gm_malloc(sizeof(gm_queued_result_t));
+    result->queue = gm_strdup(queue);
+    result->data  = gm_strdup(data);
+    result->next  = NULL;
+    gettimeofday(&result->queued, NULL);
+    if(sender_tail == NULL)
+        sender_head = result;
+    else
+        sender_tail->next = result;
+    sender_tail = result;
+    sender_queued++;
+    sender_idle = FALSE;
+
+    pthread_cond_signal(&sender_cond);
+    pthread_mutex_unlock(&sender_mutex);
+
+    return GM_OK;
+}
+
+
+/* send queued results, everything queued while sending goes into the next batch */
+void *result_sender_loop(void *arg) {
+    gm_queued_result_t *batch, *last;
+    sigset_t mask;
+    int x;
+    arg = arg;
+
+    /* signals are handled by the worker thread */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    pthread_mutex_lock(&sender_mutex);
+    while(1) {
+        while(sender_head == NULL && sender_stop == FALSE) {
+            sender_idle = TRUE;
+            pthread_cond_wait(&sender_cond, &sender_mutex);
+        }
+        if(sender_head == NULL && sender_stop == TRUE)
+            break;
+
+        if(sender_batch_size > 1 && sender_stop_requested == FALSE)
+            wait_for_more_results();
+
+        /* take up to GM_RESULT_SENDER_BATCH_SIZE results */
+        batch = sender_head;
+        last  = sender_head;
+        for(x = 1; x < GM_RESULT_SENDER_BATCH_SIZE && last->next != NULL; x++)
+            last = last->next;
+        sender_head = last->next;
+        if(sender_head == NULL)
+            sender_tail = NULL;
+        last->next = NULL;
+        sender_queued -= x;
+        pthread_mutex_unlock(&sender_mutex);
+
+        send_result_batch(batch);
+
+        pthread_mutex_lock(&sender_mutex);
+    }
+    sender_idle = TRUE;
+    pthread_mutex_unlock(&sender_mutex);
+
+    return NULL;
+}
+
+
+/* give other results a chance to join the next batch, called with locked mutex */
+static void wait_for_more_results() {
+    struct timeval now;
+    struct timespec deadline;
+
+    gettimeofday(&now, NULL);
+    deadline.tv_sec  = now.tv_sec + sender_batch_wait / 1000;
+    deadline.tv_nsec = (now.tv_usec + (sender_batch_wait % 1000) * 1000) * 1000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    while(sender_queued < sender_batch_size && sender_stop == FALSE) {
+        if(pthread_cond_timedwait(&sender_cond, &sender_mutex, &deadline) == ETIMEDOUT)
+            break;
+    }
+    return;
+}
+
+
+/* send a batch of results with one round trip per queue, only jobs gearmand did not accept are resent */
+static void send_result_batch(gm_queued_result_t *batch) {
+    gm_queued_result_t *result, *next;
+    char *group[GM_RESULT_SENDER_BATCH_SIZE];
+    char *packets[GM_RESULT_SENDER_BATCH_SIZE];
+    int failed_packets[GM_RESULT_SENDER_BATCH_SIZE];
+    char *queue;
+    int num, packet_num, failed, x;
+
+    for(result = batch; result != NULL; result = result->next) {
+        if(result->queue == NULL)
+            continue;
+
+        /* pack up to result_batch_size results for the same queue into one job */
+        queue      = result->queue;
+        packet_num = 0;
+        num        = 0;
+        for(next = result; next != NULL; next = next->next) {
+            if(next->queue == NULL || strcmp(next->queue, queue))
+                continue;
+            group[num++] = next->data;
+            if(next != result) {
+                free(next->queue);
+                next->queue = NULL;
+            }
+            if(num == sender_batch_size || sender_batch_size <= 1) {
+                packets[packet_num++] = num > 1 ? build_multi_result(group, num) : gm_strdup(group[0]);
+                num = 0;
+            }
+        }
+        if(num > 0)
+            packets[packet_num++] = num > 1 ? build_multi_result(group, num) : gm_strdup(group[0]);
+
+        failed = add_jobs_to_queue( &sender_client, sender_server_list, queue, packets, packet_num,
+                                    GM_JOB_PRIO_NORMAL, sender_transportmode, failed_packets );
+        GM_LOG( GM_LOG_TRACE, "result sender sent %d jobs to %s, %d failed\n", packet_num, queue, failed );
+        if(failed > 0)
+            metrics_inc(GM_METRIC_RECONNECTS);
+
+        for(x = 0; x < packet_num; x++)
+            free(packets[x]);
+        free(result->queue);
+        result->queue = NULL;
+    }
+
+    for(result = batch; result != NULL; result = next) {
+        next = result->next;
+        metrics_result_sent(&result->queued);
+        free(result->data);
+        free(result);
+    }
+    return;
+}
+
+
+/* free the options copied for the thread */
+static void free_sender_options() {
+    int x;
+    for(x = 0; x < sender_server_num; x++) {
+        free(sender_server_list[x]->host);
+        free(sender_server_list[x]);
+        sender_server_list[x] = NULL;
+    }
+    sender_server_num = 0;
+    return;
+}
@@ -0,0 +1,278 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "config.h"
+#include "single_flight.h"
+#include "utils.h"
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+static gm_flight_table_t *flight_table      = NULL;
+static size_t             flight_table_size = 0;
+
+static void lock_flight_table(void);
+static int wait_flight_table(struct timespec *until);
+static int flight_owner_alive(gm_flight_slot_t *slot);
+static void fill_timeout_result(gm_job_t *job);
+
+
+/* create shared table */
+int init_single_flight(int size) {
+    pthread_mutexattr_t mattr;
+    pthread_condattr_t  cattr;
+
+    if(flight_table != NULL)
+        return GM_OK;
+    if(size <= 0)
+        return GM_ERROR;
+
+    flight_table_size = sizeof(gm_flight_table_t) + size * sizeof(gm_flight_slot_t);
+    flight_table = mmap(NULL, flight_table_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(flight_table == MAP_FAILED) {
+        gm_log( GM_LOG_ERROR, "cannot create single flight table: %s\n", strerror(errno));
+        flight_table = NULL;
+        return GM_ERROR;
+    }
+    memset(flight_table, 0, flight_table_size);
+    flight_table->size = size;
+
+    /* worker may die while holding the lock, ex. when killed by a timeout */
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&flight_table->mutex, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&flight_table->cond, &cattr);
+    pthread_condattr_destroy(&cattr);
+
+    GM_LOG( GM_LOG_DEBUG, "created single flight table with %d slots\n", size);
+    return GM_OK;
+}
+
+
+/* unmap shared table */
+void free_single_flight() {
+    if(flight_table == NULL)
+        return;
+    munmap(flight_table, flight_table_size);
+    flight_table      = NULL;
+    flight_table_size = 0;
+}
+
+
+/* announce job or wait for identical running job */
+int single_flight_join(gm_job_t *job) {
+    gm_flight_slot_t *slot = NULL, *free_slot = NULL;
+    unsigned long hash = 5381;
+    unsigned int generation;
+    struct timespec until;
+    struct timeval now;
+    const char *c;
+    int x, timed_out = FALSE;
+
+    if(flight_table == NULL || job->command_line == NULL)
+        return GM_FLIGHT_NONE;
+    if(strlen(job->command_line) >= GM_FLIGHT_MAX_COMMAND)
+        return GM_FLIGHT_NONE;
+
+    for(c = job->command_line; *c != '\0'; c++)
+        hash = ((hash << 5) + hash) + (unsigned char)*c;
+
+    lock_flight_table();
+    for(x = 0; x < flight_table->size; x++) {
+        slot = &flight_table->slots[x];
+        if(slot->state == GM_FLIGHT_RUNNING && slot->hash == hash && !strcmp(slot->command, job->command_line)) {
+            if(flight_owner_alive(slot))
+                break;
+            slot->state = GM_FLIGHT_FREE;
+            slot->generation++;
+            pthread_cond_broadcast(&flight_table->cond);
+        }
+        if(slot->state != GM_FLIGHT_RUNNING && slot->waiters == 0 && free_slot == NULL)
+            free_slot = slot;
+    }
+
+    /* nobody runs this command, so we do */
+    if(x == flight_table->size) {
+        if(free_slot == NULL) {
+            pthread_mutex_unlock(&flight_table->mutex);
+            return GM_FLIGHT_NONE;
+        }
+        free_slot->state       = GM_FLIGHT_RUNNING;
+        free_slot->generation++;
+        free_slot->hash        = hash;
+        free_slot->pid         = getpid();
+        free_slot->output[0]   = '\0';
+        free_slot->error[0]    = '\0';
+        strcpy(free_slot->command, job->command_line);
+        pthread_mutex_unlock(&flight_table->mutex);
+        return (int)(free_slot - flight_table->slots);
+    }
+
+    /* wait for the result, but not longer than our own timeout */
+    GM_LOG( GM_LOG_DEBUG, "waiting for identical command from worker %d\n", (int)slot->pid);
+    until.tv_sec  = job->start_time.tv_sec + job->timeout;
+    until.tv_nsec = job->start_time.tv_usec * 1000;
+    generation    = slot->generation;
+    slot->waiters++;
+    while(slot->state == GM_FLIGHT_RUNNING && slot->generation == generation) {
+        if(wait_flight_table(&until) == ETIMEDOUT) {
+            gettimeofday(&now, NULL);
+            if(now.tv_sec > until.tv_sec || (now.tv_sec == until.tv_sec && now.tv_usec * 1000 >= until.tv_nsec)) {
+                timed_out = TRUE;
+                break;
+            }
+            if(!flight_owner_alive(slot)) {
+                slot->state = GM_FLIGHT_FREE;
+                slot->generation++;
+                pthread_cond_broadcast(&flight_table->cond);
+            }
+        }
+    }
+    slot->waiters--;
+
+    if(slot->state != GM_FLIGHT_DONE || slot->generation != generation) {
+        pthread_mutex_unlock(&flight_table->mutex);
+        if(timed_out == FALSE) {
+            /* worker died before finishing the command */
+            return GM_FLIGHT_NONE;
+        }
+        fill_timeout_result(job);
+        return GM_FLIGHT_SHARED;
+    }
+
+    job->return_code   = slot->return_code;
+    job->early_timeout = slot->early_timeout;
+    job->exited_ok     = slot->exited_ok;
+    free(job->output);
+    job->output        = gm_strdup(slot->output);
+    free(job->error);
+    job->error         = gm_strdup(slot->error);
+    flight_table->shared++;
+    pthread_mutex_unlock(&flight_table->mutex);
+
+    if(job->early_timeout == 1) {
+        fill_timeout_result(job);
+        return GM_FLIGHT_SHARED;
+    }
+
+    gettimeofday(&job->finish_time, NULL);
+    free(job->source);
+    gm_asprintf(&job->source, "Mod-Gearman Worker @ %s", mod_gm_opt->identifier);
+
+    return GM_FLIGHT_SHARED;
+}
+
+
+/* publish result */
+void single_flight_done(int slot_nr, gm_job_t *job) {
+    gm_flight_slot_t *slot;
+
+    if(flight_table == NULL || slot_nr < 0 || slot_nr >= flight_table->size)
+        return;
+
+    lock_flight_table();
+    slot = &flight_table->slots[slot_nr];
+
+    /* result does not fit into the slot, let waiting workers run the command themselves */
+    if((job->output != NULL && strlen(job->output) >= sizeof(slot->output))
+       || (job->error != NULL && strlen(job->error) >= sizeof(slot->error))) {
+        GM_LOG( GM_LOG_DEBUG, "result too large to share, waiting workers run the command themselves\n");
+        slot->state = GM_FLIGHT_FREE;
+        slot->generation++;
+        pthread_cond_broadcast(&flight_table->cond);
+        pthread_mutex_unlock(&flight_table->mutex);
+        return;
+    }
+
+    slot->return_code   = job->return_code;
+    slot->early_timeout = job->early_timeout;
+    slot->exited_ok     = job->exited_ok;
+    snprintf(slot->output, sizeof(slot->output), "%s", job->output != NULL ? job->output : "");
+    snprintf(slot->error, sizeof(slot->error), "%s", job->error != NULL ? job->error : "");
+    slot->state         = GM_FLIGHT_DONE;
+    pthread_cond_broadcast(&flight_table->cond);
+    pthread_mutex_unlock(&flight_table->mutex);
+}
+
+
+/* return number of shared results */
+int single_flight_shared() {
+    if(flight_table == NULL)
+        return 0;
+    return flight_table->shared;
+}
+
+
+/* lock table and recover from dead lock owners */
+static void lock_flight_table() {
+    if(pthread_mutex_lock(&flight_table->mutex) == EOWNERDEAD)
+        pthread_mutex_consistent(&flight_table->mutex);
+}
+
+
+/* wait at most one second, so dead owners can be detected */
+static int wait_flight_table(struct timespec *until) {
+    struct timespec wait;
+    int rc;
+
+    clock_gettime(CLOCK_REALTIME, &wait);
+    wait.tv_sec++;
+    if(wait.tv_sec > until->tv_sec || (wait.tv_sec == until->tv_sec && wait.tv_nsec > until->tv_nsec))
+        wait = *until;
+
+    rc = pthread_cond_timedwait(&flight_table->cond, &flight_table->mutex, &wait);
+    if(rc == EOWNERDEAD) {
+        pthread_mutex_consistent(&flight_table->mutex);
+        rc = 0;
+    }
+    return rc;
+}
+
+
+/* is the worker running the command still alive */
+static int flight_owner_alive(gm_flight_slot_t *slot) {
+    if(kill(slot->pid, 0) == 0 || errno == EPERM)
+        return TRUE;
+    return FALSE;
+}
+
+
+/* set timeout result like execute_safe_command does */
+static void fill_timeout_result(gm_job_t *job) {
+    gettimeofday(&job->finish_time, NULL);
+    job->return_code   = mod_gm_opt->timeout_return;
+    job->early_timeout = 1;
+    free(job->output);
+    if(job->type != NULL && !strcmp(job->type, "service"))
+        gm_asprintf(&job->output, "(Service Check Timed Out On Worker: %s)", mod_gm_opt->identifier);
+    else
+        gm_asprintf(&job->output, "(Host Check Timed Out On Worker: %s)", mod_gm_opt->identifier);
+    free(job->source);
+    gm_asprintf(&job->source, "Mod-Gearman Worker @ %s", mod_gm_opt->identifier);
+}
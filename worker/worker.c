@@ -26,6 +26,21 @@
 #include "worker.h"
 #include "utils.h"
 #include "worker_client.h"
+#include "dl_plugins.h"
+#include "epn_utils.h"
+#include "single_flight.h"
+#include "plugin_usage.h"
+#include "cpu_affinity.h"
+#include "worker_metrics.h"
+#include "exec_plan.h"
+#include "log_ring.h"
+
+#ifdef GM_EVENT_SUPERVISOR
+#include <poll.h>
+#include <stdint.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#endif
 
 int current_number_of_workers                = 0;
 volatile sig_atomic_t current_number_of_jobs = 0;  /* must be signal safe */
@@ -33,8 +48,13 @@ volatile sig_atomic_t current_number_of_jobs = 0;  /* must be signal safe */
 int     orig_argc;
 char ** orig_argv;
 int     last_time_increased;
+int     worker_busy_signaled = FALSE;
 volatile sig_atomic_t shmid;
 int   * shm;
+int     metrics_fd = -1;
+int     rolling_restart_pids[GM_SHM_SIZE];
+int     rolling_restart_num  = 0;
+int     rolling_restart_next = 0;
 #ifdef EMBEDDEDPERL
 extern char *p1_file;
 char **start_env;
@@ -116,8 +136,8 @@ int main (int argc, char **argv) {
     }
 
     /* print some version information */
-    gm_log( GM_LOG_DEBUG, "Version %s\n", GM_VERSION );
-    gm_log( GM_LOG_DEBUG, "running on libgearman %s\n", gearman_version() );
+    GM_LOG( GM_LOG_DEBUG, "Version %s\n", GM_VERSION );
+    GM_LOG( GM_LOG_DEBUG, "running on libgearman %s\n", gearman_version() );
 
 
     /* set signal handlers for a clean exit */
@@ -139,11 +159,15 @@ int main (int argc, char **argv) {
         mod_gm_opt->transportmode = GM_ENCODE_ONLY;
     }
 
-    gm_log( GM_LOG_DEBUG, "main process started\n");
+    GM_LOG( GM_LOG_DEBUG, "main process started\n");
+
+    /* load shared object plugins once, our worker inherit them */
+    if(mod_gm_opt->plugin_dir != NULL)
+        load_dl_plugins(mod_gm_opt->plugin_dir);
 
     /* start a single non forked standalone worker */
     if(mod_gm_opt->debug_level >= 10) {
-        gm_log( GM_LOG_TRACE, "starting standalone worker\n");
+        GM_LOG( GM_LOG_TRACE, "starting standalone worker\n");
 #ifdef EMBEDDEDPERL
         worker_client(GM_WORKER_STANDALONE, 1, shmid, start_env);
 #else
@@ -155,6 +179,24 @@ int main (int argc, char **argv) {
     /* setup shared memory */
     setup_child_communicator();
 
+    /* compile perl plugins once, our worker inherit them */
+    precompile_perl_plugins();
+
+    /* queues pinned to numa nodes need worker on these nodes */
+    verify_cpu_affinity();
+
+    /* resource usage of all plugins, aggregated by name */
+    init_plugin_usage();
+
+    /* identical checks running at the same time share one execution */
+    if(mod_gm_opt->single_flight == GM_ENABLED)
+        init_single_flight(mod_gm_opt->max_worker);
+
+    /* scoreboard for the metrics endpoint, served by this process */
+    init_metrics();
+    if(mod_gm_opt->metrics_listen != NULL)
+        metrics_fd = open_metrics_listener(mod_gm_opt->metrics_listen);
+
     /* start status worker */
     make_new_child(GM_WORKER_STATUS);
 
@@ -174,14 +216,80 @@ int main (int argc, char **argv) {
 
 /* main loop for checking worker */
 void monitor_loop() {
+#ifdef GM_EVENT_SUPERVISOR
+    int sigchld_fd;
+    sigset_t mask;
+    struct pollfd fds[3];
+    struct signalfd_siginfo siginfo;
+    uint64_t busy_signals;
+
+    /* receive SIGCHLD through a filedescriptor, so we can wait for
+     * exited children and busy signals at the same time */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    sigchld_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if(sigchld_fd == -1 || gm_busy_eventfd == -1) {
+        gm_log( GM_LOG_ERROR, "cannot create event filedescriptors, falling back to polling: %s\n", strerror(errno));
+        if(sigchld_fd != -1)
+            close(sigchld_fd);
+        sigprocmask(SIG_UNBLOCK, &mask, NULL);
+    }
+    else {
+        GM_LOG( GM_LOG_DEBUG, "using event driven worker supervisor\n");
+        fds[0].fd     = sigchld_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd     = gm_busy_eventfd;
+        fds[1].events = POLLIN;
+        fds[2].fd     = metrics_fd;
+        fds[2].events = POLLIN;
+
+        /* maintain the population */
+        while (1) {
+            /* wake up on exited children, busy signals or at least every second */
+            if(poll(fds, metrics_fd >= 0 ? 3 : 2, GM_DEFAULT_WORKER_LOOP_SLEEP*1000) == -1 && errno != EINTR) {
+                gm_log( GM_LOG_ERROR, "poll failed: %s\n", strerror(errno));
+                sleep(GM_DEFAULT_WORKER_LOOP_SLEEP);
+            }
+
+            /* drain pending child signals, children are reaped below */
+            if(fds[0].revents & POLLIN) {
+                while(read(sigchld_fd, &siginfo, sizeof(siginfo)) == sizeof(siginfo))
+                    GM_LOG( GM_LOG_TRACE3, "got SIGCHLD from pid %d\n", siginfo.ssi_pid);
+            }
+
+            /* all worker are busy, scale up immediately */
+            if(fds[1].revents & POLLIN) {
+                if(read(gm_busy_eventfd, &busy_signals, sizeof(busy_signals)) == sizeof(busy_signals)) {
+                    GM_LOG( GM_LOG_TRACE, "got %d busy signals from worker\n", (int)busy_signals);
+                    worker_busy_signaled = TRUE;
+                }
+            }
+
+            /* metrics scrape */
+            if(metrics_fd >= 0 && fds[2].revents & POLLIN)
+                handle_metrics_request(metrics_fd, shm);
+
+            /* make sure our worker are running */
+            check_worker_population();
+
+            dump_plugin_usage(mod_gm_opt->plugin_usage_dump);
+        }
+    }
+#endif
 
     /* maintain the population */
     while (1) {
         /* check number of workers every second */
-        sleep(GM_DEFAULT_WORKER_LOOP_SLEEP);
+        if(metrics_fd >= 0)
+            serve_metrics(metrics_fd, shm, GM_DEFAULT_WORKER_LOOP_SLEEP);
+        else
+            sleep(GM_DEFAULT_WORKER_LOOP_SLEEP);
 
         /* make sure our worker are running */
         check_worker_population();
+
+        dump_plugin_usage(mod_gm_opt->plugin_usage_dump);
     }
     return;
 }
@@ -191,8 +299,8 @@ void monitor_loop() {
 void count_current_worker(int restart) {
     int x;
 
-    gm_log( GM_LOG_TRACE3, "count_current_worker()\n");
-    gm_log( GM_LOG_TRACE3, "done jobs:     shm[SHM_JOBS_DONE] = %d\n", shm[SHM_JOBS_DONE]);
+    GM_LOG( GM_LOG_TRACE3, "count_current_worker()\n");
+    GM_LOG( GM_LOG_TRACE3, "done jobs:     shm[SHM_JOBS_DONE] = %d\n", shm[SHM_JOBS_DONE]);
 
     /* shm states:
      *   0 -> undefined
@@ -203,19 +311,19 @@ void count_current_worker(int restart) {
 
     /* check if status worker died */
     if( shm[SHM_STATUS_WORKER_PID] != -1 && pid_alive(shm[SHM_STATUS_WORKER_PID]) == FALSE ) {
-        gm_log( GM_LOG_TRACE, "removed stale status worker, old pid: %d\n", shm[SHM_STATUS_WORKER_PID] );
+        GM_LOG( GM_LOG_TRACE, "removed stale status worker, old pid: %d\n", shm[SHM_STATUS_WORKER_PID] );
         shm[SHM_STATUS_WORKER_PID] = -1;
     }
-    gm_log( GM_LOG_TRACE3, "status worker: shm[SHM_STATUS_WORKER_PID] = %d\n", shm[SHM_STATUS_WORKER_PID]);
+    GM_LOG( GM_LOG_TRACE3, "status worker: shm[SHM_STATUS_WORKER_PID] = %d\n", shm[SHM_STATUS_WORKER_PID]);
 
     /* check all known worker */
     current_number_of_workers = 0;
     current_number_of_jobs    = 0;
     for(x=SHM_SHIFT; x < mod_gm_opt->max_worker+SHM_SHIFT; x++) {
         /* verify worker is alive */
-        gm_log( GM_LOG_TRACE3, "worker slot:   shm[%d] = %d\n", x, shm[x]);
+        GM_LOG( GM_LOG_TRACE3, "worker slot:   shm[%d] = %d\n", x, shm[x]);
         if( shm[x] != -1 && pid_alive(shm[x]) == FALSE ) {
-            gm_log( GM_LOG_TRACE, "removed stale worker %d, old pid: %d\n", x, shm[x]);
+            GM_LOG( GM_LOG_TRACE, "removed stale worker %d, old pid: %d\n", x, shm[x]);
             shm[x] = -1;
             /* immediately start new worker, otherwise the fork rate cannot be guaranteed */
             if(restart == GM_ENABLED) {
@@ -234,22 +342,24 @@ void count_current_worker(int restart) {
     shm[SHM_WORKER_TOTAL]   = current_number_of_workers; /* total worker   */
     shm[SHM_WORKER_RUNNING] = current_number_of_jobs;    /* running worker */
 
-    gm_log( GM_LOG_TRACE3, "worker: %d  -  running: %d\n", current_number_of_workers, current_number_of_jobs);
+    GM_LOG( GM_LOG_TRACE3, "worker: %d  -  running: %d\n", current_number_of_workers, current_number_of_jobs);
 
     return;
 }
 
 /* start new worker if needed */
 void check_worker_population() {
-    int x, now, status, target_number_of_workers;
+    int x, now, status, target_number_of_workers, latency;
 
-    gm_log( GM_LOG_TRACE3, "check_worker_population()\n");
+    GM_LOG( GM_LOG_TRACE3, "check_worker_population()\n");
 
     now = (int)time(NULL);
 
     /* collect finished workers */
-    while(waitpid(-1, &status, WNOHANG) > 0)
-        gm_log( GM_LOG_TRACE, "waitpid() worker exited with: %d\n", status);
+    while(waitpid(-1, &status, WNOHANG) > 0) {
+        GM_LOG( GM_LOG_TRACE, "waitpid() worker exited with: %d\n", status);
+        metrics_inc(GM_METRIC_REAPED);
+    }
 
     /* set current worker number */
     count_current_worker(GM_ENABLED);
@@ -279,9 +389,17 @@ void check_worker_population() {
         current_number_of_workers++;
     }
 
-    /* check every second if we need to increase worker population */
-    if(last_time_increased >= now)
+    /* stop surplus idle worker */
+    retire_spare_worker();
+
+    /* replace worker with old config */
+    continue_rolling_restart();
+
+    /* check every second if we need to increase worker population,
+     * busy signals from our worker are handled right away */
+    if(last_time_increased >= now && worker_busy_signaled == FALSE)
         return;
+    worker_busy_signaled = FALSE;
 
     target_number_of_workers = adjust_number_of_worker(mod_gm_opt->min_worker, mod_gm_opt->max_worker, current_number_of_workers, current_number_of_jobs);
     for (x = current_number_of_workers; x < target_number_of_workers; x++) {
@@ -289,6 +407,50 @@ void check_worker_population() {
         /* top up the worker pool */
         make_new_child(GM_WORKER_MULTI);
     }
+
+    /* measure time from first busy signal till new worker are started */
+    if(shm[SHM_WORKER_BUSY_SINCE] != 0 && target_number_of_workers > current_number_of_workers) {
+        latency = get_msec_timestamp() - shm[SHM_WORKER_BUSY_SINCE];
+        if(latency < 0)
+            latency += GM_MSEC_TIMESTAMP_WRAP;
+        record_scale_up_latency(latency);
+        GM_LOG( GM_LOG_DEBUG, "scaled up from %d to %d worker in %dms\n", current_number_of_workers, target_number_of_workers, latency);
+    }
+    shm[SHM_WORKER_BUSY_SINCE] = 0;
+    return;
+}
+
+
+/* stop one idle worker if there are more than max_spare_workers idle */
+void retire_spare_worker() {
+    int x;
+    int idle = current_number_of_workers - current_number_of_jobs;
+
+    if(!worker_pool_surplus(current_number_of_workers, current_number_of_jobs, mod_gm_opt->min_worker, mod_gm_opt->max_spare_workers))
+        return;
+
+    /* only one per check, so we don't flap between starting and stopping */
+    for(x=SHM_SHIFT; x < mod_gm_opt->max_worker+SHM_SHIFT; x++) {
+        if(shm[x] < -1) {
+            GM_LOG( GM_LOG_TRACE, "%d idle worker, max spare is %d: stopping worker %d\n", idle, mod_gm_opt->max_spare_workers, -shm[x]);
+            save_kill(shm[x], SIGTERM);
+            return;
+        }
+    }
+    return;
+}
+
+
+/* add scale up latency to histogram */
+void record_scale_up_latency(int msec) {
+    int x;
+    int scale_up_buckets[SHM_SCALE_UP_BUCKETS] = GM_SCALE_UP_BUCKET_LIMITS;
+    for(x = 0; x < SHM_SCALE_UP_BUCKETS; x++) {
+        if(scale_up_buckets[x] == 0 || msec <= scale_up_buckets[x]) {
+            shm[SHM_SCALE_UP_HIST+x]++;
+            return;
+        }
+    }
     return;
 }
 
@@ -298,13 +460,13 @@ int make_new_child(int mode) {
     pid_t pid = 0;
     int next_shm_index;
 
-    gm_log( GM_LOG_TRACE, "make_new_child(%d)\n", mode);
+    GM_LOG( GM_LOG_TRACE, "make_new_child(%d)\n", mode);
 
     if(mode == GM_WORKER_STATUS) {
-        gm_log( GM_LOG_TRACE, "forking status worker\n");
+        GM_LOG( GM_LOG_TRACE, "forking status worker\n");
         next_shm_index = 3;
     } else {
-        gm_log( GM_LOG_TRACE, "forking worker\n");
+        GM_LOG( GM_LOG_TRACE, "forking worker\n");
         next_shm_index = get_next_shm_index();
     }
 
@@ -323,8 +485,17 @@ int make_new_child(int mode) {
 
     /* we are in the child process */
     else if(pid==0){
+#ifdef GM_EVENT_SUPERVISOR
+        sigset_t mask;
+        /* SIGCHLD is only blocked for the supervisor */
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        sigprocmask(SIG_UNBLOCK, &mask, NULL);
+#endif
 
-        gm_log( GM_LOG_DEBUG, "child started with pid: %d\n", getpid() );
+        GM_LOG( GM_LOG_DEBUG, "child started with pid: %d\n", getpid() );
+        if(metrics_fd >= 0)
+            close(metrics_fd);
         shm[next_shm_index] = -getpid();
 
         /* do the real work */
@@ -342,6 +513,7 @@ int make_new_child(int mode) {
         signal(SIGINT, clean_exit);
         signal(SIGTERM,clean_exit);
         shm[next_shm_index] = -pid;
+        metrics_inc(GM_METRIC_SPAWNED);
     }
 
     return GM_OK;
@@ -381,6 +553,7 @@ int parse_arguments(int argc, char **argv) {
 
     /* close old logfile */
     if(mod_gm_opt->logfile_fp != NULL) {
+        log_ring_flush();
         fclose(mod_gm_opt->logfile_fp);
         mod_gm_opt->logfile_fp = NULL;
     }
@@ -443,7 +616,7 @@ int verify_options(mod_gm_opt_t *opt) {
 
     /* nothing set by hand -> defaults */
     if( opt->set_queues_by_hand == 0 ) {
-        gm_log( GM_LOG_DEBUG, "starting client with default queues\n" );
+        GM_LOG( GM_LOG_DEBUG, "starting client with default queues\n" );
         opt->hosts          = GM_ENABLED;
         opt->services       = GM_ENABLED;
         opt->events         = GM_ENABLED;
@@ -465,6 +638,12 @@ int verify_options(mod_gm_opt_t *opt) {
     if(opt->min_worker > opt->max_worker)
         opt->min_worker = opt->max_worker;
 
+    if(opt->min_spare_workers > opt->max_worker)
+        opt->min_spare_workers = opt->max_worker;
+
+    if(opt->max_spare_workers > 0 && opt->max_spare_workers < opt->min_spare_workers)
+        opt->max_spare_workers = opt->min_spare_workers;
+
     /* encryption without key? */
     if(opt->encryption == GM_ENABLED) {
         if(opt->crypt_key == NULL && opt->keyfile == NULL) {
@@ -487,6 +666,8 @@ void print_usage() {
     printf("       --debug=<lvl>                                \n");
     printf("       --logmode=<automatic|stdout|syslog|file>     \n");
     printf("       --logfile=<path>                             \n");
+    printf("       --log_format=<text|kv|json>                  \n");
+    printf("       --log_async                                  \n");
     printf("       --debug-result                               \n");
     printf("       --help|-h                                    \n");
     printf("       --daemon|-d                                  \n");
@@ -516,7 +697,24 @@ void print_usage() {
     printf("       --idle-timeout=<nr>                          \n");
     printf("       --max-jobs=<nr>                              \n");
     printf("       --spawn-rate=<nr>                            \n");
+    printf("       --min-spare-workers=<nr>                     \n");
+    printf("       --max-spare-workers=<nr>                     \n");
     printf("       --fork_on_exec                               \n");
+    printf("       --builtin_plugins                            \n");
+    printf("       --plugin_dir=<path>                          \n");
+    printf("       --plugin_isolation                           \n");
+    printf("       --async_results                              \n");
+    printf("       --result_batch_size=<nr>                     \n");
+    printf("       --result_batch_wait=<ms>                     \n");
+    printf("       --exec_plan_cache=<nr>                       \n");
+    printf("       --single_flight=<yes|no>                     \n");
+    printf("       --plugin_usage_dump=<seconds>                \n");
+    printf("       --plugin_usage_result=<yes|no>               \n");
+    printf("       --prefetch_jobs=<nr>                         \n");
+    printf("       --cpu_affinity=<no|core|node>                \n");
+    printf("       --cpu_affinity_mbind=<yes|no>                \n");
+    printf("       --queue_node=<queue>:<node>                  \n");
+    printf("       --metrics_listen=<unix:path|host:port>       \n");
     printf("       --load_limit1=load1                          \n");
     printf("       --load_limit5=load5                          \n");
     printf("       --load_limit15=load15                        \n");
@@ -528,6 +726,7 @@ void print_usage() {
     printf("       --use_embedded_perl_implicitly              \n");
     printf("       --use_perl_cache                            \n");
     printf("       --p1_file                                   \n");
+    printf("       --perl_precompile=<plugin>                  \n");
     printf("\n");
 #endif
     printf("Miscellaneous:\n");
@@ -545,7 +744,7 @@ void setup_child_communicator() {
     int x;
     int now = (int)time(NULL);
 
-    gm_log( GM_LOG_TRACE, "setup_child_communicator()\n");
+    GM_LOG( GM_LOG_TRACE, "setup_child_communicator()\n");
 
     /* Create the segment. */
     mod_gm_shm_key = getpid(); /* use pid as shm key */
@@ -565,10 +764,56 @@ void setup_child_communicator() {
     shm[SHM_WORKER_RUNNING]    = 0;   /* running worker    */
     shm[SHM_STATUS_WORKER_PID] = -1;  /* status worker pid */
     shm[SHM_WORKER_LAST_CHECK] = now; /* time of last check */
-    for(x = 0; x < mod_gm_opt->max_worker; x++) {
-        shm[x+SHM_SHIFT] = -1; /* normal worker   */
+    shm[SHM_WORKER_BUSY_SINCE] = 0;   /* no busy signal    */
+    for(x = 0; x < SHM_SCALE_UP_BUCKETS; x++) {
+        shm[x+SHM_SCALE_UP_HIST] = 0; /* scale up latency  */
+    }
+    shm[SHM_EPN_CACHE_HITS]    = 0;   /* epn cache hits    */
+    shm[SHM_EPN_CACHE_MISSES]  = 0;   /* epn cache misses  */
+    shm[SHM_EPN_COMPILE_MSEC]  = 0;   /* perl compile time */
+    /* all slots, max_worker may grow on reloads */
+    for(x = SHM_SHIFT; x < GM_SHM_SIZE / (int)sizeof(int); x++) {
+        shm[x] = -1; /* normal worker   */
+    }
+
+#ifdef GM_EVENT_SUPERVISOR
+    /* children use this to tell us when all of them are busy */
+    gm_busy_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(gm_busy_eventfd == -1) {
+        gm_log( GM_LOG_ERROR, "eventfd failed: %s\n", strerror(errno));
+    }
+#endif
+
+    return;
+}
+
+
+/* compile perl plugins before forking the worker */
+void precompile_perl_plugins() {
+#ifdef EMBEDDEDPERL
+    if(mod_gm_opt->perl_precompile_num == 0 || mod_gm_opt->enable_embedded_perl != GM_ENABLED)
+        return;
+
+    /* without the cache Persistent.pm compiles every plugin on each run again */
+    if(mod_gm_opt->use_perl_cache != GM_ENABLED) {
+        gm_log( GM_LOG_INFO, "use_perl_cache is disabled, perl_precompile is ignored\n");
+        return;
     }
 
+    if(init_embedded_perl(start_env) == GM_ERROR) {
+        gm_log( GM_LOG_ERROR, "cannot precompile perl plugins\n");
+        return;
+    }
+    precompile_epn_plugins(mod_gm_opt->perl_precompile, mod_gm_opt->perl_precompile_num);
+
+    /* move our statistics to the shared memory, otherwise every worker would report them again */
+    shm[SHM_EPN_CACHE_HITS]   += epn_cache_hits;
+    shm[SHM_EPN_CACHE_MISSES] += epn_cache_misses;
+    shm[SHM_EPN_COMPILE_MSEC] += epn_compile_usec / 1000;
+    epn_cache_hits   = 0;
+    epn_cache_misses = 0;
+    epn_compile_usec = 0;
+#endif
     return;
 }
 
@@ -577,51 +822,64 @@ void setup_child_communicator() {
 int adjust_number_of_worker(int min, int max, int cur_workers, int cur_jobs) {
     int perc_running;
     int idle;
+    int spare_missing;
     int target = min;
     double load[3];
 
     if(cur_workers == 0) {
-        gm_log( GM_LOG_TRACE3, "adjust_number_of_worker(min %d, max %d, worker %d, jobs %d) -> %d\n", min, max, cur_workers, cur_jobs, mod_gm_opt->min_worker);
-        return mod_gm_opt->min_worker;
+        if(target < mod_gm_opt->min_spare_workers)
+            target = mod_gm_opt->min_spare_workers;
+        if(target > max)
+            target = max;
+        GM_LOG( GM_LOG_TRACE3, "adjust_number_of_worker(min %d, max %d, worker %d, jobs %d) -> %d\n", min, max, cur_workers, cur_jobs, target);
+        return target;
     }
 
-    perc_running = (int)cur_jobs*100/cur_workers;
-    idle         = (int)cur_workers - cur_jobs;
+    perc_running  = (int)cur_jobs*100/cur_workers;
+    idle          = (int)cur_workers - cur_jobs;
+    spare_missing = mod_gm_opt->min_spare_workers - idle;
 
-    gm_log( GM_LOG_TRACE3, "adjust_number_of_worker(min %d, max %d, worker %d, jobs %d) = %d%% running\n", min, max, cur_workers, cur_jobs, perc_running);
+    GM_LOG( GM_LOG_TRACE3, "adjust_number_of_worker(min %d, max %d, worker %d, jobs %d) = %d%% running\n", min, max, cur_workers, cur_jobs, perc_running);
 
     if(cur_workers == max)
         return max;
 
-    /* > 90% workers running */
-    if(cur_jobs > 0 && ( perc_running > 90 || idle <= 2 )) {
+    /* > 90% workers running or not enough spare worker */
+    if(worker_pool_busy(cur_workers, cur_jobs, mod_gm_opt->min_spare_workers)) {
         if (getloadavg(load, 3) == -1) {
             gm_log( GM_LOG_ERROR, "failed to get current load\n");
             perror("getloadavg");
         }
         if(mod_gm_opt->load_limit1 > 0 && load[0] >= mod_gm_opt->load_limit1) {
-            gm_log( GM_LOG_TRACE, "load limit 1min hit, not starting any more workers: %1.2f > %1.2f\n", load[0], mod_gm_opt->load_limit1);
+            GM_LOG( GM_LOG_TRACE, "load limit 1min hit, not starting any more workers: %1.2f > %1.2f\n", load[0], mod_gm_opt->load_limit1);
             return cur_workers;
         }
         if(mod_gm_opt->load_limit5 > 0 && load[1] >= mod_gm_opt->load_limit5) {
-            gm_log( GM_LOG_TRACE, "load limit 5min hit, not starting any more workers: %1.2f > %1.2f\n", load[1], mod_gm_opt->load_limit5);
+            GM_LOG( GM_LOG_TRACE, "load limit 5min hit, not starting any more workers: %1.2f > %1.2f\n", load[1], mod_gm_opt->load_limit5);
             return cur_workers;
         }
         if(mod_gm_opt->load_limit15 > 0 && load[2] >= mod_gm_opt->load_limit15) {
-            gm_log( GM_LOG_TRACE, "load limit 15min hit, not starting any more workers: %1.2f > %1.2f\n", load[2], mod_gm_opt->load_limit15);
+            GM_LOG( GM_LOG_TRACE, "load limit 15min hit, not starting any more workers: %1.2f > %1.2f\n", load[2], mod_gm_opt->load_limit15);
             return cur_workers;
         }
 
         /* increase target number by spawn rate */
-        gm_log( GM_LOG_TRACE, "starting %d new workers\n", mod_gm_opt->spawn_rate);
+        GM_LOG( GM_LOG_TRACE, "starting %d new workers\n", mod_gm_opt->spawn_rate);
         target = cur_workers + mod_gm_opt->spawn_rate;
+
+        /* refill the spare pool at once */
+        if(cur_workers + spare_missing > target)
+            target = cur_workers + spare_missing;
+
+        /* don't start worker which retire_spare_worker() stops again */
+        target = limit_spare_worker(target, cur_workers, cur_jobs, mod_gm_opt->max_spare_workers);
     }
 
     /* dont go over the top */
     if(target > max) { target = max; }
 
     if(target != cur_workers)
-        gm_log( GM_LOG_TRACE3, "adjust_number_of_worker(min %d, max %d, worker %d, jobs %d) = %d%% running -> %d\n", min, max, cur_workers, cur_jobs, perc_running, target);
+        GM_LOG( GM_LOG_TRACE3, "adjust_number_of_worker(min %d, max %d, worker %d, jobs %d) = %d%% running -> %d\n", min, max, cur_workers, cur_jobs, perc_running, target);
 
     return target;
 }
@@ -629,7 +887,7 @@ int adjust_number_of_worker(int min, int max, int cur_workers, int cur_jobs) {
 
 /* do a clean exit */
 void clean_exit(int sig) {
-    gm_log( GM_LOG_TRACE, "clean_exit(%d)\n", sig);
+    GM_LOG( GM_LOG_TRACE, "clean_exit(%d)\n", sig);
 
     if(mod_gm_opt->pidfile != NULL)
         unlink(mod_gm_opt->pidfile);
@@ -637,6 +895,8 @@ void clean_exit(int sig) {
     /* stop all children */
     stop_children(GM_WORKER_STOP);
 
+    close_metrics_listener(metrics_fd);
+
     /* detach shm */
     if(shmdt(shm) < 0)
         perror("shmdt");
@@ -648,10 +908,11 @@ void clean_exit(int sig) {
     if( shmctl( shmid, IPC_RMID, 0 ) == -1 ) {
         perror("shmctl");
     } else {
-        gm_log( GM_LOG_DEBUG, "shared memory deleted\n");
+        GM_LOG( GM_LOG_DEBUG, "shared memory deleted\n");
     }
 
     gm_log( GM_LOG_INFO, "mod_gearman worker exited\n");
+    log_ring_stop();
     mod_gm_free_opt(mod_gm_opt);
     exit( EXIT_SUCCESS );
 }
@@ -663,7 +924,7 @@ void stop_children(int mode) {
     int waited = 0;
     int x;
 
-    gm_log( GM_LOG_TRACE, "stop_children(%d)\n", mode);
+    GM_LOG( GM_LOG_TRACE, "stop_children(%d)\n", mode);
 
     /* ignore some signals for now */
     signal(SIGTERM, SIG_IGN);
@@ -676,13 +937,14 @@ void stop_children(int mode) {
     killpg(0, SIGTERM);
     while(current_number_of_workers > 0) {
 
-        gm_log( GM_LOG_TRACE, "send SIGTERM\n");
+        GM_LOG( GM_LOG_TRACE, "send SIGTERM\n");
         save_kill(shm[SHM_STATUS_WORKER_PID], SIGTERM);
         for(x=SHM_SHIFT; x < mod_gm_opt->max_worker+SHM_SHIFT; x++) {
             save_kill(shm[x], SIGTERM);
         }
         while((chld = waitpid(-1, &status, WNOHANG)) != -1 && chld > 0) {
-            gm_log( GM_LOG_TRACE, "wait() %d exited with %d\n", chld, status);
+            GM_LOG( GM_LOG_TRACE, "wait() %d exited with %d\n", chld, status);
+            metrics_inc(GM_METRIC_REAPED);
         }
 
         if(mode == GM_WORKER_RESTART)
@@ -696,7 +958,7 @@ void stop_children(int mode) {
         count_current_worker(GM_DISABLED);
         if(current_number_of_workers == 0)
             break;
-        gm_log( GM_LOG_TRACE, "still waiting (%d) %d children missing...\n", waited, current_number_of_workers);
+        GM_LOG( GM_LOG_TRACE, "still waiting (%d) %d children missing...\n", waited, current_number_of_workers);
     }
 
     if(mode == GM_WORKER_STOP) {
@@ -705,7 +967,7 @@ void stop_children(int mode) {
         if(current_number_of_workers == 0)
             return;
 
-        gm_log( GM_LOG_TRACE, "sending SIGINT...\n");
+        GM_LOG( GM_LOG_TRACE, "sending SIGINT...\n");
         save_kill(shm[SHM_STATUS_WORKER_PID], SIGINT);
         for(x=SHM_SHIFT; x < mod_gm_opt->max_worker+SHM_SHIFT; x++) {
             save_kill(shm[x], SIGINT);
@@ -716,7 +978,8 @@ void stop_children(int mode) {
             sleep(3);
 
         while((chld = waitpid(-1, &status, WNOHANG)) != -1 && chld > 0) {
-            gm_log( GM_LOG_TRACE, "wait() %d exited with %d\n", chld, status);
+            GM_LOG( GM_LOG_TRACE, "wait() %d exited with %d\n", chld, status);
+            metrics_inc(GM_METRIC_REAPED);
         }
 
         /* kill them the hard way */
@@ -789,7 +1052,7 @@ int write_pid_file() {
 
     fprintf(fp, "%d\n", getpid());
     fclose(fp);
-    gm_log( GM_LOG_DEBUG, "pid file %s written\n", mod_gm_opt->pidfile );
+    GM_LOG( GM_LOG_DEBUG, "pid file %s written\n", mod_gm_opt->pidfile );
     return GM_OK;
 }
 
@@ -804,26 +1067,149 @@ int store_original_comandline(int argc, char **argv) {
 
 /* try to reload the config */
 void reload_config(int sig) {
-    gm_log( GM_LOG_TRACE, "reload_config(%d)\n", sig);
+    mod_gm_opt_t *new_opt;
+    char *old_metrics_listen;
+    int x, mode;
+
+    GM_LOG( GM_LOG_TRACE, "reload_config(%d)\n", sig);
+
+    /* find out what changed before replacing our options */
+    new_opt = read_worker_options();
+    if(new_opt == NULL) {
+        gm_log( GM_LOG_ERROR, "reload config failed, check your config\n");
+        return;
+    }
+    mode = compare_options(mod_gm_opt, new_opt);
+    mod_gm_free_opt(new_opt);
+
+    if(mode == GM_RELOAD_NONE) {
+        gm_log( GM_LOG_INFO, "config unchanged, nothing to reload\n");
+        return;
+    }
+
+    /* remember the current worker, max_worker may shrink */
+    if(mode == GM_RELOAD_RESTART)
+        start_rolling_restart();
+
+    old_metrics_listen = mod_gm_opt->metrics_listen != NULL ? gm_strdup(mod_gm_opt->metrics_listen) : NULL;
     if(parse_arguments(orig_argc, orig_argv) != GM_OK) {
         gm_log( GM_LOG_ERROR, "reload config failed, check your config\n");
+        rolling_restart_num = 0;
+        free(old_metrics_listen);
+        return;
+    }
+    flush_exec_plans();
+
+    /* move metrics endpoint */
+    if((old_metrics_listen == NULL) != (mod_gm_opt->metrics_listen == NULL)
+       || (old_metrics_listen != NULL && strcmp(old_metrics_listen, mod_gm_opt->metrics_listen))) {
+        close_metrics_listener(metrics_fd);
+        metrics_fd = -1;
+        if(mod_gm_opt->metrics_listen != NULL)
+            metrics_fd = open_metrics_listener(mod_gm_opt->metrics_listen);
+    }
+    free(old_metrics_listen);
+
+    /* worker re-register their queues after their current job */
+    if(mode == GM_RELOAD_QUEUES) {
+        for(x=SHM_SHIFT; x < mod_gm_opt->max_worker+SHM_SHIFT; x++) {
+            save_kill(shm[x], GM_WORKER_RELOAD_SIGNAL);
+        }
+        gm_log( GM_LOG_INFO, "reloading queues was successful\n");
         return;
     }
 
-    /*
-     * restart workers gracefully:
-     * send term signal to our children
-     * children will finish the current job and exit
-     */
-    stop_children(GM_WORKER_RESTART);
+    /* replace worker step by step, new worker are started by the population check */
+    continue_rolling_restart();
 
-    /* start status worker */
-    make_new_child(GM_WORKER_STATUS);
+    gm_log( GM_LOG_INFO, "reloading config was successful, restarting %d worker\n", rolling_restart_num);
+
+    return;
+}
+
+
+/* read options into a new structure, the current options stay untouched */
+mod_gm_opt_t *read_worker_options() {
+    mod_gm_opt_t *opt;
+    int i, errors = 0;
+
+    opt = gm_malloc(sizeof(mod_gm_opt_t));
+    set_default_options(opt);
+    for(i=1;i<orig_argc;i++) {
+        char * arg = gm_strdup( orig_argv[i] );
+        if(parse_args_line(opt, arg, 0) != GM_OK)
+            errors++;
+        free(arg);
+        if(errors > 0)
+            break;
+    }
+
+    if(opt->identifier == NULL) {
+        gethostname(hostname, GM_BUFFERSIZE-1);
+        opt->identifier = gm_strdup(hostname);
+    }
+
+    if(opt->logmode == GM_LOG_MODE_AUTO && opt->logfile)
+        opt->logmode = GM_LOG_MODE_FILE;
+
+    if(errors == 0 && verify_options(opt) != GM_OK)
+        errors++;
+    if(errors == 0 && opt->keyfile != NULL && read_keyfile(opt) != GM_OK)
+        errors++;
+
+    if(errors > 0) {
+        mod_gm_free_opt(opt);
+        return(NULL);
+    }
+
+    return(opt);
+}
+
+
+/* remember all running worker for a rolling restart */
+void start_rolling_restart() {
+    int x;
+
+    rolling_restart_num  = 0;
+    rolling_restart_next = 0;
+    if(shm[SHM_STATUS_WORKER_PID] != -1)
+        rolling_restart_pids[rolling_restart_num++] = shm[SHM_STATUS_WORKER_PID];
+    for(x=SHM_SHIFT; x < mod_gm_opt->max_worker+SHM_SHIFT; x++) {
+        if(shm[x] != -1)
+            rolling_restart_pids[rolling_restart_num++] = shm[x];
+    }
+
+    return;
+}
 
-    /* start normal worker */
-    check_worker_population();
 
-    gm_log( GM_LOG_INFO, "reloading config was successful\n");
+/* stop the next worker of a rolling restart once the previous ones exited */
+void continue_rolling_restart() {
+    int x, running = 0, batch;
+
+    if(rolling_restart_num == 0)
+        return;
+
+    for(x = 0; x < rolling_restart_next; x++) {
+        if(pid_alive(rolling_restart_pids[x]) == TRUE)
+            running++;
+    }
+
+    batch = current_number_of_workers / GM_ROLLING_RESTART_PARTS;
+    if(batch < 1)
+        batch = 1;
+    while(running < batch && rolling_restart_next < rolling_restart_num) {
+        GM_LOG( GM_LOG_TRACE, "rolling restart: stopping worker %d\n", abs(rolling_restart_pids[rolling_restart_next]));
+        save_kill(rolling_restart_pids[rolling_restart_next], SIGTERM);
+        rolling_restart_next++;
+        running++;
+    }
+
+    if(running == 0 && rolling_restart_next == rolling_restart_num) {
+        GM_LOG( GM_LOG_DEBUG, "rolling restart finished\n");
+        rolling_restart_num  = 0;
+        rolling_restart_next = 0;
+    }
 
     return;
 }
@@ -834,7 +1220,7 @@ int get_next_shm_index() {
     int x;
     int next_index = 0;
 
-    gm_log( GM_LOG_TRACE, "get_next_shm_index()\n" );
+    GM_LOG( GM_LOG_TRACE, "get_next_shm_index()\n" );
 
     for(x = SHM_SHIFT; x < mod_gm_opt->max_worker+SHM_SHIFT; x++) {
         if(shm[x] == -1) {
@@ -849,7 +1235,7 @@ int get_next_shm_index() {
         clean_exit(15);
         exit(EXIT_FAILURE);
     }
-    gm_log( GM_LOG_TRACE, "get_next_shm_index() -> %d\n", next_index );
+    GM_LOG( GM_LOG_TRACE, "get_next_shm_index() -> %d\n", next_index );
 
     return next_index;
 }
@@ -28,9 +28,21 @@
 #include "utils.h"
 #include "check_utils.h"
 #include "gearman_utils.h"
+#include "dl_plugins.h"
+#include "result_sender.h"
+#include "single_flight.h"
+#include "plugin_usage.h"
+#include "job_window.h"
+#include "cpu_affinity.h"
+#include "worker_metrics.h"
+#include "exec_plan.h"
+#include "log_ring.h"
 #ifdef EMBEDDEDPERL
 #include "epn_utils.h"
 #endif
+#ifdef GM_EVENT_SUPERVISOR
+#include <stdint.h>
+#endif
 
 gearman_worker_st worker;
 gearman_client_st client;
@@ -43,7 +55,11 @@ int jobs_done = 0;
 int sleep_time_after_error = 1;
 int worker_run_mode;
 int shm_index = 0;
+int gm_busy_eventfd = -1;
 volatile sig_atomic_t shmid;
+volatile sig_atomic_t worker_reload_requested = FALSE;
+volatile sig_atomic_t worker_stop_requested   = FALSE;
+static int *spare_shm = NULL;
 
 /* callback for task completed */
 #ifdef EMBEDDEDPERL
@@ -52,11 +68,12 @@ void worker_client(int worker_mode, int indx, int shid, char **env) {
 void worker_client(int worker_mode, int indx, int shid) {
 #endif
 
-    gm_log( GM_LOG_TRACE, "%s worker client started\n", (worker_mode == GM_WORKER_STATUS ? "status" : "job" ));
+    GM_LOG( GM_LOG_TRACE, "%s worker client started\n", (worker_mode == GM_WORKER_STATUS ? "status" : "job" ));
 
     /* set signal handlers for a clean exit */
     signal(SIGINT, clean_worker_exit);
-    signal(SIGTERM,clean_worker_exit);
+    signal(SIGTERM,stop_sighandler);
+    signal(GM_WORKER_RELOAD_SIGNAL, reload_sighandler);
 
     worker_run_mode = worker_mode;
     shm_index       = indx;
@@ -65,6 +82,20 @@ void worker_client(int worker_mode, int indx, int shid) {
 
     gethostname(hostname, GM_BUFFERSIZE-1);
 
+    /* keep the shm attached, the idle signal handler counts idle worker from it */
+    if(worker_mode == GM_WORKER_MULTI) {
+        if((spare_shm = shmat(shmid, NULL, SHM_RDONLY)) == (int *) -1) {
+            perror("shmat");
+            spare_shm = NULL;
+        }
+    }
+
+    /* pin worker and its plugins, must be done before registering queues */
+    if(worker_mode == GM_WORKER_MULTI)
+        set_worker_affinity(indx - SHM_SHIFT);
+    else if(worker_mode == GM_WORKER_STANDALONE)
+        set_worker_affinity(0);
+
     /* create worker */
     if(set_worker(&worker) != GM_OK) {
         gm_log( GM_LOG_ERROR, "cannot start worker\n" );
@@ -95,6 +126,12 @@ void worker_client(int worker_mode, int indx, int shid) {
     }
 #endif
 
+    if(worker_mode != GM_WORKER_STATUS)
+        init_dl_plugins();
+
+    if(worker_mode != GM_WORKER_STATUS && mod_gm_opt->async_results == GM_ENABLED)
+        start_result_sender();
+
     worker_loop();
 
     return;
@@ -107,6 +144,37 @@ void worker_loop() {
     while ( 1 ) {
         gearman_return_t ret;
 
+        /* apply reloaded queues between jobs */
+        if (worker_reload_requested == TRUE)
+            reload_worker_queues();
+
+        /* stop requested while jobs were prefetched, those run first */
+        if (worker_stop_requested == TRUE && job_window_size() == 0) {
+            GM_LOG( GM_LOG_TRACE, "prefetched jobs done -> exiting...\n" );
+            worker_exit( EXIT_SUCCESS );
+        }
+
+        /* exit after max-jobs, prefetched jobs are finished before */
+        if (mod_gm_opt->max_jobs > 0 && jobs_done >= mod_gm_opt->max_jobs && job_window_size() == 0) {
+            GM_LOG( GM_LOG_TRACE, "jobs done: %i -> exiting...\n", jobs_done );
+            worker_exit( EXIT_SUCCESS );
+        }
+
+        /* fill the window with jobs which are ready right now, then run the most urgent one */
+        if(job_window_size() > 0) {
+            if(job_window_size() < mod_gm_opt->prefetch_jobs && worker_stop_requested == FALSE
+               && (mod_gm_opt->max_jobs == 0 || jobs_done < mod_gm_opt->max_jobs)) {
+                alarm(0);
+                gearman_worker_set_timeout( &worker, GM_JOB_WINDOW_WAIT );
+                ret = gearman_worker_work( &worker );
+                gearman_worker_set_timeout( &worker, -1 );
+                if(ret == GEARMAN_SUCCESS)
+                    continue;
+            }
+            run_window_job();
+            continue;
+        }
+
         /* wait for a job, otherwise exit when hit the idle timeout */
         if(mod_gm_opt->idle_timeout > 0 && ( worker_run_mode == GM_WORKER_MULTI || worker_run_mode == GM_WORKER_STATUS )) {
             signal(SIGALRM, idle_sighandler);
@@ -116,11 +184,9 @@ void worker_loop() {
         signal(SIGPIPE, SIG_IGN);
         ret = gearman_worker_work( &worker );
 
-        if (mod_gm_opt->max_jobs > 0 && jobs_done >= mod_gm_opt->max_jobs) {
-            gm_log( GM_LOG_TRACE, "jobs done: %i -> exiting...\n", jobs_done );
-            clean_worker_exit(0);
-            _exit( EXIT_SUCCESS );
-        }
+        /* woken up by a reload */
+        if ( ret == GEARMAN_TIMEOUT && worker_reload_requested == TRUE )
+            continue;
 
         if ( ret != GEARMAN_SUCCESS ) {
             gm_log( GM_LOG_ERROR, "worker error: %s\n", gearman_worker_error( &worker ) );
@@ -137,6 +203,7 @@ void worker_loop() {
                 sleep_time_after_error = 60;
 
             /* create new connections */
+            metrics_inc(GM_METRIC_RECONNECTS);
             set_worker( &worker );
             create_client( mod_gm_opt->server_list, &client );
             current_client = &client;
@@ -162,6 +229,7 @@ void *get_job( gearman_job_st *job, void *context, size_t *result_size, gearman_
     char *ptr;
     int is_notification_job = FALSE;
     int is_eventhandler_job = FALSE;
+    int prefetched = FALSE;
 
     /* reset timeout for now, will be set befor execution again */
     alarm(0);
@@ -172,7 +240,7 @@ void *get_job( gearman_job_st *job, void *context, size_t *result_size, gearman_
     /* send start signal to parent */
     set_state(GM_JOB_START);
 
-    gm_log( GM_LOG_TRACE, "get_job()\n" );
+    GM_LOG( GM_LOG_TRACE, "get_job()\n" );
 
     /* contect is unused */
     context = context;
@@ -194,8 +262,8 @@ void *get_job( gearman_job_st *job, void *context, size_t *result_size, gearman_
     workload = gm_malloc(sizeof(char*)*wsize+1);
     strncpy(workload, (const char*)gearman_job_workload(job), wsize);
     workload[wsize] = '\0';
-    gm_log( GM_LOG_TRACE, "got new job %s\n", gearman_job_handle( job ) );
-    gm_log( GM_LOG_TRACE, "%d +++>\n%s\n<+++\n", strlen(workload), workload );
+    GM_LOG( GM_LOG_TRACE, "got new job %s\n", gearman_job_handle( job ) );
+    GM_LOG( GM_LOG_TRACE, "%d +++>\n%s\n<+++\n", strlen(workload), workload );
 
     /* decrypt data */
     decrypted_data = gm_malloc(wsize*2);
@@ -209,13 +277,16 @@ void *get_job( gearman_job_st *job, void *context, size_t *result_size, gearman_
         free(decrypted_orig);
         return NULL;
     }
-    gm_log( GM_LOG_TRACE, "%d --->\n%s\n<---\n", strlen(decrypted_data), decrypted_data );
+    GM_LOG( GM_LOG_TRACE, "%d --->\n%s\n<---\n", strlen(decrypted_data), decrypted_data );
 
     /* set result pointer to success */
     *ret_ptr= GEARMAN_SUCCESS;
 
     exec_job = ( gm_job_t * )gm_malloc( sizeof *exec_job );
     set_default_job(exec_job, mod_gm_opt);
+    gettimeofday(&exec_job->pickup_time, NULL);
+    if(gearman_job_function_name(job) != NULL)
+        exec_job->queue = gm_strdup(gearman_job_function_name(job));
 
     valid_lines = 0;
     while ( (ptr = strsep(&decrypted_data, "\n" )) != NULL ) {
@@ -263,6 +334,10 @@ void *get_job( gearman_job_st *job, void *context, size_t *result_size, gearman_
         } else if ( !strcmp( key, "core_time" ) ) {
             string2timeval(value, &exec_job->core_time);
             valid_lines++;
+        } else if ( !strcmp( key, "trace_id" ) ) {
+            free(exec_job->trace_id);
+            exec_job->trace_id = gm_strdup(value);
+            valid_lines++;
         } else if ( !strcmp( key, "timeout" ) ) {
             exec_job->timeout = atoi(value);
             valid_lines++;
@@ -313,6 +388,10 @@ void *get_job( gearman_job_st *job, void *context, size_t *result_size, gearman_
 
     if(valid_lines == 0) {
         gm_log( GM_LOG_ERROR, "discarded invalid job (%s), check your encryption settings\n", gearman_job_handle( job ) );
+    } else if(prefetch_job(exec_job) == TRUE) {
+        /* will be executed later from the window, which keeps the slot busy */
+        exec_job   = NULL;
+        prefetched = TRUE;
     } else {
         do_exec_job();
     }
@@ -335,7 +414,8 @@ void *get_job( gearman_job_st *job, void *context, size_t *result_size, gearman_
 
     free(decrypted_orig);
     free(decrypted_data_c);
-    free_job(exec_job);
+    if(exec_job != NULL)
+        free_job(exec_job);
 
     if(is_notification_job == TRUE) {
         /* clear the environment */
@@ -348,19 +428,89 @@ void *get_job( gearman_job_st *job, void *context, size_t *result_size, gearman_
         }
     }
 
-    /* send finish signal to parent */
-    set_state(GM_JOB_END);
+    /* send finish signal to parent, prefetched jobs are counted when they have been run */
+    if(prefetched == FALSE)
+        set_state(GM_JOB_END);
 
     return NULL;
 }
 
 
+/* put host and service checks into the job window */
+int prefetch_job(gm_job_t *job) {
+    gm_job_t *superseded;
+
+    if(mod_gm_opt->prefetch_jobs <= 0 || job->type == NULL || job->command_line == NULL)
+        return FALSE;
+    if(strcmp( job->type, "service" ) && strcmp( job->type, "host" ))
+        return FALSE;
+
+    superseded = job_window_add(job);
+    if(superseded != NULL) {
+        GM_LOG( GM_LOG_DEBUG, "check superseded by newer job: %s%s%s\n", superseded->host_name, superseded->service_description != NULL ? " - " : "", superseded->service_description != NULL ? superseded->service_description : "");
+        send_stale_result(superseded, "(Superseded By Newer Check)");
+        free_job(superseded);
+    }
+    GM_LOG( GM_LOG_TRACE, "prefetched job, %d jobs in window\n", job_window_size());
+
+    return TRUE;
+}
+
+
+/* run prefetched job with the earliest deadline */
+void run_window_job() {
+    sigset_t block_mask;
+
+    exec_job = job_window_next();
+    if(exec_job == NULL)
+        return;
+
+    set_state(GM_JOB_START);
+
+    /* ignore sigterms while running job */
+    sigemptyset(&block_mask);
+    sigaddset(&block_mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &block_mask, NULL);
+
+    /* too old jobs are dropped by max_age in do_exec_job */
+    do_exec_job();
+
+    sigprocmask(SIG_UNBLOCK, &block_mask, NULL);
+
+    free_job(exec_job);
+    exec_job = NULL;
+
+    set_state(GM_JOB_END);
+}
+
+
+/* send result for a job which will not be executed */
+void send_stale_result(gm_job_t *job, char *reason) {
+    struct timeval now;
+    char source[GM_BUFFERSIZE];
+
+    gettimeofday(&now, NULL);
+    if(job->start_time.tv_sec == 0)
+        job->start_time = now;
+    job->finish_time   = now;
+    job->return_code   = 3;
+    job->early_timeout = 0;
+    free(job->output);
+    job->output = gm_strdup(reason);
+    snprintf( source, sizeof( source )-1, "Mod-Gearman Worker @ %s", mod_gm_opt->identifier);
+    free(job->source);
+    job->source = gm_strdup(source);
+
+    send_result_back(job);
+}
+
+
 /* do some job */
 void do_exec_job( ) {
     struct timeval start_time, end_time;
-    int latency, age;
+    int latency, age, flight = GM_FLIGHT_NONE;
 
-    gm_log( GM_LOG_TRACE, "do_exec_job()\n" );
+    GM_LOG( GM_LOG_TRACE, "do_exec_job()\n" );
 
     if(exec_job->type == NULL) {
         gm_log( GM_LOG_ERROR, "discarded invalid job, no type given\n" );
@@ -372,16 +522,16 @@ void do_exec_job( ) {
     }
 
     if ( !strcmp( exec_job->type, "service" ) ) {
-        gm_log( GM_LOG_DEBUG, "got service job: %s - %s\n", exec_job->host_name, exec_job->service_description);
+        GM_LOG( GM_LOG_DEBUG, "got service job: %s - %s\n", exec_job->host_name, exec_job->service_description);
     }
     else if ( !strcmp( exec_job->type, "host" ) ) {
-        gm_log( GM_LOG_DEBUG, "got host job: %s\n", exec_job->host_name);
+        GM_LOG( GM_LOG_DEBUG, "got host job: %s\n", exec_job->host_name);
     }
     else if ( !strcmp( exec_job->type, "eventhandler" ) ) {
-        gm_log( GM_LOG_DEBUG, "got eventhandler job\n");
+        GM_LOG( GM_LOG_DEBUG, "got eventhandler job\n");
     }
     else if ( !strcmp( exec_job->type, "notification" ) ) {
-        gm_log( GM_LOG_DEBUG, "got notification job\n");
+        GM_LOG( GM_LOG_DEBUG, "got notification job\n");
     }
 
     /* check proper timeout value */
@@ -395,7 +545,7 @@ void do_exec_job( ) {
     latency = start_time.tv_sec - exec_job->next_check.tv_sec;
     age     = start_time.tv_sec - exec_job->core_time.tv_sec;
 
-    gm_log( GM_LOG_TRACE, "timeout: %i, core latency: %i\n", exec_job->timeout, latency);
+    GM_LOG( GM_LOG_TRACE, "timeout: %i, core latency: %i\n", exec_job->timeout, latency);
 
     /* job is too old */
     if(mod_gm_opt->max_age > 0 && age > mod_gm_opt->max_age) {
@@ -423,13 +573,29 @@ void do_exec_job( ) {
     exec_job->early_timeout = 0;
 
     /* run the command */
-    gm_log( GM_LOG_TRACE, "command: %s\n", exec_job->command_line);
+    GM_LOG( GM_LOG_TRACE, "command: %s\n", exec_job->command_line);
     current_job = exec_job;
-    execute_safe_command(exec_job, mod_gm_opt->fork_on_exec, mod_gm_opt->identifier );
+    /* eventhandler and notifications have side effects and always run */
+    if ( !strcmp( exec_job->type, "service" ) || !strcmp( exec_job->type, "host" ) ) {
+        flight = single_flight_join(exec_job);
+    }
+    if(flight == GM_FLIGHT_SHARED) {
+        GM_LOG( GM_LOG_DEBUG, "reused result of identical command: %s\n", exec_job->command_line);
+    } else {
+        execute_safe_command(exec_job, mod_gm_opt->fork_on_exec, mod_gm_opt->identifier );
+        if(flight >= 0)
+            single_flight_done(flight, exec_job);
+        if(exec_job->has_rusage == TRUE)
+            add_plugin_usage(exec_job->command_line, &exec_job->rusage);
+    }
     current_job = NULL;
+    metrics_job_done(exec_job);
 
     if ( !strcmp( exec_job->type, "service" ) || !strcmp( exec_job->type, "host" ) ) {
         send_result_back(exec_job);
+        /* queued results are accounted by the result sender */
+        if(gm_result_sender == NULL)
+            metrics_result_sent(&exec_job->finish_time);
     }
 
     return;
@@ -438,12 +604,21 @@ void do_exec_job( ) {
 
 /* create the worker */
 int set_worker( gearman_worker_st *w ) {
-    int x = 0;
 
-    gm_log( GM_LOG_TRACE, "set_worker()\n" );
+    GM_LOG( GM_LOG_TRACE, "set_worker()\n" );
 
     create_worker( mod_gm_opt->server_list, w );
 
+    register_job_functions( w );
+
+    return GM_OK;
+}
+
+
+/* register all configured queues */
+void register_job_functions( gearman_worker_st *w ) {
+    int x = 0;
+
     if(worker_run_mode == GM_WORKER_STATUS) {
         /* register status function */
         char status_queue[GM_BUFFERSIZE];
@@ -453,21 +628,21 @@ int set_worker( gearman_worker_st *w ) {
     else {
         /* normal worker */
         if(mod_gm_opt->hosts == GM_ENABLED)
-            worker_add_function( w, "host", get_job );
+            add_job_function( w, "host" );
 
         if(mod_gm_opt->services == GM_ENABLED)
-            worker_add_function( w, "service", get_job );
+            add_job_function( w, "service" );
 
         if(mod_gm_opt->events == GM_ENABLED)
-            worker_add_function( w, "eventhandler", get_job );
+            add_job_function( w, "eventhandler" );
 
         if(mod_gm_opt->notifications == GM_ENABLED)
-            worker_add_function( w, "notification", get_job );
+            add_job_function( w, "notification" );
 
         while ( mod_gm_opt->hostgroups_list[x] != NULL ) {
             char buffer[GM_BUFFERSIZE];
             snprintf( buffer, (sizeof(buffer)-1), "hostgroup_%s", mod_gm_opt->hostgroups_list[x] );
-            worker_add_function( w, buffer, get_job );
+            add_job_function( w, buffer );
             x++;
         }
 
@@ -475,7 +650,7 @@ int set_worker( gearman_worker_st *w ) {
         while ( mod_gm_opt->servicegroups_list[x] != NULL ) {
             char buffer[GM_BUFFERSIZE];
             snprintf( buffer, (sizeof(buffer)-1), "servicegroup_%s", mod_gm_opt->servicegroups_list[x] );
-            worker_add_function( w, buffer, get_job );
+            add_job_function( w, buffer );
             x++;
         }
     }
@@ -483,18 +658,101 @@ int set_worker( gearman_worker_st *w ) {
     /* add our dummy queue, gearman sometimes forgets the last added queue */
     worker_add_function( w, "dummy", dummy);
 
-    return GM_OK;
+    return;
+}
+
+
+/* reread config and register changed queues, called between jobs */
+void reload_worker_queues() {
+    mod_gm_opt_t *new_opt;
+    int mode;
+
+    GM_LOG( GM_LOG_TRACE, "reload_worker_queues()\n" );
+
+    worker_reload_requested = FALSE;
+    gearman_worker_set_timeout( &worker, -1 );
+
+    new_opt = read_worker_options();
+    if(new_opt == NULL) {
+        gm_log( GM_LOG_ERROR, "reloading queues failed, check your config\n" );
+        return;
+    }
+
+    mode = compare_options(mod_gm_opt, new_opt);
+    if(mode == GM_RELOAD_NONE) {
+        mod_gm_free_opt(new_opt);
+        return;
+    }
+
+    /* config changed again since the supervisor read it, start over with a new worker */
+    if(mode == GM_RELOAD_RESTART) {
+        gm_log( GM_LOG_INFO, "config changed beyond queues, restarting worker\n" );
+        mod_gm_free_opt(new_opt);
+        worker_exit( EXIT_SUCCESS );
+    }
+
+    /* the sender thread must not see the options while they are replaced */
+    stop_result_sender();
+
+    /* keep our logfile */
+    new_opt->logfile_fp = mod_gm_opt->logfile_fp;
+    mod_gm_opt->logfile_fp = NULL;
+    mod_gm_free_opt(mod_gm_opt);
+    mod_gm_opt = new_opt;
+    flush_exec_plans();
+
+    if(worker_run_mode != GM_WORKER_STATUS && mod_gm_opt->async_results == GM_ENABLED)
+        start_result_sender();
+
+    gearman_worker_unregister_all( &worker );
+    register_job_functions( &worker );
+    gm_log( GM_LOG_INFO, "re-registered queues after config reload\n" );
+
+    return;
+}
+
+/* register job function unless the queue belongs to another numa node */
+void add_job_function( gearman_worker_st *w, char *queue ) {
+    if(queue_allowed_on_worker(queue) == FALSE) {
+        GM_LOG( GM_LOG_DEBUG, "queue %s is served on another numa node\n", queue );
+        return;
+    }
+    worker_add_function( w, queue, get_job );
 }
 
 /* called when worker runs into exit timeout */
 void exit_sighandler(int sig) {
-    gm_log( GM_LOG_TRACE, "exit_sighandler(%i)\n", sig );
+    GM_LOG( GM_LOG_TRACE, "exit_sighandler(%i)\n", sig );
     _exit( EXIT_SUCCESS );
 }
 
+/* graceful stop, prefetched jobs are run before exiting */
+void stop_sighandler(int sig) {
+    if(job_window_size() == 0)
+        clean_worker_exit(sig);
+    GM_LOG( GM_LOG_TRACE, "stop_sighandler(%i)\n", sig );
+    worker_stop_requested = TRUE;
+    gearman_worker_set_timeout( &worker, 1 );
+}
+
+/* queues will be reloaded after the current job, wake up an idle worker */
+void reload_sighandler(int sig) {
+    GM_LOG( GM_LOG_TRACE, "reload_sighandler(%i)\n", sig );
+    worker_reload_requested = TRUE;
+    gearman_worker_set_timeout( &worker, 1 );
+}
+
+
 /* called when worker runs into idle timeout */
 void idle_sighandler(int sig) {
-    gm_log( GM_LOG_TRACE, "idle_sighandler(%i)\n", sig );
+    GM_LOG( GM_LOG_TRACE, "idle_sighandler(%i)\n", sig );
+
+    /* stay in the spare pool */
+    if(worker_run_mode == GM_WORKER_MULTI && is_spare_worker_needed() == TRUE) {
+        alarm(mod_gm_opt->idle_timeout);
+        return;
+    }
+
     clean_worker_exit(0);
     _exit( EXIT_SUCCESS );
 }
@@ -504,7 +762,7 @@ void idle_sighandler(int sig) {
 void set_state(int status) {
     int *shm;
 
-    gm_log( GM_LOG_TRACE, "set_state(%d)\n", status );
+    GM_LOG( GM_LOG_TRACE, "set_state(%d)\n", status );
 
     if(worker_run_mode == GM_WORKER_STANDALONE)
         return;
@@ -516,32 +774,49 @@ void set_state(int status) {
     /* Now we attach the segment to our data space. */
     if ((shm = shmat(shmid, NULL, 0)) == (int *) -1) {
         perror("shmat");
-        gm_log( GM_LOG_TRACE, "worker finished: %d\n", getpid() );
+        GM_LOG( GM_LOG_TRACE, "worker finished: %d\n", getpid() );
         clean_worker_exit(0);
         _exit( EXIT_FAILURE );
     }
 
-    if(status == GM_JOB_START)
+    /* the slot stays busy while prefetched jobs are waiting, so signal only once.
+     * A slot freed by the supervisor is not taken again */
+    if(status == GM_JOB_START && shm[shm_index] != current_pid && shm[shm_index] != -1) {
         shm[shm_index] = current_pid;
+        signal_busy_worker(shm);
+    }
     if(status == GM_JOB_END) {
         shm[SHM_JOBS_DONE]++; /* increase jobs done */
 
+#ifdef EMBEDDEDPERL
+        /* add our embedded perl statistics */
+        shm[SHM_EPN_CACHE_HITS]   += epn_cache_hits;
+        shm[SHM_EPN_CACHE_MISSES] += epn_cache_misses;
+        shm[SHM_EPN_COMPILE_MSEC] += epn_compile_usec / 1000;
+        epn_cache_hits    = 0;
+        epn_cache_misses  = 0;
+        epn_compile_usec %= 1000;
+#endif
+
         shm[SHM_WORKER_LAST_CHECK] = (int)time(NULL); /* set last job date */
 
-        /* status slot changed to -1 -> exit */
+        /* status slot changed to -1 -> exit, after running the prefetched jobs gearmand handed out already */
         if( shm[shm_index] == -1 ) {
-            gm_log( GM_LOG_TRACE, "worker finished: %d\n", getpid() );
-            clean_worker_exit(0);
-            _exit( EXIT_SUCCESS );
+            if(job_window_size() == 0) {
+                GM_LOG( GM_LOG_TRACE, "worker finished: %d\n", getpid() );
+                worker_exit( EXIT_SUCCESS );
+            }
+            worker_stop_requested = TRUE;
         }
 
         /* pid in our status slot changed, this should not happen -> exit */
-        if( shm[shm_index] != current_pid && shm[shm_index] != -current_pid ) {
+        else if( shm[shm_index] != current_pid && shm[shm_index] != -current_pid ) {
             gm_log( GM_LOG_ERROR, "double used worker slot: %d != %d\n", current_pid, shm[shm_index] );
-            clean_worker_exit(0);
-            _exit( EXIT_FAILURE );
+            worker_exit( EXIT_FAILURE );
+        }
+        else if(job_window_size() == 0) {
+            shm[shm_index] = -current_pid;
         }
-        shm[shm_index] = -current_pid;
     }
 
     /* detach from shared memory */
@@ -554,6 +829,111 @@ void set_state(int status) {
 }
 
 
+/* returns true if we would drop below min_spare_workers when exiting,
+ * called from the idle signal handler, so only reads the attached shm */
+int is_spare_worker_needed() {
+    int x, idle = 0;
+
+    if(mod_gm_opt->min_spare_workers <= 0 || spare_shm == NULL)
+        return FALSE;
+
+    for(x = SHM_SHIFT; x < mod_gm_opt->max_worker+SHM_SHIFT; x++) {
+        if(spare_shm[x] < -1)
+            idle++;
+    }
+
+    return(idle <= mod_gm_opt->min_spare_workers ? TRUE : FALSE);
+}
+
+
+/* returns true if more worker should be started */
+int worker_pool_busy(int workers, int jobs, int min_spare) {
+    int idle = workers - jobs;
+    if(workers <= 0)
+        return TRUE;
+    if(jobs > 0 && (jobs*100/workers > GM_BUSY_PERCENT || idle <= GM_BUSY_IDLE_WORKER))
+        return TRUE;
+    if(idle < min_spare)
+        return TRUE;
+    return FALSE;
+}
+
+
+/* returns true if there are more idle worker than max_spare_workers */
+int worker_pool_surplus(int workers, int jobs, int min_worker, int max_spare) {
+    if(max_spare <= 0 || workers - jobs <= max_spare)
+        return FALSE;
+    if(workers <= min_worker)
+        return FALSE;
+    return TRUE;
+}
+
+
+/* limit new worker, so worker_pool_surplus() would not stop them again */
+int limit_spare_worker(int target, int workers, int jobs, int max_spare) {
+    if(max_spare <= 0 || target <= workers)
+        return target;
+    if(target - jobs > max_spare)
+        target = jobs + max_spare;
+    if(target < workers)
+        target = workers;
+    return target;
+}
+
+
+/* wake up the supervisor if (nearly) all worker are busy */
+void signal_busy_worker(int *shm) {
+#ifdef GM_EVENT_SUPERVISOR
+    int x, total = 0, running = 0;
+    uint64_t one = 1;
+
+    if(gm_busy_eventfd == -1)
+        return;
+
+    for(x = SHM_SHIFT; x < mod_gm_opt->max_worker+SHM_SHIFT; x++) {
+        if(shm[x] != -1)
+            total++;
+        if(shm[x] > 0)
+            running++;
+    }
+
+    /* same threshold as used by adjust_number_of_worker() */
+    if(total >= mod_gm_opt->max_worker)
+        return;
+    if(!worker_pool_busy(total, running, mod_gm_opt->min_spare_workers))
+        return;
+    if(limit_spare_worker(total+1, total, running, mod_gm_opt->max_spare_workers) == total)
+        return;
+
+    if(shm[SHM_WORKER_BUSY_SINCE] == 0)
+        shm[SHM_WORKER_BUSY_SINCE] = get_msec_timestamp();
+    if(write(gm_busy_eventfd, &one, sizeof(one)) != sizeof(one))
+        GM_LOG( GM_LOG_TRACE, "signal_busy_worker() write failed: %s\n", strerror(errno));
+#else
+    shm = shm;
+#endif
+    return;
+}
+
+
+/* return a monotonic, wrapping millisecond timestamp, never 0 */
+int get_msec_timestamp() {
+    struct timespec ts;
+    long long msec;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    msec = (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    return (int)(msec % GM_MSEC_TIMESTAMP_WRAP) + 1;
+}
+
+
+/* exit from the main loop, flushes the result sender first which is not possible from signal handlers */
+void worker_exit(int status) {
+    stop_result_sender();
+    clean_worker_exit(0);
+    _exit( status );
+}
+
+
 /* do a clean exit */
 void clean_worker_exit(int sig) {
     int *shm;
@@ -562,7 +942,7 @@ void clean_worker_exit(int sig) {
     signal(SIGALRM, exit_sighandler);
     alarm(30);
 
-    gm_log( GM_LOG_TRACE, "clean_worker_exit(%d)\n", sig);
+    GM_LOG( GM_LOG_TRACE, "clean_worker_exit(%d)\n", sig);
 
     /* clear gearmans job, otherwise it would be retried and retried */
     if(current_gearman_job != NULL) {
@@ -576,10 +956,24 @@ void clean_worker_exit(int sig) {
         kill_child_checks();
     }
 
-    gm_log( GM_LOG_TRACE, "cleaning worker\n");
+    /* prefetched jobs will not be executed anymore */
+    while(job_window_size() > 0) {
+        gm_job_t *job = job_window_next();
+        send_stale_result(job, "(Could Not Start Check In Time)");
+        free_job(job);
+    }
+
+    /* this runs inside signal handlers, so the sender thread is not joined here.
+     * Normal exits flush it before, see worker_exit() */
+    request_result_sender_stop();
+    if(wait_result_sender_idle(GM_RESULT_SENDER_EXIT_WAIT) == FALSE)
+        GM_LOG( GM_LOG_DEBUG, "result sender still busy, queued results are lost\n");
+    log_ring_stop();
+
+    GM_LOG( GM_LOG_TRACE, "cleaning worker\n");
     gearman_worker_unregister_all(&worker);
     gearman_job_free_all( &worker );
-    gm_log( GM_LOG_TRACE, "cleaning client\n");
+    GM_LOG( GM_LOG_TRACE, "cleaning client\n");
     gearman_client_free( &client );
     mod_gm_free_opt(mod_gm_opt);
 
@@ -587,13 +981,16 @@ void clean_worker_exit(int sig) {
     deinit_embedded_perl(0);
 #endif
 
+    if(worker_run_mode != GM_WORKER_STATUS)
+        teardown_dl_plugins();
+
     if(worker_run_mode == GM_WORKER_STANDALONE)
         exit( EXIT_SUCCESS );
 
     /* Now we attach the segment to our data space. */
     if((shm = shmat(shmid, NULL, 0)) == (int *) -1) {
         perror("shmat");
-        gm_log( GM_LOG_TRACE, "worker finished: %d\n", getpid() );
+        GM_LOG( GM_LOG_TRACE, "worker finished: %d\n", getpid() );
         _exit( EXIT_FAILURE );
     }
     /* clean our pid from worker list */
@@ -611,12 +1008,13 @@ void clean_worker_exit(int sig) {
 
 /* answer status querys */
 void *return_status( gearman_job_st *job, void *context, size_t *result_size, gearman_return_t *ret_ptr ) {
-    int wsize;
+    int wsize, x, len;
+    int scale_up_bucket_limits[SHM_SCALE_UP_BUCKETS] = GM_SCALE_UP_BUCKET_LIMITS;
     char workload[GM_BUFFERSIZE];
     int *shm;
     char * result;
 
-    gm_log( GM_LOG_TRACE, "return_status()\n" );
+    GM_LOG( GM_LOG_TRACE, "return_status()\n" );
 
     /* contect is unused */
     context = context;
@@ -625,8 +1023,8 @@ void *return_status( gearman_job_st *job, void *context, size_t *result_size, ge
     wsize = gearman_job_workload_size(job);
     strncpy(workload, (const char*)gearman_job_workload(job), wsize);
     workload[wsize] = '\0';
-    gm_log( GM_LOG_TRACE, "got status job %s\n", gearman_job_handle( job ) );
-    gm_log( GM_LOG_TRACE, "%d +++>\n%s\n<+++\n", strlen(workload), workload );
+    GM_LOG( GM_LOG_TRACE, "got status job %s\n", gearman_job_handle( job ) );
+    GM_LOG( GM_LOG_TRACE, "%d +++>\n%s\n<+++\n", strlen(workload), workload );
 
     /* set result pointer to success */
     *ret_ptr= GEARMAN_SUCCESS;
@@ -639,6 +1037,15 @@ void *return_status( gearman_job_st *job, void *context, size_t *result_size, ge
     signal(SIGALRM, exit_sighandler);
     alarm(10);
 
+    /* resource usage per plugin instead of the summary */
+    if(!strcmp(workload, "plugins")) {
+        len = snprintf(result, GM_BUFFERSIZE, "%s plugin usage:\n", hostname);
+        if(format_plugin_usage(result+len, GM_BUFFERSIZE-len) == 0)
+            snprintf(result+len, GM_BUFFERSIZE-len, "no plugins executed yet\n");
+        alarm(0);
+        return((void*)result);
+    }
+
     /* Now we attach the segment to our data space. */
     if ((shm = shmat(shmid, NULL, 0)) == (int *) -1) {
         perror("shmat");
@@ -650,6 +1057,31 @@ void *return_status( gearman_job_st *job, void *context, size_t *result_size, ge
 
     snprintf(result, GM_BUFFERSIZE, "%s has %i worker and is working on %i jobs. Version: %s|worker=%i;;;%i;%i jobs=%ic", hostname, shm[SHM_WORKER_TOTAL], shm[SHM_WORKER_RUNNING], GM_VERSION, shm[SHM_WORKER_TOTAL], mod_gm_opt->min_worker, mod_gm_opt->max_worker, shm[SHM_JOBS_DONE] );
 
+    /* append scale up latency histogram */
+    for(x = 0; x < SHM_SCALE_UP_BUCKETS; x++) {
+        if(shm[SHM_SCALE_UP_HIST+x] == 0)
+            continue;
+        len = strlen(result);
+        if(scale_up_bucket_limits[x] == 0)
+            snprintf(result+len, GM_BUFFERSIZE-len, " scale_up_inf=%ic", shm[SHM_SCALE_UP_HIST+x]);
+        else
+            snprintf(result+len, GM_BUFFERSIZE-len, " scale_up_le_%ims=%ic", scale_up_bucket_limits[x], shm[SHM_SCALE_UP_HIST+x]);
+    }
+
+    /* append embedded perl cache statistics */
+    if(shm[SHM_EPN_CACHE_HITS] + shm[SHM_EPN_CACHE_MISSES] > 0) {
+        len = strlen(result);
+        snprintf(result+len, GM_BUFFERSIZE-len, " epn_cache_hit_rate=%.1f%%;;;0;100 epn_cache_hits=%ic epn_cache_misses=%ic epn_compile=%.3fs",
+                 100.0 * shm[SHM_EPN_CACHE_HITS] / (shm[SHM_EPN_CACHE_HITS] + shm[SHM_EPN_CACHE_MISSES]),
+                 shm[SHM_EPN_CACHE_HITS], shm[SHM_EPN_CACHE_MISSES], (double)shm[SHM_EPN_COMPILE_MSEC] / 1000);
+    }
+
+    /* append single flight statistics */
+    if(mod_gm_opt->single_flight == GM_ENABLED) {
+        len = strlen(result);
+        snprintf(result+len, GM_BUFFERSIZE-len, " single_flight_shared=%ic", single_flight_shared());
+    }
+
     /* and increase job counter */
     shm[SHM_JOBS_DONE]++;
 
@@ -0,0 +1,286 @@
+/******************************************************************************
+ *
+ * mod_gearman - distribute checks with gearman
+ *
+ * Copyright (c) 2010 Sven Nierlein - sven.nierlein@consol.de
+ *
+ * This file is part of mod_gearman.
+ *
+ *  mod_gearman is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mod_gearman is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with mod_gearman.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *****************************************************************************/
+
+#include "config.h"
+#include "worker_metrics.h"
+#include "worker.h"
+#include "utils.h"
+#include "gearman_utils.h"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+static gm_metrics_t *metrics        = NULL;
+static char         *metrics_socket = NULL;
+
+static const double metrics_limits[GM_HISTOGRAM_BUCKETS-1] = GM_METRICS_BUCKET_LIMITS;
+
+static int request_time_left(struct timeval *start);
+
+
+/* create shared scoreboard */
+int init_metrics() {
+    pthread_mutexattr_t mattr;
+
+    if(metrics != NULL)
+        return GM_OK;
+
+    metrics = mmap(NULL, sizeof(gm_metrics_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(metrics == MAP_FAILED) {
+        gm_log( GM_LOG_ERROR, "cannot create metrics scoreboard: %s\n", strerror(errno));
+        metrics = NULL;
+        return GM_ERROR;
+    }
+    memset(metrics, 0, sizeof(gm_metrics_t));
+
+    /* worker may die while holding the lock, ex. when killed by a timeout */
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&metrics->mutex, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+
+    return GM_OK;
+}
+
+
+/* unmap scoreboard */
+void free_metrics() {
+    if(metrics == NULL)
+        return;
+    munmap(metrics, sizeof(gm_metrics_t));
+    metrics = NULL;
+}
+
+
+/* increase counter */
+void metrics_inc(int counter) {
+    if(metrics == NULL || counter < 0 || counter >= GM_METRIC_COUNTERS)
+        return;
+    __sync_fetch_and_add(&metrics->counters[counter], 1);
+}
+
+
+/* account executed job */
+void metrics_job_done(gm_job_t *job) {
+    gm_queue_metrics_t *queue;
+    int slot;
+
+    if(metrics == NULL || job->start_time.tv_sec == 0)
+        return;
+
+    slot  = histogram_queue(&metrics->queue_names, &metrics->mutex, job->queue != NULL ? job->queue : job->type);
+    queue = &metrics->queues[slot];
+    __sync_fetch_and_add(&queue->jobs, 1);
+    if(job->early_timeout == 1)
+        __sync_fetch_and_add(&queue->timeouts, 1);
+    observe_histogram(&queue->exec_time, metrics_limits, timeval2double(&job->finish_time) - timeval2double(&job->start_time));
+}
+
+
+/* account result send duration */
+void metrics_result_sent(struct timeval *finished) {
+    struct timeval now;
+
+    if(metrics == NULL || finished->tv_sec == 0)
+        return;
+    gettimeofday(&now, NULL);
+    observe_histogram(&metrics->result_send, metrics_limits, timeval2double(&now) - timeval2double(finished));
+}
+
+
+/* write metrics in prometheus text format */
+int format_metrics(char *buf, int size, int *shm) {
+    gm_queue_metrics_t *queue;
+    char name[GM_HISTOGRAM_QUEUE_NAME*2];
+    char labels[GM_HISTOGRAM_QUEUE_NAME*2+16];
+    int x, used, len = 0;
+
+#define GM_METRICS_PRINT(...) \
+    if(len < size) len += snprintf(buf+len, size-len, __VA_ARGS__)
+
+    if(shm != NULL) {
+        GM_METRICS_PRINT("# HELP mod_gearman_worker_workers Number of running worker processes.\n");
+        GM_METRICS_PRINT("# TYPE mod_gearman_worker_workers gauge\n");
+        GM_METRICS_PRINT("mod_gearman_worker_workers %d\n", shm[SHM_WORKER_TOTAL]);
+        GM_METRICS_PRINT("# HELP mod_gearman_worker_busy_workers Number of worker processes executing a job.\n");
+        GM_METRICS_PRINT("# TYPE mod_gearman_worker_busy_workers gauge\n");
+        GM_METRICS_PRINT("mod_gearman_worker_busy_workers %d\n", shm[SHM_WORKER_RUNNING]);
+    }
+    if(metrics == NULL) {
+        return(len < size ? len : size - 1);
+    }
+
+    GM_METRICS_PRINT("# HELP mod_gearman_worker_spawned_total Worker processes started.\n");
+    GM_METRICS_PRINT("# TYPE mod_gearman_worker_spawned_total counter\n");
+    GM_METRICS_PRINT("mod_gearman_worker_spawned_total %llu\n", metrics->counters[GM_METRIC_SPAWNED]);
+    GM_METRICS_PRINT("# HELP mod_gearman_worker_reaped_total Worker processes exited.\n");
+    GM_METRICS_PRINT("# TYPE mod_gearman_worker_reaped_total counter\n");
+    GM_METRICS_PRINT("mod_gearman_worker_reaped_total %llu\n", metrics->counters[GM_METRIC_REAPED]);
+    GM_METRICS_PRINT("# HELP mod_gearman_worker_reconnects_total Reconnects to the gearman job server.\n");
+    GM_METRICS_PRINT("# TYPE mod_gearman_worker_reconnects_total counter\n");
+    GM_METRICS_PRINT("mod_gearman_worker_reconnects_total %llu\n", metrics->counters[GM_METRIC_RECONNECTS]);
+
+    used = metrics->queue_names.used;
+    GM_METRICS_PRINT("# HELP mod_gearman_worker_jobs_total Executed jobs per queue.\n");
+    GM_METRICS_PRINT("# TYPE mod_gearman_worker_jobs_total counter\n");
+    for(x = 0; x < used; x++) {
+        queue = &metrics->queues[x];
+        escape_label_value(name, sizeof(name), metrics->queue_names.names[x]);
+        GM_METRICS_PRINT("mod_gearman_worker_jobs_total{queue=\"%s\"} %llu\n", name, queue->jobs);
+    }
+    GM_METRICS_PRINT("# HELP mod_gearman_worker_job_timeouts_total Jobs per queue which ran into the timeout.\n");
+    GM_METRICS_PRINT("# TYPE mod_gearman_worker_job_timeouts_total counter\n");
+    for(x = 0; x < used; x++) {
+        queue = &metrics->queues[x];
+        escape_label_value(name, sizeof(name), metrics->queue_names.names[x]);
+        GM_METRICS_PRINT("mod_gearman_worker_job_timeouts_total{queue=\"%s\"} %llu\n", name, queue->timeouts);
+    }
+    GM_METRICS_PRINT("# HELP mod_gearman_worker_job_duration_seconds Execution time of jobs per queue.\n");
+    GM_METRICS_PRINT("# TYPE mod_gearman_worker_job_duration_seconds histogram\n");
+    for(x = 0; x < used; x++) {
+        queue = &metrics->queues[x];
+        escape_label_value(name, sizeof(name), metrics->queue_names.names[x]);
+        snprintf(labels, sizeof(labels), "queue=\"%s\"", name);
+        if(len < size)
+            len += format_histogram(buf+len, size-len, "mod_gearman_worker_job_duration_seconds", labels, metrics_limits, &queue->exec_time);
+    }
+    GM_METRICS_PRINT("# HELP mod_gearman_worker_result_send_seconds Time from finishing a job until the result has been sent.\n");
+    GM_METRICS_PRINT("# TYPE mod_gearman_worker_result_send_seconds histogram\n");
+    if(len < size)
+        len += format_histogram(buf+len, size-len, "mod_gearman_worker_result_send_seconds", "", metrics_limits, &metrics->result_send);
+
+#undef GM_METRICS_PRINT
+
+    return(len < size ? len : size - 1);
+}
+
+
+/* listen on unix socket or tcp address */
+int open_metrics_listener(char *address) {
+    char *path = NULL;
+    int fd;
+
+    fd = gm_net_listen(address, &path);
+    if(fd < 0)
+        return -1;
+    free(metrics_socket);
+    metrics_socket = path;
+    GM_LOG( GM_LOG_DEBUG, "serving metrics on %s\n", address);
+
+    return fd;
+}
+
+
+/* close listener */
+void close_metrics_listener(int fd) {
+    if(fd < 0)
+        return;
+    close(fd);
+    if(metrics_socket != NULL) {
+        unlink(metrics_socket);
+        free(metrics_socket);
+        metrics_socket = NULL;
+    }
+}
+
+
+/* answer a single http request, runs in the supervisor so the whole
+ * request is limited to GM_METRICS_REQUEST_TIMEOUT */
+void handle_metrics_request(int fd, int *shm) {
+    struct timeval start, timeout;
+    struct pollfd pfd;
+    char request[GM_BUFFERSIZE];
+    char *body, *header;
+    int client, len, left, size = GM_METRICS_BUFFERSIZE;
+    ssize_t rc;
+
+    client = accept(fd, NULL, NULL);
+    if(client < 0)
+        return;
+    gettimeofday(&start, NULL);
+
+    /* only the request line is of interest, wait for the end of the header */
+    len        = 0;
+    pfd.fd     = client;
+    pfd.events = POLLIN;
+    while(len < (int)sizeof(request) - 1) {
+        left = request_time_left(&start);
+        if(left <= 0 || poll(&pfd, 1, left) <= 0)
+            break;
+        rc = read(client, request+len, sizeof(request) - 1 - len);
+        if(rc <= 0)
+            break;
+        len += rc;
+        request[len] = '\0';
+        if(strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL)
+            break;
+    }
+    request[len] = '\0';
+
+    body = gm_malloc(size);
+    if(!strncmp(request, "GET / ", 6) || !strncmp(request, "GET /metrics ", 13) || !strncmp(request, "GET /metrics?", 13)) {
+        len = format_metrics(body, size, shm);
+        gm_asprintf(&header, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\nConnection: close\r\n\r\n", len);
+    } else {
+        len = snprintf(body, size, "not found\n");
+        gm_asprintf(&header, "HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: %d\r\nConnection: close\r\n\r\n", len);
+    }
+
+    /* slow scrapers get a truncated response */
+    left = request_time_left(&start);
+    timeout.tv_sec  = left > 0 ? left / 1000 : 0;
+    timeout.tv_usec = left > 0 ? (left % 1000) * 1000 : 1000;
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if(write(client, header, strlen(header)) > 0 && write(client, body, len) < 0)
+        GM_LOG( GM_LOG_DEBUG, "sending metrics failed: %s\n", strerror(errno));
+
+    free(header);
+    free(body);
+    close(client);
+}
+
+
+/* wait for a request, used instead of sleeping */
+void serve_metrics(int fd, int *shm, int timeout) {
+    struct pollfd pfd;
+
+    pfd.fd     = fd;
+    pfd.events = POLLIN;
+    if(poll(&pfd, 1, timeout*1000) > 0 && pfd.revents & POLLIN)
+        handle_metrics_request(fd, shm);
+}
+
+
+/* milliseconds left to answer a request */
+static int request_time_left(struct timeval *start) {
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return GM_METRICS_REQUEST_TIMEOUT - (int)((now.tv_sec - start->tv_sec) * 1000 + (now.tv_usec - start->tv_usec) / 1000);
+}